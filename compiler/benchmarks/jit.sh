@@ -0,0 +1,15 @@
+#!/bin/sh
+# Times each benchmark on the VM with the JIT off and on, and checks that
+# both print the same. loops.fn and arith.fn are the arithmetic-heavy ones;
+# strings.fn uses strings throughout, so nothing in it is compiled.
+# Usage: jit.sh [path/to/compiler] [threshold]
+COMPILER=${1:-./build/compiler}
+THRESHOLD=${2:-1000}
+DIR=$(dirname "$0")
+
+for program in "$DIR"/*.fn; do
+    echo "== $(basename "$program")"
+    "$COMPILER" --run --no-jit --time "$program" > /tmp/interpreted.out || exit 1
+    "$COMPILER" --run --jit-threshold="$THRESHOLD" --time "$program" > /tmp/jit.out || exit 1
+    cmp -s /tmp/interpreted.out /tmp/jit.out || { echo "   output differs with the JIT"; exit 1; }
+done
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compiles generated programs with deeply nested parentheses, unary minus,
+# if statements, blocks, assignment chains and long left-associative chains.
+# Nesting just under the parser's limit must compile and run; nesting far
+# beyond it must be a syntax error, never a crash.
+# Usage: nesting.sh [path/to/compiler]
+COMPILER=${1:-./build/compiler}
+GENERATED=$(mktemp /tmp/nesting.XXXXXX.fn)
+failed=0
+
+# repeat <text> <count>
+repeat() {
+    yes -- "$1" | head -n "$2" | tr -d '\n'
+}
+
+# generate <kind> <levels>: writes a program nesting <kind> <levels> deep.
+generate() {
+    {
+        echo 'fn int main() {'
+        case "$1" in
+            parens) printf 'return %s0%s;\n' "$(repeat '(' "$2")" "$(repeat ')' "$2")" ;;
+            unary) printf 'return %s0;\n' "$(repeat '- ' "$2")" ;;
+            if) printf '%sreturn 0;\n' "$(repeat 'if (true) ' "$2")" ;;
+            blocks) printf '%s%s\n' "$(repeat '{' "$2")" "$(repeat '}' "$2")" ;;
+            assign) printf 'int a; %s0;\n' "$(repeat 'a = ' "$2")" ;;
+            chain) printf 'return 0%s;\n' "$(repeat '+0' "$2")" ;;
+        esac
+        echo 'return 0;'
+        echo '}'
+    } > "$GENERATED"
+}
+
+# check <kind> <levels> <expected exit status>
+check() {
+    generate "$1" "$2"
+    "$COMPILER" --run "$GENERATED" > /dev/null 2> /tmp/nesting.err
+    status=$?
+    verdict=ok
+    if [ "$status" -ne "$3" ]; then
+        verdict="FAIL (exit status $status, expected $3)"
+    elif [ "$3" -ne 0 ] && ! grep -q 'nesting deeper than' /tmp/nesting.err; then
+        verdict="FAIL (no nesting error)"
+    fi
+    [ "$verdict" = ok ] || failed=1
+    printf '%-8s %8s levels  %s\n' "$1" "$2" "$verdict"
+}
+
+for kind in parens unary if blocks assign chain; do
+    check "$kind" 900 0
+    check "$kind" 200000 1
+done
+
+rm -f "$GENERATED" /tmp/nesting.err
+exit $failed
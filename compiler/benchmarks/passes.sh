@@ -0,0 +1,43 @@
+#!/bin/sh
+# Shows what each IR pass does to the bundled programs and what it costs on a
+# generated input. Usage: passes.sh [path/to/compiler] [functions]
+COMPILER=${1:-./build/compiler}
+FUNCTIONS=${2:-20}
+DIR=$(dirname "$0")
+
+# Instructions left after the pipeline, from the last row of --time-passes.
+instructions() {
+    "$COMPILER" --time-passes --passes="$1" "$2" 2>&1 >/dev/null | tail -n 1 | awk '{ print $3 }'
+}
+
+printf '%-12s %8s %10s %8s %8s %8s %8s\n' program none constfold cse licm dce all
+for program in "$DIR"/*.fn; do
+    printf '%-12s' "$(basename "$program")"
+    for passes in none constfold cse licm dce constfold,cse,licm,dce; do
+        printf ' %8s' "$(instructions "$passes" "$program")"
+    done
+    printf '\n'
+done
+
+GENERATED=$(mktemp /tmp/passes.XXXXXX.fn)
+i=0
+while [ "$i" -lt "$FUNCTIONS" ]; do
+    cat >> "$GENERATED" <<FN
+fn int work$i(int n, int k) {
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        int j = 0;
+        while (j < 8) { total += (k * 3 + $i) * (j + 1) + (k * 3 + $i); j++; }
+        if (total > 1000000) { break; }
+    }
+    return total + 2 * 0;
+}
+FN
+    i=$((i + 1))
+done
+echo 'fn int main() { return 0; }' >> "$GENERATED"
+
+echo
+echo "== $FUNCTIONS generated functions"
+"$COMPILER" --time-passes "$GENERATED" > /dev/null
+rm -f "$GENERATED"
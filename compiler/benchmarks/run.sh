@@ -0,0 +1,25 @@
+#!/bin/sh
+# Compares the bytecode VM interpreting everything (--no-jit), the VM with
+# the template JIT, the tree-walking interpreter and, where the program
+# compiles natively, the x86-64 backend on each benchmark.
+# Usage: run.sh [path/to/compiler]
+COMPILER=${1:-./build/compiler}
+DIR=$(dirname "$0")
+
+for program in "$DIR"/*.fn; do
+    echo "== $(basename "$program")"
+    "$COMPILER" --run --no-jit --time "$program" > /tmp/vm.out || exit 1
+    "$COMPILER" --run --time "$program" > /tmp/jit.out || exit 1
+    "$COMPILER" --interpret --time "$program" > /tmp/tree.out || exit 1
+    cmp -s /tmp/vm.out /tmp/jit.out || echo "   output differs between backends"
+    cmp -s /tmp/vm.out /tmp/tree.out || echo "   output differs between backends"
+    if "$COMPILER" --native=/tmp/bench.native "$program" 2> /dev/null; then
+        start=$(date +%s%N)
+        /tmp/bench.native > /tmp/native.out
+        end=$(date +%s%N)
+        echo "native: $(( (end - start) / 1000000 )) ms"
+        cmp -s /tmp/vm.out /tmp/native.out || echo "   output differs between backends"
+    else
+        echo "native: n/a"
+    fi
+done
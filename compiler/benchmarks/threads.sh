@@ -0,0 +1,33 @@
+#!/bin/sh
+# Times compiling a generated program to assembly at several thread counts
+# and checks that the output is byte-identical for all of them.
+# Usage: threads.sh [path/to/compiler] [functions]
+COMPILER=${1:-./build/compiler}
+FUNCTIONS=${2:-20}
+
+GENERATED=$(mktemp /tmp/threads.XXXXXX.fn)
+i=0
+while [ "$i" -lt "$FUNCTIONS" ]; do
+    cat >> "$GENERATED" <<FN
+fn int work$i(int n, float x) {
+    int total = $i;
+    for (int i = 0; i < n; i++) {
+        total = total * 3 + i % $((i + 2));
+        if (total > 100000) { print("wrap", $i, x); total = total % 1000; }
+    }
+    return total;
+}
+FN
+    i=$((i + 1))
+done
+echo 'fn int main() { print(work0(10, 1.5)); return 0; }' >> "$GENERATED"
+
+"$COMPILER" --emit-asm --threads=1 "$GENERATED" > /tmp/threads.1.s || exit 1
+for threads in 1 2 4 0; do
+    start=$(date +%s%N)
+    "$COMPILER" --emit-asm --threads=$threads "$GENERATED" > /tmp/threads.n.s || exit 1
+    end=$(date +%s%N)
+    printf 'threads=%-3s %8s ms' "$threads" "$(( (end - start) / 1000000 ))"
+    cmp -s /tmp/threads.1.s /tmp/threads.n.s && echo "  identical" || echo "  output differs"
+done
+rm -f "$GENERATED" /tmp/threads.1.s /tmp/threads.n.s
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "brackets.hpp"
+#include "token.hpp"
+
+// Index of a node in an AstArena. Nodes refer to each other and to tokens by
+// 32-bit index instead of by pointer, so a function body is two flat arrays.
+using NodeId = uint32_t;
+constexpr NodeId kNoNode = UINT32_MAX;
+
+enum class NodeKind : uint8_t {
+    // Statements
+    Block,      // a = first list entry, b = statement count
+    VarDecl,    // token = name, a = initializer or kNoNode, b = declared type (a TokenType)
+    If,         // a = condition, b = then branch, c = else branch or kNoNode
+    While,      // a = condition, b = body
+    For,        // a = init statement, b = condition, c = step (each may be kNoNode), d = body
+    Return,     // a = value or kNoNode
+    Break,
+    Continue,
+    ExprStmt,   // a = expression
+
+    // Expressions; `token` is the literal, name or operator token.
+    IntLit,
+    FloatLit,
+    StringLit,
+    BoolLit,
+    Name,
+    Unary,      // prefix ! ~ - + ++ --; a = operand
+    Postfix,    // postfix ++ --; a = operand
+    Binary,     // a = left, b = right
+    Assign,     // = += -=; a = target, b = value
+    Ternary,    // a = condition, b = then, c = else
+    Call,       // a = callee, b = first list entry, c = argument count
+    Index,      // a = array, b = index
+    Member,     // a = object; token = member name
+};
+
+struct Node {
+    NodeKind kind;
+    uint32_t token;  // index into Program::tokens
+    uint32_t a = kNoNode;
+    uint32_t b = kNoNode;
+    uint32_t c = kNoNode;
+    uint32_t d = kNoNode;
+};
+
+// Node storage for one function body. Variable-length children (block
+// statements, call arguments) are runs in a shared list array.
+class AstArena {
+public:
+    NodeId add(const Node& node) {
+        nodes_.push_back(node);
+        return static_cast<NodeId>(nodes_.size() - 1);
+    }
+
+    // Appends a run of node ids and returns the index of its first entry.
+    uint32_t addList(const NodeId* ids, size_t count) {
+        const uint32_t first = static_cast<uint32_t>(lists_.size());
+        lists_.insert(lists_.end(), ids, ids + count);
+        return first;
+    }
+
+    const Node& operator[](NodeId id) const { return nodes_[id]; }
+    const NodeId* list(uint32_t first) const { return lists_.data() + first; }
+    size_t size() const { return nodes_.size(); }
+
+    void clear() {
+        nodes_.clear();
+        lists_.clear();
+    }
+
+private:
+    std::vector<Node> nodes_;
+    std::vector<NodeId> lists_;
+};
+
+class SyntaxError : public std::runtime_error {
+public:
+    SyntaxError(const std::string& message, int line, int column)
+        : std::runtime_error(message), line_(line), column_(column) {}
+
+    int line() const { return line_; }
+    int column() const { return column_; }
+
+private:
+    int line_;
+    int column_;
+};
+
+struct Param {
+    TokenType type;
+    uint32_t name;  // token index
+};
+
+struct Function {
+    TokenType returnType;
+    uint32_t name;  // token index
+    std::vector<Param> params;
+    uint32_t bodyBegin = 0;  // token range of the body, braces included
+    uint32_t bodyEnd = 0;
+    bool bodyParsed = false;  // false while a lazily parsed body is still tokens only
+    AstArena body;
+    NodeId root = kNoNode;  // the body Block
+    std::vector<SyntaxError> errors;  // errors inside the body
+};
+
+// A parsed source file. `tokens` holds the lexer's tokens as they came; all
+// token indices refer to it.
+struct Program {
+    std::vector<Token> tokens;
+    BracketTable brackets;
+    std::vector<Function> functions;
+    std::vector<SyntaxError> errors;  // errors outside function bodies
+
+    // Every error, function bodies included, in source order.
+    std::vector<SyntaxError> allErrors() const;
+};
+
+// Prints the program as indented S-expressions, one statement per line.
+void printAst(std::ostream& out, const Program& program);
+
+// Prints "<line>: fn <type> <name>(<type> <name>, ...)" per function; bodies
+// are not needed.
+void printSignatures(std::ostream& out, const Program& program);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "token.hpp"
+
+// Matching (), [] and {} pairs of a token stream, found in one linear sweep
+// before parsing. The lazy parser uses it to step over a function body in
+// O(1), and error recovery to skip whole nested groups.
+class BracketTable {
+public:
+    static constexpr uint32_t kNoMatch = UINT32_MAX;
+
+    BracketTable() = default;
+    explicit BracketTable(const std::vector<Token>& tokens);
+
+    // The index of the bracket paired with tokens[index], or kNoMatch for an
+    // unbalanced bracket or a token that is not a bracket.
+    uint32_t match(uint32_t index) const { return index < partner_.size() ? partner_[index] : kNoMatch; }
+
+private:
+    std::vector<uint32_t> partner_;
+};
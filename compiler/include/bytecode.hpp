@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "sema.hpp"
+
+// Register bytecode for the VM. Types are static, so every instruction is
+// specialised by operand type and registers carry no tags. A frame has two
+// register files: scalar registers (int, float and bool, 8 bytes each) and
+// string registers. Locals occupy the low registers of their file in
+// declaration order, parameters first; temporaries come after them.
+//
+// Operand legend: a is usually the destination, b and c sources. Jumps keep
+// their 32-bit target instruction index in b (low half) and c (high half).
+#define BYTECODE_OPCODES(X)                                                        \
+    X(Mov)     /* a = b */                                                         \
+    X(MovS)    /* string a = string b */                                          \
+    X(LoadK)   /* a = constants[bx] */                                            \
+    X(LoadS)   /* string a = strings[bx] */                                       \
+    X(IToF)    /* a = (float)b */                                                 \
+    X(AddI) X(SubI) X(MulI) X(DivI) X(ModI)                                        \
+    X(AddIK)   /* a = b + (int16)c */                                             \
+    X(AddF) X(SubF) X(MulF) X(DivF)                                                \
+    X(NegI) X(NegF) X(Not) X(BitNot)                                               \
+    X(BitAnd) X(BitOr) X(BitXor) X(Shl) X(Shr)                                     \
+    X(LtI) X(LeI) X(EqI) X(NeI)                                                    \
+    X(LtF) X(LeF) X(EqF) X(NeF)                                                    \
+    X(LtS) X(LeS) X(EqS) X(NeS) /* scalar a = compare(string b, string c) */      \
+    X(Concat)  /* string a = b + c */                                             \
+    X(Append)  /* string a += b */                                                \
+    X(Len)     /* a = length of string b */                                       \
+    X(Jmp)     /* goto bx */                                                      \
+    X(JmpF)    /* if !a goto bx */                                                \
+    X(JmpT)    /* if a goto bx */                                                 \
+    X(Call)    /* a = functions[bx](...); next word: a = first scalar argument,   \
+                  b = first string argument */                                    \
+    X(Ret)     /* return scalar a */                                              \
+    X(RetS)    /* return string a */                                              \
+    X(Print)   /* print register a of PrintKind b, then a space (c = 0) or a      \
+                  newline (c = 1); c = 2 prints only the newline */
+
+enum class Op : uint16_t {
+#define BYTECODE_ENUM(name) name,
+    BYTECODE_OPCODES(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+};
+
+enum PrintKind : uint16_t { kPrintInt, kPrintFloat, kPrintBool, kPrintString };
+
+struct Instruction {
+    Op op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+
+    uint32_t bx() const { return b | static_cast<uint32_t>(c) << 16; }
+};
+
+// One scalar register or constant.
+union Slot {
+    int64_t i;
+    double f;
+};
+
+struct CompiledFunction {
+    std::string name;
+    Type returnType;
+    std::vector<Instruction> code;
+    uint16_t scalarRegisters = 0;  // frame size in each register file
+    uint16_t stringRegisters = 0;
+};
+
+struct BytecodeModule {
+    std::vector<CompiledFunction> functions;  // parallel to Program::functions
+    std::vector<Slot> constants;
+    std::vector<std::string> strings;
+};
+
+class CompileError : public std::runtime_error {
+public:
+    explicit CompileError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Compiles a program that passed analyze(). Throws CompileError if a
+// function needs more than 65535 registers in one file.
+BytecodeModule compileBytecode(const Program& program, const SemanticModel& model);
+
+void disassemble(std::ostream& out, const BytecodeModule& module);
+
+// The text of a string literal without its quotes, escapes resolved.
+std::string unescape(const std::string& literal);
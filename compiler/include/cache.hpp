@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "ir.hpp"
+#include "passes.hpp"
+#include "token.hpp"
+
+// Bump whenever the artifact format changes. Keys also mix in
+// compilerBuildId(), so a rebuilt lexer, front end, lowering or pass never
+// reuses entries made by the previous build.
+constexpr const char* kCacheVersion = "fn-compiler-cache-2";
+
+// A hash of the running executable's ELF build ID, read from memory once, or
+// 0 when it has none. Without one, builds cannot be told apart, so the cache
+// must not be used.
+uint64_t compilerBuildId();
+
+struct CacheStats {
+    bool tokensReused = false;
+    size_t functionsReused = 0;
+    size_t functionsCompiled = 0;
+};
+
+// Content-addressed store of build artifacts in a directory. Every entry is
+// named by a hash of everything that went into it plus kCacheVersion and the
+// build ID, so an entry never needs invalidating: changed input simply
+// hashes elsewhere.
+// Entries are written to a temporary file and renamed into place, and are
+// checksummed, so concurrent builds and torn writes read as misses.
+//
+// Two artifacts are kept:
+//   - the token stream of a whole source file, keyed by its bytes;
+//   - the optimized IR of one function, keyed by its own tokens, the
+//     signatures of every function in the file and the enabled passes.
+// A function whose IR is reused is not parsed, checked, lowered or optimized.
+class BuildCache {
+public:
+    explicit BuildCache(std::string directory);
+
+    // Tokens for `source`; lex() runs only on a miss, and its result is stored.
+    std::vector<Token> tokens(const std::string& source, const std::function<std::vector<Token>()>& lex);
+
+    // Per-function keys for a program parsed in ParseMode::Lazy without errors.
+    // Functions whose body was parsed anyway get 0, which is never looked up.
+    std::vector<uint64_t> functionKeys(const Program& program, const PassManager& passes) const;
+
+    // Loads the cached IR of every function with a key. Returns a flag per
+    // function telling whether it was found; found functions are kept until
+    // reuse() moves them into a module.
+    std::vector<bool> probe(const std::vector<uint64_t>& keys);
+
+    // Replaces the signature-only functions of `module` (see lowerToIr) by
+    // the IR probe() found, then stores every other function under its key.
+    void reuse(IrModule& module, const std::vector<uint64_t>& keys);
+
+    const CacheStats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        IrFunction function;
+        std::vector<std::string> strings;  // the function's ConstS operands index these
+    };
+
+    std::string directory_;
+    std::vector<Entry> found_;  // parallel to the probed keys
+    std::vector<bool> present_;
+    CacheStats stats_;
+
+    std::string path(const char* kind, uint64_t key) const;
+    bool load(const char* kind, uint64_t key, std::string& payload) const;
+    void store(const char* kind, uint64_t key, const std::string& payload) const;
+};
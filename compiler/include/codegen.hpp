@@ -0,0 +1,28 @@
+#pragma once
+
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include "ir.hpp"
+
+class CodegenError : public std::runtime_error {
+public:
+    explicit CodegenError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Emits GNU-syntax x86-64 assembly for an optimized IrModule, following the
+// System V AMD64 calling convention. Each `fn name` becomes `fn_name`; a C
+// `main` calls `fn_main` and returns its result as the exit status. print()
+// goes through printf with the VM's formats, so output matches --run.
+//
+// Values get registers by linear scan over live intervals: ints, bools and
+// strings in general-purpose registers, floats in xmm2-xmm15. A value live
+// across a call is kept in a callee-saved register or spilled to the frame.
+// Strings are pointers to read-only data; comparison and len() call the C
+// library, and concatenation is rejected with CodegenError. Integer division
+// by zero prints the VM's runtime error and exits with status 1.
+//
+// Functions are compiled on `threads` workers (0 = one per core); the output
+// is the same for any count. Critical edges are split in `module` as a side
+// effect.
+void emitAssembly(std::ostream& out, IrModule& module, unsigned threads = 1);
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash map from 32-bit ids (interned names, symbol indices)
+// to small values. Keys and values sit side by side in one array probed
+// linearly, so a lookup touches one or two cache lines. There is no erase:
+// callers that need to unbind a key store a sentinel value instead.
+template <typename Value>
+class FlatMap {
+public:
+    static constexpr uint32_t kEmptyKey = UINT32_MAX;
+
+    explicit FlatMap(size_t capacity = 16) {
+        size_t size = 16;
+        while (size < capacity * 2) size <<= 1;
+        slots_.assign(size, Slot{kEmptyKey, Value{}});
+    }
+
+    Value* find(uint32_t key) {
+        Slot& slot = slots_[probe(key)];
+        return slot.key == key ? &slot.value : nullptr;
+    }
+
+    const Value* find(uint32_t key) const {
+        const Slot& slot = slots_[probe(key)];
+        return slot.key == key ? &slot.value : nullptr;
+    }
+
+    // The value for `key`, inserting `initial` first when the key is absent.
+    // The reference is valid until the next insertion.
+    Value& insert(uint32_t key, const Value& initial) {
+        size_t index = probe(key);
+        if (slots_[index].key != key) {
+            if ((size_ + 1) * 2 > slots_.size()) {
+                grow();
+                index = probe(key);
+            }
+            slots_[index] = Slot{key, initial};
+            ++size_;
+        }
+        return slots_[index].value;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    struct Slot {
+        uint32_t key;
+        Value value;
+    };
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+
+    // The slot holding `key`, or the empty slot where it would go.
+    size_t probe(uint32_t key) const {
+        const size_t mask = slots_.size() - 1;
+        size_t index = (key * 0x9E3779B1u) & mask;  // Fibonacci hashing spreads sequential ids
+        while (slots_[index].key != key && slots_[index].key != kEmptyKey) {
+            index = (index + 1) & mask;
+        }
+        return index;
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2, Slot{kEmptyKey, Value{}});
+        old.swap(slots_);
+        for (const Slot& slot : old) {
+            if (slot.key != kEmptyKey) slots_[probe(slot.key)] = slot;
+        }
+    }
+};
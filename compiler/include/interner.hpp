@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps each distinct identifier to a dense 32-bit id, so later stages compare
+// and hash names as integers. Ids are assigned in first-seen order from 0.
+class Interner {
+public:
+    uint32_t intern(std::string_view name);
+    const std::string& name(uint32_t id) const { return names_[id]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    std::vector<std::string> names_;
+    std::vector<uint64_t> hashes_;   // parallel to names_
+    std::vector<uint32_t> table_ = std::vector<uint32_t>(64, kEmpty);  // open addressing over ids
+
+    void grow();
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include "ast.hpp"
+#include "sema.hpp"
+
+// Reference tree-walking interpreter: evaluates the AST directly with boxed
+// values and a C++ call per node. It is the baseline the bytecode VM is
+// measured against and prints exactly what the VM prints for the same
+// program. Runs a function that takes no arguments and returns its int
+// result; throws RuntimeError (vm.hpp) on division by zero or when calls
+// nest too deeply.
+int64_t interpret(const Program& program, const SemanticModel& model, uint32_t function, std::ostream& out);
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "sema.hpp"
+
+// SSA intermediate representation. A function is a dense array of
+// instructions whose index is the value they define, plus basic blocks that
+// list the live instructions in order (phis first) and end in a terminator.
+// Every value has exactly one definition; variables are gone after lowering.
+// Instructions take the type of their result, so an Add of type Float is a
+// float addition and comparisons are typed by their operands.
+using ValueId = uint32_t;
+using BlockId = uint32_t;
+constexpr uint32_t kNoValue = UINT32_MAX;
+
+#define IR_OPCODES(X)                                                              \
+    X(Nop)      /* removed; not listed in any block */                            \
+    X(Const)    /* scalar constant */                                             \
+    X(ConstS)   /* string constant: a = index into IrModule::strings */           \
+    X(Param)    /* a = parameter index */                                         \
+    X(Phi)      /* operands parallel to the block's predecessors */              \
+    X(Add) X(Sub) X(Mul) X(Div) X(Mod)                                             \
+    X(BitAnd) X(BitOr) X(BitXor) X(Shl) X(Shr)                                     \
+    X(Neg) X(Not) X(BitNot)                                                        \
+    X(Lt) X(Le) X(Eq) X(Ne)                                                        \
+    X(IToF)                                                                        \
+    X(Concat)   /* string a + string b */                                         \
+    X(Len)      /* length of string a */                                          \
+    X(Call)     /* a = callee function index; operands are the arguments */       \
+    X(Print)    /* operands printed space separated, then a newline */
+
+enum class IrOp : uint8_t {
+#define IR_ENUM(name) name,
+    IR_OPCODES(IR_ENUM)
+#undef IR_ENUM
+};
+
+const char* irOpName(IrOp op);
+
+struct IrInst {
+    union Constant {
+        int64_t i;
+        double f;
+    };
+
+    IrOp op = IrOp::Nop;
+    Type type = Type::None;
+    BlockId block = 0;
+    ValueId a = kNoValue;
+    ValueId b = kNoValue;
+    uint32_t first = 0;  // Phi, Call, Print: operands are IrFunction::operands[first, first + count)
+    uint32_t count = 0;
+    Constant constant{0};
+};
+
+enum class Terminator : uint8_t { None, Jump, Branch, Return };
+
+struct IrBlock {
+    std::vector<ValueId> insts;  // live instructions in order, phis first
+    std::vector<BlockId> preds;
+    Terminator terminator = Terminator::None;
+    ValueId value = kNoValue;  // Branch condition or returned value
+    BlockId targets[2] = {0, 0};  // Jump: targets[0]; Branch: true, false
+
+    uint32_t successorCount() const {
+        return terminator == Terminator::Jump ? 1 : terminator == Terminator::Branch ? 2 : 0;
+    }
+};
+
+struct IrFunction {
+    std::string name;
+    Type returnType = Type::None;
+    std::vector<Type> params;
+    std::vector<IrInst> insts;     // indexed by ValueId
+    std::vector<ValueId> operands; // variadic operand lists
+    std::vector<IrBlock> blocks;   // blocks[0] is the entry
+
+    ValueId* operandList(const IrInst& inst) { return operands.data() + inst.first; }
+    const ValueId* operandList(const IrInst& inst) const { return operands.data() + inst.first; }
+
+    // Number of instructions listed in blocks.
+    size_t liveInstructions() const;
+};
+
+struct IrModule {
+    std::vector<IrFunction> functions;  // parallel to Program::functions
+    std::vector<std::string> strings;
+};
+
+// Lowers a program that passed analyze() using Braun et al.'s on-the-fly SSA
+// construction: blocks are sealed once all their predecessors are known,
+// reads in unsealed blocks create operandless phis that are completed on
+// sealing, and trivial phis are removed as they appear. A function whose body
+// was never parsed gets its signature and no blocks. Functions are lowered
+// on `threads` workers (0 = one per core) with the same result for any count.
+IrModule lowerToIr(const Program& program, const SemanticModel& model, unsigned threads = 1);
+
+void printIr(std::ostream& out, const IrModule& module);
+
+// CFG helpers shared by lowering and the passes.
+
+// Blocks reachable from the entry, in reverse postorder.
+std::vector<BlockId> reversePostorder(const IrFunction& function);
+
+// Immediate dominator of every block (the entry is its own); blocks that are
+// not reachable get kNoValue. Cooper, Harvey and Kennedy's iterative scheme.
+std::vector<BlockId> immediateDominators(const IrFunction& function);
+
+// Drops the edge from -> to, along with the matching phi operands in `to`.
+void removeEdge(IrFunction& function, BlockId from, BlockId to);
+
+// Deletes unreachable blocks and renumbers the rest. Returns how many went.
+size_t removeUnreachableBlocks(IrFunction& function);
+
+// Puts a block on every edge from a block with two successors to a block
+// with several predecessors, so phi copies have a block of their own.
+// Returns how many blocks were added.
+size_t splitCriticalEdges(IrFunction& function);
+
+// Calls visit(ValueId&) for every value an instruction reads.
+template <typename Visit>
+void forEachOperand(IrFunction& function, IrInst& inst, Visit visit) {
+    switch (inst.op) {
+        case IrOp::Nop: case IrOp::Const: case IrOp::ConstS: case IrOp::Param:
+            break;
+        case IrOp::Phi: case IrOp::Call: case IrOp::Print:
+            for (uint32_t i = 0; i < inst.count; ++i) visit(function.operands[inst.first + i]);
+            break;
+        default:
+            visit(inst.a);
+            if (inst.b != kNoValue) visit(inst.b);
+            break;
+    }
+}
+
+// Follows a chain of replacements in `forward` to the value that stands.
+ValueId resolveForward(std::vector<ValueId>& forward, ValueId value);
+
+// Rewrites every operand through `forward` (value -> replacement, kNoValue
+// for none; chains are followed) and turns replaced instructions into Nops.
+void applyForwarding(IrFunction& function, std::vector<ValueId>& forward);
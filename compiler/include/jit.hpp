@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "bytecode.hpp"
+
+// Baseline template JIT for the VM. A function that the VM has called often
+// enough is translated instruction by instruction: every opcode has a fixed
+// x86-64 template that loads its operands from the frame's scalar registers,
+// computes, and stores the result back, so the register layout stays exactly
+// the VM's. The code is written to memory from mmap and then made executable
+// with mprotect. Only x86-64 Linux is supported; elsewhere compile() always
+// fails and the VM keeps interpreting.
+//
+// A function is compiled together with every function it can call, so
+// compiled code only ever calls compiled code. Anything touching strings or
+// print() has no template; a function that reaches one stays interpreted.
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+constexpr uint32_t kDefaultJitThreshold = 1000;
+
+struct JitRuntime;
+
+// Compiled code takes the callee's frame (its first scalar register) and the
+// runtime. It returns a JitStatus; on kJitOk the result is in
+// JitRuntime::result.
+using JitEntry = int (*)(Slot* registers, JitRuntime* runtime);
+
+enum JitStatus : int { kJitOk, kJitDivisionByZero, kJitStackOverflow };
+
+// Shared by all compiled code for one VM::run(). Compiled code reads it
+// through fixed offsets, so it has to stay standard layout.
+struct JitRuntime {
+    int64_t result = 0;
+    const Slot* scalarEnd = nullptr;     // first slot past the VM's scalar stack
+    const char* stackLimit = nullptr;    // compiled calls fail below this native stack address
+    const JitEntry* entries = nullptr;   // per function, null if not compiled
+    uint32_t failed = 0;                 // function that raised a non-kJitOk status
+};
+
+class Jit {
+public:
+    explicit Jit(const BytecodeModule& module);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Compiles `function` and everything it calls. Returns false, and never
+    // tries that function again, if one of them has no template.
+    bool compile(uint32_t function);
+
+    JitEntry entry(uint32_t function) const { return entries_[function]; }
+    const JitEntry* entries() const { return entries_.data(); }
+    size_t compiledFunctions() const { return compiled_; }
+
+private:
+    enum State : uint8_t { kInterpreted, kCompiled, kUnsupported };
+
+    const BytecodeModule& module_;
+    std::vector<JitEntry> entries_;
+    std::vector<State> states_;
+    std::vector<std::pair<void*, size_t>> mappings_;
+    size_t compiled_ = 0;
+
+    bool supported(const CompiledFunction& function) const;
+};
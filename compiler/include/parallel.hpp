@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include "thread_pool.hpp"
+
+// Runs work(state, i) for every i in [0, count) on `threads` workers (0 = one
+// per core, 1 = inline on the calling thread). Each worker builds one State
+// with make() and reuses it for every item it runs, so scratch tables and
+// buffers are allocated per thread rather than per function.
+//
+// Items must only write to results of their own (slot i of a vector sized up
+// front); the caller then merges the slots in index order. Which worker ran
+// which item never shows, so output is the same for any thread count. If
+// items throw, the exception of the lowest index is rethrown after all finish.
+template <typename Make, typename Work>
+void forEachIndex(unsigned threads, size_t count, Make make, Work work) {
+    if (threads == 1 || count < 2) {
+        auto state = make();
+        for (size_t i = 0; i < count; ++i) work(state, i);
+        return;
+    }
+    ThreadPool pool(threads);
+    using State = decltype(make());
+    std::vector<State> states;
+    states.reserve(pool.size());
+    for (unsigned w = 0; w < pool.size(); ++w) states.push_back(make());
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
+    size_t failed_index = count;
+    for (size_t i = 0; i < count; ++i) {
+        pool.submit([&, i] {
+            try {
+                work(states[static_cast<size_t>(pool.currentWorker())], i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failure_mutex);
+                if (i < failed_index) {
+                    failed_index = i;
+                    failure = std::current_exception();
+                }
+            }
+        });
+    }
+    pool.wait();
+    if (failure) std::rethrow_exception(failure);
+}
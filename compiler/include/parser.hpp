@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include "ast.hpp"
+#include "token.hpp"
+
+// Builds the AST for the tokens of Lexer::tokenize(). Syntax errors do not
+// throw: each one is recorded (Program::errors, Function::errors), the parser
+// skips to the next statement or function and carries on, so one run reports
+// every error. Grammar:
+//
+//   program   := function*
+//   function  := "fn" type IDENT "(" [type IDENT ("," type IDENT)*] ")" block
+//   statement := block | type IDENT ["=" expr] ";" | "if" "(" expr ")" statement ["else" statement]
+//              | "while" "(" expr ")" statement | "for" "(" [init] ";" [expr] ";" [expr] ")" statement
+//              | "return" [expr] ";" | "break" ";" | "continue" ";" | [expr] ";"
+//   type      := "int" | "float" | "string" | "bool"
+//
+// Expressions use C precedence, from assignment (= += -=, right associative)
+// and ?: up to the unary and postfix operators, calls, indexing and member access.
+//
+// ParseMode::Lazy parses only the signatures: each body is stepped over with
+// the BracketTable and kept as a token range until parseBody() is called, so
+// signature-only queries cost one linear pass over the tokens.
+enum class ParseMode { Eager, Lazy };
+
+Program parseProgram(std::vector<Token> tokens, ParseMode mode = ParseMode::Eager);
+
+// Parses a body left by ParseMode::Lazy; does nothing if it is already parsed.
+// Bodies only read the shared tokens, so different functions may be parsed
+// concurrently.
+void parseBody(const Program& program, Function& function);
+
+// Parses every remaining body on `threads` workers (0 = one per core),
+// except those of functions flagged in `skip` (indexed like Program::functions).
+void parseBodies(Program& program, unsigned threads = 0, const std::vector<bool>& skip = {});
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+// Optimization passes over the SSA IR. Each returns how many changes it
+// made (values folded, removed, merged or hoisted) and leaves the function
+// in valid SSA form with no unreachable blocks.
+
+// Folds operations on constants, forwards trivial phis and algebraic
+// identities (x + 0, x * 1, ...), and turns branches on constants into
+// jumps. Division by a constant zero is left for run time.
+size_t foldConstants(IrFunction& function);
+
+// Removes instructions whose results are never used and that have no side
+// effect: calls, prints and divisions that may trap are kept.
+size_t eliminateDeadCode(IrFunction& function);
+
+// Merges identical pure instructions where one dominates the other, walking
+// the dominator tree with a scoped hash table.
+size_t eliminateCommonSubexpressions(IrFunction& function);
+
+// Moves pure, non-trapping instructions whose operands are all defined
+// outside a natural loop into the loop's preheader, innermost loops first.
+size_t hoistLoopInvariants(IrFunction& function);
+
+struct PassStats {
+    std::string name;
+    bool enabled = true;
+    size_t changes = 0;
+    size_t instructionsBefore = 0;
+    size_t instructionsAfter = 0;
+    double milliseconds = 0;
+};
+
+// Runs an ordered list of named passes over every function of a module and
+// records per-pass change counts, instruction counts and wall time.
+class PassManager {
+public:
+    using Pass = size_t (*)(IrFunction&);
+
+    // The default pipeline: constfold, cse, licm, dce.
+    PassManager();
+
+    void add(const std::string& name, Pass pass);
+    // Returns false when no pass has that name.
+    bool setEnabled(const std::string& name, bool enabled);
+    void disableAll();
+
+    // Each pass runs over all functions, on `threads` workers (0 = one per
+    // core), before the next pass starts. Functions without blocks (bodies
+    // not lowered) are skipped.
+    void run(IrModule& module, unsigned threads = 1);
+
+    const std::vector<PassStats>& stats() const { return stats_; }
+    void printTimings(std::ostream& out) const;
+
+private:
+    std::vector<Pass> passes_;
+    std::vector<PassStats> stats_;  // parallel to passes_
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "interner.hpp"
+
+enum class Type : uint8_t { None, Int, Float, String, Bool, Error };
+
+Type typeFromToken(TokenType type);
+const char* typeName(Type type);
+
+// Callee ids of the built-in functions, stored where a Call would otherwise
+// hold the index of a user function.
+enum Builtin : uint32_t {
+    kBuiltinPrint = UINT32_MAX - 2,  // print(any...) -> int: prints its arguments, space separated
+    kBuiltinLen = UINT32_MAX - 1,    // len(string) -> int
+};
+
+class SemanticError : public std::runtime_error {
+public:
+    SemanticError(const std::string& message, int line, int column)
+        : std::runtime_error(message), line_(line), column_(column) {}
+
+    int line() const { return line_; }
+    int column() const { return column_; }
+
+private:
+    int line_;
+    int column_;
+};
+
+// What the checker learned about one function, indexed by NodeId of its body.
+struct FunctionInfo {
+    std::vector<Type> types;        // type of each expression node; None for statements
+    std::vector<uint32_t> symbols;  // Name and VarDecl: local slot; Call: callee function index or Builtin
+    std::vector<Type> locals;       // type of each local slot, parameters first
+};
+
+struct SemanticModel {
+    Interner names;  // function names; locals are interned per checking thread
+    std::vector<FunctionInfo> functions;  // parallel to Program::functions
+    std::vector<SemanticError> errors;
+};
+
+// Resolves names and checks types. Bodies still unparsed (ParseMode::Lazy)
+// are skipped and get an empty FunctionInfo. Rules:
+//   - int widens to float in initializers, assignments, arguments, returns and
+//     mixed arithmetic; nothing narrows implicitly.
+//   - + - * / take numbers, + also concatenates strings; % and the bitwise
+//     and shift operators take ints; && || ! take bools; conditions are bool.
+//   - = += -= ++ -- need a variable; += also appends to a string.
+//   - Each block is a scope; a local may shadow an outer one but not a name
+//     declared earlier in the same scope. Parameters share the body's scope.
+// Errors are collected, not thrown, and an erroneous subexpression does not
+// produce follow-up errors. Bodies are checked independently on `threads`
+// workers (0 = one per core); the result does not depend on the count.
+SemanticModel analyze(const Program& program, unsigned threads = 1);
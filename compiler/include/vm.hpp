@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "jit.hpp"
+
+class RuntimeError : public std::runtime_error {
+public:
+    explicit RuntimeError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// How print() renders values; shared by every backend so their output can be
+// compared byte for byte.
+void appendInt(std::string& out, int64_t value);
+void appendFloat(std::string& out, double value);  // printf "%g"
+
+// Interpreter for BytecodeModule. Dispatch is threaded (computed goto) when
+// the compiler supports labels as values, a switch otherwise. All frames live
+// on two contiguous stacks, one per register file; a call slides the frame
+// window up to the caller's argument registers, so arguments are never copied.
+//
+// A function called `jitThreshold` times is handed to the JIT (jit.hpp), and
+// later calls to it run the compiled code on the same frame window. Compiled
+// recursion uses the native stack, which is capped at half its limit (at most
+// 4 MB), so very deep recursion there reports a stack overflow sooner.
+class VM {
+public:
+    VM(const BytecodeModule& module, std::ostream& out);
+
+    // Runs a function that takes no arguments and returns its int result.
+    // Throws RuntimeError on division by zero or stack overflow.
+    int64_t run(uint32_t function);
+
+    // 0 never compiles. Defaults to kDefaultJitThreshold where the JIT is supported.
+    void setJitThreshold(uint32_t calls) { jitThreshold_ = calls; }
+    size_t jitCompiledFunctions() const { return jit_.compiledFunctions(); }
+
+private:
+    struct Frame {
+        const CompiledFunction* function;
+        const Instruction* returnPc;
+        size_t scalarBase;
+        size_t stringBase;
+        uint16_t result;  // register in the caller's frame
+    };
+
+    const BytecodeModule& module_;
+    std::ostream& out_;
+    std::vector<Slot> scalars_;
+    std::vector<std::string> strings_;
+    std::vector<Frame> frames_;
+    std::string buffer_;  // pending print() output
+    Jit jit_;
+    JitRuntime jitRuntime_;
+    uint32_t jitThreshold_;
+    std::vector<uint32_t> callCounts_;
+
+    void flush();
+    RuntimeError jitError(int status) const;
+};
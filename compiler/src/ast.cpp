@@ -0,0 +1,186 @@
+#include "ast.hpp"
+
+namespace {
+
+std::string_view typeName(TokenType type) {
+    return isTypeName(type) ? tokenSpelling(type) : "?";
+}
+
+class AstPrinter {
+public:
+    AstPrinter(std::ostream& out, const Program& program) : out_(out), tokens_(program.tokens) {}
+
+    void printFunction(const Function& function) {
+        arena_ = &function.body;
+        out_ << "(fn " << typeName(function.returnType) << ' ' << tokens_[function.name].value << " (";
+        for (size_t i = 0; i < function.params.size(); ++i) {
+            if (i > 0) out_ << ' ';
+            out_ << '(' << typeName(function.params[i].type) << ' ' << tokens_[function.params[i].name].value << ')';
+        }
+        out_ << ')';
+        if (function.root != kNoNode) {
+            printStatement(function.root, 1);
+        }
+        out_ << ")\n";
+    }
+
+private:
+    std::ostream& out_;
+    const std::vector<Token>& tokens_;
+    const AstArena* arena_ = nullptr;
+
+    void newline(int depth) {
+        out_ << '\n' << std::string(static_cast<size_t>(depth) * 2, ' ');
+    }
+
+    void printStatement(NodeId id, int depth) {
+        const Node& node = (*arena_)[id];
+        newline(depth);
+        switch (node.kind) {
+            case NodeKind::Block:
+                out_ << "(block";
+                for (uint32_t i = 0; i < node.b; ++i) {
+                    printStatement(arena_->list(node.a)[i], depth + 1);
+                }
+                out_ << ')';
+                break;
+            case NodeKind::If:
+                out_ << "(if ";
+                printExpression(node.a);
+                printStatement(node.b, depth + 1);
+                if (node.c != kNoNode) printStatement(node.c, depth + 1);
+                out_ << ')';
+                break;
+            case NodeKind::While:
+                out_ << "(while ";
+                printExpression(node.a);
+                printStatement(node.b, depth + 1);
+                out_ << ')';
+                break;
+            case NodeKind::For:
+                out_ << "(for ";
+                printOptional(node.a);
+                out_ << ' ';
+                printOptional(node.b);
+                out_ << ' ';
+                printOptional(node.c);
+                printStatement(node.d, depth + 1);
+                out_ << ')';
+                break;
+            default:
+                printInline(id);
+                break;
+        }
+    }
+
+    // Statements that fit on one line: declarations, jumps and expressions.
+    void printInline(NodeId id) {
+        const Node& node = (*arena_)[id];
+        switch (node.kind) {
+            case NodeKind::VarDecl:
+                out_ << "(var " << typeName(static_cast<TokenType>(node.b)) << ' ' << tokens_[node.token].value;
+                if (node.a != kNoNode) {
+                    out_ << ' ';
+                    printExpression(node.a);
+                }
+                out_ << ')';
+                break;
+            case NodeKind::Return:
+                out_ << "(return";
+                if (node.a != kNoNode) {
+                    out_ << ' ';
+                    printExpression(node.a);
+                }
+                out_ << ')';
+                break;
+            case NodeKind::Break: out_ << "(break)"; break;
+            case NodeKind::Continue: out_ << "(continue)"; break;
+            case NodeKind::ExprStmt: printExpression(node.a); break;
+            default: printExpression(id); break;
+        }
+    }
+
+    void printOptional(NodeId id) {
+        if (id == kNoNode) {
+            out_ << '_';
+        } else {
+            printInline(id);
+        }
+    }
+
+    void printExpression(NodeId id) {
+        const Node& node = (*arena_)[id];
+        const std::string& text = tokens_[node.token].value;
+        switch (node.kind) {
+            case NodeKind::IntLit:
+            case NodeKind::FloatLit:
+            case NodeKind::StringLit:
+            case NodeKind::BoolLit:
+            case NodeKind::Name:
+                out_ << text;
+                break;
+            case NodeKind::Unary:
+            case NodeKind::Postfix:
+                out_ << '(' << (node.kind == NodeKind::Postfix ? "post" : "") << text << ' ';
+                printExpression(node.a);
+                out_ << ')';
+                break;
+            case NodeKind::Binary:
+            case NodeKind::Assign:
+            case NodeKind::Index:
+                out_ << '(' << (node.kind == NodeKind::Index ? "index" : text) << ' ';
+                printExpression(node.a);
+                out_ << ' ';
+                printExpression(node.b);
+                out_ << ')';
+                break;
+            case NodeKind::Ternary:
+                out_ << "(? ";
+                printExpression(node.a);
+                out_ << ' ';
+                printExpression(node.b);
+                out_ << ' ';
+                printExpression(node.c);
+                out_ << ')';
+                break;
+            case NodeKind::Call:
+                out_ << "(call ";
+                printExpression(node.a);
+                for (uint32_t i = 0; i < node.c; ++i) {
+                    out_ << ' ';
+                    printExpression(arena_->list(node.b)[i]);
+                }
+                out_ << ')';
+                break;
+            case NodeKind::Member:
+                out_ << "(. ";
+                printExpression(node.a);
+                out_ << ' ' << text << ')';
+                break;
+            default:
+                out_ << "(?stmt)";
+                break;
+        }
+    }
+};
+
+} // namespace
+
+void printSignatures(std::ostream& out, const Program& program) {
+    for (const Function& function : program.functions) {
+        const Token& name = program.tokens[function.name];
+        out << name.line << ": fn " << typeName(function.returnType) << ' ' << name.value << '(';
+        for (size_t i = 0; i < function.params.size(); ++i) {
+            if (i > 0) out << ", ";
+            out << typeName(function.params[i].type) << ' ' << program.tokens[function.params[i].name].value;
+        }
+        out << ")\n";
+    }
+}
+
+void printAst(std::ostream& out, const Program& program) {
+    AstPrinter printer(out, program);
+    for (const Function& function : program.functions) {
+        printer.printFunction(function);
+    }
+}
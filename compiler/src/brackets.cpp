@@ -0,0 +1,42 @@
+#include "brackets.hpp"
+
+namespace {
+
+TokenType openerOf(TokenType closer) {
+    switch (closer) {
+        case T_PARENR: return T_PARENL;
+        case T_BRACKR: return T_BRACKL;
+        case T_BRACER: return T_BRACEL;
+        default: return T_EOF;
+    }
+}
+
+} // namespace
+
+BracketTable::BracketTable(const std::vector<Token>& tokens) : partner_(tokens.size(), kNoMatch) {
+    std::vector<uint32_t> open;
+    for (uint32_t i = 0; i < tokens.size(); ++i) {
+        const TokenType type = tokens[i].type;
+        if (type == T_PARENL || type == T_BRACKL || type == T_BRACEL) {
+            open.push_back(i);
+            continue;
+        }
+        const TokenType opener = openerOf(type);
+        if (opener == T_EOF) continue;
+
+        // A '}' closes its '{' even across unbalanced ( or [ inside the block,
+        // so one bad expression cannot unpair every body after it. A stray )
+        // or ] never closes past an open brace.
+        if (type == T_BRACER) {
+            size_t depth = open.size();
+            while (depth > 0 && tokens[open[depth - 1]].type != T_BRACEL) --depth;
+            if (depth == 0) continue;
+            open.resize(depth);
+        }
+        if (!open.empty() && tokens[open.back()].type == opener) {
+            partner_[open.back()] = i;
+            partner_[i] = open.back();
+            open.pop_back();
+        }
+    }
+}
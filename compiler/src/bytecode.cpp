@@ -0,0 +1,569 @@
+#include "bytecode.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint32_t kMaxRegisters = UINT16_MAX;
+
+const char* const kOpNames[] = {
+#define BYTECODE_NAME(name) #name,
+    BYTECODE_OPCODES(BYTECODE_NAME)
+#undef BYTECODE_NAME
+};
+
+// Interns constants so each distinct value is stored once per module.
+class ConstantPool {
+public:
+    explicit ConstantPool(BytecodeModule& module) : module_(module) {}
+
+    uint32_t scalar(Slot value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto it = scalars_.find(bits);
+        if (it != scalars_.end()) return it->second;
+        module_.constants.push_back(value);
+        return scalars_[bits] = static_cast<uint32_t>(module_.constants.size() - 1);
+    }
+
+    uint32_t string(const std::string& value) {
+        auto it = strings_.find(value);
+        if (it != strings_.end()) return it->second;
+        module_.strings.push_back(value);
+        return strings_[value] = static_cast<uint32_t>(module_.strings.size() - 1);
+    }
+
+private:
+    BytecodeModule& module_;
+    std::unordered_map<uint64_t, uint32_t> scalars_;
+    std::unordered_map<std::string, uint32_t> strings_;
+};
+
+class FunctionCompiler {
+public:
+    FunctionCompiler(const Program& program, const SemanticModel& model, ConstantPool& constants, size_t index)
+        : program_(program), function_(program.functions[index]), info_(model.functions[index]),
+          constants_(constants) {}
+
+    CompiledFunction compile() {
+        out_.name = program_.tokens[function_.name].value;
+        out_.returnType = typeFromToken(function_.returnType);
+        for (Type type : info_.locals) {
+            localRegisters_.push_back(static_cast<uint16_t>(type == Type::String ? stringLocals_++ : scalarLocals_++));
+        }
+        if (scalarLocals_ > kMaxRegisters || stringLocals_ > kMaxRegisters) tooManyRegisters();
+        scalarTop_ = scalarLocals_;
+        stringTop_ = stringLocals_;
+        updateFrameSize();
+
+        if (function_.root != kNoNode) compileStatement(function_.root);
+
+        // Falling off the end returns the zero value of the return type.
+        const uint16_t result = temp(out_.returnType);
+        if (out_.returnType == Type::String) {
+            emitWide(Op::LoadS, result, constants_.string(""));
+            emit(Op::RetS, result);
+        } else {
+            loadScalar(result, Slot{0});
+            emit(Op::Ret, result);
+        }
+        return std::move(out_);
+    }
+
+private:
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+
+    const Program& program_;
+    const Function& function_;
+    const FunctionInfo& info_;
+    ConstantPool& constants_;
+    CompiledFunction out_;
+    std::vector<uint16_t> localRegisters_;  // sema local slot -> register in its file
+    uint32_t scalarLocals_ = 0;
+    uint32_t stringLocals_ = 0;
+    uint32_t scalarTop_ = 0;  // next free temporary in each file
+    uint32_t stringTop_ = 0;
+    std::vector<Loop> loops_;
+
+    const Node& node(NodeId id) const { return function_.body[id]; }
+    Type type(NodeId id) const { return info_.types[id]; }
+    TokenType opOf(const Node& n) const { return program_.tokens[n.token].type; }
+    uint16_t localRegister(NodeId name) const { return localRegisters_[info_.symbols[name]]; }
+    Type localType(NodeId name) const { return info_.locals[info_.symbols[name]]; }
+
+    [[noreturn]] void tooManyRegisters() const {
+        throw CompileError("function '" + out_.name + "' needs more than " + std::to_string(kMaxRegisters) +
+                           " registers");
+    }
+
+    void updateFrameSize() {
+        if (scalarTop_ > kMaxRegisters || stringTop_ > kMaxRegisters) tooManyRegisters();
+        out_.scalarRegisters = std::max(out_.scalarRegisters, static_cast<uint16_t>(scalarTop_));
+        out_.stringRegisters = std::max(out_.stringRegisters, static_cast<uint16_t>(stringTop_));
+    }
+
+    uint16_t temp(Type t) {
+        const uint32_t reg = t == Type::String ? stringTop_++ : scalarTop_++;
+        updateFrameSize();
+        return static_cast<uint16_t>(reg);
+    }
+
+    size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        out_.code.push_back(Instruction{op, static_cast<uint16_t>(a), static_cast<uint16_t>(b), static_cast<uint16_t>(c)});
+        return out_.code.size() - 1;
+    }
+
+    // Emits an instruction whose 32-bit operand sits in b and c.
+    size_t emitWide(Op op, uint32_t a, uint32_t bx) { return emit(op, a, bx & 0xFFFF, bx >> 16); }
+
+    size_t here() const { return out_.code.size(); }
+
+    void patch(size_t jump, size_t target) {
+        out_.code[jump].b = static_cast<uint16_t>(target & 0xFFFF);
+        out_.code[jump].c = static_cast<uint16_t>(target >> 16);
+    }
+
+    void loadScalar(uint16_t dest, Slot value) { emitWide(Op::LoadK, dest, constants_.scalar(value)); }
+
+    // Expressions that write their destination before reading all of their
+    // operands; storing them straight into a variable they read is unsafe.
+    bool writesEarly(const Node& n) const {
+        const TokenType op = opOf(n);
+        return n.kind == NodeKind::Postfix || n.kind == NodeKind::Assign ||
+               (n.kind == NodeKind::Unary && (op == T_INCREMENT || op == T_DECREMENT)) ||
+               (n.kind == NodeKind::Binary && (op == T_AND || op == T_OR));
+    }
+
+    // A register holding the value of `id`: a variable's own register, or a new temporary.
+    uint16_t compileAny(NodeId id) {
+        if (node(id).kind == NodeKind::Name) return localRegister(id);
+        const uint16_t dest = temp(type(id));
+        compileInto(id, dest);
+        return dest;
+    }
+
+    // Like compileAny, widened to float when `want` is float.
+    uint16_t compileAs(NodeId id, Type want) {
+        if (want != Type::Float || type(id) != Type::Int) return compileAny(id);
+        const uint16_t value = compileAny(id);
+        const uint16_t dest = temp(Type::Float);
+        emit(Op::IToF, dest, value);
+        return dest;
+    }
+
+    void compileIntoAs(NodeId id, Type want, uint16_t dest) {
+        compileInto(id, dest);
+        if (want == Type::Float && type(id) == Type::Int) emit(Op::IToF, dest, dest);
+    }
+
+    void storeLocal(NodeId value, Type want, uint16_t reg) {
+        if (!writesEarly(node(value))) {
+            compileIntoAs(value, want, reg);
+            return;
+        }
+        const uint16_t scratch = temp(want);
+        compileIntoAs(value, want, scratch);
+        emit(want == Type::String ? Op::MovS : Op::Mov, reg, scratch);
+    }
+
+    void move(Type t, uint16_t dest, uint16_t source) {
+        if (dest != source) emit(t == Type::String ? Op::MovS : Op::Mov, dest, source);
+    }
+
+    void step(uint16_t reg, Type t, bool increment) {
+        if (t == Type::Int) {
+            emit(Op::AddIK, reg, reg, static_cast<uint16_t>(increment ? 1 : -1));
+            return;
+        }
+        const uint16_t one = temp(Type::Float);
+        Slot value;
+        value.f = 1.0;
+        loadScalar(one, value);
+        emit(increment ? Op::AddF : Op::SubF, reg, reg, one);
+    }
+
+    // Small int literals fold into AddIK.
+    bool smallIntLiteral(NodeId id, int64_t& value) const {
+        const Node& n = node(id);
+        if (n.kind != NodeKind::IntLit) return false;
+        value = std::strtoll(program_.tokens[n.token].value.c_str(), nullptr, 0);
+        return value >= INT16_MIN + 1 && value <= INT16_MAX;
+    }
+
+    void compileEffect(NodeId id) {
+        const Node& n = node(id);
+        const TokenType op = opOf(n);
+        if (n.kind == NodeKind::Postfix || (n.kind == NodeKind::Unary && (op == T_INCREMENT || op == T_DECREMENT))) {
+            step(localRegister(n.a), localType(n.a), op == T_INCREMENT);
+        } else if (n.kind == NodeKind::Assign) {
+            compileAssign(n);
+        } else {
+            compileAny(id);
+        }
+    }
+
+    // Performs the assignment and returns the variable's register.
+    uint16_t compileAssign(const Node& n) {
+        const uint16_t target = localRegister(n.a);
+        const Type target_type = localType(n.a);
+        const TokenType op = opOf(n);
+        if (op == T_ASSIGNOP) {
+            storeLocal(n.b, target_type, target);
+            return target;
+        }
+        if (target_type == Type::String) {
+            emit(Op::Append, target, compileAny(n.b));
+            return target;
+        }
+        int64_t immediate;
+        if (target_type == Type::Int && smallIntLiteral(n.b, immediate)) {
+            emit(Op::AddIK, target, target, static_cast<uint16_t>(op == T_PLUS_ASSIGN ? immediate : -immediate));
+            return target;
+        }
+        const uint16_t value = compileAs(n.b, target_type);
+        const bool is_float = target_type == Type::Float;
+        emit(op == T_PLUS_ASSIGN ? (is_float ? Op::AddF : Op::AddI) : (is_float ? Op::SubF : Op::SubI), target, target,
+             value);
+        return target;
+    }
+
+    void compileInto(NodeId id, uint16_t dest) {
+        const Node& n = node(id);
+        const std::string& text = program_.tokens[n.token].value;
+        switch (n.kind) {
+            case NodeKind::IntLit:
+                loadScalar(dest, Slot{std::strtoll(text.c_str(), nullptr, 0)});
+                break;
+            case NodeKind::FloatLit: {
+                Slot value;
+                value.f = std::strtod(text.c_str(), nullptr);
+                loadScalar(dest, value);
+                break;
+            }
+            case NodeKind::BoolLit:
+                loadScalar(dest, Slot{text == "true" ? 1 : 0});
+                break;
+            case NodeKind::StringLit:
+                emitWide(Op::LoadS, dest, constants_.string(unescape(text)));
+                break;
+            case NodeKind::Name:
+                move(type(id), dest, localRegister(id));
+                break;
+            case NodeKind::Unary:
+                compileUnary(id, n, dest);
+                break;
+            case NodeKind::Postfix: {
+                const uint16_t reg = localRegister(n.a);
+                move(type(id), dest, reg);
+                step(reg, localType(n.a), opOf(n) == T_INCREMENT);
+                break;
+            }
+            case NodeKind::Binary:
+                compileBinary(n, dest);
+                break;
+            case NodeKind::Assign:
+                move(type(id), dest, compileAssign(n));
+                break;
+            case NodeKind::Ternary: {
+                const size_t to_else = emitWide(Op::JmpF, compileAny(n.a), 0);
+                compileIntoAs(n.b, type(id), dest);
+                const size_t to_end = emitWide(Op::Jmp, 0, 0);
+                patch(to_else, here());
+                compileIntoAs(n.c, type(id), dest);
+                patch(to_end, here());
+                break;
+            }
+            case NodeKind::Call:
+                compileCall(id, n, dest);
+                break;
+            default:
+                throw CompileError("unexpected node in function '" + out_.name + "'");
+        }
+    }
+
+    void compileUnary(NodeId id, const Node& n, uint16_t dest) {
+        switch (opOf(n)) {
+            case T_MINUS:
+                emit(type(id) == Type::Float ? Op::NegF : Op::NegI, dest, compileAny(n.a));
+                break;
+            case T_PLUS:
+                compileInto(n.a, dest);
+                break;
+            case T_NOT:
+                emit(Op::Not, dest, compileAny(n.a));
+                break;
+            case T_BITNOT:
+                emit(Op::BitNot, dest, compileAny(n.a));
+                break;
+            default: {  // prefix ++ / --
+                const uint16_t reg = localRegister(n.a);
+                step(reg, localType(n.a), opOf(n) == T_INCREMENT);
+                move(type(id), dest, reg);
+                break;
+            }
+        }
+    }
+
+    void compileBinary(const Node& n, uint16_t dest) {
+        const TokenType op = opOf(n);
+        if (op == T_AND || op == T_OR) {
+            compileInto(n.a, dest);
+            const size_t skip = emitWide(op == T_AND ? Op::JmpF : Op::JmpT, dest, 0);
+            compileInto(n.b, dest);
+            patch(skip, here());
+            return;
+        }
+
+        const Type left = type(n.a);
+        const Type right = type(n.b);
+        if (left == Type::String) {
+            const uint16_t a = compileAny(n.a);
+            const uint16_t b = compileAny(n.b);
+            switch (op) {
+                case T_PLUS: emit(Op::Concat, dest, a, b); break;
+                case T_LT: emit(Op::LtS, dest, a, b); break;
+                case T_GT: emit(Op::LtS, dest, b, a); break;
+                case T_LTE: emit(Op::LeS, dest, a, b); break;
+                case T_GTE: emit(Op::LeS, dest, b, a); break;
+                case T_EQUALSOP: emit(Op::EqS, dest, a, b); break;
+                default: emit(Op::NeS, dest, a, b); break;
+            }
+            return;
+        }
+
+        const bool is_float = left == Type::Float || right == Type::Float;
+        int64_t immediate;
+        if (!is_float && (op == T_PLUS || op == T_MINUS) && smallIntLiteral(n.b, immediate)) {
+            emit(Op::AddIK, dest, compileAny(n.a), static_cast<uint16_t>(op == T_PLUS ? immediate : -immediate));
+            return;
+        }
+        const Type operand = is_float ? Type::Float : Type::Int;
+        const uint16_t a = compileAs(n.a, operand);
+        const uint16_t b = compileAs(n.b, operand);
+        switch (op) {
+            case T_PLUS: emit(is_float ? Op::AddF : Op::AddI, dest, a, b); break;
+            case T_MINUS: emit(is_float ? Op::SubF : Op::SubI, dest, a, b); break;
+            case T_MULT: emit(is_float ? Op::MulF : Op::MulI, dest, a, b); break;
+            case T_DIV: emit(is_float ? Op::DivF : Op::DivI, dest, a, b); break;
+            case T_MOD: emit(Op::ModI, dest, a, b); break;
+            case T_BITAND: emit(Op::BitAnd, dest, a, b); break;
+            case T_BITOR: emit(Op::BitOr, dest, a, b); break;
+            case T_BITXOR: emit(Op::BitXor, dest, a, b); break;
+            case T_LEFTSHIFT: emit(Op::Shl, dest, a, b); break;
+            case T_RIGHTSHIFT: emit(Op::Shr, dest, a, b); break;
+            case T_LT: emit(is_float ? Op::LtF : Op::LtI, dest, a, b); break;
+            case T_GT: emit(is_float ? Op::LtF : Op::LtI, dest, b, a); break;
+            case T_LTE: emit(is_float ? Op::LeF : Op::LeI, dest, a, b); break;
+            case T_GTE: emit(is_float ? Op::LeF : Op::LeI, dest, b, a); break;
+            case T_EQUALSOP: emit(is_float ? Op::EqF : Op::EqI, dest, a, b); break;
+            default: emit(is_float ? Op::NeF : Op::NeI, dest, a, b); break;
+        }
+    }
+
+    void compileCall(NodeId id, const Node& n, uint16_t dest) {
+        const uint32_t callee = info_.symbols[id];
+        const NodeId* arguments = function_.body.list(n.b);
+        if (callee == kBuiltinPrint) {
+            for (uint32_t i = 0; i < n.c; ++i) {
+                const Type t = type(arguments[i]);
+                const PrintKind kind = t == Type::Float ? kPrintFloat
+                                     : t == Type::Bool ? kPrintBool
+                                     : t == Type::String ? kPrintString : kPrintInt;
+                emit(Op::Print, compileAny(arguments[i]), kind, i + 1 == n.c ? 1 : 0);
+            }
+            if (n.c == 0) emit(Op::Print, 0, kPrintString, 2);  // 2: just end the line
+            loadScalar(dest, Slot{0});
+            return;
+        }
+        if (callee == kBuiltinLen) {
+            emit(Op::Len, dest, compileAny(arguments[0]));
+            return;
+        }
+
+        // Arguments go into consecutive registers at the top of each file; the
+        // callee's frame starts there, so they become its parameters in place.
+        const Function& target = program_.functions[callee];
+        const uint32_t scalar_base = scalarTop_;
+        const uint32_t string_base = stringTop_;
+        std::vector<uint16_t> slots;
+        slots.reserve(n.c);
+        for (uint32_t i = 0; i < n.c; ++i) {
+            slots.push_back(temp(typeFromToken(target.params[i].type)));
+        }
+        for (uint32_t i = 0; i < n.c; ++i) {
+            compileIntoAs(arguments[i], typeFromToken(target.params[i].type), slots[i]);
+        }
+        emitWide(Op::Call, dest, callee);
+        emit(Op::Call, scalar_base, string_base);
+    }
+
+    void compileStatement(NodeId id) {
+        const Node& n = node(id);
+        const uint32_t scalar_top = scalarTop_;
+        const uint32_t string_top = stringTop_;
+        switch (n.kind) {
+            case NodeKind::Block:
+                for (uint32_t i = 0; i < n.b; ++i) {
+                    compileStatement(function_.body.list(n.a)[i]);
+                }
+                break;
+            case NodeKind::VarDecl: {
+                const Type t = info_.locals[info_.symbols[id]];
+                const uint16_t reg = localRegisters_[info_.symbols[id]];
+                if (n.a != kNoNode) {
+                    storeLocal(n.a, t, reg);
+                } else if (t == Type::String) {
+                    emitWide(Op::LoadS, reg, constants_.string(""));
+                } else {
+                    loadScalar(reg, Slot{0});
+                }
+                break;
+            }
+            case NodeKind::If: {
+                const size_t to_else = emitWide(Op::JmpF, compileAny(n.a), 0);
+                compileStatement(n.b);
+                if (n.c == kNoNode) {
+                    patch(to_else, here());
+                    break;
+                }
+                const size_t to_end = emitWide(Op::Jmp, 0, 0);
+                patch(to_else, here());
+                compileStatement(n.c);
+                patch(to_end, here());
+                break;
+            }
+            case NodeKind::While:
+                compileLoop(kNoNode, n.a, kNoNode, n.b);
+                break;
+            case NodeKind::For:
+                compileLoop(n.a, n.b, n.c, n.d);
+                break;
+            case NodeKind::Return: {
+                const Type t = out_.returnType;
+                emit(t == Type::String ? Op::RetS : Op::Ret, compileAs(n.a, t));
+                break;
+            }
+            case NodeKind::Break:
+                loops_.back().breaks.push_back(emitWide(Op::Jmp, 0, 0));
+                break;
+            case NodeKind::Continue:
+                loops_.back().continues.push_back(emitWide(Op::Jmp, 0, 0));
+                break;
+            case NodeKind::ExprStmt:
+                compileEffect(n.a);
+                break;
+            default:
+                compileEffect(id);
+                break;
+        }
+        // Temporaries die with the statement that made them.
+        scalarTop_ = scalar_top;
+        stringTop_ = string_top;
+    }
+
+    // Rotated loop: the condition is tested at the bottom, so each iteration
+    // takes one conditional jump.
+    void compileLoop(NodeId init, NodeId condition, NodeId update, NodeId body) {
+        if (init != kNoNode) compileStatement(init);
+        const size_t to_condition = emitWide(Op::Jmp, 0, 0);
+        const size_t body_start = here();
+        loops_.emplace_back();
+        compileStatement(body);
+        const size_t continue_target = here();
+        if (update != kNoNode) {
+            const uint32_t scalar_top = scalarTop_;
+            const uint32_t string_top = stringTop_;
+            compileEffect(update);
+            scalarTop_ = scalar_top;
+            stringTop_ = string_top;
+        }
+        patch(to_condition, here());
+        if (condition != kNoNode) {
+            emitWide(Op::JmpT, compileAny(condition), static_cast<uint32_t>(body_start));
+        } else {
+            emitWide(Op::Jmp, 0, static_cast<uint32_t>(body_start));
+        }
+        for (size_t jump : loops_.back().breaks) patch(jump, here());
+        for (size_t jump : loops_.back().continues) patch(jump, continue_target);
+        loops_.pop_back();
+    }
+};
+
+} // namespace
+
+std::string unescape(const std::string& literal) {
+    std::string text;
+    text.reserve(literal.size());
+    for (size_t i = 1; i + 1 < literal.size(); ++i) {
+        char c = literal[i];
+        if (c == '\\' && i + 2 < literal.size()) {
+            c = literal[++i];
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = '\0'; break;
+                default: break;  // \" \\ and unknown escapes stand for the character itself
+            }
+        }
+        text += c;
+    }
+    return text;
+}
+
+BytecodeModule compileBytecode(const Program& program, const SemanticModel& model) {
+    BytecodeModule module;
+    ConstantPool constants(module);
+    module.functions.reserve(program.functions.size());
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        module.functions.push_back(FunctionCompiler(program, model, constants, i).compile());
+    }
+    return module;
+}
+
+void disassemble(std::ostream& out, const BytecodeModule& module) {
+    for (const CompiledFunction& function : module.functions) {
+        out << "fn " << function.name << " (scalar registers " << function.scalarRegisters << ", string registers "
+            << function.stringRegisters << ")\n";
+        for (size_t pc = 0; pc < function.code.size(); ++pc) {
+            const Instruction& in = function.code[pc];
+            out << "  " << std::setw(4) << pc << "  " << std::left << std::setw(7) << kOpNames[static_cast<int>(in.op)]
+                << std::right;
+            switch (in.op) {
+                case Op::Jmp:
+                    out << ' ' << in.bx();
+                    break;
+                case Op::JmpF: case Op::JmpT:
+                    out << " r" << in.a << ' ' << in.bx();
+                    break;
+                case Op::LoadK: {
+                    const Slot value = module.constants[in.bx()];
+                    out << " r" << in.a << " #" << in.bx() << " (" << value.i << " / " << value.f << ')';
+                    break;
+                }
+                case Op::LoadS:
+                    out << " s" << in.a << " #" << in.bx() << " (\"" << module.strings[in.bx()] << "\")";
+                    break;
+                case Op::Call: {
+                    const Instruction& args = function.code[++pc];
+                    out << ' ' << (module.functions[in.bx()].returnType == Type::String ? 's' : 'r') << in.a << ' '
+                        << module.functions[in.bx()].name << " (r" << args.a << ", s" << args.b << ')';
+                    break;
+                }
+                case Op::AddIK:
+                    out << " r" << in.a << " r" << in.b << ' ' << static_cast<int16_t>(in.c);
+                    break;
+                default:
+                    out << ' ' << in.a << ' ' << in.b << ' ' << in.c;
+                    break;
+            }
+            out << '\n';
+        }
+    }
+}
@@ -0,0 +1,433 @@
+#include "cache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <link.h>
+#endif
+
+namespace {
+
+constexpr char kMagic[4] = {'F', 'N', 'C', 'A'};
+
+// 64-bit FNV-1a. Strings are length-prefixed so adjacent fields cannot run
+// into each other.
+class Hasher {
+public:
+    void bytes(const void* data, size_t size) {
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash_ ^= p[i];
+            hash_ *= 0x100000001b3ULL;
+        }
+    }
+    void u64(uint64_t value) { bytes(&value, sizeof(value)); }
+    void text(const std::string& value) {
+        u64(value.size());
+        bytes(value.data(), value.size());
+    }
+    uint64_t value() const { return hash_; }
+
+private:
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+};
+
+uint64_t checksum(const std::string& payload) {
+    Hasher hasher;
+    hasher.bytes(payload.data(), payload.size());
+    return hasher.value();
+}
+
+#if defined(__linux__)
+// Hash of the NT_GNU_BUILD_ID note in the executable's PT_NOTE segments, or 0.
+int findBuildId(struct dl_phdr_info* info, size_t, void* result) {
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr)& segment = info->dlpi_phdr[i];
+        if (segment.p_type != PT_NOTE) continue;
+        const size_t align = segment.p_align == 8 ? 8 : 4;
+        const auto padded = [align](size_t size) { return (size + align - 1) & ~(align - 1); };
+        const char* p = reinterpret_cast<const char*>(info->dlpi_addr + segment.p_vaddr);
+        const char* end = p + segment.p_memsz;
+        while (static_cast<size_t>(end - p) >= sizeof(ElfW(Nhdr))) {
+            const auto* note = reinterpret_cast<const ElfW(Nhdr)*>(p);
+            const char* name = p + sizeof(ElfW(Nhdr));
+            const char* desc = name + padded(note->n_namesz);
+            if (desc > end || static_cast<size_t>(end - desc) < note->n_descsz) break;
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0 &&
+                note->n_descsz > 0) {
+                Hasher hasher;
+                hasher.bytes(desc, note->n_descsz);
+                *static_cast<uint64_t*>(result) = hasher.value() != 0 ? hasher.value() : 1;
+                return 1;
+            }
+            p = desc + padded(note->n_descsz);
+        }
+    }
+    return 1;  // the executable comes first; shared libraries are not the compiler
+}
+#endif
+
+class Writer {
+public:
+    template <typename T>
+    void raw(T value) {
+        out_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void text(const std::string& value) {
+        raw<uint64_t>(value.size());
+        out_ += value;
+    }
+    template <typename T>
+    void list(const std::vector<T>& values) {
+        raw<uint64_t>(values.size());
+        for (const T& value : values) raw(value);
+    }
+    std::string& str() { return out_; }
+
+private:
+    std::string out_;
+};
+
+// Reads what Writer wrote; every read is bounds checked, and a short or
+// malformed payload sets failed() instead of reading past the end.
+class Reader {
+public:
+    explicit Reader(const std::string& in) : in_(in) {}
+
+    template <typename T>
+    T raw() {
+        T value{};
+        if (in_.size() - pos_ < sizeof(T)) {
+            failed_ = true;
+            return value;
+        }
+        std::memcpy(&value, in_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+    std::string text() {
+        const uint64_t size = raw<uint64_t>();
+        if (failed_ || in_.size() - pos_ < size) {
+            failed_ = true;
+            return std::string();
+        }
+        std::string value = in_.substr(pos_, size);
+        pos_ += size;
+        return value;
+    }
+    template <typename T>
+    void list(std::vector<T>& values) {
+        const uint64_t size = raw<uint64_t>();
+        if (failed_ || (in_.size() - pos_) / sizeof(T) < size) {
+            failed_ = true;
+            return;
+        }
+        values.resize(size);
+        for (T& value : values) value = raw<T>();
+    }
+    bool failed() const { return failed_; }
+    bool atEnd() const { return pos_ == in_.size(); }
+
+private:
+    const std::string& in_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+};
+
+void writeFunction(Writer& out, const IrFunction& function, const std::vector<std::string>& strings) {
+    out.text(function.name);
+    out.raw(function.returnType);
+    out.list(function.params);
+    out.raw<uint64_t>(function.insts.size());
+    for (const IrInst& inst : function.insts) {
+        out.raw(inst.op);
+        out.raw(inst.type);
+        out.raw(inst.block);
+        out.raw(inst.a);
+        out.raw(inst.b);
+        out.raw(inst.first);
+        out.raw(inst.count);
+        out.raw(inst.constant.i);
+    }
+    out.list(function.operands);
+    out.raw<uint64_t>(function.blocks.size());
+    for (const IrBlock& block : function.blocks) {
+        out.list(block.insts);
+        out.list(block.preds);
+        out.raw(block.terminator);
+        out.raw(block.value);
+        out.raw(block.targets[0]);
+        out.raw(block.targets[1]);
+    }
+    out.raw<uint64_t>(strings.size());
+    for (const std::string& text : strings) out.text(text);
+}
+
+// Structural checks that keep a bad entry from indexing out of bounds later.
+bool valid(const IrFunction& function, size_t strings) {
+    const size_t values = function.insts.size();
+    const size_t blocks = function.blocks.size();
+    for (const IrInst& inst : function.insts) {
+        if (static_cast<uint8_t>(inst.op) > static_cast<uint8_t>(IrOp::Print)) return false;
+        if (static_cast<uint8_t>(inst.type) > static_cast<uint8_t>(Type::Error)) return false;
+        if (inst.block >= blocks && inst.op != IrOp::Nop) return false;
+        if (inst.first > function.operands.size() || inst.count > function.operands.size() - inst.first) return false;
+        if (inst.op == IrOp::ConstS && inst.a >= strings) return false;
+    }
+    for (ValueId operand : function.operands) {
+        if (operand >= values) return false;
+    }
+    for (const IrBlock& block : function.blocks) {
+        if (static_cast<uint8_t>(block.terminator) > static_cast<uint8_t>(Terminator::Return)) return false;
+        for (ValueId id : block.insts) {
+            if (id >= values) return false;
+        }
+        for (BlockId pred : block.preds) {
+            if (pred >= blocks) return false;
+        }
+        for (uint32_t s = 0; s < block.successorCount(); ++s) {
+            if (block.targets[s] >= blocks) return false;
+        }
+        if (block.terminator != Terminator::Jump && block.terminator != Terminator::None && block.value >= values) {
+            return false;
+        }
+    }
+    return blocks != 0;
+}
+
+bool readFunction(Reader& in, IrFunction& function, std::vector<std::string>& strings) {
+    function.name = in.text();
+    function.returnType = in.raw<Type>();
+    in.list(function.params);
+    const uint64_t insts = in.raw<uint64_t>();
+    for (uint64_t i = 0; i < insts && !in.failed(); ++i) {
+        IrInst inst;
+        inst.op = in.raw<IrOp>();
+        inst.type = in.raw<Type>();
+        inst.block = in.raw<BlockId>();
+        inst.a = in.raw<ValueId>();
+        inst.b = in.raw<ValueId>();
+        inst.first = in.raw<uint32_t>();
+        inst.count = in.raw<uint32_t>();
+        inst.constant.i = in.raw<int64_t>();
+        function.insts.push_back(inst);
+    }
+    in.list(function.operands);
+    const uint64_t blocks = in.raw<uint64_t>();
+    for (uint64_t b = 0; b < blocks && !in.failed(); ++b) {
+        IrBlock block;
+        in.list(block.insts);
+        in.list(block.preds);
+        block.terminator = in.raw<Terminator>();
+        block.value = in.raw<ValueId>();
+        block.targets[0] = in.raw<BlockId>();
+        block.targets[1] = in.raw<BlockId>();
+        function.blocks.push_back(std::move(block));
+    }
+    const uint64_t count = in.raw<uint64_t>();
+    for (uint64_t i = 0; i < count && !in.failed(); ++i) strings.push_back(in.text());
+    return !in.failed() && in.atEnd() && valid(function, strings.size());
+}
+
+} // namespace
+
+BuildCache::BuildCache(std::string directory) : directory_(std::move(directory)) {}
+
+uint64_t compilerBuildId() {
+    static const uint64_t id = [] {
+        uint64_t found = 0;
+#if defined(__linux__)
+        dl_iterate_phdr(findBuildId, &found);
+#endif
+        return found;
+    }();
+    return id;
+}
+
+std::string BuildCache::path(const char* kind, uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return directory_ + "/" + kind + "/" + name;
+}
+
+// Layout: magic, checksum of the rest, version string, kind, payload.
+bool BuildCache::load(const char* kind, uint64_t key, std::string& payload) const {
+    std::ifstream file(path(kind, key), std::ios::binary);
+    if (!file.is_open()) return false;
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (contents.size() < sizeof(kMagic) + sizeof(uint64_t)) return false;
+    if (contents.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0) return false;
+    const std::string rest = contents.substr(sizeof(kMagic) + sizeof(uint64_t));
+    uint64_t sum;
+    std::memcpy(&sum, contents.data() + sizeof(kMagic), sizeof(sum));
+    if (sum != checksum(rest)) return false;
+
+    Reader in(rest);
+    if (in.text() != kCacheVersion || in.text() != kind || in.failed()) return false;
+    payload = in.text();
+    return !in.failed() && in.atEnd();
+}
+
+void BuildCache::store(const char* kind, uint64_t key, const std::string& payload) const {
+    // A cache that cannot be written only costs speed, so failures are silent.
+    ::mkdir(directory_.c_str(), 0777);
+    ::mkdir((directory_ + "/" + kind).c_str(), 0777);
+
+    Writer body;
+    body.text(kCacheVersion);
+    body.text(kind);
+    body.text(payload);
+    std::string contents(kMagic, sizeof(kMagic));
+    const uint64_t sum = checksum(body.str());
+    contents.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+    contents += body.str();
+
+    const std::string target = path(kind, key);
+    const std::string temporary = target + ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return;
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!file) {
+            file.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporary.c_str(), target.c_str()) != 0) std::remove(temporary.c_str());
+}
+
+std::vector<Token> BuildCache::tokens(const std::string& source, const std::function<std::vector<Token>()>& lex) {
+    Hasher hasher;
+    hasher.text(kCacheVersion);
+    hasher.u64(compilerBuildId());
+    hasher.text(source);
+    const uint64_t key = hasher.value();
+
+    std::string payload;
+    if (load("tokens", key, payload)) {
+        std::vector<Token> tokens;
+        Reader list(payload);
+        const uint64_t count = list.raw<uint64_t>();
+        for (uint64_t i = 0; i < count && !list.failed(); ++i) {
+            Token token;
+            token.type = static_cast<TokenType>(list.raw<int32_t>());
+            token.value = list.text();
+            token.line = list.raw<int32_t>();
+            token.column = list.raw<int32_t>();
+            token.offset = list.raw<uint64_t>();
+            tokens.push_back(std::move(token));
+        }
+        if (!list.failed() && list.atEnd()) {
+            stats_.tokensReused = true;
+            return tokens;
+        }
+    }
+
+    std::vector<Token> tokens = lex();
+    Writer out;
+    out.raw<uint64_t>(tokens.size());
+    for (const Token& token : tokens) {
+        out.raw<int32_t>(token.type);
+        out.text(token.value);
+        out.raw<int32_t>(token.line);
+        out.raw<int32_t>(token.column);
+        out.raw<uint64_t>(token.offset);
+    }
+    store("tokens", key, out.str());
+    return tokens;
+}
+
+std::vector<uint64_t> BuildCache::functionKeys(const Program& program, const PassManager& passes) const {
+    // Calls resolve to a callee's index and types, so every function depends
+    // on all signatures, in order.
+    Hasher shared;
+    shared.text(kCacheVersion);
+    shared.u64(compilerBuildId());
+    for (const PassStats& pass : passes.stats()) {
+        if (pass.enabled) shared.text(pass.name);
+    }
+    for (const Function& function : program.functions) {
+        shared.u64(function.returnType);
+        shared.text(program.tokens[function.name].value);
+        shared.u64(function.params.size());
+        for (const Param& param : function.params) shared.u64(param.type);
+    }
+
+    std::vector<uint64_t> keys(program.functions.size(), 0);
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        const Function& function = program.functions[i];
+        if (function.bodyParsed) continue;
+        Hasher hasher = shared;
+        hasher.u64(i);
+        for (const Param& param : function.params) hasher.text(program.tokens[param.name].value);
+        for (uint32_t t = function.bodyBegin; t < function.bodyEnd; ++t) {
+            hasher.u64(program.tokens[t].type);
+            hasher.text(program.tokens[t].value);
+        }
+        keys[i] = hasher.value() != 0 ? hasher.value() : 1;
+    }
+    return keys;
+}
+
+std::vector<bool> BuildCache::probe(const std::vector<uint64_t>& keys) {
+    found_.assign(keys.size(), Entry());
+    present_.assign(keys.size(), false);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string payload;
+        if (keys[i] == 0 || !load("ir", keys[i], payload)) continue;
+        Reader in(payload);
+        Entry entry;
+        if (!readFunction(in, entry.function, entry.strings)) continue;
+        found_[i] = std::move(entry);
+        present_[i] = true;
+    }
+    return present_;
+}
+
+void BuildCache::reuse(IrModule& module, const std::vector<uint64_t>& keys) {
+    std::unordered_map<std::string, uint32_t> index;
+    for (uint32_t s = 0; s < module.strings.size(); ++s) index.emplace(module.strings[s], s);
+
+    for (size_t i = 0; i < module.functions.size() && i < keys.size(); ++i) {
+        IrFunction& function = module.functions[i];
+        if (i < present_.size() && present_[i]) {
+            // Splice in the cached body, renumbering its strings into the module's.
+            Entry& entry = found_[i];
+            std::vector<uint32_t> renumber;
+            for (std::string& text : entry.strings) {
+                const auto it = index.emplace(text, static_cast<uint32_t>(module.strings.size())).first;
+                if (it->second == module.strings.size()) module.strings.push_back(std::move(text));
+                renumber.push_back(it->second);
+            }
+            function = std::move(entry.function);
+            for (IrInst& inst : function.insts) {
+                if (inst.op == IrOp::ConstS) inst.a = renumber[inst.a];
+            }
+            ++stats_.functionsReused;
+            continue;
+        }
+        if (keys[i] == 0) continue;
+
+        // Store with a table of just the strings this function uses.
+        IrFunction local = function;
+        std::vector<std::string> strings;
+        std::unordered_map<uint32_t, uint32_t> numbering;
+        for (IrInst& inst : local.insts) {
+            if (inst.op != IrOp::ConstS) continue;
+            const auto it = numbering.emplace(inst.a, static_cast<uint32_t>(strings.size())).first;
+            if (it->second == strings.size()) strings.push_back(module.strings[inst.a]);
+            inst.a = it->second;
+        }
+        Writer out;
+        writeFunction(out, local, strings);
+        store("ir", keys[i], out.str());
+        ++stats_.functionsCompiled;
+    }
+    found_.clear();
+    present_.clear();
+}
@@ -0,0 +1,819 @@
+#include "codegen.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include "parallel.hpp"
+
+namespace {
+
+enum Register { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+const char* const kGprNames[] = {"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+                                 "%r8",  "%r9",  "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+
+// rax, rcx, rdx, r10 and r11 are scratch for division, shifts, constants and
+// moves; xmm0 and xmm1 likewise for floats.
+const int kCallerSaved[] = {RSI, RDI, R8, R9};
+const int kCalleeSaved[] = {RBX, R12, R13, R14, R15};
+const int kIntArguments[] = {RDI, RSI, RDX, RCX, R8, R9};
+constexpr int kFloatArguments = 8;
+constexpr int kFirstFloatRegister = 2;
+constexpr int kFloatRegisters = 16;
+
+struct Location {
+    enum Kind : uint8_t { None, Gpr, Xmm, Frame };
+    Kind kind = None;
+    int index = 0;  // register number, or offset from %rbp
+
+    bool operator==(const Location& other) const { return kind == other.kind && index == other.index; }
+    bool operator!=(const Location& other) const { return !(*this == other); }
+};
+
+Location gpr(int reg) { return Location{Location::Gpr, reg}; }
+Location xmm(int reg) { return Location{Location::Xmm, reg}; }
+
+std::string name(Location location) {
+    switch (location.kind) {
+        case Location::Gpr: return kGprNames[location.index];
+        case Location::Xmm: return "%xmm" + std::to_string(location.index);
+        case Location::Frame: return std::to_string(location.index) + "(%rbp)";
+        default: return "?";
+    }
+}
+
+std::string quoted(const std::string& text) {
+    std::string out = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            char escape[5];
+            std::snprintf(escape, sizeof(escape), "\\%03o", c);
+            out += escape;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + '"';
+}
+
+// Read-only strings of one function: literals, printf formats and its name
+// for runtime errors. Each function numbers its own labels, so functions can
+// be emitted independently; the strings go in a mergeable section and the
+// linker folds duplicates.
+class DataSection {
+public:
+    DataSection(const IrModule& module, std::string prefix) : module_(module), prefix_(std::move(prefix)) {}
+
+    std::string literal(uint32_t index) { return label(module_.strings[index]); }
+
+    std::string label(const std::string& text) {
+        auto it = labels_.find(text);
+        if (it != labels_.end()) return it->second;
+        const std::string label = prefix_ + std::to_string(labels_.size());
+        labels_.emplace(text, label);
+        order_.push_back(text);
+        return label;
+    }
+
+    void write(std::ostream& out) const {
+        if (order_.empty()) return;
+        out << "\t.section .rodata.str1.1,\"aMS\",@progbits,1\n";
+        for (const std::string& text : order_) {
+            out << labels_.at(text) << ":\n\t.string " << quoted(text) << "\n";
+        }
+    }
+
+private:
+    const IrModule& module_;
+    std::string prefix_;
+    std::unordered_map<std::string, std::string> labels_;
+    std::vector<std::string> order_;
+};
+
+struct Move {
+    Location from;
+    Location to;
+};
+
+class FunctionEmitter {
+public:
+    FunctionEmitter(std::ostream& out, IrModule& module, size_t index, DataSection& data)
+        : out_(out), module_(module), function_(module.functions[index]), index_(index), data_(data) {}
+
+    void emit() {
+        splitCriticalEdges(function_);
+        layout();
+        computeLiveness();
+        buildIntervals();
+        allocate();
+        emitFunction();
+    }
+
+private:
+    struct Interval {
+        ValueId value;
+        uint32_t from;
+        uint32_t to;
+        bool floating;
+        bool crossesCall;
+    };
+
+    std::ostream& out_;
+    IrModule& module_;
+    IrFunction& function_;
+    size_t index_;
+    DataSection& data_;
+
+    std::vector<BlockId> order_;
+    std::vector<uint32_t> blockStart_;
+    std::vector<uint32_t> blockEnd_;
+    std::vector<uint32_t> position_;  // per value
+    std::vector<uint32_t> calls_;     // positions where caller-saved registers die
+    std::vector<std::vector<uint64_t>> liveIn_;
+    std::vector<std::vector<uint64_t>> liveOut_;
+    std::vector<Interval> intervals_;
+    std::vector<Location> locations_;  // per value
+    std::vector<int> savedRegisters_;  // callee-saved registers this function uses
+    int frameSize_ = 0;
+    bool usesDivision_ = false;
+
+    const IrInst& inst(ValueId id) const { return function_.insts[id]; }
+    std::string label(BlockId block) const { return ".Lf" + std::to_string(index_) + "_b" + std::to_string(block); }
+    std::string operand(ValueId value) const { return name(locations_[value]); }
+
+    [[noreturn]] void unsupported(const std::string& what) const {
+        throw CodegenError(what + " is not supported by the native backend (function '" + function_.name + "')");
+    }
+
+    bool isCall(const IrInst& i) const {
+        if (i.op == IrOp::Call || i.op == IrOp::Print || i.op == IrOp::Len) return true;
+        const bool comparison = i.op == IrOp::Lt || i.op == IrOp::Le || i.op == IrOp::Eq || i.op == IrOp::Ne;
+        return comparison && inst(i.a).type == Type::String;
+    }
+
+    // Layout and liveness
+
+    void layout() {
+        order_ = reversePostorder(function_);
+        // Parameters are read from their ABI registers before anything else runs.
+        std::vector<ValueId>& entry = function_.blocks[0].insts;
+        std::stable_partition(entry.begin(), entry.end(), [&](ValueId id) { return inst(id).op == IrOp::Param; });
+
+        blockStart_.assign(function_.blocks.size(), 0);
+        blockEnd_.assign(function_.blocks.size(), 0);
+        position_.assign(function_.insts.size(), 0);
+        uint32_t position = 0;
+        for (BlockId b : order_) {
+            blockStart_[b] = position;
+            position += 2;
+            for (ValueId id : function_.blocks[b].insts) {
+                position_[id] = position;
+                if (isCall(inst(id))) calls_.push_back(position);
+                position += 2;
+            }
+            blockEnd_[b] = position;
+            position += 2;
+        }
+    }
+
+    static void set(std::vector<uint64_t>& bits, ValueId value) { bits[value / 64] |= uint64_t{1} << (value % 64); }
+
+    void computeLiveness() {
+        const size_t words = (function_.insts.size() + 63) / 64;
+        const size_t blocks = function_.blocks.size();
+        std::vector<std::vector<uint64_t>> uses(blocks, std::vector<uint64_t>(words, 0));
+        std::vector<std::vector<uint64_t>> defs(blocks, std::vector<uint64_t>(words, 0));
+        liveIn_.assign(blocks, std::vector<uint64_t>(words, 0));
+        liveOut_.assign(blocks, std::vector<uint64_t>(words, 0));
+
+        for (BlockId b : order_) {
+            IrBlock& block = function_.blocks[b];
+            for (ValueId id : block.insts) {
+                set(defs[b], id);
+                IrInst& i = function_.insts[id];
+                if (i.op == IrOp::Phi) continue;
+                forEachOperand(function_, i, [&](ValueId& v) {
+                    if (inst(v).block != b) set(uses[b], v);
+                });
+            }
+            if (block.terminator == Terminator::Branch || block.terminator == Terminator::Return) {
+                if (inst(block.value).block != b) set(uses[b], block.value);
+            }
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto it = order_.rbegin(); it != order_.rend(); ++it) {
+                const BlockId b = *it;
+                const IrBlock& block = function_.blocks[b];
+                std::vector<uint64_t> out(words, 0);
+                for (uint32_t s = 0; s < block.successorCount(); ++s) {
+                    const BlockId successor = block.targets[s];
+                    for (size_t w = 0; w < words; ++w) out[w] |= liveIn_[successor][w];
+                    const IrBlock& target = function_.blocks[successor];
+                    const size_t edge = static_cast<size_t>(
+                        std::find(target.preds.begin(), target.preds.end(), b) - target.preds.begin());
+                    for (ValueId id : target.insts) {
+                        if (inst(id).op != IrOp::Phi) break;
+                        set(out, function_.operands[inst(id).first + edge]);
+                    }
+                }
+                for (size_t w = 0; w < words; ++w) {
+                    const uint64_t in = uses[b][w] | (out[w] & ~defs[b][w]);
+                    if (in != liveIn_[b][w]) {
+                        liveIn_[b][w] = in;
+                        changed = true;
+                    }
+                }
+                liveOut_[b] = std::move(out);
+            }
+        }
+    }
+
+    // One conservative range per value: from its definition to its last use,
+    // covering every block it is live through.
+    void buildIntervals() {
+        std::vector<uint32_t> from(function_.insts.size(), UINT32_MAX);
+        std::vector<uint32_t> to(function_.insts.size(), 0);
+        const auto extend = [&](ValueId v, uint32_t position) {
+            from[v] = std::min(from[v], position);
+            to[v] = std::max(to[v], position);
+        };
+        const auto each = [](const std::vector<uint64_t>& bits, auto visit) {
+            for (size_t w = 0; w < bits.size(); ++w) {
+                for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+                    visit(static_cast<ValueId>(w * 64 + static_cast<unsigned>(__builtin_ctzll(word))));
+                }
+            }
+        };
+
+        for (BlockId b : order_) {
+            IrBlock& block = function_.blocks[b];
+            for (ValueId id : block.insts) {
+                IrInst& i = function_.insts[id];
+                if (i.op == IrOp::Phi) {
+                    extend(id, blockStart_[b]);
+                    for (uint32_t k = 0; k < i.count; ++k) {
+                        const uint32_t end = blockEnd_[block.preds[k]];
+                        extend(function_.operands[i.first + k], end);
+                        extend(id, end);  // written by the copies at the end of each predecessor
+                    }
+                    continue;
+                }
+                extend(id, position_[id]);
+                forEachOperand(function_, i, [&](ValueId& v) { extend(v, position_[id]); });
+            }
+            if (block.terminator == Terminator::Branch || block.terminator == Terminator::Return) {
+                extend(block.value, blockEnd_[b]);
+            }
+            each(liveIn_[b], [&](ValueId v) { extend(v, blockStart_[b]); });
+            each(liveOut_[b], [&](ValueId v) { extend(v, blockEnd_[b]); });
+        }
+
+        for (BlockId b : order_) {
+            for (ValueId id : function_.blocks[b].insts) {
+                if (inst(id).type == Type::None) continue;
+                const auto call = std::upper_bound(calls_.begin(), calls_.end(), from[id]);
+                const bool crosses = call != calls_.end() && *call < to[id];
+                intervals_.push_back(Interval{id, from[id], to[id], inst(id).type == Type::Float, crosses});
+            }
+        }
+        std::sort(intervals_.begin(), intervals_.end(),
+                  [](const Interval& x, const Interval& y) { return x.from < y.from || (x.from == y.from && x.value < y.value); });
+    }
+
+    // Linear scan (Poletto and Sarkar). An interval ends strictly before the
+    // next one may take its register, so a result never shares a register
+    // with its operands.
+    void allocate() {
+        locations_.assign(function_.insts.size(), Location{});
+        std::vector<size_t> active;
+        bool gpr_free[16] = {};
+        bool xmm_free[kFloatRegisters] = {};
+        for (int reg : kCallerSaved) gpr_free[reg] = true;
+        for (int reg : kCalleeSaved) gpr_free[reg] = true;
+        for (int reg = kFirstFloatRegister; reg < kFloatRegisters; ++reg) xmm_free[reg] = true;
+        bool callee_used[16] = {};
+        int spills = 0;
+        std::vector<int> spill_slot(function_.insts.size(), -1);
+
+        const auto release = [&](const Interval& interval) {
+            const Location location = locations_[interval.value];
+            if (location.kind == Location::Gpr) gpr_free[location.index] = true;
+            if (location.kind == Location::Xmm) xmm_free[location.index] = true;
+        };
+        const auto spill = [&](ValueId value) {
+            spill_slot[value] = spills++;
+            locations_[value] = Location{Location::Frame, 0};
+        };
+        const auto allowed = [&](const Interval& interval, Location location) {
+            if (location.kind == Location::Xmm) return !interval.crossesCall;
+            if (location.kind != Location::Gpr) return false;
+            if (!interval.crossesCall) return true;
+            return std::find(std::begin(kCalleeSaved), std::end(kCalleeSaved), location.index) != std::end(kCalleeSaved);
+        };
+
+        for (size_t i = 0; i < intervals_.size(); ++i) {
+            const Interval& current = intervals_[i];
+            active.erase(std::remove_if(active.begin(), active.end(),
+                                        [&](size_t j) {
+                                            if (intervals_[j].to >= current.from) return false;
+                                            release(intervals_[j]);
+                                            return true;
+                                        }),
+                         active.end());
+
+            Location chosen;
+            if (current.floating) {
+                if (!current.crossesCall) {
+                    for (int reg = kFirstFloatRegister; reg < kFloatRegisters; ++reg) {
+                        if (xmm_free[reg]) {
+                            chosen = xmm(reg);
+                            break;
+                        }
+                    }
+                }
+            } else {
+                if (!current.crossesCall) {
+                    for (int reg : kCallerSaved) {
+                        if (gpr_free[reg]) {
+                            chosen = gpr(reg);
+                            break;
+                        }
+                    }
+                }
+                if (chosen.kind == Location::None) {
+                    for (int reg : kCalleeSaved) {
+                        if (gpr_free[reg]) {
+                            chosen = gpr(reg);
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (chosen.kind == Location::None) {
+                // Evict the active interval that ends last, if it outlives this one.
+                size_t victim = SIZE_MAX;
+                for (size_t j : active) {
+                    const Interval& other = intervals_[j];
+                    if (other.floating != current.floating || !allowed(current, locations_[other.value])) continue;
+                    if (victim == SIZE_MAX || other.to > intervals_[victim].to) victim = j;
+                }
+                if (victim != SIZE_MAX && intervals_[victim].to > current.to) {
+                    chosen = locations_[intervals_[victim].value];
+                    spill(intervals_[victim].value);
+                    active.erase(std::find(active.begin(), active.end(), victim));
+                } else {
+                    spill(current.value);
+                    continue;
+                }
+            }
+
+            locations_[current.value] = chosen;
+            if (chosen.kind == Location::Gpr) {
+                gpr_free[chosen.index] = false;
+                if (std::find(std::begin(kCalleeSaved), std::end(kCalleeSaved), chosen.index) != std::end(kCalleeSaved)) {
+                    callee_used[chosen.index] = true;
+                }
+            } else {
+                xmm_free[chosen.index] = false;
+            }
+            active.push_back(i);
+        }
+
+        // Frame: saved callee-saved registers, then spill slots.
+        for (int reg : kCalleeSaved) {
+            if (callee_used[reg]) savedRegisters_.push_back(reg);
+        }
+        const int saved = static_cast<int>(savedRegisters_.size());
+        for (ValueId v = 0; v < function_.insts.size(); ++v) {
+            if (spill_slot[v] >= 0) locations_[v] = Location{Location::Frame, -8 * (saved + spill_slot[v] + 1)};
+        }
+        frameSize_ = 8 * (saved + spills);
+        frameSize_ = (frameSize_ + 15) & ~15;
+    }
+
+    // Moves
+
+    void move(Location from, Location to) {
+        if (from == to) return;
+        if (from.kind == Location::Frame && to.kind == Location::Frame) {
+            out_ << "\tmovq " << name(from) << ", %r10\n\tmovq %r10, " << name(to) << "\n";
+        } else if (from.kind == Location::Xmm && to.kind == Location::Xmm) {
+            out_ << "\tmovapd " << name(from) << ", " << name(to) << "\n";
+        } else if (from.kind == Location::Xmm || to.kind == Location::Xmm) {
+            const bool crosses = from.kind == Location::Gpr || to.kind == Location::Gpr;
+            out_ << (crosses ? "\tmovq " : "\tmovsd ") << name(from) << ", " << name(to) << "\n";
+        } else {
+            out_ << "\tmovq " << name(from) << ", " << name(to) << "\n";
+        }
+    }
+
+    // Performs all moves as if at once; cycles go through r11 or xmm1.
+    void parallelMove(std::vector<Move> moves) {
+        moves.erase(std::remove_if(moves.begin(), moves.end(), [](const Move& m) { return m.from == m.to; }),
+                    moves.end());
+        while (!moves.empty()) {
+            bool progress = false;
+            for (size_t i = 0; i < moves.size(); ++i) {
+                const bool blocked = std::any_of(moves.begin(), moves.end(),
+                                                 [&](const Move& other) { return other.from == moves[i].to; });
+                if (blocked) continue;
+                move(moves[i].from, moves[i].to);
+                moves.erase(moves.begin() + static_cast<std::ptrdiff_t>(i));
+                progress = true;
+                break;
+            }
+            if (progress) continue;
+            const Location source = moves.front().from;
+            const Location scratch = source.kind == Location::Xmm ? xmm(1) : gpr(R11);
+            move(source, scratch);
+            for (Move& m : moves) {
+                if (m.from == source) m.from = scratch;
+            }
+        }
+    }
+
+    // Calls
+
+    // Sets up the System V argument registers and stack, then calls. With a
+    // format, this is printf: the format takes rdi and bools are passed as
+    // "true"/"false" strings.
+    void call(const std::string& target, const std::vector<ValueId>& arguments, const std::string& format = "") {
+        const bool printing = !format.empty();
+        std::vector<Move> moves;
+        std::vector<int> bool_registers;
+        std::vector<ValueId> stacked;
+        int ints = printing ? 1 : 0;
+        int floats = 0;
+        for (ValueId v : arguments) {
+            const bool floating = inst(v).type == Type::Float;
+            if (floating && floats < kFloatArguments) {
+                moves.push_back(Move{locations_[v], xmm(floats++)});
+            } else if (!floating && ints < 6) {
+                moves.push_back(Move{locations_[v], gpr(kIntArguments[ints])});
+                if (printing && inst(v).type == Type::Bool) bool_registers.push_back(kIntArguments[ints]);
+                ++ints;
+            } else {
+                stacked.push_back(v);
+            }
+        }
+
+        const size_t stack_bytes = 8 * (stacked.size() + stacked.size() % 2);
+        if (stacked.size() % 2 != 0) out_ << "\tsubq $8, %rsp\n";
+        for (auto it = stacked.rbegin(); it != stacked.rend(); ++it) {
+            const Location location = locations_[*it];
+            if (location.kind == Location::Xmm) {
+                out_ << "\tsubq $8, %rsp\n\tmovsd " << name(location) << ", (%rsp)\n";
+            } else {
+                out_ << "\tpushq " << name(location) << "\n";
+            }
+            if (printing && inst(*it).type == Type::Bool) boolToString("(%rsp)");
+        }
+        parallelMove(moves);
+        for (int reg : bool_registers) boolToString(kGprNames[reg]);
+        if (printing) {
+            out_ << "\tleaq " << data_.label(format) << "(%rip), %rdi\n\tmovl $" << floats << ", %eax\n";
+        }
+        out_ << "\tcall " << target << "\n";
+        if (stack_bytes != 0) out_ << "\taddq $" << stack_bytes << ", %rsp\n";
+    }
+
+    void boolToString(const std::string& where) {
+        out_ << "\tleaq " << data_.label("true") << "(%rip), %r10\n"
+             << "\tleaq " << data_.label("false") << "(%rip), %r11\n"
+             << "\tcmpq $0, " << where << "\n"
+             << "\tcmoveq %r11, %r10\n"
+             << "\tmovq %r10, " << where << "\n";
+    }
+
+    // Instructions
+
+    // Where to compute a result: its register, or scratch when it is spilled.
+    Location target(ValueId id, Location scratch) const {
+        const Location location = locations_[id];
+        return location.kind == Location::Frame ? scratch : location;
+    }
+
+    void store(ValueId id, Location computed) {
+        if (locations_[id].kind != Location::None) move(computed, locations_[id]);
+    }
+
+    void loadConstant(ValueId id) {
+        const IrInst& i = inst(id);
+        uint64_t bits;
+        std::memcpy(&bits, &i.constant, sizeof(bits));
+        const int64_t value = static_cast<int64_t>(bits);
+        const Location location = locations_[id];
+        if (location.kind == Location::None) return;
+        if (location.kind != Location::Xmm && value >= INT32_MIN && value <= INT32_MAX) {
+            out_ << "\tmovq $" << value << ", " << name(location) << "\n";
+            return;
+        }
+        out_ << "\tmovabsq $" << value << ", %rax\n";
+        move(gpr(RAX), location);
+    }
+
+    void setFlag(const char* condition, ValueId id) {
+        out_ << "\tset" << condition << " %al\n\tmovzbl %al, %eax\n";
+        store(id, gpr(RAX));
+    }
+
+    void emitInst(ValueId id) {
+        const IrInst& i = inst(id);
+        switch (i.op) {
+            case IrOp::Param:
+            case IrOp::Phi:
+            case IrOp::Nop:
+                break;
+            case IrOp::Const:
+                loadConstant(id);
+                break;
+            case IrOp::ConstS: {
+                const Location t = target(id, gpr(RAX));
+                out_ << "\tleaq " << data_.literal(i.a) << "(%rip), " << name(t) << "\n";
+                store(id, t);
+                break;
+            }
+            case IrOp::Add: case IrOp::Sub: case IrOp::Mul: case IrOp::Div:
+                if (i.type == Type::Float) {
+                    emitFloatArithmetic(id, i);
+                } else if (i.op == IrOp::Div) {
+                    emitDivision(id, i);
+                } else {
+                    emitIntArithmetic(id, i);
+                }
+                break;
+            case IrOp::Mod:
+                emitDivision(id, i);
+                break;
+            case IrOp::BitAnd: case IrOp::BitOr: case IrOp::BitXor:
+                emitIntArithmetic(id, i);
+                break;
+            case IrOp::Shl: case IrOp::Shr: {
+                const Location t = target(id, gpr(RAX));
+                out_ << "\tmovq " << operand(i.b) << ", %rcx\n\tmovq " << operand(i.a) << ", " << name(t) << "\n"
+                     << (i.op == IrOp::Shl ? "\tsalq %cl, " : "\tsarq %cl, ") << name(t) << "\n";
+                store(id, t);
+                break;
+            }
+            case IrOp::Neg:
+                if (i.type == Type::Float) {
+                    const Location t = target(id, xmm(0));
+                    out_ << "\tmovsd " << operand(i.a) << ", " << name(t) << "\n"
+                         << "\tmovabsq $-9223372036854775808, %rax\n\tmovq %rax, %xmm1\n"
+                         << "\txorpd %xmm1, " << name(t) << "\n";
+                    store(id, t);
+                    break;
+                }
+                [[fallthrough]];
+            case IrOp::Not: case IrOp::BitNot: {
+                const Location t = target(id, gpr(RAX));
+                out_ << "\tmovq " << operand(i.a) << ", " << name(t) << "\n";
+                if (i.op == IrOp::Neg) out_ << "\tnegq " << name(t) << "\n";
+                if (i.op == IrOp::Not) out_ << "\txorq $1, " << name(t) << "\n";
+                if (i.op == IrOp::BitNot) out_ << "\tnotq " << name(t) << "\n";
+                store(id, t);
+                break;
+            }
+            case IrOp::Lt: case IrOp::Le: case IrOp::Eq: case IrOp::Ne:
+                emitComparison(id, i);
+                break;
+            case IrOp::IToF: {
+                const Location t = target(id, xmm(0));
+                out_ << "\tcvtsi2sdq " << operand(i.a) << ", " << name(t) << "\n";
+                store(id, t);
+                break;
+            }
+            case IrOp::Concat:
+                unsupported("string concatenation");
+            case IrOp::Len:
+                call("strlen@PLT", {i.a});
+                store(id, gpr(RAX));
+                break;
+            case IrOp::Call: {
+                const ValueId* arguments = function_.operandList(i);
+                call("fn_" + module_.functions[i.a].name, std::vector<ValueId>(arguments, arguments + i.count));
+                store(id, i.type == Type::Float ? xmm(0) : gpr(RAX));
+                break;
+            }
+            case IrOp::Print:
+                emitPrint(i);
+                break;
+        }
+    }
+
+    void emitIntArithmetic(ValueId id, const IrInst& i) {
+        const char* mnemonic = i.op == IrOp::Add    ? "addq"
+                             : i.op == IrOp::Sub    ? "subq"
+                             : i.op == IrOp::Mul    ? "imulq"
+                             : i.op == IrOp::BitAnd ? "andq"
+                             : i.op == IrOp::BitOr  ? "orq" : "xorq";
+        const Location t = target(id, gpr(RAX));
+        out_ << "\tmovq " << operand(i.a) << ", " << name(t) << "\n\t" << mnemonic << ' ' << operand(i.b) << ", "
+             << name(t) << "\n";
+        store(id, t);
+    }
+
+    void emitFloatArithmetic(ValueId id, const IrInst& i) {
+        const char* mnemonic = i.op == IrOp::Add ? "addsd" : i.op == IrOp::Sub ? "subsd" : i.op == IrOp::Mul ? "mulsd" : "divsd";
+        const Location t = target(id, xmm(0));
+        out_ << "\tmovsd " << operand(i.a) << ", " << name(t) << "\n\t" << mnemonic << ' ' << operand(i.b) << ", "
+             << name(t) << "\n";
+        store(id, t);
+    }
+
+    // Traps on a zero divisor like the VM; INT64_MIN / -1 wraps instead of faulting.
+    void emitDivision(ValueId id, const IrInst& i) {
+        usesDivision_ = true;
+        const bool remainder = i.op == IrOp::Mod;
+        out_ << "\tmovq " << operand(i.b) << ", %r11\n"
+             << "\ttestq %r11, %r11\n"
+             << "\tje .Lf" << index_ << "_division_by_zero\n"
+             << "\tmovq " << operand(i.a) << ", %rax\n"
+             << "\tcmpq $-1, %r11\n"
+             << "\tjne 1f\n"
+             << (remainder ? "\txorl %eax, %eax\n" : "\tnegq %rax\n")
+             << "\tjmp 2f\n"
+             << "1:\n\tcqto\n\tidivq %r11\n"
+             << (remainder ? "\tmovq %rdx, %rax\n" : "")
+             << "2:\n";
+        store(id, gpr(RAX));
+    }
+
+    void emitComparison(ValueId id, const IrInst& i) {
+        const Type operands = inst(i.a).type;
+        if (operands == Type::String) {
+            call("strcmp@PLT", {i.a, i.b});
+            out_ << "\ttestl %eax, %eax\n";
+            setFlag(i.op == IrOp::Lt ? "l" : i.op == IrOp::Le ? "le" : i.op == IrOp::Eq ? "e" : "ne", id);
+            return;
+        }
+        if (operands == Type::Float) {
+            // Compare b against a so that unordered operands make < and <= false.
+            out_ << "\tmovsd " << operand(i.b) << ", %xmm0\n\tucomisd " << operand(i.a) << ", %xmm0\n";
+            switch (i.op) {
+                case IrOp::Lt: setFlag("a", id); break;
+                case IrOp::Le: setFlag("ae", id); break;
+                case IrOp::Eq:
+                    out_ << "\tsete %al\n\tsetnp %cl\n\tandb %cl, %al\n\tmovzbl %al, %eax\n";
+                    store(id, gpr(RAX));
+                    break;
+                default:
+                    out_ << "\tsetne %al\n\tsetp %cl\n\torb %cl, %al\n\tmovzbl %al, %eax\n";
+                    store(id, gpr(RAX));
+                    break;
+            }
+            return;
+        }
+        out_ << "\tmovq " << operand(i.a) << ", %rax\n\tcmpq " << operand(i.b) << ", %rax\n";
+        setFlag(i.op == IrOp::Lt ? "l" : i.op == IrOp::Le ? "le" : i.op == IrOp::Eq ? "e" : "ne", id);
+    }
+
+    void emitPrint(const IrInst& i) {
+        const std::vector<ValueId> arguments(function_.operandList(i), function_.operandList(i) + i.count);
+        std::string format;
+        for (size_t k = 0; k < arguments.size(); ++k) {
+            const Type t = inst(arguments[k]).type;
+            format += t == Type::Int ? "%lld" : t == Type::Float ? "%g" : "%s";
+            format += k + 1 == arguments.size() ? "\n" : " ";
+        }
+        if (arguments.empty()) format = "\n";
+        call("printf@PLT", arguments, format);
+    }
+
+    // Function body
+
+    void epilogue() {
+        for (size_t k = 0; k < savedRegisters_.size(); ++k) {
+            out_ << "\tmovq " << -8 * static_cast<int>(k + 1) << "(%rbp), " << kGprNames[savedRegisters_[k]] << "\n";
+        }
+        out_ << "\tleave\n\tret\n";
+    }
+
+    void emitFunction() {
+        const std::string symbol = "fn_" + function_.name;
+        out_ << "\n\t.text\n\t.type " << symbol << ", @function\n" << symbol << ":\n"
+             << "\tpushq %rbp\n\tmovq %rsp, %rbp\n";
+        if (frameSize_ != 0) out_ << "\tsubq $" << frameSize_ << ", %rsp\n";
+        for (size_t k = 0; k < savedRegisters_.size(); ++k) {
+            out_ << "\tmovq " << kGprNames[savedRegisters_[k]] << ", " << -8 * static_cast<int>(k + 1) << "(%rbp)\n";
+        }
+
+        // Parameters arrive in ABI registers or above the return address.
+        std::vector<Move> parameters;
+        int ints = 0;
+        int floats = 0;
+        int stacked = 0;
+        std::vector<Location> incoming(function_.params.size());
+        for (size_t k = 0; k < function_.params.size(); ++k) {
+            const bool floating = function_.params[k] == Type::Float;
+            if (floating && floats < kFloatArguments) {
+                incoming[k] = xmm(floats++);
+            } else if (!floating && ints < 6) {
+                incoming[k] = gpr(kIntArguments[ints++]);
+            } else {
+                incoming[k] = Location{Location::Frame, 16 + 8 * stacked++};
+            }
+        }
+        for (ValueId id : function_.blocks[0].insts) {
+            if (inst(id).op != IrOp::Param) break;
+            if (locations_[id].kind != Location::None) parameters.push_back(Move{incoming[inst(id).a], locations_[id]});
+        }
+        parallelMove(parameters);
+
+        for (size_t position = 0; position < order_.size(); ++position) {
+            const BlockId b = order_[position];
+            const BlockId next = position + 1 < order_.size() ? order_[position + 1] : kNoValue;
+            const IrBlock& block = function_.blocks[b];
+            out_ << label(b) << ":\n";
+            for (ValueId id : block.insts) emitInst(id);
+            switch (block.terminator) {
+                case Terminator::Jump: {
+                    const BlockId successor = block.targets[0];
+                    const IrBlock& target = function_.blocks[successor];
+                    const size_t edge = static_cast<size_t>(
+                        std::find(target.preds.begin(), target.preds.end(), b) - target.preds.begin());
+                    std::vector<Move> copies;
+                    for (ValueId id : target.insts) {
+                        if (inst(id).op != IrOp::Phi) break;
+                        copies.push_back(Move{locations_[function_.operands[inst(id).first + edge]], locations_[id]});
+                    }
+                    parallelMove(copies);
+                    if (successor != next) out_ << "\tjmp " << label(successor) << "\n";
+                    break;
+                }
+                case Terminator::Branch:
+                    out_ << "\tcmpq $0, " << operand(block.value) << "\n";
+                    if (block.targets[0] == next) {
+                        out_ << "\tje " << label(block.targets[1]) << "\n";
+                    } else {
+                        out_ << "\tjne " << label(block.targets[0]) << "\n";
+                        if (block.targets[1] != next) out_ << "\tjmp " << label(block.targets[1]) << "\n";
+                    }
+                    break;
+                case Terminator::Return:
+                    if (locations_[block.value].kind != Location::None) {
+                        move(locations_[block.value], function_.returnType == Type::Float ? xmm(0) : gpr(RAX));
+                    }
+                    epilogue();
+                    break;
+                case Terminator::None:
+                    break;
+            }
+        }
+
+        if (usesDivision_) {
+            out_ << ".Lf" << index_ << "_division_by_zero:\n"
+                 << "\tleaq " << data_.label(function_.name) << "(%rip), %rdi\n"
+                 << "\tjmp .Ldivision_by_zero\n";
+        }
+        out_ << "\t.size " << symbol << ", .-" << symbol << "\n";
+    }
+};
+
+} // namespace
+
+void emitAssembly(std::ostream& out, IrModule& module, unsigned threads) {
+    // Functions are emitted into buffers of their own and written in order.
+    const size_t count = module.functions.size();
+    std::vector<std::string> text(count);
+    forEachIndex(
+        threads, count, [] { return std::ostringstream(); },
+        [&](std::ostringstream& buffer, size_t i) {
+            buffer.str(std::string());
+            DataSection data(module, ".LS" + std::to_string(i) + "_");
+            FunctionEmitter(buffer, module, i, data).emit();
+            data.write(buffer);
+            text[i] = buffer.str();
+        });
+
+    out << "\t.file \"program\"\n";
+    for (const std::string& function : text) out << function;
+
+    DataSection data(module, ".LSrt");
+
+    // Runtime support. Reached by a jump from a function body, so the stack
+    // is aligned as at a call site; rdi holds the function name.
+    out << "\n\t.text\n.Ldivision_by_zero:\n"
+        << "\tmovq %rdi, %rbx\n"
+        << "\txorl %edi, %edi\n\tcall fflush@PLT\n"
+        << "\tmovl $2, %edi\n"
+        << "\tleaq " << data.label("Runtime error: division by zero in function '%s'\n") << "(%rip), %rsi\n"
+        << "\tmovq %rbx, %rdx\n\txorl %eax, %eax\n\tcall dprintf@PLT\n"
+        << "\tmovl $1, %edi\n\tcall exit@PLT\n";
+
+    out << "\n\t.globl main\n\t.type main, @function\nmain:\n"
+        << "\tpushq %rbp\n\tmovq %rsp, %rbp\n"
+        << "\tcall fn_main\n"
+        << "\tpopq %rbp\n\tret\n"
+        << "\t.size main, .-main\n\n";
+    data.write(out);
+    out << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
@@ -0,0 +1,42 @@
+#include "interner.hpp"
+
+namespace {
+
+uint64_t fnv1a(std::string_view text) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+uint32_t Interner::intern(std::string_view name) {
+    const uint64_t hash = fnv1a(name);
+    const size_t mask = table_.size() - 1;
+    size_t index = hash & mask;
+    while (table_[index] != kEmpty) {
+        const uint32_t id = table_[index];
+        if (hashes_[id] == hash && names_[id] == name) return id;
+        index = (index + 1) & mask;
+    }
+
+    const uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(name);
+    hashes_.push_back(hash);
+    table_[index] = id;
+    if (names_.size() * 2 > table_.size()) grow();
+    return id;
+}
+
+void Interner::grow() {
+    table_.assign(table_.size() * 2, kEmpty);
+    const size_t mask = table_.size() - 1;
+    for (uint32_t id = 0; id < names_.size(); ++id) {
+        size_t index = hashes_[id] & mask;
+        while (table_[index] != kEmpty) index = (index + 1) & mask;
+        table_[index] = id;
+    }
+}
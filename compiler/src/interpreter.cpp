@@ -0,0 +1,354 @@
+#include "interpreter.hpp"
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bytecode.hpp"
+#include "vm.hpp"
+
+namespace {
+
+// Deep enough for ordinary recursion, shallow enough for the native stack.
+constexpr size_t kMaxCallDepth = 2000;
+
+struct Value {
+    int64_t i = 0;
+    double f = 0;
+    std::string s;
+};
+
+enum class Flow { Next, Break, Continue, Return };
+
+int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+class TreeWalker {
+public:
+    TreeWalker(const Program& program, const SemanticModel& model, std::ostream& out)
+        : program_(program), model_(model), out_(out) {}
+
+    ~TreeWalker() { out_ << buffer_; }
+
+    Value call(uint32_t index, std::vector<Value> arguments) {
+        if (depth_ == kMaxCallDepth) {
+            throw RuntimeError("stack overflow in function '" + program_.tokens[program_.functions[index].name].value +
+                               "'");
+        }
+        const Function& function = program_.functions[index];
+        const FunctionInfo& info = model_.functions[index];
+        Frame frame{&function, &info, std::vector<Value>(info.locals.size()), Value{}};
+        for (size_t i = 0; i < arguments.size(); ++i) frame.locals[i] = std::move(arguments[i]);
+
+        Frame* caller = frame_;
+        frame_ = &frame;
+        ++depth_;
+        if (function.root != kNoNode) exec(function.root);
+        --depth_;
+        frame_ = caller;
+        return std::move(frame.result);  // a zero Value when the body fell off the end
+    }
+
+private:
+    struct Frame {
+        const Function* function;
+        const FunctionInfo* info;
+        std::vector<Value> locals;
+        Value result;
+    };
+
+    const Program& program_;
+    const SemanticModel& model_;
+    std::ostream& out_;
+    std::string buffer_;
+    Frame* frame_ = nullptr;
+    size_t depth_ = 0;
+
+    const Node& node(NodeId id) const { return frame_->function->body[id]; }
+    Type type(NodeId id) const { return frame_->info->types[id]; }
+    TokenType opOf(const Node& n) const { return program_.tokens[n.token].type; }
+    const std::string& text(const Node& n) const { return program_.tokens[n.token].value; }
+    Value& local(NodeId id) { return frame_->locals[frame_->info->symbols[id]]; }
+    Type localType(NodeId id) const { return frame_->info->locals[frame_->info->symbols[id]]; }
+
+    [[noreturn]] void divisionByZero() const {
+        throw RuntimeError("division by zero in function '" + program_.tokens[frame_->function->name].value + "'");
+    }
+
+    // Evaluates `id` and widens an int result when `want` is float.
+    Value evalAs(NodeId id, Type want) {
+        Value value = eval(id);
+        if (want == Type::Float && type(id) == Type::Int) value.f = static_cast<double>(value.i);
+        return value;
+    }
+
+    void step(Value& value, Type t, bool increment) {
+        if (t == Type::Int) {
+            value.i = wrap(static_cast<uint64_t>(value.i) + (increment ? 1 : static_cast<uint64_t>(-1)));
+        } else {
+            value.f += increment ? 1.0 : -1.0;
+        }
+    }
+
+    Flow exec(NodeId id) {
+        const Node& n = node(id);
+        switch (n.kind) {
+            case NodeKind::Block:
+                for (uint32_t i = 0; i < n.b; ++i) {
+                    const Flow flow = exec(frame_->function->body.list(n.a)[i]);
+                    if (flow != Flow::Next) return flow;
+                }
+                return Flow::Next;
+            case NodeKind::VarDecl: {
+                const Type t = frame_->info->locals[frame_->info->symbols[id]];
+                frame_->locals[frame_->info->symbols[id]] = n.a != kNoNode ? evalAs(n.a, t) : Value{};
+                return Flow::Next;
+            }
+            case NodeKind::If:
+                if (eval(n.a).i) return exec(n.b);
+                return n.c != kNoNode ? exec(n.c) : Flow::Next;
+            case NodeKind::While:
+                while (eval(n.a).i) {
+                    const Flow flow = exec(n.b);
+                    if (flow == Flow::Break) break;
+                    if (flow == Flow::Return) return flow;
+                }
+                return Flow::Next;
+            case NodeKind::For:
+                if (n.a != kNoNode) exec(n.a);
+                while (n.b == kNoNode || eval(n.b).i) {
+                    const Flow flow = exec(n.d);
+                    if (flow == Flow::Break) break;
+                    if (flow == Flow::Return) return flow;
+                    if (n.c != kNoNode) eval(n.c);
+                }
+                return Flow::Next;
+            case NodeKind::Return:
+                frame_->result = evalAs(n.a, typeFromToken(frame_->function->returnType));
+                return Flow::Return;
+            case NodeKind::Break:
+                return Flow::Break;
+            case NodeKind::Continue:
+                return Flow::Continue;
+            case NodeKind::ExprStmt:
+                eval(n.a);
+                return Flow::Next;
+            default:
+                eval(id);
+                return Flow::Next;
+        }
+    }
+
+    Value eval(NodeId id) {
+        const Node& n = node(id);
+        Value value;
+        switch (n.kind) {
+            case NodeKind::IntLit:
+                value.i = std::strtoll(text(n).c_str(), nullptr, 0);
+                break;
+            case NodeKind::FloatLit:
+                value.f = std::strtod(text(n).c_str(), nullptr);
+                break;
+            case NodeKind::BoolLit:
+                value.i = text(n) == "true";
+                break;
+            case NodeKind::StringLit:
+                value.s = unescape(text(n));
+                break;
+            case NodeKind::Name:
+                value = local(id);
+                break;
+            case NodeKind::Unary:
+                value = evalUnary(id, n);
+                break;
+            case NodeKind::Postfix: {
+                Value& target = local(n.a);
+                value = target;
+                step(target, localType(n.a), opOf(n) == T_INCREMENT);
+                break;
+            }
+            case NodeKind::Binary:
+                value = evalBinary(n);
+                break;
+            case NodeKind::Assign:
+                value = evalAssign(n);
+                break;
+            case NodeKind::Ternary:
+                value = evalAs(eval(n.a).i ? n.b : n.c, type(id));
+                break;
+            case NodeKind::Call:
+                value = evalCall(id, n);
+                break;
+            default:
+                break;
+        }
+        return value;
+    }
+
+    Value evalUnary(NodeId id, const Node& n) {
+        switch (opOf(n)) {
+            case T_MINUS: {
+                Value value = eval(n.a);
+                if (type(id) == Type::Float) {
+                    value.f = -value.f;
+                } else {
+                    value.i = wrap(0 - static_cast<uint64_t>(value.i));
+                }
+                return value;
+            }
+            case T_PLUS:
+                return eval(n.a);
+            case T_NOT: {
+                Value value = eval(n.a);
+                value.i = !value.i;
+                return value;
+            }
+            case T_BITNOT: {
+                Value value = eval(n.a);
+                value.i = ~value.i;
+                return value;
+            }
+            default: {  // prefix ++ / --
+                Value& target = local(n.a);
+                step(target, localType(n.a), opOf(n) == T_INCREMENT);
+                return target;
+            }
+        }
+    }
+
+    Value evalBinary(const Node& n) {
+        const TokenType op = opOf(n);
+        Value result;
+        if (op == T_AND || op == T_OR) {
+            result.i = eval(n.a).i;
+            if ((op == T_AND) == (result.i != 0)) result.i = eval(n.b).i;
+            return result;
+        }
+
+        const Type left = type(n.a);
+        const Type right = type(n.b);
+        if (left == Type::String) {
+            const Value a = eval(n.a);
+            const Value b = eval(n.b);
+            switch (op) {
+                case T_PLUS: result.s = a.s + b.s; break;
+                case T_LT: result.i = a.s < b.s; break;
+                case T_GT: result.i = a.s > b.s; break;
+                case T_LTE: result.i = a.s <= b.s; break;
+                case T_GTE: result.i = a.s >= b.s; break;
+                case T_EQUALSOP: result.i = a.s == b.s; break;
+                default: result.i = a.s != b.s; break;
+            }
+            return result;
+        }
+
+        if (left == Type::Float || right == Type::Float) {
+            const double a = evalAs(n.a, Type::Float).f;
+            const double b = evalAs(n.b, Type::Float).f;
+            switch (op) {
+                case T_PLUS: result.f = a + b; break;
+                case T_MINUS: result.f = a - b; break;
+                case T_MULT: result.f = a * b; break;
+                case T_DIV: result.f = a / b; break;
+                case T_LT: result.i = a < b; break;
+                case T_GT: result.i = a > b; break;
+                case T_LTE: result.i = a <= b; break;
+                case T_GTE: result.i = a >= b; break;
+                case T_EQUALSOP: result.i = a == b; break;
+                default: result.i = a != b; break;
+            }
+            return result;
+        }
+
+        const int64_t a = eval(n.a).i;
+        const int64_t b = eval(n.b).i;
+        const uint64_t ua = static_cast<uint64_t>(a);
+        const uint64_t ub = static_cast<uint64_t>(b);
+        switch (op) {
+            case T_PLUS: result.i = wrap(ua + ub); break;
+            case T_MINUS: result.i = wrap(ua - ub); break;
+            case T_MULT: result.i = wrap(ua * ub); break;
+            case T_DIV:
+                if (b == 0) divisionByZero();
+                result.i = b == -1 ? wrap(0 - ua) : a / b;
+                break;
+            case T_MOD:
+                if (b == 0) divisionByZero();
+                result.i = b == -1 ? 0 : a % b;
+                break;
+            case T_BITAND: result.i = a & b; break;
+            case T_BITOR: result.i = a | b; break;
+            case T_BITXOR: result.i = a ^ b; break;
+            case T_LEFTSHIFT: result.i = wrap(ua << (b & 63)); break;
+            case T_RIGHTSHIFT: result.i = a >> (b & 63); break;
+            case T_LT: result.i = a < b; break;
+            case T_GT: result.i = a > b; break;
+            case T_LTE: result.i = a <= b; break;
+            case T_GTE: result.i = a >= b; break;
+            case T_EQUALSOP: result.i = a == b; break;
+            default: result.i = a != b; break;
+        }
+        return result;
+    }
+
+    Value evalAssign(const Node& n) {
+        const Type t = localType(n.a);
+        const TokenType op = opOf(n);
+        if (op == T_ASSIGNOP) {
+            Value value = evalAs(n.b, t);
+            Value& target = local(n.a);
+            target = std::move(value);
+            return target;
+        }
+        const Value value = evalAs(n.b, t);
+        Value& target = local(n.a);
+        const bool add = op == T_PLUS_ASSIGN;
+        if (t == Type::String) {
+            target.s += value.s;
+        } else if (t == Type::Float) {
+            target.f = add ? target.f + value.f : target.f - value.f;
+        } else {
+            const uint64_t ua = static_cast<uint64_t>(target.i);
+            const uint64_t ub = static_cast<uint64_t>(value.i);
+            target.i = wrap(add ? ua + ub : ua - ub);
+        }
+        return target;
+    }
+
+    Value evalCall(NodeId id, const Node& n) {
+        const uint32_t callee = frame_->info->symbols[id];
+        const NodeId* arguments = frame_->function->body.list(n.b);
+        if (callee == kBuiltinPrint) {
+            for (uint32_t i = 0; i < n.c; ++i) {
+                const Value value = eval(arguments[i]);
+                switch (type(arguments[i])) {
+                    case Type::Float: appendFloat(buffer_, value.f); break;
+                    case Type::Bool: buffer_ += value.i ? "true" : "false"; break;
+                    case Type::String: buffer_ += value.s; break;
+                    default: appendInt(buffer_, value.i); break;
+                }
+                buffer_ += i + 1 == n.c ? '\n' : ' ';
+            }
+            if (n.c == 0) buffer_ += '\n';
+            return Value{};
+        }
+        if (callee == kBuiltinLen) {
+            Value value;
+            value.i = static_cast<int64_t>(eval(arguments[0]).s.size());
+            return value;
+        }
+
+        const Function& target = program_.functions[callee];
+        std::vector<Value> values;
+        values.reserve(n.c);
+        for (uint32_t i = 0; i < n.c; ++i) {
+            values.push_back(evalAs(arguments[i], typeFromToken(target.params[i].type)));
+        }
+        return call(callee, std::move(values));
+    }
+};
+
+} // namespace
+
+int64_t interpret(const Program& program, const SemanticModel& model, uint32_t function, std::ostream& out) {
+    TreeWalker walker(program, model, out);
+    return walker.call(function, {}).i;
+}
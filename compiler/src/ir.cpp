@@ -0,0 +1,865 @@
+#include "ir.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <unordered_map>
+#include <utility>
+#include "bytecode.hpp"
+#include "flat_map.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+const char* const kIrOpNames[] = {
+#define IR_NAME(name) #name,
+    IR_OPCODES(IR_NAME)
+#undef IR_NAME
+};
+
+// Marks every phi whose operands are all one value (or the phi itself) as
+// forwarded to that value, until no more become trivial.
+void forwardTrivialPhis(IrFunction& function, std::vector<ValueId>& forward) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const IrBlock& block : function.blocks) {
+            for (ValueId id : block.insts) {
+                const IrInst& inst = function.insts[id];
+                if (inst.op != IrOp::Phi) break;
+                if (forward[id] != kNoValue) continue;
+                ValueId same = kNoValue;
+                bool trivial = true;
+                for (uint32_t i = 0; i < inst.count && trivial; ++i) {
+                    const ValueId operand = resolveForward(forward, function.operands[inst.first + i]);
+                    if (operand == same || operand == id) continue;
+                    if (same != kNoValue) trivial = false;
+                    same = operand;
+                }
+                if (trivial && same != kNoValue) {
+                    forward[id] = same;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+// String literals of one function, numbered in first-use order. lowerToIr
+// renumbers them into IrModule::strings.
+struct StringTable {
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> index;
+
+    void clear() {
+        strings.clear();
+        index.clear();
+    }
+};
+
+class IrBuilder {
+public:
+    IrBuilder(const Program& program, const SemanticModel& model, size_t index, StringTable& strings)
+        : program_(program), function_(program.functions[index]), info_(model.functions[index]), strings_(strings) {}
+
+    IrFunction build() {
+        out_.name = program_.tokens[function_.name].value;
+        out_.returnType = typeFromToken(function_.returnType);
+        if (!function_.bodyParsed) {
+            for (const Param& param : function_.params) out_.params.push_back(typeFromToken(param.type));
+            return std::move(out_);
+        }
+        current_ = newBlock();
+        seal(current_);
+        for (uint32_t i = 0; i < function_.params.size(); ++i) {
+            const Type t = typeFromToken(function_.params[i].type);
+            out_.params.push_back(t);
+            IrInst param;
+            param.op = IrOp::Param;
+            param.type = t;
+            param.a = i;
+            writeVariable(i, current_, emit(param));
+        }
+
+        if (function_.root != kNoNode) lowerStatement(function_.root);
+        if (out_.blocks[current_].terminator == Terminator::None) ret(zero(out_.returnType));
+
+        removeUnreachableBlocks(out_);
+        forwardTrivialPhis(out_, forward_);
+        applyForwarding(out_, forward_);
+        return std::move(out_);
+    }
+
+private:
+    struct Loop {
+        BlockId breakTarget;
+        BlockId continueTarget;
+    };
+
+    const Program& program_;
+    const Function& function_;
+    const FunctionInfo& info_;
+    StringTable& strings_;
+    IrFunction out_;
+    BlockId current_ = 0;
+    std::vector<FlatMap<ValueId>> definitions_;  // per block: local slot -> current value
+    std::vector<bool> sealed_;
+    std::vector<std::vector<std::pair<uint32_t, ValueId>>> incomplete_;  // per block: (slot, phi)
+    std::vector<ValueId> forward_;  // removed trivial phi -> its replacement
+    ValueId zeros_[6] = {kNoValue, kNoValue, kNoValue, kNoValue, kNoValue, kNoValue};
+    std::vector<Loop> loops_;
+
+    const Node& node(NodeId id) const { return function_.body[id]; }
+    Type type(NodeId id) const { return info_.types[id]; }
+    TokenType opOf(const Node& n) const { return program_.tokens[n.token].type; }
+    uint32_t slot(NodeId id) const { return info_.symbols[id]; }
+
+    // Blocks and instructions
+
+    BlockId newBlock() {
+        out_.blocks.emplace_back();
+        definitions_.emplace_back();
+        sealed_.push_back(false);
+        incomplete_.emplace_back();
+        return static_cast<BlockId>(out_.blocks.size() - 1);
+    }
+
+    ValueId append(IrInst inst) {
+        const ValueId id = static_cast<ValueId>(out_.insts.size());
+        out_.insts.push_back(inst);
+        forward_.push_back(kNoValue);
+        return id;
+    }
+
+    ValueId emit(IrInst inst) {
+        inst.block = current_;
+        const ValueId id = append(inst);
+        out_.blocks[current_].insts.push_back(id);
+        return id;
+    }
+
+    ValueId emit(IrOp op, Type t, ValueId a = kNoValue, ValueId b = kNoValue) {
+        IrInst inst;
+        inst.op = op;
+        inst.type = t;
+        inst.a = a;
+        inst.b = b;
+        return emit(inst);
+    }
+
+    ValueId emitList(IrOp op, Type t, uint32_t a, const std::vector<ValueId>& operands) {
+        IrInst inst;
+        inst.op = op;
+        inst.type = t;
+        inst.a = a;
+        inst.first = static_cast<uint32_t>(out_.operands.size());
+        inst.count = static_cast<uint32_t>(operands.size());
+        out_.operands.insert(out_.operands.end(), operands.begin(), operands.end());
+        return emit(inst);
+    }
+
+    ValueId constant(Type t, IrInst::Constant value) {
+        IrInst inst;
+        inst.op = IrOp::Const;
+        inst.type = t;
+        inst.constant = value;
+        return emit(inst);
+    }
+
+    ValueId intConstant(int64_t value) {
+        IrInst::Constant c;
+        c.i = value;
+        return constant(Type::Int, c);
+    }
+
+    ValueId floatConstant(double value) {
+        IrInst::Constant c;
+        c.f = value;
+        return constant(Type::Float, c);
+    }
+
+    ValueId stringConstant(const std::string& text) {
+        auto it = strings_.index.find(text);
+        if (it == strings_.index.end()) {
+            strings_.strings.push_back(text);
+            it = strings_.index.emplace(text, static_cast<uint32_t>(strings_.strings.size() - 1)).first;
+        }
+        IrInst inst;
+        inst.op = IrOp::ConstS;
+        inst.type = Type::String;
+        inst.a = it->second;
+        return emit(inst);
+    }
+
+    // The zero value of a type, defined once at the top of the entry block so
+    // it dominates every use.
+    ValueId zero(Type t) {
+        ValueId& cached = zeros_[static_cast<int>(t)];
+        if (cached != kNoValue) return cached;
+        const BlockId saved = current_;
+        current_ = 0;
+        cached = t == Type::String ? stringConstant("") : t == Type::Float ? floatConstant(0) : constant(t, IrInst::Constant{0});
+        current_ = saved;
+        std::vector<ValueId>& entry = out_.blocks[0].insts;
+        entry.pop_back();
+        entry.insert(entry.begin(), cached);
+        return cached;
+    }
+
+    ValueId newPhi(BlockId block, Type t) {
+        IrInst inst;
+        inst.op = IrOp::Phi;
+        inst.type = t;
+        inst.block = block;
+        const ValueId id = append(inst);
+        std::vector<ValueId>& insts = out_.blocks[block].insts;
+        auto position = insts.begin();
+        while (position != insts.end() && out_.insts[*position].op == IrOp::Phi) ++position;
+        insts.insert(position, id);
+        return id;
+    }
+
+    void setPhiOperands(ValueId phi, const std::vector<ValueId>& values) {
+        out_.insts[phi].first = static_cast<uint32_t>(out_.operands.size());
+        out_.insts[phi].count = static_cast<uint32_t>(values.size());
+        out_.operands.insert(out_.operands.end(), values.begin(), values.end());
+    }
+
+    void addEdge(BlockId to) { out_.blocks[to].preds.push_back(current_); }
+
+    void jump(BlockId target) {
+        IrBlock& block = out_.blocks[current_];
+        block.terminator = Terminator::Jump;
+        block.targets[0] = target;
+        addEdge(target);
+    }
+
+    void branch(ValueId condition, BlockId if_true, BlockId if_false) {
+        IrBlock& block = out_.blocks[current_];
+        block.terminator = Terminator::Branch;
+        block.value = condition;
+        block.targets[0] = if_true;
+        block.targets[1] = if_false;
+        addEdge(if_true);
+        addEdge(if_false);
+    }
+
+    void ret(ValueId value) {
+        IrBlock& block = out_.blocks[current_];
+        block.terminator = Terminator::Return;
+        block.value = value;
+    }
+
+    // Code after return, break or continue goes to a block nothing jumps to;
+    // it is dropped once the function is built.
+    void startUnreachable() {
+        current_ = newBlock();
+        seal(current_);
+    }
+
+    // Variables (Braun et al.)
+
+    void writeVariable(uint32_t variable, BlockId block, ValueId value) {
+        definitions_[block].insert(variable, value) = value;
+    }
+
+    ValueId readVariable(uint32_t variable, BlockId block) {
+        if (const ValueId* value = definitions_[block].find(variable)) return resolveForward(forward_, *value);
+        const Type t = info_.locals[variable];
+        ValueId value;
+        const std::vector<BlockId>& preds = out_.blocks[block].preds;
+        if (!sealed_[block]) {
+            value = newPhi(block, t);
+            incomplete_[block].emplace_back(variable, value);
+        } else if (preds.size() == 1) {
+            value = readVariable(variable, preds[0]);
+        } else if (preds.empty()) {
+            value = zero(t);  // only in unreachable code
+        } else {
+            value = newPhi(block, t);
+            writeVariable(variable, block, value);  // breaks cycles through loops
+            value = completePhi(variable, value);
+        }
+        writeVariable(variable, block, value);
+        return value;
+    }
+
+    ValueId completePhi(uint32_t variable, ValueId phi) {
+        const BlockId block = out_.insts[phi].block;
+        std::vector<ValueId> values;
+        values.reserve(out_.blocks[block].preds.size());
+        for (size_t i = 0; i < out_.blocks[block].preds.size(); ++i) {
+            values.push_back(readVariable(variable, out_.blocks[block].preds[i]));
+        }
+        setPhiOperands(phi, values);
+        return removeTrivialPhi(phi);
+    }
+
+    // A phi whose operands are one value besides itself is that value. Phis
+    // that only become trivial later are swept up when the function is done.
+    ValueId removeTrivialPhi(ValueId phi) {
+        const IrInst& inst = out_.insts[phi];
+        ValueId same = kNoValue;
+        for (uint32_t i = 0; i < inst.count; ++i) {
+            const ValueId operand = resolveForward(forward_, out_.operands[inst.first + i]);
+            if (operand == same || operand == phi) continue;
+            if (same != kNoValue) return phi;
+            same = operand;
+        }
+        if (same == kNoValue) same = zero(inst.type);
+        forward_[phi] = same;
+        return same;
+    }
+
+    void seal(BlockId block) {
+        std::vector<std::pair<uint32_t, ValueId>> pending = std::move(incomplete_[block]);
+        incomplete_[block].clear();
+        for (const auto& [variable, phi] : pending) completePhi(variable, phi);
+        sealed_[block] = true;
+    }
+
+    // Expressions
+
+    ValueId lowerAs(NodeId id, Type want) {
+        const ValueId value = lower(id);
+        if (want == Type::Float && type(id) == Type::Int) return emit(IrOp::IToF, Type::Float, value);
+        return value;
+    }
+
+    ValueId step(ValueId value, Type t, bool increment) {
+        const ValueId one = t == Type::Float ? floatConstant(1.0) : intConstant(1);
+        return emit(increment ? IrOp::Add : IrOp::Sub, t, value, one);
+    }
+
+    ValueId lower(NodeId id) {
+        const Node& n = node(id);
+        const std::string& text = program_.tokens[n.token].value;
+        switch (n.kind) {
+            case NodeKind::IntLit:
+                return intConstant(std::strtoll(text.c_str(), nullptr, 0));
+            case NodeKind::FloatLit:
+                return floatConstant(std::strtod(text.c_str(), nullptr));
+            case NodeKind::BoolLit:
+                return constant(Type::Bool, IrInst::Constant{text == "true" ? 1 : 0});
+            case NodeKind::StringLit:
+                return stringConstant(unescape(text));
+            case NodeKind::Name:
+                return readVariable(slot(id), current_);
+            case NodeKind::Unary:
+                return lowerUnary(id, n);
+            case NodeKind::Postfix: {
+                const ValueId old = readVariable(slot(n.a), current_);
+                writeVariable(slot(n.a), current_, step(old, type(id), opOf(n) == T_INCREMENT));
+                return old;
+            }
+            case NodeKind::Binary:
+                return lowerBinary(n);
+            case NodeKind::Assign:
+                return lowerAssign(n);
+            case NodeKind::Ternary: {
+                const ValueId condition = lower(n.a);
+                const BlockId then_block = newBlock();
+                const BlockId else_block = newBlock();
+                const BlockId join = newBlock();
+                branch(condition, then_block, else_block);
+                seal(then_block);
+                seal(else_block);
+                current_ = then_block;
+                const ValueId then_value = lowerAs(n.b, type(id));
+                jump(join);
+                current_ = else_block;
+                const ValueId else_value = lowerAs(n.c, type(id));
+                jump(join);
+                return merge(join, type(id), then_value, else_value);
+            }
+            case NodeKind::Call:
+                return lowerCall(id, n);
+            default:
+                return zero(type(id));
+        }
+    }
+
+    // Continues in `join`, whose two predecessors produced `first` and `second`.
+    ValueId merge(BlockId join, Type t, ValueId first, ValueId second) {
+        seal(join);
+        current_ = join;
+        const ValueId phi = newPhi(join, t);
+        setPhiOperands(phi, {first, second});
+        return removeTrivialPhi(phi);
+    }
+
+    ValueId lowerUnary(NodeId id, const Node& n) {
+        switch (opOf(n)) {
+            case T_MINUS: return emit(IrOp::Neg, type(id), lower(n.a));
+            case T_PLUS: return lower(n.a);
+            case T_NOT: return emit(IrOp::Not, Type::Bool, lower(n.a));
+            case T_BITNOT: return emit(IrOp::BitNot, Type::Int, lower(n.a));
+            default: {  // prefix ++ / --
+                const ValueId value = step(readVariable(slot(n.a), current_), type(id), opOf(n) == T_INCREMENT);
+                writeVariable(slot(n.a), current_, value);
+                return value;
+            }
+        }
+    }
+
+    ValueId lowerBinary(const Node& n) {
+        const TokenType op = opOf(n);
+        if (op == T_AND || op == T_OR) {
+            const ValueId left = lower(n.a);
+            const BlockId right_block = newBlock();
+            const BlockId join = newBlock();
+            if (op == T_AND) {
+                branch(left, right_block, join);
+            } else {
+                branch(left, join, right_block);
+            }
+            seal(right_block);
+            current_ = right_block;
+            const ValueId right = lower(n.b);
+            jump(join);
+            return merge(join, Type::Bool, left, right);
+        }
+
+        const Type left = type(n.a);
+        const Type right = type(n.b);
+        const Type operand = left == Type::String ? Type::String
+                           : left == Type::Float || right == Type::Float ? Type::Float : Type::Int;
+        const ValueId a = lowerAs(n.a, operand);
+        const ValueId b = lowerAs(n.b, operand);
+        switch (op) {
+            case T_PLUS: return emit(operand == Type::String ? IrOp::Concat : IrOp::Add, operand, a, b);
+            case T_MINUS: return emit(IrOp::Sub, operand, a, b);
+            case T_MULT: return emit(IrOp::Mul, operand, a, b);
+            case T_DIV: return emit(IrOp::Div, operand, a, b);
+            case T_MOD: return emit(IrOp::Mod, operand, a, b);
+            case T_BITAND: return emit(IrOp::BitAnd, operand, a, b);
+            case T_BITOR: return emit(IrOp::BitOr, operand, a, b);
+            case T_BITXOR: return emit(IrOp::BitXor, operand, a, b);
+            case T_LEFTSHIFT: return emit(IrOp::Shl, operand, a, b);
+            case T_RIGHTSHIFT: return emit(IrOp::Shr, operand, a, b);
+            case T_LT: return emit(IrOp::Lt, Type::Bool, a, b);
+            case T_GT: return emit(IrOp::Lt, Type::Bool, b, a);
+            case T_LTE: return emit(IrOp::Le, Type::Bool, a, b);
+            case T_GTE: return emit(IrOp::Le, Type::Bool, b, a);
+            case T_EQUALSOP: return emit(IrOp::Eq, Type::Bool, a, b);
+            default: return emit(IrOp::Ne, Type::Bool, a, b);
+        }
+    }
+
+    ValueId lowerAssign(const Node& n) {
+        const uint32_t variable = slot(n.a);
+        const Type t = info_.locals[variable];
+        const TokenType op = opOf(n);
+        ValueId value = lowerAs(n.b, t);
+        if (op != T_ASSIGNOP) {
+            const ValueId old = readVariable(variable, current_);
+            const IrOp combine = t == Type::String ? IrOp::Concat : op == T_PLUS_ASSIGN ? IrOp::Add : IrOp::Sub;
+            value = emit(combine, t, old, value);
+        }
+        writeVariable(variable, current_, value);
+        return value;
+    }
+
+    ValueId lowerCall(NodeId id, const Node& n) {
+        const uint32_t callee = info_.symbols[id];
+        const NodeId* arguments = function_.body.list(n.b);
+        if (callee == kBuiltinLen) return emit(IrOp::Len, Type::Int, lower(arguments[0]));
+
+        const bool is_print = callee == kBuiltinPrint;
+        std::vector<ValueId> values;
+        values.reserve(n.c);
+        for (uint32_t i = 0; i < n.c; ++i) {
+            values.push_back(is_print ? lower(arguments[i])
+                                      : lowerAs(arguments[i], typeFromToken(program_.functions[callee].params[i].type)));
+        }
+        if (!is_print) return emitList(IrOp::Call, type(id), callee, values);
+        emitList(IrOp::Print, Type::None, kNoValue, values);
+        return intConstant(0);
+    }
+
+    // Statements
+
+    void lowerStatement(NodeId id) {
+        const Node& n = node(id);
+        switch (n.kind) {
+            case NodeKind::Block:
+                for (uint32_t i = 0; i < n.b; ++i) lowerStatement(function_.body.list(n.a)[i]);
+                break;
+            case NodeKind::VarDecl: {
+                const Type t = info_.locals[slot(id)];
+                writeVariable(slot(id), current_, n.a != kNoNode ? lowerAs(n.a, t) : zero(t));
+                break;
+            }
+            case NodeKind::If: {
+                const ValueId condition = lower(n.a);
+                const BlockId then_block = newBlock();
+                const BlockId else_block = n.c != kNoNode ? newBlock() : kNoValue;
+                const BlockId join = newBlock();
+                branch(condition, then_block, n.c != kNoNode ? else_block : join);
+                seal(then_block);
+                current_ = then_block;
+                lowerStatement(n.b);
+                jump(join);
+                if (n.c != kNoNode) {
+                    seal(else_block);
+                    current_ = else_block;
+                    lowerStatement(n.c);
+                    jump(join);
+                }
+                seal(join);
+                current_ = join;
+                break;
+            }
+            case NodeKind::While:
+                lowerLoop(n.a, kNoNode, n.b);
+                break;
+            case NodeKind::For:
+                if (n.a != kNoNode) lowerStatement(n.a);
+                lowerLoop(n.b, n.c, n.d);
+                break;
+            case NodeKind::Return:
+                ret(lowerAs(n.a, out_.returnType));
+                startUnreachable();
+                break;
+            case NodeKind::Break:
+                jump(loops_.back().breakTarget);
+                startUnreachable();
+                break;
+            case NodeKind::Continue:
+                jump(loops_.back().continueTarget);
+                startUnreachable();
+                break;
+            case NodeKind::ExprStmt:
+                lower(n.a);
+                break;
+            default:
+                lower(id);
+                break;
+        }
+    }
+
+    // The block before the header is left with a single jump into it, so it
+    // serves as the loop's preheader.
+    void lowerLoop(NodeId condition, NodeId update, NodeId body) {
+        const BlockId header = newBlock();
+        jump(header);
+        current_ = header;
+        const BlockId body_block = newBlock();
+        const BlockId exit = newBlock();
+        if (condition != kNoNode) {
+            branch(lower(condition), body_block, exit);
+        } else {
+            jump(body_block);
+        }
+        seal(body_block);
+        const BlockId latch = update != kNoNode ? newBlock() : header;
+        loops_.push_back(Loop{exit, latch});
+        current_ = body_block;
+        lowerStatement(body);
+        jump(latch);
+        loops_.pop_back();
+        if (update != kNoNode) {
+            seal(latch);
+            current_ = latch;
+            lower(update);
+            jump(header);
+        }
+        seal(header);
+        seal(exit);
+        current_ = exit;
+    }
+};
+
+} // namespace
+
+const char* irOpName(IrOp op) { return kIrOpNames[static_cast<int>(op)]; }
+
+ValueId resolveForward(std::vector<ValueId>& forward, ValueId value) {
+    ValueId root = value;
+    while (root != kNoValue && forward[root] != kNoValue) root = forward[root];
+    while (value != root && value != kNoValue && forward[value] != kNoValue) {  // path compression
+        const ValueId next = forward[value];
+        forward[value] = root;
+        value = next;
+    }
+    return root;
+}
+
+size_t IrFunction::liveInstructions() const {
+    size_t count = 0;
+    for (const IrBlock& block : blocks) count += block.insts.size();
+    return count;
+}
+
+std::vector<BlockId> reversePostorder(const IrFunction& function) {
+    std::vector<BlockId> order;
+    if (function.blocks.empty()) return order;
+    std::vector<bool> visited(function.blocks.size(), false);
+    std::vector<std::pair<BlockId, uint32_t>> stack{{0, 0}};  // block, next successor
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        const IrBlock& b = function.blocks[block];
+        if (next < b.successorCount()) {
+            const BlockId successor = b.targets[next++];
+            if (!visited[successor]) {
+                visited[successor] = true;
+                stack.emplace_back(successor, 0);
+            }
+        } else {
+            order.push_back(block);
+            stack.pop_back();
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+std::vector<BlockId> immediateDominators(const IrFunction& function) {
+    const std::vector<BlockId> order = reversePostorder(function);
+    std::vector<uint32_t> position(function.blocks.size(), kNoValue);
+    for (uint32_t i = 0; i < order.size(); ++i) position[order[i]] = i;
+
+    std::vector<BlockId> idom(function.blocks.size(), kNoValue);
+    if (order.empty()) return idom;
+    idom[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < order.size(); ++i) {
+            const BlockId block = order[i];
+            BlockId candidate = kNoValue;
+            for (BlockId pred : function.blocks[block].preds) {
+                if (idom[pred] == kNoValue) continue;
+                if (candidate == kNoValue) {
+                    candidate = pred;
+                    continue;
+                }
+                BlockId x = pred;
+                BlockId y = candidate;
+                while (x != y) {
+                    while (position[x] > position[y]) x = idom[x];
+                    while (position[y] > position[x]) y = idom[y];
+                }
+                candidate = x;
+            }
+            if (idom[block] != candidate) {
+                idom[block] = candidate;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+void removeEdge(IrFunction& function, BlockId from, BlockId to) {
+    IrBlock& block = function.blocks[to];
+    const auto it = std::find(block.preds.begin(), block.preds.end(), from);
+    if (it == block.preds.end()) return;
+    const size_t index = static_cast<size_t>(it - block.preds.begin());
+    block.preds.erase(it);
+    for (ValueId id : block.insts) {
+        IrInst& phi = function.insts[id];
+        if (phi.op != IrOp::Phi) break;
+        ValueId* operands = function.operandList(phi);
+        std::copy(operands + index + 1, operands + phi.count, operands + index);
+        --phi.count;
+    }
+}
+
+size_t removeUnreachableBlocks(IrFunction& function) {
+    const std::vector<BlockId> order = reversePostorder(function);
+    if (order.size() == function.blocks.size()) return 0;
+
+    std::vector<BlockId> renumber(function.blocks.size(), kNoValue);
+    for (BlockId block : order) renumber[block] = 0;
+    for (BlockId block = 0; block < function.blocks.size(); ++block) {
+        if (renumber[block] != kNoValue) continue;
+        const IrBlock& dead = function.blocks[block];
+        for (uint32_t i = 0; i < dead.successorCount(); ++i) removeEdge(function, block, dead.targets[i]);
+        for (ValueId id : dead.insts) function.insts[id].op = IrOp::Nop;
+    }
+
+    // Keep the original order so printing stays stable.
+    BlockId next = 0;
+    for (BlockId block = 0; block < function.blocks.size(); ++block) {
+        if (renumber[block] != kNoValue) renumber[block] = next++;
+    }
+    std::vector<IrBlock> blocks;
+    blocks.reserve(next);
+    for (BlockId block = 0; block < function.blocks.size(); ++block) {
+        if (renumber[block] == kNoValue) continue;
+        IrBlock& b = function.blocks[block];
+        for (BlockId& pred : b.preds) pred = renumber[pred];
+        for (uint32_t i = 0; i < b.successorCount(); ++i) b.targets[i] = renumber[b.targets[i]];
+        for (ValueId id : b.insts) function.insts[id].block = renumber[block];
+        blocks.push_back(std::move(b));
+    }
+    const size_t removed = function.blocks.size() - blocks.size();
+    function.blocks = std::move(blocks);
+    return removed;
+}
+
+size_t splitCriticalEdges(IrFunction& function) {
+    size_t added = 0;
+    const size_t original = function.blocks.size();
+    for (BlockId from = 0; from < original; ++from) {
+        if (function.blocks[from].terminator != Terminator::Branch) continue;
+        for (int i = 0; i < 2; ++i) {
+            const BlockId to = function.blocks[from].targets[i];
+            if (function.blocks[to].preds.size() < 2) continue;
+            const BlockId middle = static_cast<BlockId>(function.blocks.size());
+            IrBlock block;
+            block.preds.push_back(from);
+            block.terminator = Terminator::Jump;
+            block.targets[0] = to;
+            function.blocks.push_back(std::move(block));
+            function.blocks[from].targets[i] = middle;
+            // Same predecessor slot, so the phi operands keep their order.
+            std::vector<BlockId>& preds = function.blocks[to].preds;
+            *std::find(preds.begin(), preds.end(), from) = middle;
+            ++added;
+        }
+    }
+    return added;
+}
+
+void applyForwarding(IrFunction& function, std::vector<ValueId>& forward) {
+    const auto rewrite = [&](ValueId& value) { value = resolveForward(forward, value); };
+    for (IrBlock& block : function.blocks) {
+        block.insts.erase(std::remove_if(block.insts.begin(), block.insts.end(),
+                                         [&](ValueId id) {
+                                             if (forward[id] == kNoValue) return false;
+                                             function.insts[id].op = IrOp::Nop;
+                                             return true;
+                                         }),
+                          block.insts.end());
+        for (ValueId id : block.insts) forEachOperand(function, function.insts[id], rewrite);
+        if (block.terminator == Terminator::Branch || block.terminator == Terminator::Return) rewrite(block.value);
+    }
+}
+
+IrModule lowerToIr(const Program& program, const SemanticModel& model, unsigned threads) {
+    IrModule module;
+    const size_t count = program.functions.size();
+    module.functions.resize(count);
+    std::vector<std::vector<std::string>> literals(count);
+    forEachIndex(
+        threads, count, [] { return StringTable(); },
+        [&](StringTable& strings, size_t i) {
+            strings.clear();
+            module.functions[i] = IrBuilder(program, model, i, strings).build();
+            literals[i] = std::move(strings.strings);
+        });
+
+    // Number the strings in function order, as a sequential lowering would.
+    std::unordered_map<std::string, uint32_t> index;
+    std::vector<uint32_t> renumber;
+    for (size_t i = 0; i < count; ++i) {
+        renumber.clear();
+        for (std::string& text : literals[i]) {
+            const auto it = index.emplace(text, static_cast<uint32_t>(module.strings.size())).first;
+            if (it->second == module.strings.size()) module.strings.push_back(std::move(text));
+            renumber.push_back(it->second);
+        }
+        for (IrInst& inst : module.functions[i].insts) {
+            if (inst.op == IrOp::ConstS) inst.a = renumber[inst.a];
+        }
+    }
+    return module;
+}
+
+namespace {
+
+void printValue(std::ostream& out, ValueId value) {
+    out << '%' << value;
+}
+
+void printInst(std::ostream& out, const IrModule& module, const IrFunction& function, ValueId id) {
+    const IrInst& inst = function.insts[id];
+    std::string name = irOpName(inst.op);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+    out << "    ";
+    if (inst.type != Type::None) {
+        printValue(out, id);
+        out << " = ";
+    }
+    out << name;
+    if (inst.type != Type::None) out << ' ' << typeName(inst.type);
+    switch (inst.op) {
+        case IrOp::Const:
+            if (inst.type == Type::Float) {
+                out << ' ' << inst.constant.f;
+            } else if (inst.type == Type::Bool) {
+                out << (inst.constant.i ? " true" : " false");
+            } else {
+                out << ' ' << inst.constant.i;
+            }
+            break;
+        case IrOp::ConstS:
+            out << " \"" << module.strings[inst.a] << '"';
+            break;
+        case IrOp::Param:
+            out << ' ' << inst.a;
+            break;
+        case IrOp::Phi:
+            for (uint32_t i = 0; i < inst.count; ++i) {
+                out << (i == 0 ? " [" : ", [");
+                printValue(out, function.operands[inst.first + i]);
+                out << ", b" << function.blocks[inst.block].preds[i] << ']';
+            }
+            break;
+        case IrOp::Call:
+        case IrOp::Print:
+            if (inst.op == IrOp::Call) out << ' ' << module.functions[inst.a].name;
+            for (uint32_t i = 0; i < inst.count; ++i) {
+                out << (i == 0 ? " " : ", ");
+                printValue(out, function.operands[inst.first + i]);
+            }
+            break;
+        default:
+            out << ' ';
+            printValue(out, inst.a);
+            if (inst.b != kNoValue) {
+                out << ", ";
+                printValue(out, inst.b);
+            }
+            break;
+    }
+    out << '\n';
+}
+
+} // namespace
+
+void printIr(std::ostream& out, const IrModule& module) {
+    for (const IrFunction& function : module.functions) {
+        out << "fn " << typeName(function.returnType) << ' ' << function.name << '(';
+        for (size_t i = 0; i < function.params.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << typeName(function.params[i]);
+        }
+        out << ")\n";
+        for (BlockId b = 0; b < function.blocks.size(); ++b) {
+            const IrBlock& block = function.blocks[b];
+            out << "  b" << b << ':';
+            for (size_t i = 0; i < block.preds.size(); ++i) out << (i == 0 ? " ; preds b" : ", b") << block.preds[i];
+            out << '\n';
+            for (ValueId id : block.insts) printInst(out, module, function, id);
+            switch (block.terminator) {
+                case Terminator::Jump:
+                    out << "    jmp b" << block.targets[0] << '\n';
+                    break;
+                case Terminator::Branch:
+                    out << "    br ";
+                    printValue(out, block.value);
+                    out << ", b" << block.targets[0] << ", b" << block.targets[1] << '\n';
+                    break;
+                case Terminator::Return:
+                    out << "    ret ";
+                    printValue(out, block.value);
+                    out << '\n';
+                    break;
+                case Terminator::None:
+                    break;
+            }
+        }
+    }
+}
@@ -0,0 +1,380 @@
+#include "jit.hpp"
+#include <cstring>
+#include <initializer_list>
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+enum Register { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI };
+
+// Condition codes, the low nibble of jcc and setcc.
+enum Condition : uint8_t { kBelow = 2, kAboveEqual = 3, kEqual = 4, kNotEqual = 5, kBelowEqual = 6, kAbove = 7,
+                           kParity = 0xA, kNoParity = 0xB, kLess = 0xC, kLessEqual = 0xE };
+
+// Compiled code keeps the frame in rbx and the runtime in rbp, both
+// callee-saved; rax, rcx, rdx and xmm0 are scratch.
+constexpr Register kFrame = RBX;
+constexpr Register kRuntime = RBP;
+
+constexpr int32_t kResult = offsetof(JitRuntime, result);
+constexpr int32_t kScalarEnd = offsetof(JitRuntime, scalarEnd);
+constexpr int32_t kStackLimit = offsetof(JitRuntime, stackLimit);
+constexpr int32_t kEntries = offsetof(JitRuntime, entries);
+constexpr int32_t kFailed = offsetof(JitRuntime, failed);
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    size_t size() const { return code.size(); }
+
+    void bytes(std::initializer_list<uint8_t> list) { code.insert(code.end(), list); }
+
+    void u32(uint32_t value) {
+        for (int shift = 0; shift < 32; shift += 8) code.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    void u64(uint64_t value) {
+        u32(static_cast<uint32_t>(value));
+        u32(static_cast<uint32_t>(value >> 32));
+    }
+
+    // `opcode` (prefixes included) with a [base + disp32] operand. None of the
+    // bases used here needs a SIB byte.
+    void memory(std::initializer_list<uint8_t> opcode, int reg, Register base, int32_t disp) {
+        bytes(opcode);
+        code.push_back(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | base));
+        u32(static_cast<uint32_t>(disp));
+    }
+
+    // Scalar register `index` of the current frame.
+    void slot(std::initializer_list<uint8_t> opcode, int reg, uint16_t index) {
+        memory(opcode, reg, kFrame, static_cast<int32_t>(index) * 8);
+    }
+
+    // A forward jump; returns where its rel32 goes, for bind() or patch().
+    size_t jump() {
+        bytes({0xE9});
+        u32(0);
+        return code.size() - 4;
+    }
+
+    size_t jump(Condition condition) {
+        bytes({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        u32(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        const uint32_t rel = static_cast<uint32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, sizeof(rel));
+    }
+
+    void bind(size_t at) { patch(at, code.size()); }
+
+    // setcc al; movzx eax, al
+    void flag(Condition condition) { bytes({0x0F, static_cast<uint8_t>(0x90 | condition), 0xC0, 0x0F, 0xB6, 0xC0}); }
+
+    void prologue() {
+        bytes({0x53, 0x55, 0x48, 0x83, 0xEC, 0x08});  // push rbx; push rbp; sub rsp, 8 (keeps calls aligned)
+        bytes({0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5});  // mov rbx, rdi; mov rbp, rsi
+    }
+
+    void epilogue() { bytes({0x48, 0x83, 0xC4, 0x08, 0x5D, 0x5B, 0xC3}); }
+
+    // Returns `status` with `function` as the culprit.
+    void fail(JitStatus status, uint32_t function) {
+        memory({0xC7}, 0, kRuntime, kFailed);
+        u32(function);
+        bytes({0xB8});
+        u32(static_cast<uint32_t>(status));
+        epilogue();
+    }
+
+    // rax = slot b <op> slot c; slot a = rax
+    void integer(std::initializer_list<uint8_t> opcode, const Instruction& in) {
+        slot({0x48, 0x8B}, RAX, in.b);
+        slot(opcode, RAX, in.c);
+        slot({0x48, 0x89}, RAX, in.a);
+    }
+
+    // xmm0 = slot b <op> slot c; slot a = xmm0
+    void floating(uint8_t opcode, const Instruction& in) {
+        slot({0xF2, 0x0F, 0x10}, 0, in.b);
+        slot({0xF2, 0x0F, opcode}, 0, in.c);
+        slot({0xF2, 0x0F, 0x11}, 0, in.a);
+    }
+
+    void compareInt(Condition condition, const Instruction& in) {
+        slot({0x48, 0x8B}, RAX, in.b);
+        slot({0x48, 0x3B}, RAX, in.c);
+        flag(condition);
+        slot({0x48, 0x89}, RAX, in.a);
+    }
+
+    // ucomisd sets CF and ZF for unordered operands, so b < c is tested as
+    // c > b: NaN then compares false, as in C++.
+    void compareFloat(Op op, const Instruction& in) {
+        const bool swapped = op == Op::LtF || op == Op::LeF;
+        slot({0xF2, 0x0F, 0x10}, 0, swapped ? in.c : in.b);
+        slot({0x66, 0x0F, 0x2E}, 0, swapped ? in.b : in.c);
+        switch (op) {
+            case Op::LtF: flag(kAbove); break;
+            case Op::LeF: flag(kAboveEqual); break;
+            case Op::EqF:
+                bytes({0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8, 0x0F, 0xB6, 0xC0});  // sete; setnp cl; and
+                break;
+            default:
+                bytes({0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8, 0x0F, 0xB6, 0xC0});  // setne; setp cl; or
+                break;
+        }
+        slot({0x48, 0x89}, RAX, in.a);
+    }
+
+    // Division by zero fails; a divisor of -1 is special-cased because idiv
+    // traps on INT64_MIN / -1, where the VM wraps.
+    void divide(bool remainder, const Instruction& in, uint32_t function) {
+        slot({0x48, 0x8B}, RCX, in.c);
+        bytes({0x48, 0x85, 0xC9});  // test rcx, rcx
+        const size_t nonzero = jump(kNotEqual);
+        fail(kJitDivisionByZero, function);
+        bind(nonzero);
+        slot({0x48, 0x8B}, RAX, in.b);
+        bytes({0x48, 0x83, 0xF9, 0xFF});  // cmp rcx, -1
+        const size_t general = jump(kNotEqual);
+        if (remainder) {
+            bytes({0x31, 0xC0});  // xor eax, eax
+        } else {
+            bytes({0x48, 0xF7, 0xD8});  // neg rax
+        }
+        const size_t done = jump();
+        bind(general);
+        bytes({0x48, 0x99, 0x48, 0xF7, 0xF9});  // cqo; idiv rcx
+        if (remainder) bytes({0x48, 0x89, 0xD0});  // mov rax, rdx
+        bind(done);
+        slot({0x48, 0x89}, RAX, in.a);
+    }
+
+    // Checks both stacks, calls through JitRuntime::entries and copies the
+    // result into slot a. A failing callee's status is passed straight up.
+    void call(const Instruction* pc, const CompiledFunction& callee, uint32_t index) {
+        slot({0x48, 0x8D}, RDI, pc[1].a);                                    // lea rdi, callee frame
+        memory({0x48, 0x8D}, RAX, RDI, int32_t(callee.scalarRegisters) * 8);  // lea rax, its end
+        memory({0x48, 0x3B}, RAX, kRuntime, kScalarEnd);
+        const size_t fits = jump(kBelowEqual);
+        fail(kJitStackOverflow, index);
+        bind(fits);
+        memory({0x48, 0x3B}, RSP, kRuntime, kStackLimit);
+        const size_t room = jump(kAboveEqual);
+        fail(kJitStackOverflow, index);
+        bind(room);
+        bytes({0x48, 0x89, 0xEE});  // mov rsi, rbp
+        memory({0x48, 0x8B}, RAX, kRuntime, kEntries);
+        memory({0xFF}, 2, RAX, static_cast<int32_t>(index) * 8);  // call [rax + 8 * index]
+        bytes({0x85, 0xC0});  // test eax, eax
+        const size_t ok = jump(kEqual);
+        epilogue();
+        bind(ok);
+        memory({0x48, 0x8B}, RAX, kRuntime, kResult);
+        slot({0x48, 0x89}, RAX, pc->a);
+    }
+};
+
+void emitFunction(Assembler& as, const BytecodeModule& module, uint32_t index) {
+    const CompiledFunction& function = module.functions[index];
+    const std::vector<Instruction>& code = function.code;
+    std::vector<size_t> labels(code.size());
+    std::vector<std::pair<size_t, uint32_t>> jumps;  // rel32 position, target instruction
+
+    as.prologue();
+    for (size_t i = 0; i < code.size(); ++i) {
+        const Instruction& in = code[i];
+        labels[i] = as.size();
+        switch (in.op) {
+            case Op::Mov:
+                as.slot({0x48, 0x8B}, RAX, in.b);
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+            case Op::LoadK: {
+                uint64_t bits;
+                std::memcpy(&bits, &module.constants[in.bx()], sizeof(bits));
+                as.bytes({0x48, 0xB8});
+                as.u64(bits);
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+            }
+            case Op::IToF:
+                as.slot({0xF2, 0x48, 0x0F, 0x2A}, 0, in.b);  // cvtsi2sd xmm0, qword
+                as.slot({0xF2, 0x0F, 0x11}, 0, in.a);
+                break;
+
+            case Op::AddI: as.integer({0x48, 0x03}, in); break;
+            case Op::SubI: as.integer({0x48, 0x2B}, in); break;
+            case Op::MulI: as.integer({0x48, 0x0F, 0xAF}, in); break;
+            case Op::DivI: as.divide(false, in, index); break;
+            case Op::ModI: as.divide(true, in, index); break;
+            case Op::AddIK:
+                as.slot({0x48, 0x8B}, RAX, in.b);
+                as.bytes({0x48, 0x05});
+                as.u32(static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(in.c))));
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+
+            case Op::AddF: as.floating(0x58, in); break;
+            case Op::SubF: as.floating(0x5C, in); break;
+            case Op::MulF: as.floating(0x59, in); break;
+            case Op::DivF: as.floating(0x5E, in); break;
+
+            case Op::NegI:
+            case Op::NegF:
+            case Op::BitNot:
+                as.slot({0x48, 0x8B}, RAX, in.b);
+                if (in.op == Op::NegI) as.bytes({0x48, 0xF7, 0xD8});                   // neg rax
+                if (in.op == Op::NegF) as.bytes({0x48, 0x0F, 0xBA, 0xF8, 0x3F});       // btc rax, 63
+                if (in.op == Op::BitNot) as.bytes({0x48, 0xF7, 0xD0});                 // not rax
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+            case Op::Not:
+                as.slot({0x48, 0x83}, 7, in.b);  // cmp qword, imm8
+                as.bytes({0x00});
+                as.flag(kEqual);
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+            case Op::BitAnd: as.integer({0x48, 0x23}, in); break;
+            case Op::BitOr: as.integer({0x48, 0x0B}, in); break;
+            case Op::BitXor: as.integer({0x48, 0x33}, in); break;
+            case Op::Shl:
+            case Op::Shr:
+                // The hardware masks the count to 6 bits, as the VM does.
+                as.slot({0x48, 0x8B}, RCX, in.c);
+                as.slot({0x48, 0x8B}, RAX, in.b);
+                as.bytes({0x48, 0xD3, static_cast<uint8_t>(in.op == Op::Shl ? 0xE0 : 0xF8)});
+                as.slot({0x48, 0x89}, RAX, in.a);
+                break;
+
+            case Op::LtI: as.compareInt(kLess, in); break;
+            case Op::LeI: as.compareInt(kLessEqual, in); break;
+            case Op::EqI: as.compareInt(kEqual, in); break;
+            case Op::NeI: as.compareInt(kNotEqual, in); break;
+            case Op::LtF: case Op::LeF: case Op::EqF: case Op::NeF: as.compareFloat(in.op, in); break;
+
+            case Op::Jmp:
+                jumps.emplace_back(as.jump(), in.bx());
+                break;
+            case Op::JmpF:
+            case Op::JmpT:
+                as.slot({0x48, 0x83}, 7, in.a);
+                as.bytes({0x00});
+                jumps.emplace_back(as.jump(in.op == Op::JmpF ? kEqual : kNotEqual), in.bx());
+                break;
+
+            case Op::Call:
+                as.call(&in, module.functions[in.bx()], in.bx());
+                labels[++i] = as.size();  // the argument word
+                break;
+            case Op::Ret:
+                as.slot({0x48, 0x8B}, RAX, in.a);
+                as.memory({0x48, 0x89}, RAX, kRuntime, kResult);
+                as.bytes({0x31, 0xC0});
+                as.epilogue();
+                break;
+
+            default:
+                break;  // supported() keeps everything else out
+        }
+    }
+    for (const auto& [at, target] : jumps) as.patch(at, labels[target]);
+}
+
+} // namespace
+
+Jit::Jit(const BytecodeModule& module)
+    : module_(module), entries_(module.functions.size(), nullptr), states_(module.functions.size(), kInterpreted) {}
+
+Jit::~Jit() {
+#if JIT_SUPPORTED
+    for (const auto& [address, size] : mappings_) munmap(address, size);
+#endif
+}
+
+bool Jit::supported(const CompiledFunction& function) const {
+    if (function.stringRegisters != 0) return false;
+    const std::vector<Instruction>& code = function.code;
+    for (size_t i = 0; i < code.size(); ++i) {
+        switch (code[i].op) {
+            case Op::MovS: case Op::LoadS: case Op::LtS: case Op::LeS: case Op::EqS: case Op::NeS:
+            case Op::Concat: case Op::Append: case Op::Len: case Op::RetS: case Op::Print:
+                return false;
+            case Op::Jmp: case Op::JmpF: case Op::JmpT:
+                if (code[i].bx() >= code.size()) return false;
+                break;
+            case Op::Call:
+                if (i + 1 == code.size()) return false;
+                ++i;
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool Jit::compile(uint32_t function) {
+    if (states_[function] != kInterpreted) return states_[function] == kCompiled;
+
+    // The functions still to compile: `function` and everything it reaches.
+    std::vector<uint32_t> batch;
+    std::vector<bool> queued(module_.functions.size(), false);
+    batch.push_back(function);
+    queued[function] = true;
+    for (size_t next = 0; next < batch.size(); ++next) {
+        const CompiledFunction& current = module_.functions[batch[next]];
+        if (!JIT_SUPPORTED || states_[batch[next]] == kUnsupported || !supported(current)) {
+            states_[batch[next]] = kUnsupported;
+            states_[function] = kUnsupported;
+            return false;
+        }
+        for (size_t i = 0; i < current.code.size(); ++i) {
+            if (current.code[i].op != Op::Call) continue;
+            const uint32_t callee = current.code[i++].bx();
+            if (queued[callee] || states_[callee] == kCompiled) continue;
+            queued[callee] = true;
+            batch.push_back(callee);
+        }
+    }
+
+    Assembler as;
+    std::vector<size_t> starts;
+    for (uint32_t index : batch) {
+        starts.push_back(as.size());
+        emitFunction(as, module_, index);
+    }
+
+#if JIT_SUPPORTED
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = (as.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        states_[function] = kUnsupported;
+        return false;
+    }
+    std::memcpy(memory, as.code.data(), as.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        states_[function] = kUnsupported;
+        return false;
+    }
+    mappings_.emplace_back(memory, size);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        entries_[batch[i]] = reinterpret_cast<JitEntry>(static_cast<uint8_t*>(memory) + starts[i]);
+        states_[batch[i]] = kCompiled;
+    }
+    compiled_ += batch.size();
+    return true;
+#else
+    return false;
+#endif
+}
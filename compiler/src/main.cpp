@@ -0,0 +1,274 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "sema.hpp"
+#include "bytecode.hpp"
+#include "vm.hpp"
+#include "interpreter.hpp"
+#include "ir.hpp"
+#include "passes.hpp"
+#include "codegen.hpp"
+#include "cache.hpp"
+
+int main(int argc, char* argv[]) {
+    bool print_ast = false;
+    bool signatures = false;
+    bool run = false;
+    bool tree_walk = false;
+    bool dump_bytecode = false;
+    bool timing = false;
+    uint32_t jit_threshold = kDefaultJitThreshold;
+    bool jit_flag = false;
+    bool emit_ir = false;
+    bool time_passes = false;
+    const char* pass_list = nullptr;
+    bool emit_asm = false;
+    const char* native_path = nullptr;
+    const char* cache_dir = nullptr;
+    unsigned threads = 1;
+    const char* input_path = nullptr;
+    bool usage_error = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--ast") {
+            print_ast = true;
+        } else if (arg == "--signatures") {
+            signatures = true;
+        } else if (arg == "--run") {
+            run = true;
+        } else if (arg == "--interpret") {
+            tree_walk = true;
+        } else if (arg == "--dump-bytecode") {
+            dump_bytecode = true;
+        } else if (arg == "--time") {
+            timing = true;
+        } else if (arg == "--no-jit") {
+            jit_threshold = 0;
+            jit_flag = true;
+        } else if (arg.rfind("--jit-threshold=", 0) == 0) {
+            char* end = nullptr;
+            const unsigned long calls = std::strtoul(arg.c_str() + 16, &end, 10);
+            jit_threshold = static_cast<uint32_t>(calls);
+            jit_flag = true;
+            usage_error = end == arg.c_str() + 16 || *end != '\0' || calls == 0 || calls > UINT32_MAX;
+        } else if (arg == "--emit-ir") {
+            emit_ir = true;
+        } else if (arg == "--time-passes") {
+            time_passes = true;
+        } else if (arg == "--emit-asm") {
+            emit_asm = true;
+        } else if (arg.rfind("--native=", 0) == 0 && arg.size() > 9) {
+            native_path = argv[i] + 9;
+        } else if (arg.rfind("--cache=", 0) == 0 && arg.size() > 8) {
+            cache_dir = argv[i] + 8;
+        } else if (arg.rfind("--passes=", 0) == 0) {
+            pass_list = argv[i] + 9;
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            threads = static_cast<unsigned>(std::strtoul(arg.c_str() + 10, nullptr, 10));
+        } else if (input_path == nullptr && arg.rfind("--", 0) != 0) {
+            input_path = argv[i];
+        } else {
+            usage_error = true;
+        }
+    }
+
+    const bool executes = run || tree_walk;
+    const bool native = emit_asm || native_path != nullptr;
+    const bool optimizes = emit_ir || time_passes || native;
+    PassManager passes;
+    if (pass_list != nullptr) {
+        // A comma-separated list of the passes to keep; "none" keeps none.
+        passes.disableAll();
+        const std::string list = pass_list;
+        size_t begin = 0;
+        while (begin <= list.size()) {
+            size_t end = list.find(',', begin);
+            if (end == std::string::npos) end = list.size();
+            const std::string name = list.substr(begin, end - begin);
+            if (name != "none" && !passes.setEnabled(name, true)) {
+                std::cerr << "Error: unknown pass '" << name << "' (passes: constfold, cse, licm, dce)" << std::endl;
+                return 1;
+            }
+            begin = end + 1;
+        }
+    }
+    if (usage_error || input_path == nullptr || (signatures && (print_ast || executes || dump_bytecode || optimizes)) ||
+        (run && tree_walk) || (emit_asm && native_path != nullptr) || (timing && !executes) || (jit_flag && !run) ||
+        (pass_list != nullptr && !optimizes)) {
+        std::cerr << "Usage: " << argv[0] << " [--ast] [--threads=<n>] [--dump-bytecode] [--cache=<dir>] <input_file>\n"
+                  << "       " << argv[0] << " --run|--interpret [--time] [--threads=<n>] <input_file>\n"
+                  << "       " << argv[0] << " --run [--no-jit|--jit-threshold=<calls>] [--time] <input_file>\n"
+                  << "       " << argv[0] << " --emit-ir|--time-passes [--passes=<list>] [--threads=<n>] <input_file>\n"
+                  << "       " << argv[0] << " --emit-asm|--native=<executable> [--passes=<list>] [--threads=<n>] <input_file>\n"
+                  << "       " << argv[0] << " --signatures <input_file>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream input_file(input_path);
+    if (!input_file.is_open()) {
+        std::cerr << "Error: Could not open file " << input_path << std::endl;
+        return 1;
+    }
+    std::string source_code((std::istreambuf_iterator<char>(input_file)), std::istreambuf_iterator<char>());
+
+    // Reusing a function's IR skips its parse, so the paths that read the
+    // AST of every function only reuse tokens.
+    std::unique_ptr<BuildCache> cache;
+    if (cache_dir != nullptr && compilerBuildId() == 0) {
+        std::cerr << "warning: --cache ignored, this compiler was linked without a build ID\n";
+    } else if (cache_dir != nullptr) {
+        cache = std::make_unique<BuildCache>(cache_dir);
+    }
+    const bool reuse_ir = cache && optimizes && !executes && !dump_bytecode && !print_ast;
+
+    Program program;
+    try {
+        // Unknown tokens and invalid identifiers surface as syntax errors, so
+        // the lexer's own reports would only repeat them.
+        std::ostream discard(nullptr);
+        const auto lex = [&source_code, &discard] {
+            Lexer lexer(source_code);
+            lexer.setDiagnosticStream(discard);
+            return lexer.tokenize();
+        };
+        // Signatures never need the bodies; with several threads the bodies are
+        // skimmed first and then parsed in parallel, and with a cache only the
+        // bodies it does not have are parsed.
+        const bool lazy = signatures || threads != 1 || reuse_ir;
+        std::vector<Token> tokens = cache ? cache->tokens(source_code, lex) : lex();
+        program = parseProgram(std::move(tokens), lazy ? ParseMode::Lazy : ParseMode::Eager);
+    } catch (const LexerError& e) {
+        std::cerr << "Lexical error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<uint64_t> cache_keys;
+    std::vector<bool> cached;
+    if (reuse_ir && program.errors.empty()) {
+        cache_keys = cache->functionKeys(program, passes);
+        cached = cache->probe(cache_keys);
+    }
+    if (signatures) {
+        printSignatures(std::cout, program);
+    } else if (threads != 1 || reuse_ir) {
+        parseBodies(program, threads, cached);
+    }
+    if (print_ast) {
+        printAst(std::cout, program);
+    }
+
+    const std::vector<SyntaxError> errors = program.allErrors();
+    for (const SyntaxError& e : errors) {
+        std::cerr << "Syntax error at line " << e.line() << ", column " << e.column() << ": " << e.what() << std::endl;
+    }
+    // Checking a tree the parser had to patch up would mostly report its gaps.
+    if (!errors.empty()) return 1;
+    if (signatures) return 0;
+
+    const SemanticModel model = analyze(program, threads);
+    for (const SemanticError& e : model.errors) {
+        std::cerr << "Semantic error at line " << e.line() << ", column " << e.column() << ": " << e.what() << std::endl;
+    }
+    if (!model.errors.empty()) return 1;
+
+    uint32_t entry = 0;
+    while (entry < program.functions.size() && program.tokens[program.functions[entry].name].value != "main") ++entry;
+    if ((executes || native) && (entry == program.functions.size() || program.functions[entry].returnType != T_INT ||
+                                 !program.functions[entry].params.empty())) {
+        std::cerr << "Error: program has no 'fn int main()'" << std::endl;
+        return 1;
+    }
+
+    if (optimizes) {
+        const auto start = std::chrono::steady_clock::now();
+        IrModule ir = lowerToIr(program, model, threads);
+        const std::chrono::duration<double, std::milli> lowering = std::chrono::steady_clock::now() - start;
+        size_t lowered = 0;
+        for (const IrFunction& function : ir.functions) lowered += function.liveInstructions();
+        passes.run(ir, threads);
+        if (!cache_keys.empty()) cache->reuse(ir, cache_keys);
+        if (emit_ir) printIr(std::cout, ir);
+        if (time_passes) {
+            std::cerr << "lowering: " << lowered << " instructions in " << lowering.count() << " ms\n";
+            passes.printTimings(std::cerr);
+            if (cache) {
+                const CacheStats& stats = cache->stats();
+                std::cerr << "cache: tokens " << (stats.tokensReused ? "reused" : "lexed") << ", "
+                          << stats.functionsReused << " functions reused, " << stats.functionsCompiled
+                          << " compiled\n";
+            }
+        }
+        if (native) {
+            std::ostringstream assembly;
+            try {
+                emitAssembly(assembly, ir, threads);
+            } catch (const CodegenError& e) {
+                std::cerr << "Codegen error: " << e.what() << std::endl;
+                return 1;
+            }
+            if (emit_asm) {
+                std::cout << assembly.str();
+            } else {
+                // Assemble and link with the system C compiler ($CC, else cc).
+                const std::string executable = native_path;
+                const std::string assembly_path = executable + ".s";
+                std::ofstream(assembly_path) << assembly.str();
+                const char* cc = std::getenv("CC");
+                const std::string command = std::string(cc != nullptr && *cc != '\0' ? cc : "cc") + " -o '" +
+                                            executable + "' '" + assembly_path + "'";
+                const int status = std::system(command.c_str());
+                std::remove(assembly_path.c_str());
+                if (status != 0) {
+                    std::cerr << "Error: '" << command << "' failed" << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    if (!executes && !dump_bytecode) return 0;
+
+    BytecodeModule module;
+    try {
+        if (run || dump_bytecode) module = compileBytecode(program, model);
+    } catch (const CompileError& e) {
+        std::cerr << "Compile error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (dump_bytecode) disassemble(std::cout, module);
+    if (!executes) return 0;
+
+    // main's result becomes the exit status.
+    int64_t result;
+    size_t jitted = 0;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        if (run) {
+            VM vm(module, std::cout);
+            if (jit_flag) vm.setJitThreshold(jit_threshold);
+            result = vm.run(entry);
+            jitted = vm.jitCompiledFunctions();
+        } else {
+            result = interpret(program, model, entry, std::cout);
+        }
+    } catch (const RuntimeError& e) {
+        std::cout.flush();
+        std::cerr << "Runtime error: " << e.what() << std::endl;
+        return 1;
+    }
+    if (timing) {
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        const char* backend = !run ? "tree-walker" : jit_threshold != 0 ? "vm+jit" : "vm";
+        std::cerr << backend << ": " << elapsed.count() << " ms";
+        if (run && jit_threshold != 0) std::cerr << " (" << jitted << " functions compiled)";
+        std::cerr << std::endl;
+    }
+    return static_cast<int>(result);
+}
@@ -0,0 +1,482 @@
+#include "parser.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <string>
+
+namespace {
+
+// Statements and expressions nested deeper than this, and expression trees
+// taller than this, are a syntax error. A pathological input is then reported
+// instead of overflowing the native stack here or in the passes that walk the
+// tree afterwards.
+constexpr int kMaxNesting = 1000;
+
+// Binding powers for the Pratt loop; a higher power binds tighter.
+enum Precedence : int {
+    kNone = 0,
+    kAssign,
+    kTernary,
+    kOr,
+    kAnd,
+    kBitOr,
+    kBitXor,
+    kBitAnd,
+    kEquality,
+    kRelational,
+    kShift,
+    kAdditive,
+    kMultiplicative,
+    kPrefix,
+    kPostfix,
+};
+
+int infixPrecedence(TokenType type) {
+    switch (type) {
+        case T_ASSIGNOP: case T_PLUS_ASSIGN: case T_MINUS_ASSIGN: return kAssign;
+        case T_QUESTION: return kTernary;
+        case T_OR: return kOr;
+        case T_AND: return kAnd;
+        case T_BITOR: return kBitOr;
+        case T_BITXOR: return kBitXor;
+        case T_BITAND: return kBitAnd;
+        case T_EQUALSOP: case T_NEQ: return kEquality;
+        case T_LT: case T_GT: case T_LTE: case T_GTE: return kRelational;
+        case T_LEFTSHIFT: case T_RIGHTSHIFT: return kShift;
+        case T_PLUS: case T_MINUS: return kAdditive;
+        case T_MULT: case T_DIV: case T_MOD: return kMultiplicative;
+        case T_PARENL: case T_BRACKL: case T_DOT: case T_INCREMENT: case T_DECREMENT: return kPostfix;
+        default: return kNone;
+    }
+}
+
+class Parser {
+public:
+    Parser(const Program& program, size_t pos) : tokens_(program.tokens), brackets_(program.brackets), pos_(pos) {}
+
+    void parseProgram(Program& program, ParseMode mode) {
+        while (peek().type != T_EOF) {
+            if (peek().type != T_FUNCTION) {
+                program.errors.push_back(error("expected 'fn'"));
+                skipToFunction();
+                continue;
+            }
+            Function function;
+            try {
+                parseSignature(function);
+            } catch (const SyntaxError& e) {
+                program.errors.push_back(e);
+                skipToFunction();
+                continue;
+            }
+            function.bodyBegin = static_cast<uint32_t>(pos_);
+            const uint32_t close = at(T_BRACEL) ? brackets_.match(function.bodyBegin) : BracketTable::kNoMatch;
+            if (mode == ParseMode::Lazy && close != BracketTable::kNoMatch) {
+                function.bodyEnd = close + 1;
+                pos_ = function.bodyEnd;
+            } else {
+                // Without a matching '}' the body is parsed now, which reports the error.
+                parseBody(function);
+            }
+            program.functions.push_back(std::move(function));
+        }
+    }
+
+    void seek(size_t pos) { pos_ = pos; }
+
+    void parseBody(Function& function) {
+        function_ = &function;
+        scratch_.clear();
+        try {
+            function.root = parseBlock();
+        } catch (const SyntaxError& e) {
+            function.errors.push_back(e);
+            skipToFunction();
+        }
+        tooDeep_ = false;
+        if (function.bodyEnd == 0) function.bodyEnd = static_cast<uint32_t>(pos_);
+        function.bodyParsed = true;
+        function_ = nullptr;
+    }
+
+private:
+    const std::vector<Token>& tokens_;
+    const BracketTable& brackets_;
+    size_t pos_;
+    Function* function_ = nullptr;
+    std::vector<NodeId> scratch_;  // children of the lists being built, innermost last
+    int depth_ = 0;                // statements and expressions being parsed
+    int height_ = 0;               // height of the expression tree built last
+    bool tooDeep_ = false;         // set until the body that hit kMaxNesting is abandoned
+
+    // One level of nesting for as long as it lives.
+    class Nested {
+    public:
+        explicit Nested(Parser& parser) : depth_(parser.depth_) {
+            if (depth_ == kMaxNesting) throw parser.tooDeep();
+            ++depth_;
+        }
+        ~Nested() { --depth_; }
+        Nested(const Nested&) = delete;
+        Nested& operator=(const Nested&) = delete;
+
+    private:
+        int& depth_;
+    };
+
+    const Token& peek() const { return tokens_[pos_]; }
+    bool at(TokenType type) const { return tokens_[pos_].type == type; }
+
+    uint32_t advance() {
+        const uint32_t index = static_cast<uint32_t>(pos_);
+        if (tokens_[pos_].type != T_EOF) ++pos_;
+        return index;
+    }
+
+    bool accept(TokenType type) {
+        if (!at(type)) return false;
+        advance();
+        return true;
+    }
+
+    SyntaxError error(const std::string& expected) const {
+        const Token& token = peek();
+        std::string found;
+        if (token.type == T_EOF) {
+            found = "end of file";
+        } else if (token.type == T_INVALID_IDENTIFIER) {
+            found = "invalid identifier '" + token.value + "'";
+        } else if (token.type == T_UNKNOWN) {
+            found = "unknown character '" + token.value + "'";
+        } else {
+            found = "'" + token.value + "'";
+        }
+        return SyntaxError(expected + ", found " + found, token.line, token.column);
+    }
+
+    SyntaxError tooDeep() {
+        tooDeep_ = true;
+        const Token& token = peek();
+        return SyntaxError("nesting deeper than " + std::to_string(kMaxNesting) + " levels", token.line, token.column);
+    }
+
+    // Records the height of the expression node about to be built; its
+    // children were built just before it, so they are already counted.
+    void setHeight(int height) {
+        if (height > kMaxNesting) throw tooDeep();
+        height_ = height;
+    }
+
+    uint32_t expect(TokenType type, const char* expected) {
+        if (!at(type)) throw error(std::string("expected ") + expected);
+        return advance();
+    }
+
+    TokenType expectType(const char* what) {
+        if (!isTypeName(peek().type)) throw error(std::string("expected ") + what);
+        return tokens_[advance()].type;
+    }
+
+    NodeId add(NodeKind kind, uint32_t token, uint32_t a = kNoNode, uint32_t b = kNoNode,
+               uint32_t c = kNoNode, uint32_t d = kNoNode) {
+        return function_->body.add(Node{kind, token, a, b, c, d});
+    }
+
+    // Moves the entries pushed since `mark` from scratch_ into the arena.
+    uint32_t takeList(size_t mark) {
+        const uint32_t first = function_->body.addList(scratch_.data() + mark, scratch_.size() - mark);
+        scratch_.resize(mark);
+        return first;
+    }
+
+    // Steps over a token, or over a whole bracketed group when it opens one.
+    void skipGroup() {
+        const uint32_t close = brackets_.match(static_cast<uint32_t>(pos_));
+        if (close != BracketTable::kNoMatch && close > pos_) {
+            pos_ = close;
+        }
+        advance();
+    }
+
+    void skipToFunction() {
+        while (!at(T_EOF) && !at(T_FUNCTION)) skipGroup();
+    }
+
+    // Skips the rest of a broken statement: through the next ';' at this
+    // nesting level, or up to the '}' that closes the enclosing block.
+    void skipStatement() {
+        const size_t start = pos_;
+        while (!at(T_EOF)) {
+            const TokenType type = peek().type;
+            if (type == T_SEMICOLON) {
+                advance();
+                return;
+            }
+            if (type == T_BRACER || type == T_FUNCTION) return;
+            if (pos_ > start && (type == T_IF || type == T_WHILE || type == T_FOR || type == T_RETURN ||
+                                 isTypeName(type))) {
+                return;
+            }
+            skipGroup();
+        }
+    }
+
+    void parseSignature(Function& function) {
+        expect(T_FUNCTION, "'fn'");
+        function.returnType = expectType("return type");
+        function.name = expect(T_IDENTIFIER, "function name");
+        expect(T_PARENL, "'(' after function name");
+        if (!at(T_PARENR)) {
+            do {
+                const TokenType type = expectType("parameter type");
+                function.params.push_back(Param{type, expect(T_IDENTIFIER, "parameter name")});
+            } while (accept(T_COMMA));
+        }
+        expect(T_PARENR, "')' after parameters");
+    }
+
+    NodeId parseBlock() {
+        const uint32_t brace = expect(T_BRACEL, "'{'");
+        const size_t mark = scratch_.size();
+        while (!at(T_BRACER) && !at(T_EOF) && !at(T_FUNCTION)) {
+            const size_t depth = scratch_.size();
+            try {
+                const NodeId statement = parseStatement();
+                scratch_.push_back(statement);
+            } catch (const SyntaxError& e) {
+                // Recovering inside a body that is too deep would report the
+                // same error at every level; the whole body is dropped instead.
+                if (tooDeep_) throw;
+                function_->errors.push_back(e);
+                scratch_.resize(depth);  // drop children of lists the error interrupted
+                skipStatement();
+            }
+        }
+        expect(T_BRACER, "'}'");
+        const uint32_t count = static_cast<uint32_t>(scratch_.size() - mark);
+        return add(NodeKind::Block, brace, takeList(mark), count);
+    }
+
+    NodeId parseStatement() {
+        const Nested nested(*this);
+        const uint32_t start = static_cast<uint32_t>(pos_);
+        switch (peek().type) {
+            case T_BRACEL:
+                return parseBlock();
+            case T_INT: case T_FLOAT: case T_STRING: case T_BOOL: {
+                const NodeId declaration = parseVarDecl();
+                expect(T_SEMICOLON, "';' after declaration");
+                return declaration;
+            }
+            case T_IF: {
+                advance();
+                expect(T_PARENL, "'(' after 'if'");
+                const NodeId condition = parseExpression();
+                expect(T_PARENR, "')' after condition");
+                const NodeId then_branch = parseStatement();
+                const NodeId else_branch = accept(T_ELSE) ? parseStatement() : kNoNode;
+                return add(NodeKind::If, start, condition, then_branch, else_branch);
+            }
+            case T_WHILE: {
+                advance();
+                expect(T_PARENL, "'(' after 'while'");
+                const NodeId condition = parseExpression();
+                expect(T_PARENR, "')' after condition");
+                return add(NodeKind::While, start, condition, parseStatement());
+            }
+            case T_FOR: {
+                advance();
+                expect(T_PARENL, "'(' after 'for'");
+                NodeId init = kNoNode;
+                if (isTypeName(peek().type)) {
+                    init = parseVarDecl();
+                } else if (!at(T_SEMICOLON)) {
+                    const uint32_t token = static_cast<uint32_t>(pos_);
+                    init = add(NodeKind::ExprStmt, token, parseExpression());
+                }
+                expect(T_SEMICOLON, "';' after for initializer");
+                const NodeId condition = at(T_SEMICOLON) ? kNoNode : parseExpression();
+                expect(T_SEMICOLON, "';' after for condition");
+                const NodeId step = at(T_PARENR) ? kNoNode : parseExpression();
+                expect(T_PARENR, "')' after for clauses");
+                return add(NodeKind::For, start, init, condition, step, parseStatement());
+            }
+            case T_RETURN: {
+                advance();
+                const NodeId value = at(T_SEMICOLON) ? kNoNode : parseExpression();
+                expect(T_SEMICOLON, "';' after return");
+                return add(NodeKind::Return, start, value);
+            }
+            case T_BREAK:
+            case T_CONTINUE: {
+                const NodeKind kind = at(T_BREAK) ? NodeKind::Break : NodeKind::Continue;
+                advance();
+                expect(T_SEMICOLON, kind == NodeKind::Break ? "';' after 'break'" : "';' after 'continue'");
+                return add(kind, start);
+            }
+            case T_SEMICOLON:
+                advance();
+                return add(NodeKind::Block, start, takeList(scratch_.size()), 0);
+            default: {
+                const NodeId expression = parseExpression();
+                expect(T_SEMICOLON, "';' after expression");
+                return add(NodeKind::ExprStmt, start, expression);
+            }
+        }
+    }
+
+    NodeId parseVarDecl() {
+        const TokenType type = expectType("type");
+        const uint32_t name = expect(T_IDENTIFIER, "variable name");
+        const NodeId init = accept(T_ASSIGNOP) ? parseExpression() : kNoNode;
+        return add(NodeKind::VarDecl, name, init, static_cast<uint32_t>(type));
+    }
+
+    NodeId parseExpression(int min_precedence = kAssign) {
+        const Nested nested(*this);
+        NodeId left = parsePrefix();
+        // Left-associative chains such as 1 + 1 + ... grow the tree without
+        // recursing, so their height is tracked separately from depth_.
+        int height = height_;
+        for (;;) {
+            const TokenType type = peek().type;
+            const int precedence = infixPrecedence(type);
+            if (precedence == kNone || precedence < min_precedence) {
+                height_ = height;
+                return left;
+            }
+            const uint32_t op = advance();
+
+            switch (precedence) {
+                case kPostfix:
+                    left = parsePostfix(type, op, left, height);
+                    break;
+                case kAssign: {
+                    // Right associative: a = b = c is a = (b = c).
+                    const NodeId value = parseExpression(kAssign);
+                    setHeight(std::max(height, height_) + 1);
+                    left = add(NodeKind::Assign, op, left, value);
+                    break;
+                }
+                case kTernary: {
+                    const NodeId then_value = parseExpression(kAssign);
+                    const int then_height = height_;
+                    expect(T_COLON, "':' in conditional expression");
+                    const NodeId else_value = parseExpression(kTernary);
+                    setHeight(std::max({height, then_height, height_}) + 1);
+                    left = add(NodeKind::Ternary, op, left, then_value, else_value);
+                    break;
+                }
+                default: {
+                    const NodeId right = parseExpression(precedence + 1);
+                    setHeight(std::max(height, height_) + 1);
+                    left = add(NodeKind::Binary, op, left, right);
+                    break;
+                }
+            }
+            height = height_;
+        }
+    }
+
+    // `height` is the height of `left`.
+    NodeId parsePostfix(TokenType type, uint32_t op, NodeId left, int height) {
+        switch (type) {
+            case T_PARENL: {
+                const size_t mark = scratch_.size();
+                if (!at(T_PARENR)) {
+                    do {
+                        const NodeId argument = parseExpression();
+                        height = std::max(height, height_);
+                        scratch_.push_back(argument);
+                    } while (accept(T_COMMA));
+                }
+                expect(T_PARENR, "')' after arguments");
+                setHeight(height + 1);
+                const uint32_t count = static_cast<uint32_t>(scratch_.size() - mark);
+                return add(NodeKind::Call, op, left, takeList(mark), count);
+            }
+            case T_BRACKL: {
+                const NodeId index = parseExpression();
+                expect(T_BRACKR, "']' after index");
+                setHeight(std::max(height, height_) + 1);
+                return add(NodeKind::Index, op, left, index);
+            }
+            case T_DOT:
+                setHeight(height + 1);
+                return add(NodeKind::Member, expect(T_IDENTIFIER, "member name after '.'"), left);
+            default:
+                setHeight(height + 1);
+                return add(NodeKind::Postfix, op, left);
+        }
+    }
+
+    NodeId parsePrefix() {
+        const uint32_t token = static_cast<uint32_t>(pos_);
+        height_ = 1;
+        switch (peek().type) {
+            case T_INTLIT: advance(); return add(NodeKind::IntLit, token);
+            case T_FLOATLIT: advance(); return add(NodeKind::FloatLit, token);
+            case T_STRINGLIT: advance(); return add(NodeKind::StringLit, token);
+            case T_BOOLLIT: advance(); return add(NodeKind::BoolLit, token);
+            case T_IDENTIFIER: advance(); return add(NodeKind::Name, token);
+            case T_PARENL: {
+                advance();
+                const NodeId inner = parseExpression();
+                expect(T_PARENR, "')'");
+                return inner;
+            }
+            case T_NOT: case T_BITNOT: case T_MINUS: case T_PLUS: case T_INCREMENT: case T_DECREMENT: {
+                advance();
+                const NodeId operand = parseExpression(kPrefix);
+                setHeight(height_ + 1);
+                return add(NodeKind::Unary, token, operand);
+            }
+            default:
+                throw error("expected expression");
+        }
+    }
+};
+
+} // namespace
+
+std::vector<SyntaxError> Program::allErrors() const {
+    std::vector<SyntaxError> all = errors;
+    for (const Function& function : functions) {
+        all.insert(all.end(), function.errors.begin(), function.errors.end());
+    }
+    std::stable_sort(all.begin(), all.end(), [](const SyntaxError& a, const SyntaxError& b) {
+        return a.line() != b.line() ? a.line() < b.line() : a.column() < b.column();
+    });
+    return all;
+}
+
+Program parseProgram(std::vector<Token> tokens, ParseMode mode) {
+    Program program;
+    program.tokens = std::move(tokens);
+    if (program.tokens.empty() || program.tokens.back().type != T_EOF) {
+        program.tokens.push_back(Token{T_EOF, "", 1, 1, 0});
+    }
+
+    program.brackets = BracketTable(program.tokens);
+
+    Parser parser(program, 0);
+    parser.parseProgram(program, mode);
+    return program;
+}
+
+void parseBody(const Program& program, Function& function) {
+    if (function.bodyParsed) return;
+    Parser parser(program, function.bodyBegin);
+    parser.parseBody(function);
+}
+
+void parseBodies(Program& program, unsigned threads, const std::vector<bool>& skip) {
+    // One parser per worker, so its scratch list is reused across bodies.
+    forEachIndex(
+        threads, program.functions.size(), [&program] { return Parser(program, 0); },
+        [&program, &skip](Parser& parser, size_t i) {
+            Function& function = program.functions[i];
+            if (function.bodyParsed || (i < skip.size() && skip[i])) return;
+            parser.seek(function.bodyBegin);
+            parser.parseBody(function);
+        });
+}
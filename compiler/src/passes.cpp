@@ -0,0 +1,518 @@
+#include "passes.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <unordered_map>
+#include "parallel.hpp"
+
+namespace {
+
+bool isConstant(const IrFunction& function, ValueId value, int64_t expected) {
+    const IrInst& inst = function.insts[value];
+    return inst.op == IrOp::Const && inst.type != Type::Float && inst.constant.i == expected;
+}
+
+// Integer division and remainder trap unless the divisor is a nonzero constant.
+bool mayTrap(const IrFunction& function, const IrInst& inst) {
+    if ((inst.op != IrOp::Div && inst.op != IrOp::Mod) || inst.type != Type::Int) return false;
+    const IrInst& divisor = function.insts[inst.b];
+    return divisor.op != IrOp::Const || divisor.constant.i == 0;
+}
+
+bool hasSideEffect(const IrFunction& function, const IrInst& inst) {
+    return inst.op == IrOp::Call || inst.op == IrOp::Print || mayTrap(function, inst);
+}
+
+// Instructions whose result depends only on their operands.
+bool isPure(IrOp op) {
+    return op != IrOp::Nop && op != IrOp::Param && op != IrOp::Phi && op != IrOp::Call && op != IrOp::Print;
+}
+
+uint64_t bits(IrInst::Constant value) {
+    uint64_t result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+// Computes `op` on constant operands of type `operand`. False when the result
+// must be left to run time.
+bool evaluate(IrOp op, Type operand, IrInst::Constant x, IrInst::Constant y, IrInst::Constant& result) {
+    if (operand == Type::Float) {
+        switch (op) {
+            case IrOp::Add: result.f = x.f + y.f; return true;
+            case IrOp::Sub: result.f = x.f - y.f; return true;
+            case IrOp::Mul: result.f = x.f * y.f; return true;
+            case IrOp::Div: result.f = x.f / y.f; return true;
+            case IrOp::Neg: result.f = -x.f; return true;
+            case IrOp::Lt: result.i = x.f < y.f; return true;
+            case IrOp::Le: result.i = x.f <= y.f; return true;
+            case IrOp::Eq: result.i = x.f == y.f; return true;
+            case IrOp::Ne: result.i = x.f != y.f; return true;
+            default: return false;
+        }
+    }
+    const uint64_t ux = static_cast<uint64_t>(x.i);
+    const uint64_t uy = static_cast<uint64_t>(y.i);
+    switch (op) {
+        case IrOp::Add: result.i = wrap(ux + uy); return true;
+        case IrOp::Sub: result.i = wrap(ux - uy); return true;
+        case IrOp::Mul: result.i = wrap(ux * uy); return true;
+        case IrOp::Div:
+            if (y.i == 0) return false;
+            result.i = y.i == -1 ? wrap(0 - ux) : x.i / y.i;
+            return true;
+        case IrOp::Mod:
+            if (y.i == 0) return false;
+            result.i = y.i == -1 ? 0 : x.i % y.i;
+            return true;
+        case IrOp::BitAnd: result.i = x.i & y.i; return true;
+        case IrOp::BitOr: result.i = x.i | y.i; return true;
+        case IrOp::BitXor: result.i = x.i ^ y.i; return true;
+        case IrOp::Shl: result.i = wrap(ux << (y.i & 63)); return true;
+        case IrOp::Shr: result.i = x.i >> (y.i & 63); return true;
+        case IrOp::Neg: result.i = wrap(0 - ux); return true;
+        case IrOp::Not: result.i = !x.i; return true;
+        case IrOp::BitNot: result.i = ~x.i; return true;
+        case IrOp::IToF: result.f = static_cast<double>(x.i); return true;
+        case IrOp::Lt: result.i = x.i < y.i; return true;
+        case IrOp::Le: result.i = x.i <= y.i; return true;
+        case IrOp::Eq: result.i = x.i == y.i; return true;
+        case IrOp::Ne: result.i = x.i != y.i; return true;
+        default: return false;
+    }
+}
+
+class ConstantFolder {
+public:
+    explicit ConstantFolder(IrFunction& function)
+        : function_(function), forward_(function.insts.size(), kNoValue) {}
+
+    size_t run() {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (BlockId b : reversePostorder(function_)) {
+                for (size_t i = 0; i < function_.blocks[b].insts.size(); ++i) {
+                    const ValueId id = function_.blocks[b].insts[i];
+                    if (forward_[id] != kNoValue) continue;
+                    forEachOperand(function_, function_.insts[id], [&](ValueId& v) { v = resolveForward(forward_, v); });
+                    if (fold(id)) changed = true;
+                }
+                if (foldBranch(b)) changed = true;
+            }
+            if (changed) removeUnreachableBlocks(function_);
+        }
+        applyForwarding(function_, forward_);
+        return changes_;
+    }
+
+private:
+    IrFunction& function_;
+    std::vector<ValueId> forward_;
+    size_t changes_ = 0;
+
+    void replace(ValueId id, ValueId with) {
+        forward_[id] = with;
+        ++changes_;
+    }
+
+    void makeConstant(ValueId id, IrInst::Constant value) {
+        IrInst& inst = function_.insts[id];
+        inst.op = IrOp::Const;
+        inst.a = inst.b = kNoValue;
+        inst.constant = value;
+        ++changes_;
+    }
+
+    // A new constant at the top of the entry block, where it dominates everything.
+    ValueId materialize(Type type, IrInst::Constant value) {
+        IrInst inst;
+        inst.op = IrOp::Const;
+        inst.type = type;
+        inst.constant = value;
+        const ValueId id = static_cast<ValueId>(function_.insts.size());
+        function_.insts.push_back(inst);
+        forward_.push_back(kNoValue);
+        std::vector<ValueId>& entry = function_.blocks[0].insts;
+        entry.insert(entry.begin(), id);
+        return id;
+    }
+
+    bool fold(ValueId id) {
+        const IrInst inst = function_.insts[id];
+        if (inst.op == IrOp::Phi) return foldPhi(id, inst);
+        if (inst.op == IrOp::Const || !isPure(inst.op) || inst.op == IrOp::ConstS) return false;
+        if (inst.op == IrOp::Concat || inst.op == IrOp::Len) return false;
+
+        const IrInst& x = function_.insts[inst.a];
+        const bool unary = inst.b == kNoValue;
+        if (x.op == IrOp::Const && (unary || function_.insts[inst.b].op == IrOp::Const)) {
+            IrInst::Constant result{0};
+            const IrInst::Constant y = unary ? IrInst::Constant{0} : function_.insts[inst.b].constant;
+            if (evaluate(inst.op, x.type, x.constant, y, result)) {
+                makeConstant(id, result);
+                return true;
+            }
+            return false;
+        }
+        if (unary || inst.type == Type::Float || x.type == Type::Float) return false;
+
+        // Integer identities.
+        const ValueId a = inst.a;
+        const ValueId b = inst.b;
+        switch (inst.op) {
+            case IrOp::Add: case IrOp::BitOr: case IrOp::BitXor:
+                if (isConstant(function_, b, 0)) return replace(id, a), true;
+                if (isConstant(function_, a, 0)) return replace(id, b), true;
+                break;
+            case IrOp::Sub: case IrOp::Shl: case IrOp::Shr:
+                if (isConstant(function_, b, 0)) return replace(id, a), true;
+                if (inst.op == IrOp::Sub && a == b) return makeConstant(id, IrInst::Constant{0}), true;
+                break;
+            case IrOp::Mul:
+                if (isConstant(function_, b, 1)) return replace(id, a), true;
+                if (isConstant(function_, a, 1)) return replace(id, b), true;
+                if (isConstant(function_, a, 0) || isConstant(function_, b, 0)) {
+                    return makeConstant(id, IrInst::Constant{0}), true;
+                }
+                break;
+            case IrOp::Div:
+                if (isConstant(function_, b, 1)) return replace(id, a), true;
+                break;
+            case IrOp::BitAnd:
+                if (isConstant(function_, a, 0) || isConstant(function_, b, 0)) {
+                    return makeConstant(id, IrInst::Constant{0}), true;
+                }
+                break;
+            case IrOp::Eq: case IrOp::Le:
+                if (a == b) return makeConstant(id, IrInst::Constant{1}), true;
+                break;
+            case IrOp::Ne: case IrOp::Lt:
+                if (a == b) return makeConstant(id, IrInst::Constant{0}), true;
+                break;
+            default:
+                break;
+        }
+        return false;
+    }
+
+    // A phi of one value is that value; a phi of equal constants is a constant.
+    bool foldPhi(ValueId id, const IrInst& inst) {
+        ValueId same = kNoValue;
+        bool one_value = true;
+        bool equal_constants = inst.count > 0;
+        const IrInst* first = nullptr;
+        for (uint32_t i = 0; i < inst.count; ++i) {
+            const ValueId operand = function_.operands[inst.first + i];
+            if (operand == id) continue;
+            const IrInst& value = function_.insts[operand];
+            if (value.op != IrOp::Const) {
+                equal_constants = false;
+            } else if (first == nullptr) {
+                first = &value;
+            } else if (bits(value.constant) != bits(first->constant)) {
+                equal_constants = false;
+            }
+            if (same != kNoValue && operand != same) one_value = false;
+            same = operand;
+        }
+        if (same == kNoValue) return false;
+        if (one_value) {
+            replace(id, same);
+            return true;
+        }
+        if (equal_constants && first != nullptr) {
+            const IrInst::Constant value = first->constant;
+            replace(id, materialize(inst.type, value));
+            return true;
+        }
+        return false;
+    }
+
+    bool foldBranch(BlockId b) {
+        IrBlock& block = function_.blocks[b];
+        if (block.terminator != Terminator::Branch) return false;
+        block.value = resolveForward(forward_, block.value);
+        const IrInst& condition = function_.insts[block.value];
+        if (condition.op != IrOp::Const) return false;
+        const BlockId taken = block.targets[condition.constant.i ? 0 : 1];
+        const BlockId dropped = block.targets[condition.constant.i ? 1 : 0];
+        block.terminator = Terminator::Jump;
+        block.targets[0] = taken;
+        block.value = kNoValue;
+        if (dropped != taken) removeEdge(function_, b, dropped);
+        ++changes_;
+        return true;
+    }
+};
+
+// Key of a pure instruction for value numbering.
+struct ExpressionKey {
+    IrOp op;
+    Type type;
+    ValueId a;
+    ValueId b;
+    uint64_t constant;
+
+    bool operator==(const ExpressionKey& other) const {
+        return op == other.op && type == other.type && a == other.a && b == other.b && constant == other.constant;
+    }
+};
+
+struct ExpressionHash {
+    size_t operator()(const ExpressionKey& key) const {
+        uint64_t hash = static_cast<uint64_t>(key.op) << 56 ^ static_cast<uint64_t>(key.type) << 48;
+        hash ^= (static_cast<uint64_t>(key.a) << 32 | key.b) * 0x9E3779B97F4A7C15ull;
+        hash ^= key.constant * 0xC2B2AE3D27D4EB4Full;
+        return static_cast<size_t>(hash ^ hash >> 29);
+    }
+};
+
+bool isCommutative(IrOp op) {
+    return op == IrOp::Add || op == IrOp::Mul || op == IrOp::BitAnd || op == IrOp::BitOr || op == IrOp::BitXor ||
+           op == IrOp::Eq || op == IrOp::Ne;
+}
+
+std::vector<std::vector<BlockId>> dominatorTree(const IrFunction& function, const std::vector<BlockId>& idom) {
+    std::vector<std::vector<BlockId>> children(function.blocks.size());
+    for (BlockId b = 1; b < function.blocks.size(); ++b) {
+        if (idom[b] != kNoValue) children[idom[b]].push_back(b);
+    }
+    return children;
+}
+
+bool dominates(const std::vector<BlockId>& idom, BlockId a, BlockId b) {
+    while (b != a && b != 0) b = idom[b];
+    return b == a;
+}
+
+} // namespace
+
+size_t foldConstants(IrFunction& function) {
+    return ConstantFolder(function).run();
+}
+
+size_t eliminateDeadCode(IrFunction& function) {
+    removeUnreachableBlocks(function);
+    std::vector<bool> live(function.insts.size(), false);
+    std::vector<ValueId> worklist;
+    const auto mark = [&](ValueId& value) {
+        if (value == kNoValue || live[value]) return;
+        live[value] = true;
+        worklist.push_back(value);
+    };
+    for (IrBlock& block : function.blocks) {
+        for (ValueId id : block.insts) {
+            if (hasSideEffect(function, function.insts[id])) mark(id);
+        }
+        if (block.terminator == Terminator::Branch || block.terminator == Terminator::Return) mark(block.value);
+    }
+    while (!worklist.empty()) {
+        const ValueId id = worklist.back();
+        worklist.pop_back();
+        forEachOperand(function, function.insts[id], mark);
+    }
+
+    size_t removed = 0;
+    for (IrBlock& block : function.blocks) {
+        const size_t before = block.insts.size();
+        block.insts.erase(std::remove_if(block.insts.begin(), block.insts.end(),
+                                         [&](ValueId id) {
+                                             if (live[id]) return false;
+                                             function.insts[id].op = IrOp::Nop;
+                                             return true;
+                                         }),
+                          block.insts.end());
+        removed += before - block.insts.size();
+    }
+    return removed;
+}
+
+size_t eliminateCommonSubexpressions(IrFunction& function) {
+    const std::vector<BlockId> idom = immediateDominators(function);
+    const std::vector<std::vector<BlockId>> children = dominatorTree(function, idom);
+    std::vector<ValueId> forward(function.insts.size(), kNoValue);
+    std::unordered_map<ExpressionKey, ValueId, ExpressionHash> available;
+    std::vector<ExpressionKey> undo;  // keys added per dominator-tree level, removed on the way back up
+    size_t merged = 0;
+
+    // Explicit preorder walk; a block's entries stay visible to the blocks it dominates.
+    struct Visit {
+        BlockId block;
+        size_t undoMark;
+        bool leaving;
+    };
+    std::vector<Visit> stack{{0, 0, false}};
+    while (!stack.empty()) {
+        const Visit visit = stack.back();
+        stack.pop_back();
+        if (visit.leaving) {
+            while (undo.size() > visit.undoMark) {
+                available.erase(undo.back());
+                undo.pop_back();
+            }
+            continue;
+        }
+        stack.push_back(Visit{visit.block, undo.size(), true});
+        for (ValueId id : function.blocks[visit.block].insts) {
+            IrInst& inst = function.insts[id];
+            forEachOperand(function, inst, [&](ValueId& v) { v = resolveForward(forward, v); });
+            if (!isPure(inst.op)) continue;
+            ExpressionKey key{inst.op, inst.type, inst.a, inst.b, inst.op == IrOp::Const ? bits(inst.constant) : 0};
+            if (isCommutative(inst.op) && key.b < key.a) std::swap(key.a, key.b);
+            const auto [it, inserted] = available.emplace(key, id);
+            if (inserted) {
+                undo.push_back(key);
+            } else {
+                forward[id] = it->second;
+                ++merged;
+            }
+        }
+        for (BlockId child : children[visit.block]) stack.push_back(Visit{child, 0, false});
+    }
+    applyForwarding(function, forward);
+    return merged;
+}
+
+size_t hoistLoopInvariants(IrFunction& function) {
+    const std::vector<BlockId> order = reversePostorder(function);
+    const std::vector<BlockId> idom = immediateDominators(function);
+
+    // Natural loops, one per header: every block that reaches a back edge
+    // source without passing through the header.
+    struct Loop {
+        BlockId header;
+        std::vector<BlockId> body;
+    };
+    std::vector<Loop> loops;
+    std::vector<int> loop_of_header(function.blocks.size(), -1);
+    for (BlockId latch : order) {
+        const IrBlock& block = function.blocks[latch];
+        for (uint32_t i = 0; i < block.successorCount(); ++i) {
+            const BlockId header = block.targets[i];
+            if (!dominates(idom, header, latch)) continue;
+            if (loop_of_header[header] < 0) {
+                loop_of_header[header] = static_cast<int>(loops.size());
+                loops.push_back(Loop{header, {header}});
+            }
+            std::vector<BlockId>& body = loops[loop_of_header[header]].body;
+            std::vector<BlockId> worklist{latch};
+            while (!worklist.empty()) {
+                const BlockId b = worklist.back();
+                worklist.pop_back();
+                if (std::find(body.begin(), body.end(), b) != body.end()) continue;
+                body.push_back(b);
+                for (BlockId pred : function.blocks[b].preds) worklist.push_back(pred);
+            }
+        }
+    }
+    std::sort(loops.begin(), loops.end(), [](const Loop& x, const Loop& y) { return x.body.size() < y.body.size(); });
+
+    size_t hoisted = 0;
+    std::vector<bool> in_loop(function.blocks.size(), false);
+    for (const Loop& loop : loops) {
+        for (BlockId b : loop.body) in_loop[b] = true;
+        BlockId preheader = kNoValue;
+        size_t outside_preds = 0;
+        for (BlockId pred : function.blocks[loop.header].preds) {
+            if (!in_loop[pred]) {
+                preheader = pred;
+                ++outside_preds;
+            }
+        }
+        if (outside_preds == 1 && function.blocks[preheader].successorCount() == 1) {
+            for (BlockId b : order) {
+                if (!in_loop[b]) continue;
+                std::vector<ValueId>& insts = function.blocks[b].insts;
+                size_t kept = 0;
+                for (ValueId id : insts) {
+                    IrInst& inst = function.insts[id];
+                    bool invariant = isPure(inst.op) && !mayTrap(function, inst);
+                    forEachOperand(function, inst, [&](ValueId& v) { invariant = invariant && !in_loop[function.insts[v].block]; });
+                    if (invariant) {
+                        inst.block = preheader;
+                        function.blocks[preheader].insts.push_back(id);
+                        ++hoisted;
+                    } else {
+                        insts[kept++] = id;
+                    }
+                }
+                insts.resize(kept);
+            }
+        }
+        for (BlockId b : loop.body) in_loop[b] = false;
+    }
+    return hoisted;
+}
+
+PassManager::PassManager() {
+    add("constfold", foldConstants);
+    add("cse", eliminateCommonSubexpressions);
+    add("licm", hoistLoopInvariants);
+    add("dce", eliminateDeadCode);
+}
+
+void PassManager::add(const std::string& name, Pass pass) {
+    passes_.push_back(pass);
+    PassStats stats;
+    stats.name = name;
+    stats_.push_back(stats);
+}
+
+bool PassManager::setEnabled(const std::string& name, bool enabled) {
+    bool found = false;
+    for (PassStats& stats : stats_) {
+        if (stats.name == name) {
+            stats.enabled = enabled;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void PassManager::disableAll() {
+    for (PassStats& stats : stats_) stats.enabled = false;
+}
+
+void PassManager::run(IrModule& module, unsigned threads) {
+    const auto count = [&module]() {
+        size_t total = 0;
+        for (const IrFunction& function : module.functions) total += function.liveInstructions();
+        return total;
+    };
+    for (size_t i = 0; i < passes_.size(); ++i) {
+        PassStats& stats = stats_[i];
+        stats.instructionsBefore = count();
+        if (stats.enabled) {
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<size_t> changes(module.functions.size(), 0);
+            forEachIndex(
+                threads, module.functions.size(), [] { return 0; },
+                [&](int, size_t f) {
+                    IrFunction& function = module.functions[f];
+                    if (!function.blocks.empty()) changes[f] = passes_[i](function);
+                });
+            for (size_t c : changes) stats.changes += c;
+            stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        stats.instructionsAfter = count();
+    }
+}
+
+void PassManager::printTimings(std::ostream& out) const {
+    out << std::left << std::setw(12) << "pass" << std::right << std::setw(10) << "changes" << std::setw(16)
+        << "instructions" << std::setw(12) << "time (ms)" << "\n";
+    for (const PassStats& stats : stats_) {
+        out << std::left << std::setw(12) << stats.name << std::right;
+        if (!stats.enabled) {
+            out << std::setw(10) << "off" << std::setw(16) << stats.instructionsAfter << "\n";
+            continue;
+        }
+        out << std::setw(10) << stats.changes << std::setw(16) << stats.instructionsAfter << std::setw(12)
+            << std::fixed << std::setprecision(3) << stats.milliseconds << "\n";
+        out.unsetf(std::ios::fixed);
+    }
+}
@@ -0,0 +1,479 @@
+#include "sema.hpp"
+#include "flat_map.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+Type typeFromToken(TokenType type) {
+    switch (type) {
+        case T_INT: return Type::Int;
+        case T_FLOAT: return Type::Float;
+        case T_STRING: return Type::String;
+        case T_BOOL: return Type::Bool;
+        default: return Type::Error;
+    }
+}
+
+const char* typeName(Type type) {
+    switch (type) {
+        case Type::None: return "void";
+        case Type::Int: return "int";
+        case Type::Float: return "float";
+        case Type::String: return "string";
+        case Type::Bool: return "bool";
+        default: return "<error>";
+    }
+}
+
+namespace {
+
+constexpr uint32_t kUnbound = UINT32_MAX;
+
+bool isNumeric(Type type) { return type == Type::Int || type == Type::Float; }
+
+// Whether a value of type `from` may be stored where `to` is expected.
+bool assignable(Type to, Type from) {
+    return to == from || (to == Type::Float && from == Type::Int) || to == Type::Error || from == Type::Error;
+}
+
+// Checks one function at a time. After declareFunctions() a Checker can be
+// copied, and each copy checks its own share of the bodies: locals are
+// interned into the copy's name table, so no state is shared.
+class Checker {
+public:
+    explicit Checker(const Program& program) : program_(program) {}
+
+    void declareFunctions() {
+        for (uint32_t i = 0; i < program_.functions.size(); ++i) {
+            const uint32_t name = program_.functions[i].name;
+            const uint32_t& index = functions_.insert(nameId(name), i);
+            if (index != i) {
+                error(name, "function '" + token(name).value + "' is already defined");
+            }
+        }
+    }
+
+    void checkFunction(const Function& function, FunctionInfo& info) {
+        function_ = &function;
+        info_ = &info;
+        info.types.assign(function.body.size(), Type::None);
+        info.symbols.assign(function.body.size(), kUnbound);
+        loopDepth_ = 0;
+
+        pushScope();
+        for (const Param& param : function.params) {
+            declareLocal(param.name, typeFromToken(param.type));
+        }
+        if (function.root != kNoNode) {
+            checkBlock(function.root, false);
+        }
+        popScope();
+    }
+
+    const Interner& names() const { return names_; }
+
+    // Errors reported since the last call.
+    std::vector<SemanticError> takeErrors() {
+        std::vector<SemanticError> errors = std::move(errors_);
+        errors_.clear();
+        return errors;
+    }
+
+private:
+    const Program& program_;
+    Interner names_;
+    std::vector<SemanticError> errors_;
+    FlatMap<uint32_t> functions_;  // name id -> function index
+
+    // The innermost binding of each name is in bindings_. Declaring a local
+    // logs the binding it hides; leaving a scope replays the log backwards,
+    // so entering and leaving scopes never copies or clears a table.
+    struct Shadowed {
+        uint32_t name;
+        uint32_t slot;
+    };
+    FlatMap<uint32_t> bindings_;  // name id -> local slot or kUnbound
+    std::vector<Shadowed> undo_;
+    std::vector<size_t> scopeUndo_;   // undo_ size when each open scope began
+    uint32_t scopeFirstSlot_ = 0;     // first slot of the innermost scope
+    std::vector<uint32_t> scopeFirstSlots_;
+
+    const Function* function_ = nullptr;
+    FunctionInfo* info_ = nullptr;
+    int loopDepth_ = 0;
+
+    const Token& token(uint32_t index) const { return program_.tokens[index]; }
+    const Node& node(NodeId id) const { return function_->body[id]; }
+
+    void error(uint32_t token_index, const std::string& message) {
+        const Token& at = token(token_index);
+        errors_.emplace_back(message, at.line, at.column);
+    }
+
+    uint32_t nameId(uint32_t token_index) { return names_.intern(token(token_index).value); }
+
+    void pushScope() {
+        scopeUndo_.push_back(undo_.size());
+        scopeFirstSlots_.push_back(scopeFirstSlot_);
+        scopeFirstSlot_ = static_cast<uint32_t>(info_->locals.size());
+    }
+
+    void popScope() {
+        for (size_t i = undo_.size(); i > scopeUndo_.back(); --i) {
+            bindings_.insert(undo_[i - 1].name, kUnbound) = undo_[i - 1].slot;
+        }
+        undo_.resize(scopeUndo_.back());
+        scopeUndo_.pop_back();
+        scopeFirstSlot_ = scopeFirstSlots_.back();
+        scopeFirstSlots_.pop_back();
+    }
+
+    uint32_t declareLocal(uint32_t name_token, Type type) {
+        const uint32_t name = nameId(name_token);
+        uint32_t& binding = bindings_.insert(name, kUnbound);
+        if (binding != kUnbound && binding >= scopeFirstSlot_) {
+            error(name_token, "'" + token(name_token).value + "' is already declared in this scope");
+        }
+        undo_.push_back(Shadowed{name, binding});
+        binding = static_cast<uint32_t>(info_->locals.size());
+        info_->locals.push_back(type);
+        return binding;
+    }
+
+    uint32_t lookupLocal(uint32_t name_token) {
+        const uint32_t* slot = bindings_.find(nameId(name_token));
+        return slot != nullptr ? *slot : kUnbound;
+    }
+
+    void checkBlock(NodeId id, bool new_scope) {
+        const Node& block = node(id);
+        if (new_scope) pushScope();
+        for (uint32_t i = 0; i < block.b; ++i) {
+            checkStatement(function_->body.list(block.a)[i]);
+        }
+        if (new_scope) popScope();
+    }
+
+    // A branch or loop body that is a single statement still gets its own scope.
+    void checkNested(NodeId id) {
+        pushScope();
+        checkStatement(id);
+        popScope();
+    }
+
+    void checkCondition(NodeId id) {
+        const Type type = check(id);
+        if (type != Type::Bool && type != Type::Error) {
+            error(node(id).token, std::string("condition must be bool, not ") + typeName(type));
+        }
+    }
+
+    void checkStatement(NodeId id) {
+        const Node& stmt = node(id);
+        switch (stmt.kind) {
+            case NodeKind::Block:
+                checkBlock(id, true);
+                break;
+            case NodeKind::VarDecl: {
+                const Type type = typeFromToken(static_cast<TokenType>(stmt.b));
+                if (stmt.a != kNoNode) {
+                    const Type value = check(stmt.a);
+                    if (!assignable(type, value)) {
+                        error(node(stmt.a).token, std::string("cannot initialize ") + typeName(type) + " '" +
+                                                      token(stmt.token).value + "' with " + typeName(value));
+                    }
+                }
+                // Declared after the initializer, so `int x = x;` refers to an outer x.
+                info_->symbols[id] = declareLocal(stmt.token, type);
+                break;
+            }
+            case NodeKind::If:
+                checkCondition(stmt.a);
+                checkNested(stmt.b);
+                if (stmt.c != kNoNode) checkNested(stmt.c);
+                break;
+            case NodeKind::While:
+                checkCondition(stmt.a);
+                ++loopDepth_;
+                checkNested(stmt.b);
+                --loopDepth_;
+                break;
+            case NodeKind::For:
+                pushScope();
+                if (stmt.a != kNoNode) checkStatement(stmt.a);
+                if (stmt.b != kNoNode) checkCondition(stmt.b);
+                if (stmt.c != kNoNode) check(stmt.c);
+                ++loopDepth_;
+                checkNested(stmt.d);
+                --loopDepth_;
+                popScope();
+                break;
+            case NodeKind::Return: {
+                const Type expected = typeFromToken(function_->returnType);
+                if (stmt.a == kNoNode) {
+                    error(stmt.token, std::string("function returning ") + typeName(expected) + " must return a value");
+                    break;
+                }
+                const Type value = check(stmt.a);
+                if (!assignable(expected, value)) {
+                    error(node(stmt.a).token, std::string("cannot return ") + typeName(value) + " from function returning " +
+                                                  typeName(expected));
+                }
+                break;
+            }
+            case NodeKind::Break:
+            case NodeKind::Continue:
+                if (loopDepth_ == 0) {
+                    error(stmt.token, "'" + token(stmt.token).value + "' outside of a loop");
+                }
+                break;
+            case NodeKind::ExprStmt:
+                check(stmt.a);
+                break;
+            default:
+                check(id);
+                break;
+        }
+    }
+
+    Type check(NodeId id) {
+        const Type type = checkExpression(id);
+        info_->types[id] = type;
+        return type;
+    }
+
+    // The node a value can be stored into, or an error for anything else.
+    Type checkTarget(NodeId id, const char* what) {
+        const Node& target = node(id);
+        if (target.kind != NodeKind::Name) {
+            const Type type = check(id);
+            if (type != Type::Error) error(target.token, std::string("cannot ") + what + " this expression");
+            return Type::Error;
+        }
+        return check(id);
+    }
+
+    Type checkExpression(NodeId id) {
+        const Node& expr = node(id);
+        const Token& op = token(expr.token);
+        switch (expr.kind) {
+            case NodeKind::IntLit: {
+                errno = 0;
+                std::strtoll(op.value.c_str(), nullptr, 0);
+                if (errno == ERANGE) {
+                    error(expr.token, "integer literal " + op.value + " is out of range");
+                    return Type::Error;
+                }
+                return Type::Int;
+            }
+            case NodeKind::FloatLit: return Type::Float;
+            case NodeKind::StringLit: return Type::String;
+            case NodeKind::BoolLit: return Type::Bool;
+            case NodeKind::Name: {
+                const uint32_t slot = lookupLocal(expr.token);
+                if (slot == kUnbound) {
+                    const bool is_function = functions_.find(nameId(expr.token)) != nullptr;
+                    error(expr.token, is_function ? "function '" + op.value + "' can only be called"
+                                                  : "undeclared identifier '" + op.value + "'");
+                    return Type::Error;
+                }
+                info_->symbols[id] = slot;
+                return info_->locals[slot];
+            }
+            case NodeKind::Unary:
+                return checkUnary(expr, op);
+            case NodeKind::Postfix: {
+                const Type type = checkTarget(expr.a, op.type == T_INCREMENT ? "increment" : "decrement");
+                if (type != Type::Error && !isNumeric(type)) {
+                    error(expr.token, "'" + op.value + "' needs an int or float, not " + typeName(type));
+                    return Type::Error;
+                }
+                return type;
+            }
+            case NodeKind::Binary:
+                return checkBinary(expr, op);
+            case NodeKind::Assign: {
+                const Type target = checkTarget(expr.a, "assign to");
+                const Type value = check(expr.b);
+                if (target == Type::Error || value == Type::Error) return Type::Error;
+                if (op.type != T_ASSIGNOP) {
+                    const bool appends = op.type == T_PLUS_ASSIGN && target == Type::String && value == Type::String;
+                    if (!appends && !(isNumeric(target) && isNumeric(value))) {
+                        error(expr.token, "invalid operands to '" + op.value + "' (" + typeName(target) + " and " +
+                                              typeName(value) + ")");
+                        return Type::Error;
+                    }
+                }
+                if (!assignable(target, value)) {
+                    error(expr.token, std::string("cannot assign ") + typeName(value) + " to " + typeName(target));
+                    return Type::Error;
+                }
+                return target;
+            }
+            case NodeKind::Ternary: {
+                checkCondition(expr.a);
+                const Type then_type = check(expr.b);
+                const Type else_type = check(expr.c);
+                if (then_type == Type::Error || else_type == Type::Error) return Type::Error;
+                if (then_type == else_type) return then_type;
+                if (isNumeric(then_type) && isNumeric(else_type)) return Type::Float;
+                error(expr.token, std::string("conditional branches have different types (") + typeName(then_type) +
+                                      " and " + typeName(else_type) + ")");
+                return Type::Error;
+            }
+            case NodeKind::Call:
+                return checkCall(id, expr);
+            case NodeKind::Index:
+            case NodeKind::Member:
+                check(expr.a);
+                if (expr.kind == NodeKind::Index) check(expr.b);
+                error(expr.token, expr.kind == NodeKind::Index ? "indexing is not supported"
+                                                               : "member access is not supported");
+                return Type::Error;
+            default:
+                return Type::Error;
+        }
+    }
+
+    Type checkUnary(const Node& expr, const Token& op) {
+        if (op.type == T_INCREMENT || op.type == T_DECREMENT) {
+            const Type type = checkTarget(expr.a, op.type == T_INCREMENT ? "increment" : "decrement");
+            if (type != Type::Error && !isNumeric(type)) {
+                error(expr.token, "'" + op.value + "' needs an int or float, not " + typeName(type));
+                return Type::Error;
+            }
+            return type;
+        }
+        const Type operand = check(expr.a);
+        if (operand == Type::Error) return Type::Error;
+        const bool ok = op.type == T_NOT ? operand == Type::Bool
+                      : op.type == T_BITNOT ? operand == Type::Int
+                      : isNumeric(operand);
+        if (!ok) {
+            error(expr.token, "invalid operand to unary '" + op.value + "' (" + typeName(operand) + ")");
+            return Type::Error;
+        }
+        return operand;
+    }
+
+    Type checkBinary(const Node& expr, const Token& op) {
+        const Type left = check(expr.a);
+        const Type right = check(expr.b);
+        if (left == Type::Error || right == Type::Error) return Type::Error;
+
+        const bool numbers = isNumeric(left) && isNumeric(right);
+        const Type arithmetic = left == Type::Float || right == Type::Float ? Type::Float : Type::Int;
+        Type result = Type::Error;
+        switch (op.type) {
+            case T_PLUS:
+                if (left == Type::String && right == Type::String) result = Type::String;
+                else if (numbers) result = arithmetic;
+                break;
+            case T_MINUS: case T_MULT: case T_DIV:
+                if (numbers) result = arithmetic;
+                break;
+            case T_MOD: case T_BITAND: case T_BITOR: case T_BITXOR: case T_LEFTSHIFT: case T_RIGHTSHIFT:
+                if (left == Type::Int && right == Type::Int) result = Type::Int;
+                break;
+            case T_LT: case T_GT: case T_LTE: case T_GTE:
+                if (numbers || (left == Type::String && right == Type::String)) result = Type::Bool;
+                break;
+            case T_EQUALSOP: case T_NEQ:
+                if (numbers || left == right) result = Type::Bool;
+                break;
+            case T_AND: case T_OR:
+                if (left == Type::Bool && right == Type::Bool) result = Type::Bool;
+                break;
+            default:
+                break;
+        }
+        if (result == Type::Error) {
+            error(expr.token, "invalid operands to '" + op.value + "' (" + typeName(left) + " and " + typeName(right) + ")");
+        }
+        return result;
+    }
+
+    Type checkCall(NodeId id, const Node& call) {
+        const uint32_t* arguments = function_->body.list(call.b);
+        std::vector<Type> types(call.c);
+        for (uint32_t i = 0; i < call.c; ++i) {
+            types[i] = check(arguments[i]);
+        }
+
+        const Node& callee = node(call.a);
+        if (callee.kind != NodeKind::Name) {
+            check(call.a);
+            error(call.token, "only named functions can be called");
+            return Type::Error;
+        }
+        const std::string& name = token(callee.token).value;
+        if (lookupLocal(callee.token) != kUnbound) {
+            error(callee.token, "'" + name + "' is a variable, not a function");
+            return Type::Error;
+        }
+
+        const uint32_t* index = functions_.find(nameId(callee.token));
+        if (index == nullptr) {
+            // User functions may reuse a builtin's name; the builtins are only found after them.
+            if (name == "print") {
+                info_->symbols[id] = kBuiltinPrint;
+                return Type::Int;
+            }
+            if (name == "len") {
+                info_->symbols[id] = kBuiltinLen;
+                if (call.c != 1 || (types[0] != Type::String && types[0] != Type::Error)) {
+                    error(call.token, "len() takes one string");
+                    return Type::Error;
+                }
+                return Type::Int;
+            }
+            error(callee.token, "call to undefined function '" + name + "'");
+            return Type::Error;
+        }
+
+        const Function& target = program_.functions[*index];
+        info_->symbols[id] = *index;
+        if (target.params.size() != call.c) {
+            error(call.token, "'" + name + "' takes " + std::to_string(target.params.size()) + " argument" +
+                                  (target.params.size() == 1 ? "" : "s") + ", " + std::to_string(call.c) + " given");
+            return typeFromToken(target.returnType);
+        }
+        for (uint32_t i = 0; i < call.c; ++i) {
+            const Type expected = typeFromToken(target.params[i].type);
+            if (!assignable(expected, types[i])) {
+                error(node(arguments[i]).token, "argument " + std::to_string(i + 1) + " of '" + name + "' must be " +
+                                                    typeName(expected) + ", not " + typeName(types[i]));
+            }
+        }
+        return typeFromToken(target.returnType);
+    }
+};
+
+} // namespace
+
+SemanticModel analyze(const Program& program, unsigned threads) {
+    SemanticModel model;
+    Checker declarations(program);
+    declarations.declareFunctions();
+    model.errors = declarations.takeErrors();
+    const size_t count = program.functions.size();
+    model.functions.resize(count);
+    std::vector<std::vector<SemanticError>> errors(count);
+    forEachIndex(
+        threads, count, [&declarations] { return declarations; },
+        [&](Checker& checker, size_t i) {
+            if (!program.functions[i].bodyParsed) return;
+            checker.checkFunction(program.functions[i], model.functions[i]);
+            errors[i] = checker.takeErrors();
+        });
+
+    model.names = declarations.names();
+    for (std::vector<SemanticError>& function_errors : errors) {
+        model.errors.insert(model.errors.end(), function_errors.begin(), function_errors.end());
+    }
+    std::stable_sort(model.errors.begin(), model.errors.end(), [](const SemanticError& a, const SemanticError& b) {
+        return a.line() != b.line() ? a.line() < b.line() : a.column() < b.column();
+    });
+    return model;
+}
@@ -0,0 +1,247 @@
+#include "vm.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <sys/resource.h>
+#include <utility>
+
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+namespace {
+
+constexpr size_t kScalarStack = 1 << 20;
+constexpr size_t kStringStack = 1 << 16;
+constexpr size_t kFlushThreshold = 1 << 16;
+constexpr size_t kMaxJitStack = 4 << 20;
+
+// Integer arithmetic wraps like the hardware instead of being undefined.
+int64_t wrapAdd(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+int64_t wrapSub(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+int64_t wrapMul(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+
+} // namespace
+
+void appendInt(std::string& out, int64_t value) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void appendFloat(std::string& out, double value) {
+    char digits[32];
+    const int length = std::snprintf(digits, sizeof(digits), "%g", value);
+    out.append(digits, static_cast<size_t>(length));
+}
+
+VM::VM(const BytecodeModule& module, std::ostream& out)
+    : module_(module), out_(out), scalars_(kScalarStack), strings_(kStringStack), jit_(module),
+      jitThreshold_(JIT_SUPPORTED ? kDefaultJitThreshold : 0), callCounts_(module.functions.size(), 0) {}
+
+void VM::flush() {
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+RuntimeError VM::jitError(int status) const {
+    const std::string& name = module_.functions[jitRuntime_.failed].name;
+    if (status == kJitDivisionByZero) return RuntimeError("division by zero in function '" + name + "'");
+    return RuntimeError("stack overflow in function '" + name + "'");
+}
+
+int64_t VM::run(uint32_t entry) {
+    // Compiled calls may use half of what is left of the native stack.
+    size_t native_stack = kMaxJitStack * 2;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        native_stack = std::min<size_t>(native_stack, limit.rlim_cur);
+    }
+    const uintptr_t stack_top = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    jitRuntime_.stackLimit = reinterpret_cast<const char*>(stack_top - native_stack / 2);
+    jitRuntime_.scalarEnd = scalars_.data() + scalars_.size();
+    jitRuntime_.entries = jit_.entries();
+
+    const CompiledFunction* function = &module_.functions[entry];
+    const Instruction* code = function->code.data();
+    const Instruction* pc = code;
+    const Slot* constants = module_.constants.data();
+    size_t scalar_base = 0;
+    size_t string_base = 0;
+    Slot* r = scalars_.data();
+    std::string* s = strings_.data();
+    frames_.clear();
+
+#if VM_THREADED
+    static const void* const labels[] = {
+#define BYTECODE_LABEL(name) &&op_##name,
+        BYTECODE_OPCODES(BYTECODE_LABEL)
+#undef BYTECODE_LABEL
+    };
+#define VM_CASE(name) case Op::name: op_##name:
+#define VM_DISPATCH() goto *labels[static_cast<size_t>(pc->op)]
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_DISPATCH() goto dispatch
+#endif
+#define VM_NEXT() do { ++pc; VM_DISPATCH(); } while (0)
+#define VM_NEXT2() do { pc += 2; VM_DISPATCH(); } while (0)
+#define VM_JUMP(target) do { pc = code + (target); VM_DISPATCH(); } while (0)
+
+    try {
+#if VM_THREADED
+        VM_DISPATCH();
+#else
+    dispatch:
+#endif
+        switch (pc->op) {
+            VM_CASE(Mov) r[pc->a] = r[pc->b]; VM_NEXT();
+            VM_CASE(MovS) if (pc->a != pc->b) s[pc->a] = s[pc->b]; VM_NEXT();
+            VM_CASE(LoadK) r[pc->a] = constants[pc->bx()]; VM_NEXT();
+            VM_CASE(LoadS) s[pc->a] = module_.strings[pc->bx()]; VM_NEXT();
+            VM_CASE(IToF) r[pc->a].f = static_cast<double>(r[pc->b].i); VM_NEXT();
+
+            VM_CASE(AddI) r[pc->a].i = wrapAdd(r[pc->b].i, r[pc->c].i); VM_NEXT();
+            VM_CASE(SubI) r[pc->a].i = wrapSub(r[pc->b].i, r[pc->c].i); VM_NEXT();
+            VM_CASE(MulI) r[pc->a].i = wrapMul(r[pc->b].i, r[pc->c].i); VM_NEXT();
+            VM_CASE(DivI) {
+                const int64_t divisor = r[pc->c].i;
+                if (divisor == 0) throw RuntimeError("division by zero in function '" + function->name + "'");
+                r[pc->a].i = divisor == -1 ? wrapSub(0, r[pc->b].i) : r[pc->b].i / divisor;
+                VM_NEXT();
+            }
+            VM_CASE(ModI) {
+                const int64_t divisor = r[pc->c].i;
+                if (divisor == 0) throw RuntimeError("division by zero in function '" + function->name + "'");
+                r[pc->a].i = divisor == -1 ? 0 : r[pc->b].i % divisor;
+                VM_NEXT();
+            }
+            VM_CASE(AddIK) r[pc->a].i = wrapAdd(r[pc->b].i, static_cast<int16_t>(pc->c)); VM_NEXT();
+
+            VM_CASE(AddF) r[pc->a].f = r[pc->b].f + r[pc->c].f; VM_NEXT();
+            VM_CASE(SubF) r[pc->a].f = r[pc->b].f - r[pc->c].f; VM_NEXT();
+            VM_CASE(MulF) r[pc->a].f = r[pc->b].f * r[pc->c].f; VM_NEXT();
+            VM_CASE(DivF) r[pc->a].f = r[pc->b].f / r[pc->c].f; VM_NEXT();
+
+            VM_CASE(NegI) r[pc->a].i = wrapSub(0, r[pc->b].i); VM_NEXT();
+            VM_CASE(NegF) r[pc->a].f = -r[pc->b].f; VM_NEXT();
+            VM_CASE(Not) r[pc->a].i = !r[pc->b].i; VM_NEXT();
+            VM_CASE(BitNot) r[pc->a].i = ~r[pc->b].i; VM_NEXT();
+            VM_CASE(BitAnd) r[pc->a].i = r[pc->b].i & r[pc->c].i; VM_NEXT();
+            VM_CASE(BitOr) r[pc->a].i = r[pc->b].i | r[pc->c].i; VM_NEXT();
+            VM_CASE(BitXor) r[pc->a].i = r[pc->b].i ^ r[pc->c].i; VM_NEXT();
+            VM_CASE(Shl) r[pc->a].i = static_cast<int64_t>(static_cast<uint64_t>(r[pc->b].i) << (r[pc->c].i & 63)); VM_NEXT();
+            VM_CASE(Shr) r[pc->a].i = r[pc->b].i >> (r[pc->c].i & 63); VM_NEXT();
+
+            VM_CASE(LtI) r[pc->a].i = r[pc->b].i < r[pc->c].i; VM_NEXT();
+            VM_CASE(LeI) r[pc->a].i = r[pc->b].i <= r[pc->c].i; VM_NEXT();
+            VM_CASE(EqI) r[pc->a].i = r[pc->b].i == r[pc->c].i; VM_NEXT();
+            VM_CASE(NeI) r[pc->a].i = r[pc->b].i != r[pc->c].i; VM_NEXT();
+            VM_CASE(LtF) r[pc->a].i = r[pc->b].f < r[pc->c].f; VM_NEXT();
+            VM_CASE(LeF) r[pc->a].i = r[pc->b].f <= r[pc->c].f; VM_NEXT();
+            VM_CASE(EqF) r[pc->a].i = r[pc->b].f == r[pc->c].f; VM_NEXT();
+            VM_CASE(NeF) r[pc->a].i = r[pc->b].f != r[pc->c].f; VM_NEXT();
+            VM_CASE(LtS) r[pc->a].i = s[pc->b] < s[pc->c]; VM_NEXT();
+            VM_CASE(LeS) r[pc->a].i = s[pc->b] <= s[pc->c]; VM_NEXT();
+            VM_CASE(EqS) r[pc->a].i = s[pc->b] == s[pc->c]; VM_NEXT();
+            VM_CASE(NeS) r[pc->a].i = s[pc->b] != s[pc->c]; VM_NEXT();
+
+            VM_CASE(Concat) {
+                std::string& dest = s[pc->a];
+                if (pc->a == pc->b) {
+                    dest += s[pc->c];
+                } else if (pc->a == pc->c) {
+                    dest.insert(0, s[pc->b]);
+                } else {
+                    dest.assign(s[pc->b]);
+                    dest += s[pc->c];
+                }
+                VM_NEXT();
+            }
+            VM_CASE(Append) s[pc->a] += s[pc->b]; VM_NEXT();
+            VM_CASE(Len) r[pc->a].i = static_cast<int64_t>(s[pc->b].size()); VM_NEXT();
+
+            VM_CASE(Jmp) VM_JUMP(pc->bx());
+            VM_CASE(JmpF) if (!r[pc->a].i) VM_JUMP(pc->bx()); VM_NEXT();
+            VM_CASE(JmpT) if (r[pc->a].i) VM_JUMP(pc->bx()); VM_NEXT();
+
+            VM_CASE(Call) {
+                const CompiledFunction* callee = &module_.functions[pc->bx()];
+                const size_t callee_scalars = scalar_base + pc[1].a;
+                const size_t callee_strings = string_base + pc[1].b;
+                if (callee_scalars + callee->scalarRegisters > scalars_.size() ||
+                    callee_strings + callee->stringRegisters > strings_.size()) {
+                    throw RuntimeError("stack overflow in function '" + callee->name + "'");
+                }
+                if (jitThreshold_ != 0) {
+                    const uint32_t index = pc->bx();
+                    JitEntry compiled = jit_.entry(index);
+                    if (compiled == nullptr && ++callCounts_[index] == jitThreshold_ && jit_.compile(index)) {
+                        compiled = jit_.entry(index);
+                    }
+                    if (compiled != nullptr) {
+                        const int status = compiled(r + pc[1].a, &jitRuntime_);
+                        if (status != kJitOk) throw jitError(status);
+                        r[pc->a].i = jitRuntime_.result;
+                        VM_NEXT2();
+                    }
+                }
+                frames_.push_back(Frame{function, pc + 2, scalar_base, string_base, pc->a});
+                function = callee;
+                code = callee->code.data();
+                scalar_base = callee_scalars;
+                string_base = callee_strings;
+                r = scalars_.data() + scalar_base;
+                s = strings_.data() + string_base;
+                VM_JUMP(0);
+            }
+            VM_CASE(Ret)
+            VM_CASE(RetS) {
+                if (frames_.empty()) {
+                    flush();
+                    return pc->op == Op::Ret ? r[pc->a].i : 0;
+                }
+                const Frame frame = frames_.back();
+                frames_.pop_back();
+                Slot* caller_r = scalars_.data() + frame.scalarBase;
+                std::string* caller_s = strings_.data() + frame.stringBase;
+                if (pc->op == Op::Ret) {
+                    caller_r[frame.result] = r[pc->a];
+                } else {
+                    caller_s[frame.result].swap(s[pc->a]);  // keeps both buffers allocated for reuse
+                }
+                function = frame.function;
+                code = function->code.data();
+                scalar_base = frame.scalarBase;
+                string_base = frame.stringBase;
+                r = caller_r;
+                s = caller_s;
+                pc = frame.returnPc;
+                VM_DISPATCH();
+            }
+
+            VM_CASE(Print) {
+                switch (pc->b) {
+                    case kPrintInt: appendInt(buffer_, r[pc->a].i); break;
+                    case kPrintFloat: appendFloat(buffer_, r[pc->a].f); break;
+                    case kPrintBool: buffer_ += r[pc->a].i ? "true" : "false"; break;
+                    default: if (pc->c != 2) buffer_ += s[pc->a]; break;
+                }
+                buffer_ += pc->c != 0 ? '\n' : ' ';
+                if (buffer_.size() >= kFlushThreshold) flush();
+                VM_NEXT();
+            }
+        }
+    } catch (...) {
+        flush();
+        throw;
+    }
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_NEXT2
+#undef VM_JUMP
+    return 0;
+}
@@ -0,0 +1,81 @@
+#!/bin/sh
+# Lexes generated hostile inputs (huge literals, unterminated constructs,
+# long runs of junk) at a quarter of the size and at full size. Fails if any
+# of them crashes the lexer, if the full-size run takes more than MAX_GROWTH
+# (default 6) times as long as the quarter-size one, or if it takes more than
+# MAX_NS_PER_BYTE (default 10000) per input byte. Linear matching grows about
+# 4x; quadratic matching grows about 16x and recursion shows up as a crash.
+# Usage: adversarial.sh [path/to/lexer] [bytes]
+LEXER=${1:-./build/lexer}
+BYTES=${2:-1048576}
+MAX_GROWTH=${MAX_GROWTH:-6}
+MAX_NS_PER_BYTE=${MAX_NS_PER_BYTE:-10000}
+INPUT=$(mktemp /tmp/adversarial.XXXXXX)
+failed=0
+
+repeat() {
+    yes "$1" | head -n "$2" | tr -d '\n'
+}
+
+# generate <name> <bytes>: writes the input called <name> to $INPUT.
+generate() {
+    case "$1" in
+        string-literal) { printf '"'; repeat a "$2"; printf '"'; } ;;
+        unterminated-escapes) { printf '"'; repeat '\"' $(($2 / 2)); } ;;
+        unterminated-string) { printf '"'; repeat a "$2"; } ;;
+        unterminated-comment) { printf '/*'; repeat x "$2"; } ;;
+        line-comment) { printf '//'; repeat x "$2"; } ;;
+        at-signs) repeat @ "$2" ;;
+        invalid-identifier) { printf 'ab'; repeat @ "$2"; } ;;
+        identifier) repeat a "$2" ;;
+        dangling-floats) repeat 1. $(($2 / 2)) ;;
+        ordinary-code) repeat 'int x = 0x1f + 2.5e3; // ok ' $(($2 / 30)) ;;
+    esac > "$INPUT"
+}
+
+# run <expected exit status>: lexes $INPUT and sets $ns and $size.
+run() {
+    size=$(wc -c < "$INPUT")
+    start=$(date +%s%N)
+    "$LEXER" --format=binary "$INPUT" > /dev/null 2>&1
+    status=$?
+    end=$(date +%s%N)
+    ns=$((end - start))
+    [ "$status" -eq "$1" ] || verdict="FAIL (exit status $status, expected $1)"
+}
+
+# check <name> <expected exit status>
+check() {
+    verdict=ok
+    generate "$1" $((BYTES / 4))
+    run "$2"
+    small_ns=$ns
+    generate "$1" "$BYTES"
+    run "$2"
+    # Below a millisecond, process start-up dominates the small run.
+    [ "$small_ns" -gt 1000000 ] || small_ns=1000000
+    growth_x10=$((ns * 10 / small_ns))
+    ns_per_byte=$((ns / (size > 0 ? size : 1)))
+    if [ "$verdict" = ok ] && [ "$growth_x10" -gt $((MAX_GROWTH * 10)) ]; then
+        verdict="FAIL (grew more than ${MAX_GROWTH}x for 4x the input)"
+    elif [ "$verdict" = ok ] && [ "$ns_per_byte" -gt "$MAX_NS_PER_BYTE" ]; then
+        verdict="FAIL (over $MAX_NS_PER_BYTE ns/byte)"
+    fi
+    [ "$verdict" = ok ] || failed=1
+    printf '%-22s %9s bytes %8s ms %8s ns/byte %4s.%sx  %s\n' "$1" "$size" "$((ns / 1000000))" \
+        "$ns_per_byte" $((growth_x10 / 10)) $((growth_x10 % 10)) "$verdict"
+}
+
+check string-literal 0
+check unterminated-escapes 0
+check unterminated-string 0
+check unterminated-comment 1
+check line-comment 0
+check at-signs 0
+check invalid-identifier 0
+check identifier 0
+check dangling-floats 0
+check ordinary-code 0
+
+rm -f "$INPUT"
+exit $failed
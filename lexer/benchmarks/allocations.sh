@@ -0,0 +1,23 @@
+#!/bin/sh
+# Counts heap allocations while lexing a generated file and fails when the
+# tokenize phase makes more than the budget per token. Needs a lexer
+# configured with -DLEXER_ALLOC_STATS=ON.
+# Usage: allocations.sh [path/to/lexer] [allocations per token]
+LEXER=${1:-./build-alloc/lexer}
+BUDGET=${2:-0.01}
+INPUT=$(mktemp /tmp/allocations.XXXXXX)
+
+i=0
+while [ "$i" -lt 5000 ]; do
+    echo "fn int f$i(int a, float b) { int total = a * $i + 0x1f;"
+    echo "    string s = \"item $i\"; while (total < 1000) { total += a << 2; } return total; } // done"
+    i=$((i + 1))
+done > "$INPUT"
+
+status=0
+for mode in "" --pipeline; do
+    echo "== ${mode:-default} =="
+    "$LEXER" --alloc-stats --alloc-budget="$BUDGET" $mode "$INPUT" > /dev/null || status=1
+done
+rm -f "$INPUT"
+exit $status
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Lexes a generated tree of files once per file and then in one batch run
+# with each I/O backend, and checks that the batch output matches. Drop the
+# page cache first (as root: echo 3 > /proc/sys/vm/drop_caches) to measure
+# cold reads.
+# Usage: files.sh [path/to/lexer] [files]
+LEXER=${1:-./build/lexer}
+FILES=${2:-500}
+TREE=$(mktemp -d /tmp/files.XXXXXX)
+
+i=0
+while [ "$i" -lt "$FILES" ]; do
+    for j in 1 2 3 4 5 6 7 8; do
+        echo "fn int f${i}_$j(int a, float b) { int total = a * $j + 0x1f; // step $j"
+        echo "    while (total < 1000) { total += a << 2; } return total; }"
+    done > "$TREE/f$i.txt"
+    i=$((i + 1))
+done
+ls "$TREE"/*.txt > "$TREE/list"
+
+start=$(date +%s%N)
+while read -r file; do
+    echo "==> $file <=="
+    "$LEXER" "$file"
+done < "$TREE/list" > "$TREE/one-by-one.out"
+end=$(date +%s%N)
+printf '%-12s %8s ms\n' "one-by-one" "$(( (end - start) / 1000000 ))"
+
+for io in uring pread; do
+    start=$(date +%s%N)
+    "$LEXER" --io=$io --files-from="$TREE/list" > "$TREE/batch.out" || echo "   --io=$io failed"
+    end=$(date +%s%N)
+    printf '%-12s %8s ms' "--io=$io" "$(( (end - start) / 1000000 ))"
+    cmp -s "$TREE/one-by-one.out" "$TREE/batch.out" && echo "  identical" || echo "  output differs"
+done
+rm -rf "$TREE"
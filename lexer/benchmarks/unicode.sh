@@ -0,0 +1,33 @@
+#!/bin/sh
+# Checks that identifiers with non-ASCII letters split into tokens the same
+# way as their ASCII counterparts, including invalid identifiers.
+# Usage: unicode.sh [path/to/lexer]
+LEXER=${1:-./build/lexer}
+INPUT=$(mktemp /tmp/unicode.XXXXXX)
+failed=0
+
+# expect <source> <tokens>: the tokens are TYPE:text, space-separated, T_EOF left out.
+expect() {
+    printf '%s\n' "$1" > "$INPUT"
+    actual=$("$LEXER" "$INPUT" 2> /dev/null | sed -n 's/^Token(\(T_[A-Z_]*\), "\(.*\)") at line .*/\1:\2/p' |
+             grep -v '^T_EOF:' | tr '\n' ' ' | sed 's/ $//')
+    if [ "$actual" = "$2" ]; then
+        printf 'ok    %s\n' "$1"
+    else
+        printf 'FAIL  %s\n      expected: %s\n      actual:   %s\n' "$1" "$2" "$actual"
+        failed=1
+    fi
+}
+
+expect 'int a*2;' 'T_INT:int T_IDENTIFIER:a T_MULT:* T_INTLIT:2 T_SEMICOLON:;'
+expect 'int ä*2;' 'T_INT:int T_IDENTIFIER:ä T_MULT:* T_INTLIT:2 T_SEMICOLON:;'
+expect 'ab@c@d' 'T_INVALID_IDENTIFIER:ab@c T_UNKNOWN:@ T_IDENTIFIER:d'
+expect 'äb@c@d' 'T_INVALID_IDENTIFIER:äb@c T_UNKNOWN:@ T_IDENTIFIER:d'
+expect 'ab*c' 'T_INVALID_IDENTIFIER:ab*c'
+expect 'äb*c' 'T_INVALID_IDENTIFIER:äb*c'
+expect 'ä@' 'T_IDENTIFIER:ä T_UNKNOWN:@'
+expect 'größe = straße+1;' 'T_IDENTIFIER:größe T_ASSIGNOP:= T_IDENTIFIER:straße T_PLUS:+ T_INTLIT:1 T_SEMICOLON:;'
+expect 'xä€y+1' 'T_INVALID_IDENTIFIER:xä€y T_PLUS:+ T_INTLIT:1'
+
+rm -f "$INPUT"
+exit $failed
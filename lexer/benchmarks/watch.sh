@@ -0,0 +1,42 @@
+#!/bin/sh
+# Starts `lexer --watch` on a generated tree, saves one file and measures how
+# long the updated tokens take to appear, next to a full batch run over the
+# tree. The save should cost about the same whatever the size of the tree.
+# Usage: watch.sh [path/to/lexer] [files]
+LEXER=${1:-./build/lexer}
+FILES=${2:-2000}
+TREE=$(mktemp -d /tmp/watch.XXXXXX)
+mkdir "$TREE/src"
+
+i=0
+while [ "$i" -lt "$FILES" ]; do
+    for j in 1 2 3 4 5 6 7 8; do
+        echo "fn int f${i}_$j(int a, float b) { int total = a * $j + 0x1f; // step $j"
+        echo "    while (total < 1000) { total += a << 2; } return total; }"
+    done > "$TREE/src/f$i.txt"
+    i=$((i + 1))
+done
+ls "$TREE"/src/*.txt > "$TREE/list"
+
+start=$(date +%s%N)
+"$LEXER" --files-from="$TREE/list" > /dev/null
+end=$(date +%s%N)
+printf '%-16s %8s ms\n' "full run" "$(( (end - start) / 1000000 ))"
+
+"$LEXER" --watch="$TREE/src" --debounce=5 > "$TREE/out" 2> "$TREE/err" &
+WATCH=$!
+until grep -q '^Watching' "$TREE/err"; do sleep 0.05; done
+printf '%-16s %8s lines\n' "initial output" "$(wc -l < "$TREE/out")"
+
+for n in 1 2 3; do
+    : > "$TREE/out"
+    start=$(date +%s%N)
+    echo "fn int edited$n() { return $n; }" >> "$TREE/src/f0.txt"
+    until grep -q "edited$n" "$TREE/out"; do :; done
+    end=$(date +%s%N)
+    printf '%-16s %8s ms\n' "save $n" "$(( (end - start) / 1000000 ))"
+done
+
+kill "$WATCH"
+wait "$WATCH"
+rm -rf "$TREE"
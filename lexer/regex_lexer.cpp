@@ -1,24 +1,9 @@
 
 #include <bits/stdc++.h>
 #include <regex>
+#include "regex_lexer/include/token_types.hpp"
 using namespace std;
 
-enum TokenType {
-    T_FUNCTION, T_INT, T_FLOAT, T_STRING, T_BOOL, T_RETURN,
-    T_IF, T_ELSE, T_FOR, T_WHILE, T_BREAK, T_CONTINUE,
-    T_IDENTIFIER, T_INTLIT, T_FLOATLIT, T_STRINGLIT, T_BOOLLIT,
-    T_ASSIGNOP, T_EQUALSOP, T_PLUS, T_MINUS, T_MULT, T_DIV, T_MOD,
-    T_LT, T_GT, T_LTE, T_GTE, T_NEQ,
-    T_AND, T_OR, T_NOT,
-    T_BITAND, T_BITOR, T_BITXOR, T_BITNOT, T_LEFTSHIFT, T_RIGHTSHIFT,
-    T_PARENL, T_PARENR, T_BRACEL, T_BRACER, T_BRACKL, T_BRACKR,
-    T_COMMA, T_SEMICOLON, T_COLON, T_QUESTION, T_DOT,
-    T_COMMENT, T_UNKNOWN, T_EOF,
-    T_INVALID_IDENTIFIER , T_INCREMENT , T_PLUS_ASSIGN,
-    
-    T_DECREMENT,    // --
-    T_MINUS_ASSIGN  // -=
-};
 struct Token {
     TokenType type;
     string value;
@@ -220,69 +205,7 @@ vector<Token> tokenize(const string &src) {
 }
 
 string tokenTypeToString(TokenType type) {
-    switch(type) {
-        case T_FUNCTION: return "T_FUNCTION";
-        case T_INT: return "T_INT";
-        case T_FLOAT: return "T_FLOAT";
-        case T_STRING: return "T_STRING";
-        case T_BOOL: return "T_BOOL";
-        case T_RETURN: return "T_RETURN";
-        case T_IF: return "T_IF";
-        case T_ELSE: return "T_ELSE";
-        case T_FOR: return "T_FOR";
-        case T_WHILE: return "T_WHILE";
-        case T_BREAK: return "T_BREAK";
-        case T_CONTINUE: return "T_CONTINUE";
-        case T_IDENTIFIER: return "T_IDENTIFIER";
-        case T_INTLIT: return "T_INTLIT";
-        case T_FLOATLIT: return "T_FLOATLIT";
-        case T_STRINGLIT: return "T_STRINGLIT";
-        case T_BOOLLIT: return "T_BOOLLIT";
-        case T_ASSIGNOP: return "T_ASSIGNOP";
-        case T_EQUALSOP: return "T_EQUALSOP";
-        case T_PLUS: return "T_PLUS";
-        case T_MINUS: return "T_MINUS";
-        case T_MULT: return "T_MULT";
-        case T_DIV: return "T_DIV";
-        case T_MOD: return "T_MOD";
-        case T_LT: return "T_LT";
-        case T_GT: return "T_GT";
-        case T_LTE: return "T_LTE";
-        case T_GTE: return "T_GTE";
-        case T_NEQ: return "T_NEQ";
-        case T_AND: return "T_AND";
-        case T_OR: return "T_OR";
-        case T_NOT: return "T_NOT";
-        case T_BITAND: return "T_BITAND";
-        case T_BITOR: return "T_BITOR";
-        case T_BITXOR: return "T_BITXOR";
-        case T_BITNOT: return "T_BITNOT";
-        case T_LEFTSHIFT: return "T_LEFTSHIFT";
-        case T_RIGHTSHIFT: return "T_RIGHTSHIFT";
-        case T_PARENL: return "T_PARENL";
-        case T_PARENR: return "T_PARENR";
-        case T_BRACEL: return "T_BRACEL";
-        case T_BRACER: return "T_BRACER";
-        case T_BRACKL: return "T_BRACKL";
-        case T_BRACKR: return "T_BRACKR";
-        case T_COMMA: return "T_COMMA";
-        case T_SEMICOLON: return "T_SEMICOLON";
-        case T_COLON: return "T_COLON";
-        case T_QUESTION: return "T_QUESTION";
-        case T_DOT: return "T_DOT";
-        case T_COMMENT: return "T_COMMENT";
-        case T_UNKNOWN: return "T_UNKNOWN";
-        case T_EOF: return "T_EOF";
-        case T_INVALID_IDENTIFIER: return "T_INVALID_IDENTIFIER";
-        case T_INCREMENT: return "T_INCREMENT";
-        case T_DECREMENT: return "T_DECREMENT";
-        case T_PLUS_ASSIGN: return "T_PLUS_ASSIGN";
-        case T_MINUS_ASSIGN: return "T_MINUS_ASSIGN";
-        
-
-        
-        default: return "UNKNOWN";
-    }
+    return string(tokenTypeName(type));
 }
 
 int main() {
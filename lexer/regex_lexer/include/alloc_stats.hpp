@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Heap accounting for the `lexer` executable (`--alloc-stats`). Configuring
+// with -DLEXER_ALLOC_STATS=ON links alloc_stats.cpp into the executable,
+// which replaces the global operator new and delete with versions that count
+// calls and bytes. Code that reads the counters is wrapped in
+// LEXER_ALLOC_STATS_ONLY, so other builds keep the library allocator and no
+// bookkeeping at all. liblexer never carries the replacement.
+#ifdef LEXER_ALLOC_STATS
+#define LEXER_ALLOC_STATS_ONLY(...) __VA_ARGS__
+#else
+#define LEXER_ALLOC_STATS_ONLY(...)
+#endif
+
+struct AllocSample {
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;     // requested by the allocations above
+    uint64_t peakLive = 0;  // most bytes live at once, memory from earlier phases included
+    uint64_t endLive = 0;   // bytes live when the phase ended
+};
+
+// One phase of a driver run, e.g. "load" or "tokenize".
+struct AllocPhase {
+    std::string name;
+    AllocSample sample;
+};
+
+// Brackets a phase. The counters are process-wide and updated with relaxed
+// atomics, so allocations made by other threads in the meantime count too.
+class AllocCounters {
+public:
+    void start();
+    AllocSample stop();
+
+private:
+    AllocSample started_;
+};
+
+void printAllocReport(std::ostream& out, const std::vector<AllocPhase>& phases, uint64_t bytes, uint64_t tokens);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "rule_order.hpp"
+
+// How Lexer::getNextToken matches Patterns::tokenPatterns. Both engines
+// produce the same tokens.
+enum class MatchEngine {
+    // std::regex, one rule after another. Kept as the reference, but
+    // libstdc++'s matcher backtracks recursively, so a long string literal
+    // can exhaust the stack, and every token copies the rest of the source.
+    Backtracking,
+    // RuleAutomaton: linear time in the source and constant stack on any
+    // input, for sources that cannot be trusted.
+    Automaton,
+};
+
+// Every rule of Patterns::tokenPatterns compiled into one DFA (Thompson
+// construction, then subset construction over byte equivalence classes), so
+// a single left-to-right walk tracks all rules at once. Each rule yields its
+// longest match, which for the rules in pattern.cpp is also the match the
+// backtracking engine finds: none of them can give up characters to a later
+// part of the pattern. The supported syntax is literals, escapes, bracket
+// expressions, '.', groups, '|', '*', '+', '?', a leading '^' and a trailing
+// '\b' after a word character.
+class RuleAutomaton {
+public:
+    // Compiled on first use. Throws LexerError if a rule uses other syntax.
+    static const RuleAutomaton& instance();
+
+private:
+    friend class AutomatonScanner;
+    struct Accept {
+        uint32_t rule;
+        bool boundary;  // only when the next byte is not a word character ('\b')
+    };
+
+    RuleAutomaton();
+
+    uint8_t byteClass_[256];
+    size_t classes_ = 0;
+    uint32_t start_ = 0;
+    std::vector<uint32_t> next_;                // next_[state * classes_ + class]; state 0 is dead
+    std::vector<std::vector<Accept>> accepts_;  // per state
+};
+
+// Runs RuleAutomaton over one source. Picking the first rule in `order` that
+// matched means walking on until the DFA dies, and a walk that ends far past
+// the token it returns would make the lexer quadratic (think of a line of
+// '"\"\"\"...' that never closes). As in Reps' maximal-munch tokenizer, the
+// (state, position) pairs after the last accepting position of a walk are
+// remembered and end every later walk that reaches them, which bounds the
+// total work by the number of states times the source length. They are kept
+// as one bit per state for every position from the current token on; the
+// positions behind it are dropped as the lexer moves on, so the memo only
+// spans what walks have looked ahead and a lookup is an index, not a hash.
+class AutomatonScanner {
+public:
+    explicit AutomatonScanner(const RuleOrder& order);
+
+    // Rule and length of the token at source[pos]; false when no rule matches.
+    // `source` must be the same string on every call, and `pos` must not
+    // decrease from one call to the next.
+    bool match(std::string_view source, size_t pos, size_t& rule, size_t& length);
+
+private:
+    const RuleAutomaton& automaton_;
+    std::vector<size_t> rank_;                // position of each rule in the order
+    std::vector<size_t> end_;                 // per rule: end of its longest match, or npos
+    std::vector<uint32_t> matched_;           // rules with an end_ in the current walk
+    std::vector<uint64_t> trail_;             // pairs since the last accepting position
+    size_t stride_;                           // words per position in failed_
+    std::vector<uint64_t> failed_;            // per position: a bit per state from which no rule accepts
+    size_t failedHead_ = 0;                   // words of failed_ before it belong to lexed positions
+    size_t failedBase_ = 0;                   // position described at failed_[failedHead_]
+
+    void forgetBefore(size_t pos);
+    bool failed(uint32_t state, size_t pos) const;
+    void markFailed(uint32_t state, size_t pos);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "automaton.hpp"
+#include "file_reader.hpp"
+#include "rule_order.hpp"
+#include "token_format.hpp"
+
+struct BatchOptions {
+    unsigned threads = 0;     // lexer workers; 0 means one per hardware thread
+    size_t readAhead = 32;    // files between the oldest one not yet written and the newest read
+    FileBatchReader::Backend backend = FileBatchReader::Backend::Auto;
+    TokenFormat format = TokenFormat::Text;
+    MatchEngine engine = MatchEngine::Automaton;
+};
+
+// Lexes many files (`lexer a.txt b.txt ...`). The calling thread only keeps
+// reads in flight through FileBatchReader, each completed buffer goes
+// straight to a lexer task on a ThreadPool, and results are written in list
+// order as soon as every earlier file is out. Storage latency is therefore
+// hidden behind lexing, and memory stays bounded by the read-ahead window.
+//
+// Each file's output is what a single run would print, preceded in text
+// format by a "==> path <==" line; JSON documents and binary streams simply
+// follow each other. Diagnostics go to stderr in the same order, and a file
+// that cannot be read or lexed is reported without stopping the others.
+// Returns the process exit code: 1 if any file failed.
+int lexFiles(const std::vector<std::string>& paths, const RuleOrder& order, const BatchOptions& options);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+
+// Byte sets for the regex syntax used by Patterns::tokenPatterns, shared by
+// the rule-order analysis and the automaton compiler.
+using CharSet = std::bitset<256>;
+
+CharSet charRange(unsigned char first, unsigned char last);
+CharSet singleChar(char c);
+
+// Set for the character after a backslash, both inside and outside brackets.
+CharSet escapeSet(char c);
+
+// Parses a bracket expression starting at source[pos] == '[' and moves pos
+// past it. Returns false if it is not terminated.
+bool parseClass(const std::string& source, size_t& pos, CharSet& set);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "automaton.hpp"
+#include "lexer.hpp"
+#include "rule_order.hpp"
+
+// Checkpoints for random access into large files (`lexer --checkpoints`,
+// `lexer --lines=A-B`, `lexer --bytes=A-B`). A full pass records the lexer
+// state between tokens about every `interval` bytes and stores it next to the
+// source as `<file>.lxcp`. A range query then reads only the bytes from the
+// last checkpoint before the range to the second one after it, and lexes
+// those. Every rule order yields the same tokens, so checkpoints hold for any
+// --rule-profile. Layout, all integers little-endian:
+//
+//   "LXCP", u32 version, u32 interval, u32 checkpoint count,
+//   u64 source size, i64 source mtime in nanoseconds,
+//   then per checkpoint u64 offset, u32 line, u32 column
+//
+// A sidecar whose size or mtime no longer match the source is ignored.
+constexpr uint32_t kCheckpointVersion = 1;
+constexpr size_t kDefaultCheckpointInterval = 64 * 1024;
+
+struct CheckpointFile {
+    uint64_t sourceSize = 0;
+    int64_t sourceMtime = 0;
+    uint32_t interval = 0;
+    std::vector<LexerCheckpoint> checkpoints;
+};
+
+// Tokens starting on lines [first, last] (from 1) or at byte offsets
+// [first, last] (from 0).
+struct TokenRange {
+    enum class Unit { Lines, Bytes };
+    Unit unit = Unit::Lines;
+    uint64_t first = 0;
+    uint64_t last = 0;
+};
+
+// Accepts "A-B", "A-" (to the end) and "A". Returns false otherwise.
+bool parseTokenRange(const std::string& spec, TokenRange::Unit unit, TokenRange& range);
+
+std::string checkpointPath(const std::string& source_path);
+
+// Fills in the size and mtime of the source. Returns false if it cannot be stat'ed.
+bool statCheckpointSource(const std::string& source_path, CheckpointFile& file);
+
+// Reads the sidecar of `source_path`. Returns false if there is none, or it
+// is damaged or out of date.
+bool loadCheckpoints(const std::string& source_path, CheckpointFile& file);
+
+// Writes the sidecar through a temporary file. Throws LexerError.
+void saveCheckpoints(const std::string& source_path, const CheckpointFile& file);
+
+// Lexes the whole source to record checkpoints and saves them; a sidecar
+// that cannot be written only draws a warning. Throws LexerError.
+CheckpointFile buildCheckpoints(const std::string& source_path, size_t interval, const RuleOrder& order);
+
+// The tokens of `range`, exactly as a full run would produce them, lexed
+// from the nearest checkpoint. Diagnostics for those tokens go to
+// `diagnostics`. Throws LexerError.
+std::vector<Token> lexRange(const std::string& source_path, const CheckpointFile& file, const TokenRange& range,
+                            const RuleOrder& order, MatchEngine engine, std::ostream& diagnostics);
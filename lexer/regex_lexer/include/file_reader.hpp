@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "thread_pool.hpp"
+
+// One file read by FileBatchReader.
+struct FileBuffer {
+    size_t index = 0;   // position in the path list
+    std::string data;
+    std::string error;  // why the file could not be read; data is empty then
+};
+
+// Reads a list of files ahead of the code that consumes them. Reads are
+// submitted in list order, at most `depth` files at a time counting from the
+// oldest file not yet released, and completed files are returned as they
+// finish. On Linux the reads go through io_uring, so one thread keeps many
+// of them in flight; where io_uring cannot be set up (old kernels, seccomp
+// filters, other systems) a pool of threads issues blocking pread() calls.
+//
+// Opening and fstat() stay synchronous on the calling thread. next() and the
+// constructor must be called from one thread; release() may be called from
+// any.
+class FileBatchReader {
+public:
+    enum class Backend { Auto, IoUring, Pread };
+    static constexpr size_t kMaxDepth = 4096;  // keeps every completion within the ring
+
+    // `depth` is clamped to [1, kMaxDepth]. Throws LexerError if Backend::IoUring
+    // is requested and cannot be set up.
+    FileBatchReader(std::vector<std::string> paths, size_t depth, Backend backend = Backend::Auto);
+    ~FileBatchReader();
+    FileBatchReader(const FileBatchReader&) = delete;
+    FileBatchReader& operator=(const FileBatchReader&) = delete;
+
+    // Blocks until a file has been read. Returns false once every file has
+    // been returned.
+    bool next(FileBuffer& buffer);
+    // Marks the oldest returned file as consumed, which lets the read window
+    // move on by one file. Files must be released in list order.
+    void release();
+
+    const char* backendName() const;
+
+private:
+    struct Uring;
+    struct Read;
+
+    void fill();
+    bool startRead(size_t index);
+    void finish(Read& read, int error);
+    void reapUring(bool wait);
+
+    std::vector<std::string> paths_;
+    const size_t depth_;
+    size_t submitted_ = 0;    // files whose read has been started
+    size_t returned_ = 0;     // files handed out by next()
+    size_t inFlight_ = 0;     // reads started and not finished
+    std::unique_ptr<Uring> uring_;
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<std::unique_ptr<Read>> reads_;  // io_uring reads in flight, by slot
+
+    std::mutex mutex_;        // guards the members below
+    std::condition_variable changed_;
+    std::deque<FileBuffer> done_;
+    size_t released_ = 0;
+};
@@ -1,20 +1,67 @@
 #pragma once
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "automaton.hpp"
 #include "token.hpp"
 #include "exception.hpp"
+#include "rule_order.hpp"
+#include "stats.hpp"
+
+// Lexer state between two tokens. Comments and string literals are single
+// tokens, so nothing else is needed to carry on lexing from here.
+struct LexerCheckpoint {
+    uint64_t offset;
+    uint32_t line;
+    uint32_t column;
+};
 
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
+    // `source` is not copied; it has to outlive the lexer.
+    explicit Lexer(std::string_view source, const RuleOrder& order = RuleOrder::declared());
+    Lexer(std::string&& source, const RuleOrder& order = RuleOrder::declared()) = delete;
     std::vector<Token> tokenize();
+    // Produces the tokens of tokenize() one at a time, T_EOF last; returns false after that.
+    bool next(Token& token);
+    // Tokens produced by each rule, indexed like Patterns::tokenPatterns.
+    const std::vector<uint64_t>& ruleHits() const { return ruleHits_; }
+    // Where invalid-identifier and unknown-token errors are reported (std::cerr by default).
+    void setDiagnosticStream(std::ostream& out) { diagnostics_ = &out; }
+    // MatchEngine::Automaton unless set otherwise.
+    void setEngine(MatchEngine engine) {
+        engine_ = engine;
+        LEXER_STATS_ONLY(stats_.automaton = engine == MatchEngine::Automaton;)
+    }
+    // Appends the state before the first token and then, between tokens, about
+    // every `interval` bytes to `out`.
+    void recordCheckpoints(size_t interval, std::vector<LexerCheckpoint>& out);
+    // Numbers lines and columns on from `checkpoint`, for a source that starts
+    // at its offset. Token offsets stay relative to the source.
+    void resumeAt(const LexerCheckpoint& checkpoint);
+    LEXER_STATS_ONLY(const LexerStats& stats() const { return stats_; })
 
 private:
-    std::string source_;
+    std::string_view source_;
     int line_;
     int column_;
     size_t pos_;
+    bool finished_;
+    bool ascii_;  // no byte above 0x7F: columns are byte offsets and no decoding is needed
+    const RuleOrder& order_;
+    std::vector<uint64_t> ruleHits_;
+    std::ostream* diagnostics_;
+    MatchEngine engine_;
+    AutomatonScanner scanner_;
+    std::vector<LexerCheckpoint>* checkpoints_;
+    size_t checkpointInterval_;
+    size_t nextCheckpoint_;
+    LEXER_STATS_ONLY(LexerStats stats_;)
+    void advance(const char* text, size_t size);
+    Token takeMatch(size_t rule, const std::string& value);
+    bool scanUnicodeIdentifier(Token& token);
     void skipWhitespace();
-    void handleMultiLineComment();
+    bool handleMultiLineComment();
     Token getNextToken();
 };
\ No newline at end of file
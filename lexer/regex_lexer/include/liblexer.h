@@ -0,0 +1,81 @@
+/*
+ * C ABI for embedding the lexer (liblexer.so / liblexer.a).
+ *
+ * Tokens are returned as a packed array that points back into the lexed
+ * buffer instead of carrying their own text, so a caller can walk them
+ * without any serialization:
+ *
+ *     lexer_t* lx = lexer_create();
+ *     if (lexer_lex_buffer(lx, src, len) == 0) {
+ *         size_t n;
+ *         const lexer_token* toks = lexer_tokens(lx, &n);
+ *         for (size_t i = 0; i < n; ++i)
+ *             handle(toks[i].type, src + toks[i].offset, toks[i].length);
+ *     }
+ *     lexer_free(lx);
+ *
+ * The buffer is lexed in place and never copied, so it has to stay alive
+ * and unchanged while its tokens are in use. Results stay valid until the
+ * next lexer_lex_buffer() or lexer_free() on the same handle. A handle must not be used from two
+ * threads at once; separate handles are independent.
+ */
+#ifndef LIBLEXER_H
+#define LIBLEXER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define LEXER_API __attribute__((visibility("default")))
+#else
+#define LEXER_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LEXER_ABI_VERSION 2
+
+typedef struct lexer lexer_t;
+
+typedef struct lexer_token {
+    uint32_t type;   /* TokenType from token.hpp */
+    uint32_t line;   /* 1-based */
+    uint32_t column; /* 1-based */
+    uint32_t length; /* bytes of token text */
+    uint64_t offset; /* byte offset of the token text in the lexed buffer */
+} lexer_token;
+
+LEXER_API uint32_t lexer_abi_version(void);
+
+/* Returns NULL on allocation failure. */
+LEXER_API lexer_t* lexer_create(void);
+
+/* Returns 0 on success and -1 on a lexical error (see lexer_error()). */
+LEXER_API int lexer_lex_buffer(lexer_t* lexer, const char* data, size_t size);
+
+/* Tokens of the last successful lexer_lex_buffer(), ending with T_EOF. */
+LEXER_API const lexer_token* lexer_tokens(const lexer_t* lexer, size_t* count);
+
+/* The buffer passed to the last lexer_lex_buffer(); it is not NUL-terminated
+ * unless the caller's was. */
+LEXER_API const char* lexer_source(const lexer_t* lexer);
+
+/* Invalid-identifier and unknown-token messages from the last run, one per
+ * line, including a run that failed. */
+LEXER_API const char* lexer_diagnostics(const lexer_t* lexer);
+
+/* Message of the last failed lexer_lex_buffer(), or NULL. */
+LEXER_API const char* lexer_error(const lexer_t* lexer);
+
+/* "T_IDENTIFIER" etc.; never NULL. */
+LEXER_API const char* lexer_token_type_name(uint32_t type);
+
+LEXER_API void lexer_free(lexer_t* lexer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBLEXER_H */
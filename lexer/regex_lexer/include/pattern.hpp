@@ -1,10 +1,22 @@
 #pragma once
 
 #include <regex>
+#include <string>
+#include <utility>
 #include <vector>
 #include "token.hpp"
 
+// One lexer rule. The source text is kept next to the compiled regex so that
+// diagnostics and the --stats report can name the rule they are talking about.
+struct TokenPattern {
+    TokenPattern(std::string source, TokenType type) : source(std::move(source)), regex(this->source), type(type) {}
+
+    std::string source;
+    std::regex regex;
+    TokenType type;
+};
+
 class Patterns {
 public:
-    static const std::vector<std::pair<std::regex, TokenType>> tokenPatterns;
+    static const std::vector<TokenPattern> tokenPatterns;
 };
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Hardware performance counters around a region of code, read through Linux
+// perf_event_open. Each event is opened on its own so that a CPU or VM that
+// lacks one of them still reports the rest; when nothing can be opened (other
+// kernels, perf_event_paranoid, containers) only wall-clock time is measured.
+class PerfCounters {
+public:
+    enum Event { Cycles, Instructions, BranchMisses, L1DMisses, LLCMisses, EventCount };
+
+    struct Sample {
+        uint64_t nanos = 0;
+        std::array<uint64_t, EventCount> values{};
+        std::array<bool, EventCount> valid{};
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+    const std::string& unavailableReason() const { return reason_; }
+
+    void start();
+    Sample stop();
+
+    static const char* eventName(Event event);
+
+private:
+    std::array<int, EventCount> fds_;
+    std::string reason_;
+    uint64_t startNanos_ = 0;
+};
+
+// One measured phase of a driver run, e.g. "load" or "tokenize".
+struct ProfilePhase {
+    std::string name;
+    PerfCounters::Sample sample;
+};
+
+void printProfileReport(std::ostream& out, const std::vector<ProfilePhase>& phases, const PerfCounters& counters,
+                        uint64_t bytes, uint64_t tokens);
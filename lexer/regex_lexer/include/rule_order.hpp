@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The order in which Lexer::getNextToken tries Patterns::tokenPatterns.
+//
+// The declared order is what defines the token stream: the first rule that
+// matches wins. A profile-guided order may only move a rule ahead of another
+// one when rulesAreDisjoint() proves they can never match at the same
+// position, so every order produced here yields byte-identical tokens.
+class RuleOrder {
+public:
+    static const RuleOrder& declared();
+
+    // Puts frequently hit rules first, subject to the disjointness constraints.
+    // `hits` is indexed like Patterns::tokenPatterns; missing entries count as 0.
+    static RuleOrder fromHits(const std::vector<uint64_t>& hits);
+
+    const std::vector<size_t>& indices() const { return indices_; }
+
+private:
+    explicit RuleOrder(std::vector<size_t> indices);
+    std::vector<size_t> indices_;
+};
+
+// Conservative check on two rule sources: true only if, for every pair of
+// top-level alternatives, the characters each one must start with differ at
+// some position. Anything the analysis does not understand counts as overlap.
+bool rulesAreDisjoint(const std::string& first, const std::string& second);
+
+// A rule profile is a text file with one "<hits>\t<pattern source>" line per
+// rule, so it survives rules being reordered or added. Unknown patterns are
+// ignored on load. Both functions throw LexerError on I/O failure.
+std::vector<uint64_t> loadRuleProfile(const std::string& path);
+void saveRuleProfile(const std::string& path, const std::vector<uint64_t>& hits);
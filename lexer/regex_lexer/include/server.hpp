@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "rule_order.hpp"
+#include "token_format.hpp"
+
+// Long-running lexer service on a Unix domain socket (`lexer --serve=<socket>`).
+// The regexes and the rule order are built once, so a request only pays for
+// lexing its own input. Wire protocol, all integers little-endian:
+//
+//   request:  "LXRQ", u8 RequestSource, u8 TokenFormat, u16 reserved,
+//             u32 payload length, payload (an absolute path on the server or
+//             the source itself)
+//   response: u8 status (0 ok, 1 error), 3 reserved bytes, u32 output length,
+//             u32 diagnostics length, output, diagnostics
+//
+// A connection may carry any number of requests, answered in order. One
+// thread multiplexes all connections with poll() and hands each complete
+// request, not the connection, to a worker thread, so idle connections hold
+// no worker.
+enum class RequestSource : uint8_t { Path = 0, Inline = 1 };
+
+// Serves until SIGINT or SIGTERM. Returns the process exit code.
+int runServer(const std::string& socket_path, unsigned threads, const RuleOrder& order);
+
+// Sends one request, writes the output to stdout and the diagnostics to
+// stderr. Returns the process exit code.
+int runClient(const std::string& socket_path, RequestSource source, const std::string& payload, TokenFormat format);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Hot-path instrumentation for the lexer. Everything that touches the counters
+// is wrapped in LEXER_STATS_ONLY, so a build without -DLEXER_STATS carries no
+// extra members, branches or clock reads.
+#ifdef LEXER_STATS
+#define LEXER_STATS_ONLY(...) __VA_ARGS__
+#else
+#define LEXER_STATS_ONLY(...)
+#endif
+
+using StatsClock = std::chrono::steady_clock;
+
+// Counters for one entry of Patterns::tokenPatterns.
+struct RuleStats {
+    uint64_t attempts = 0;
+    uint64_t hits = 0;
+    uint64_t nanos = 0;
+};
+
+struct PhaseStats {
+    uint64_t calls = 0;
+    uint64_t nanos = 0;
+};
+
+// With the automaton engine one DFA walk tries every rule at once: each rule
+// then counts every walk as an attempt, and a walk's time goes to the rule
+// that matched.
+struct LexerStats {
+    std::vector<RuleStats> rules;   // indexed like Patterns::tokenPatterns
+    bool automaton = false;         // MatchEngine::Automaton rather than std::regex
+    uint64_t walks = 0;             // DFA walks, automaton only
+    PhaseStats whitespace;          // Lexer::skipWhitespace
+    PhaseStats comments;            // Lexer::handleMultiLineComment
+    PhaseStats tokenize;            // Lexer::tokenize, end to end
+    PhaseStats output;              // printing tokens in the driver
+    uint64_t bytes = 0;
+    uint64_t tokens = 0;
+};
+
+inline uint64_t elapsedNanos(StatsClock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(StatsClock::now() - start).count());
+}
+
+// Adds the lifetime of the object to a phase when it goes out of scope.
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(PhaseStats& phase) : phase_(phase), start_(StatsClock::now()) {}
+    ~ScopedPhaseTimer() {
+        phase_.calls++;
+        phase_.nanos += elapsedNanos(start_);
+    }
+
+private:
+    PhaseStats& phase_;
+    StatsClock::time_point start_;
+};
+
+void printStatsTable(std::ostream& out, const LexerStats& stats);
+void printStatsJson(std::ostream& out, const LexerStats& stats);
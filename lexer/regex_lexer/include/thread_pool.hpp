@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with work stealing. Every worker owns a deque:
+// it runs its own newest task first and, once the deque is empty, steals the
+// oldest task of another worker, so uneven tasks even out without all
+// workers contending on one queue.
+class ThreadPool {
+public:
+    // 0 means one thread per hardware thread.
+    explicit ThreadPool(unsigned threads = 0);
+    // Finishes every queued task, then joins the workers.
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // A worker's tasks go onto its own deque; others are dealt round robin.
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished.
+    void wait();
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+    // Index in [0, size()) of the calling worker thread, or -1 outside this
+    // pool. Lets tasks pick per-thread scratch state.
+    int currentWorker() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(unsigned index);
+    bool take(unsigned index, std::function<void()>& task);
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;  // one per worker
+    std::mutex mutex_;  // sleeping workers and wait()
+    std::condition_variable ready_;
+    std::condition_variable idle_;
+    std::atomic<size_t> queued_{0};   // tasks sitting in a deque
+    std::atomic<size_t> pending_{0};  // tasks submitted and not yet finished
+    std::atomic<unsigned> next_{0};   // round-robin cursor for outside submits
+    bool stopping_ = false;
+};
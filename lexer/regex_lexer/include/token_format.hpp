@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "token.hpp"
+
+// Serializations of a token stream.
+//
+//  text   - the human-readable `Token(T_INT, "int") at line 1, column 1` lines
+//  json   - {"tokens": [{"type": "T_INT", "value": "int", "line": 1, "column": 1}, ...]}
+//  binary - "LXTK", u32 version, u32 count, then per token u32 type, u32 line,
+//           u32 column, u32 value length and the value bytes (little-endian)
+//
+// T_COMMENT tokens are never written.
+enum class TokenFormat { Text, Json, Binary };
+
+constexpr uint32_t kBinaryTokenVersion = 1;
+
+// Returns false if `name` is not one of "text", "json" or "binary".
+bool parseTokenFormat(const std::string& name, TokenFormat& format);
+
+void writeTokens(std::ostream& out, const std::vector<Token>& tokens, TokenFormat format);
+
+// Incremental writer for consumers that receive tokens in batches. Binary
+// output starts with the token count, so only Text and Json stream.
+class TokenStreamWriter {
+public:
+    TokenStreamWriter(std::ostream& out, TokenFormat format);
+    void write(const std::vector<Token>& tokens);
+    void finish();
+
+private:
+    std::ostream& out_;
+    TokenFormat format_;
+    bool first_ = true;
+};
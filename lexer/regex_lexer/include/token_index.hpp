@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "batch_lexer.hpp"
+#include "rule_order.hpp"
+
+// On-disk inverted index from token text to where it occurs (`lexer --index`,
+// `lexer --query`). Because the text comes from the lexer, `count` inside a
+// string or a comment is not a use of the identifier `count`.
+//
+// The file is read through mmap and never parsed as a whole: a query binary
+// searches the term table and decodes one posting list. Postings carry the
+// line and column the lexer reported, so a query never opens the indexed
+// files, however large they are. Layout, all
+// integers little-endian and every table 8-byte aligned:
+//
+//   header:   "LXIX", u32 version, u32 flags (1 = literals indexed),
+//             u32 file count, u32 term count, u32 reserved,
+//             u64 offsets of the file table, term table, string blob and
+//             posting blob, u64 total size
+//   files:    per file u64 path offset, u32 path length, u32 reserved,
+//             u64 size, i64 mtime in nanoseconds
+//   terms:    sorted by text; per term u64 text offset, u32 text length,
+//             u32 token type, u64 posting offset, u32 posting bytes,
+//             u32 occurrences
+//   postings: per file holding the term, varint(file id - previous file id),
+//             varint(count), then per occurrence varint(byte-offset delta),
+//             varint(line delta), varint(column)
+//
+// Postings are kept per file, so an update re-lexes only the files whose
+// size or mtime changed, copies the others' postings from the previous
+// index and drops files no longer listed.
+constexpr uint32_t kTokenIndexVersion = 2;
+
+struct IndexOptions {
+    bool literals = false;  // also index string, number and boolean literals
+    BatchOptions batch;     // threads, read-ahead and I/O backend; format is unused
+};
+
+// Builds `index_path` from `paths`, reusing an existing index there. Writes
+// a summary to stderr and returns the process exit code.
+int buildTokenIndex(const std::string& index_path, const std::vector<std::string>& paths, const RuleOrder& order,
+                    const IndexOptions& options);
+
+// Prints "path:line:column: text" for every occurrence of each of `terms`,
+// in file order. Returns the process exit code: 1 if none was found.
+int queryTokenIndex(const std::string& index_path, const std::vector<std::string>& terms);
+
+// A mapped index file.
+class TokenIndex {
+public:
+    struct Occurrence {
+        uint32_t file;
+        uint64_t offset;
+        uint32_t line;
+        uint32_t column;
+    };
+
+    // Throws LexerError if the file cannot be mapped or is not a valid index.
+    explicit TokenIndex(const std::string& path);
+    ~TokenIndex();
+    TokenIndex(const TokenIndex&) = delete;
+    TokenIndex& operator=(const TokenIndex&) = delete;
+
+    uint32_t fileCount() const;
+    std::string filePath(uint32_t file) const;
+    uint64_t fileSize(uint32_t file) const;
+    int64_t fileMtime(uint32_t file) const;
+    bool literals() const;
+
+    uint32_t termCount() const;
+    std::string termText(uint32_t term) const;
+    uint32_t termType(uint32_t term) const;
+    std::vector<Occurrence> postings(uint32_t term) const;
+    // Terms with exactly this text (one per token type).
+    std::vector<uint32_t> find(const std::string& text) const;
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+
+    const unsigned char* fileEntry(uint32_t file) const;
+    const unsigned char* termEntry(uint32_t term) const;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lexer.hpp"
+#include "spsc_ring.hpp"
+
+// Runs a Lexer on its own thread and hands its tokens to the consuming
+// thread in batches through an SpscRing, so lexing overlaps with whatever the
+// consumer does. Batch buffers circulate through a second ring back to the
+// producer, which bounds the tokens in flight to
+// (batches_in_flight + 1) * batch_size and stops the producer when the
+// consumer falls behind.
+class TokenPipeline {
+public:
+    explicit TokenPipeline(const std::string& source, const RuleOrder& order = RuleOrder::declared(),
+                           size_t batch_size = 512, size_t batches_in_flight = 8);
+    ~TokenPipeline();
+    TokenPipeline(const TokenPipeline&) = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    // The next batch in source order, valid until the following call. Returns
+    // nullptr after the batch holding T_EOF. A LexerError raised while lexing
+    // is rethrown here once the tokens before it have been delivered.
+    const std::vector<Token>* nextBatch();
+
+private:
+    void produce();
+    template <typename Ring>
+    bool waitPush(Ring& ring, std::vector<Token>& batch);
+    template <typename Ring>
+    bool waitPop(Ring& ring, std::vector<Token>& batch);
+
+    Lexer lexer_;
+    const size_t batchSize_;
+    SpscRing<std::vector<Token>> filled_;  // producer -> consumer
+    SpscRing<std::vector<Token>> free_;    // consumer -> producer
+    std::vector<Token> current_;
+    std::exception_ptr error_;             // published by the terminating empty batch
+    std::atomic<bool> cancelled_{false};
+    bool finished_ = false;
+    std::thread producer_;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Categories a token type can belong to, as bits.
+enum TokenCategory : uint8_t {
+    kKeywordToken = 1 << 0,      // reserved words, type names included
+    kTypeNameToken = 1 << 1,     // int, float, string, bool
+    kOperatorToken = 1 << 2,
+    kPunctuationToken = 1 << 3,  // brackets and separators
+    kLiteralToken = 1 << 4,
+    kErrorToken = 1 << 5,        // text the lexer reports as an error
+    kTriviaToken = 1 << 6,       // never written out
+};
+
+// The one list of token types: X(name, spelling, categories). The spelling is
+// the fixed source text of keywords, operators and punctuation, and empty for
+// tokens whose text varies. Everything below is generated from it, so the
+// enum, the names and the tables cannot drift apart. New types go at the end:
+// the enum values are part of the binary token format and liblexer.
+#define LEXER_TOKEN_TYPES(X)                                           \
+    X(T_FUNCTION, "fn", kKeywordToken)                                 \
+    X(T_INT, "int", kKeywordToken | kTypeNameToken)                    \
+    X(T_FLOAT, "float", kKeywordToken | kTypeNameToken)                \
+    X(T_STRING, "string", kKeywordToken | kTypeNameToken)              \
+    X(T_BOOL, "bool", kKeywordToken | kTypeNameToken)                  \
+    X(T_RETURN, "return", kKeywordToken)                               \
+    X(T_IF, "if", kKeywordToken)                                       \
+    X(T_ELSE, "else", kKeywordToken)                                   \
+    X(T_FOR, "for", kKeywordToken)                                     \
+    X(T_WHILE, "while", kKeywordToken)                                 \
+    X(T_BREAK, "break", kKeywordToken)                                 \
+    X(T_CONTINUE, "continue", kKeywordToken)                           \
+    X(T_IDENTIFIER, "", 0)                                             \
+    X(T_INTLIT, "", kLiteralToken)                                     \
+    X(T_FLOATLIT, "", kLiteralToken)                                   \
+    X(T_STRINGLIT, "", kLiteralToken)                                  \
+    X(T_BOOLLIT, "", kLiteralToken)                                    \
+    X(T_ASSIGNOP, "=", kOperatorToken)                                 \
+    X(T_EQUALSOP, "==", kOperatorToken)                                \
+    X(T_PLUS, "+", kOperatorToken)                                     \
+    X(T_MINUS, "-", kOperatorToken)                                    \
+    X(T_MULT, "*", kOperatorToken)                                     \
+    X(T_DIV, "/", kOperatorToken)                                      \
+    X(T_MOD, "%", kOperatorToken)                                      \
+    X(T_LT, "<", kOperatorToken)                                       \
+    X(T_GT, ">", kOperatorToken)                                       \
+    X(T_LTE, "<=", kOperatorToken)                                     \
+    X(T_GTE, ">=", kOperatorToken)                                     \
+    X(T_NEQ, "!=", kOperatorToken)                                     \
+    X(T_AND, "&&", kOperatorToken)                                     \
+    X(T_OR, "||", kOperatorToken)                                      \
+    X(T_NOT, "!", kOperatorToken)                                      \
+    X(T_BITAND, "&", kOperatorToken)                                   \
+    X(T_BITOR, "|", kOperatorToken)                                    \
+    X(T_BITXOR, "^", kOperatorToken)                                   \
+    X(T_BITNOT, "~", kOperatorToken)                                   \
+    X(T_LEFTSHIFT, "<<", kOperatorToken)                               \
+    X(T_RIGHTSHIFT, ">>", kOperatorToken)                              \
+    X(T_PARENL, "(", kPunctuationToken)                                \
+    X(T_PARENR, ")", kPunctuationToken)                                \
+    X(T_BRACEL, "{", kPunctuationToken)                                \
+    X(T_BRACER, "}", kPunctuationToken)                                \
+    X(T_BRACKL, "[", kPunctuationToken)                                \
+    X(T_BRACKR, "]", kPunctuationToken)                                \
+    X(T_COMMA, ",", kPunctuationToken)                                 \
+    X(T_SEMICOLON, ";", kPunctuationToken)                             \
+    X(T_COLON, ":", kPunctuationToken)                                 \
+    X(T_QUESTION, "?", kOperatorToken)                                 \
+    X(T_DOT, ".", kPunctuationToken)                                   \
+    X(T_COMMENT, "", kTriviaToken)                                     \
+    X(T_UNKNOWN, "", kErrorToken)                                      \
+    X(T_EOF, "", 0)                                                    \
+    X(T_INVALID_IDENTIFIER, "", kErrorToken)                           \
+    X(T_INCREMENT, "++", kOperatorToken)                               \
+    X(T_PLUS_ASSIGN, "+=", kOperatorToken)                             \
+    X(T_DECREMENT, "--", kOperatorToken)                               \
+    X(T_MINUS_ASSIGN, "-=", kOperatorToken)
+
+#define LEXER_TOKEN_ENUM(name, spelling, categories) name,
+enum TokenType { LEXER_TOKEN_TYPES(LEXER_TOKEN_ENUM) };
+#undef LEXER_TOKEN_ENUM
+
+#define LEXER_TOKEN_COUNT(name, spelling, categories) +1
+constexpr size_t kTokenTypeCount = 0 LEXER_TOKEN_TYPES(LEXER_TOKEN_COUNT);
+#undef LEXER_TOKEN_COUNT
+
+#define LEXER_TOKEN_NAME(name, spelling, categories) std::string_view(#name),
+constexpr std::array<std::string_view, kTokenTypeCount> kTokenTypeNames{{LEXER_TOKEN_TYPES(LEXER_TOKEN_NAME)}};
+#undef LEXER_TOKEN_NAME
+
+#define LEXER_TOKEN_SPELLING(name, spelling, categories) std::string_view(spelling),
+constexpr std::array<std::string_view, kTokenTypeCount> kTokenSpellings{{LEXER_TOKEN_TYPES(LEXER_TOKEN_SPELLING)}};
+#undef LEXER_TOKEN_SPELLING
+
+#define LEXER_TOKEN_CATEGORIES(name, spelling, categories) static_cast<uint8_t>(categories),
+constexpr std::array<uint8_t, kTokenTypeCount> kTokenCategories{{LEXER_TOKEN_TYPES(LEXER_TOKEN_CATEGORIES)}};
+#undef LEXER_TOKEN_CATEGORIES
+
+// One bit per token type, so a category test is a shift and a mask of a
+// constant rather than a load or a chain of comparisons.
+static_assert(kTokenTypeCount <= 64, "category sets are 64-bit masks");
+
+constexpr uint64_t tokenTypesIn(uint8_t category) {
+    uint64_t set = 0;
+    for (size_t type = 0; type < kTokenTypeCount; ++type) {
+        if ((kTokenCategories[type] & category) != 0) set |= uint64_t(1) << type;
+    }
+    return set;
+}
+
+constexpr bool inTokenSet(uint64_t set, TokenType type) {
+    return static_cast<size_t>(type) < kTokenTypeCount && ((set >> type) & 1) != 0;
+}
+
+inline constexpr uint64_t kKeywordTypes = tokenTypesIn(kKeywordToken);
+inline constexpr uint64_t kTypeNameTypes = tokenTypesIn(kTypeNameToken);
+inline constexpr uint64_t kOperatorTypes = tokenTypesIn(kOperatorToken);
+inline constexpr uint64_t kPunctuationTypes = tokenTypesIn(kPunctuationToken);
+inline constexpr uint64_t kLiteralTypes = tokenTypesIn(kLiteralToken);
+
+constexpr bool isKeyword(TokenType type) { return inTokenSet(kKeywordTypes, type); }
+constexpr bool isTypeName(TokenType type) { return inTokenSet(kTypeNameTypes, type); }
+constexpr bool isOperator(TokenType type) { return inTokenSet(kOperatorTypes, type); }
+constexpr bool isPunctuation(TokenType type) { return inTokenSet(kPunctuationTypes, type); }
+constexpr bool isLiteral(TokenType type) { return inTokenSet(kLiteralTypes, type); }
+
+// "T_INT" for T_INT; "UNKNOWN" for a value outside the enum.
+constexpr std::string_view tokenTypeName(TokenType type) {
+    return static_cast<size_t>(type) < kTokenTypeCount ? kTokenTypeNames[type] : std::string_view("UNKNOWN");
+}
+
+// "int" for T_INT, "<<" for T_LEFTSHIFT; empty when the text varies.
+constexpr std::string_view tokenSpelling(TokenType type) {
+    return static_cast<size_t>(type) < kTokenTypeCount ? kTokenSpellings[type] : std::string_view();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// UTF-8 support for the lexer. Sources are overwhelmingly ASCII, so every
+// entry point first skips pure-ASCII runs with a vector test (16 bytes at a
+// time with SSE2, 32 with AVX2, 8 with a word mask otherwise) and only
+// decodes where a byte has its high bit set.
+
+// True when no byte of [data, data + size) is above 0x7F.
+bool isAscii(const char* data, size_t size);
+
+// Offset of the first byte that does not start a well-formed UTF-8 sequence
+// (overlong forms, surrogates and code points above U+10FFFF are rejected),
+// or `size` when the whole range is valid.
+size_t findInvalidUtf8(const char* data, size_t size);
+
+// Decodes the sequence at data[0] of already validated UTF-8 and stores its
+// byte length in `length`.
+uint32_t decodeUtf8(const char* data, size_t size, size_t& length);
+
+// Code points in [data, data + size) of valid UTF-8: the column width the
+// lexer reports for that text.
+size_t countCodePoints(const char* data, size_t size);
+
+// Unicode identifier classes (UAX #31), ASCII included: XID_Start plus '_',
+// and XID_Continue.
+bool isIdentifierStart(uint32_t code_point);
+bool isIdentifierContinue(uint32_t code_point);
+
+struct CodePointRange {
+    uint32_t first;
+    uint32_t last;
+};
+
+// Generated tables of non-ASCII ranges (unicode_tables.cpp).
+extern const CodePointRange kXidStartRanges[];
+extern const size_t kXidStartRangesSize;
+extern const CodePointRange kXidContinueRanges[];
+extern const size_t kXidContinueRangesSize;
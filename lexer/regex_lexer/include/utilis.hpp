@@ -3,4 +3,8 @@
 #include "token.hpp"
 #include <string>
 
+// An owning copy of tokenTypeName(); output code should use tokenTypeName() directly.
 std::string tokenTypeToString(TokenType type);
+
+// Escapes quotes, backslashes and control characters for embedding in a JSON string.
+std::string jsonEscape(const std::string& text);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include "automaton.hpp"
+#include "rule_order.hpp"
+
+struct WatchOptions {
+    unsigned threads = 0;      // lexer workers; 0 means one per hardware thread
+    unsigned debounceMs = 50;  // quiet time after the last change before re-lexing
+    MatchEngine engine = MatchEngine::Automaton;
+};
+
+// Keeps the token streams of a directory tree up to date (`lexer --watch=<dir>`).
+// Every regular file under `root` is lexed once at startup; after that,
+// inotify reports writes, renames and deletions, and only the files they
+// touched are re-read. A file whose contents hash the same as last time is
+// not lexed again, so a save costs time proportional to the saved file.
+//
+// Changes are collected until `debounceMs` pass without a new event, then
+// lexed on a ThreadPool. Each result is printed as soon as it is ready, in
+// text format after a "==> path <==" line; a removed file prints
+// "==> path (deleted) <==". Diagnostics go to stderr. Entries whose name
+// starts with '.' (editor swap files, .git) are ignored.
+//
+// Runs until SIGINT or SIGTERM, or until `root` itself is removed. Returns
+// the process exit code.
+int watchTree(const std::string& root, const RuleOrder& order, const WatchOptions& options);
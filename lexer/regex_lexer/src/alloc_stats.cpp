@@ -0,0 +1,116 @@
+#include "alloc_stats.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <malloc.h>
+#include <new>
+
+namespace {
+
+// Constant-initialized, so they are ready before any static constructor
+// allocates.
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> frees{0};
+std::atomic<uint64_t> allocated_bytes{0};
+std::atomic<uint64_t> live_bytes{0};
+std::atomic<uint64_t> peak_bytes{0};
+
+// Live memory is tracked in usable sizes, which malloc_usable_size() also
+// reports on free; requested sizes only feed the byte totals.
+void* recordAllocation(void* pointer, size_t size) {
+    if (pointer == nullptr) return nullptr;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    const uint64_t live = live_bytes.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed) +
+                          malloc_usable_size(pointer);
+    uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return pointer;
+}
+
+void releaseAllocation(void* pointer) {
+    if (pointer == nullptr) return;
+    frees.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(malloc_usable_size(pointer), std::memory_order_relaxed);
+    std::free(pointer);
+}
+
+void* allocate(size_t size) {
+    void* pointer = recordAllocation(std::malloc(size == 0 ? 1 : size), size);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+void* allocateAligned(size_t size, std::align_val_t alignment) {
+    const size_t align = static_cast<size_t>(alignment);
+    void* pointer = nullptr;
+    if (posix_memalign(&pointer, align < sizeof(void*) ? sizeof(void*) : align, size == 0 ? 1 : size) != 0) {
+        throw std::bad_alloc();
+    }
+    return recordAllocation(pointer, size);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return recordAllocation(std::malloc(size == 0 ? 1 : size), size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return recordAllocation(std::malloc(size == 0 ? 1 : size), size);
+}
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* pointer) noexcept { releaseAllocation(pointer); }
+void operator delete[](void* pointer) noexcept { releaseAllocation(pointer); }
+void operator delete(void* pointer, size_t) noexcept { releaseAllocation(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { releaseAllocation(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { releaseAllocation(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { releaseAllocation(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { releaseAllocation(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { releaseAllocation(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { releaseAllocation(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { releaseAllocation(pointer); }
+
+void AllocCounters::start() {
+    started_.allocations = allocations.load(std::memory_order_relaxed);
+    started_.frees = frees.load(std::memory_order_relaxed);
+    started_.bytes = allocated_bytes.load(std::memory_order_relaxed);
+    peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+AllocSample AllocCounters::stop() {
+    AllocSample sample;
+    sample.allocations = allocations.load(std::memory_order_relaxed) - started_.allocations;
+    sample.frees = frees.load(std::memory_order_relaxed) - started_.frees;
+    sample.bytes = allocated_bytes.load(std::memory_order_relaxed) - started_.bytes;
+    sample.peakLive = peak_bytes.load(std::memory_order_relaxed);
+    sample.endLive = live_bytes.load(std::memory_order_relaxed);
+    return sample;
+}
+
+void printAllocReport(std::ostream& out, const std::vector<AllocPhase>& phases, uint64_t bytes, uint64_t tokens) {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    const double per_token = tokens == 0 ? 0.0 : 1.0 / tokens;
+
+    out << "Allocations: " << bytes << " bytes, " << tokens << " tokens\n";
+    out << "\n" << std::left << std::setw(11) << "phase" << std::right << std::setw(12) << "allocs"
+        << std::setw(12) << "frees" << std::setw(14) << "bytes" << std::setw(14) << "peak live"
+        << std::setw(14) << "live after" << std::setw(13) << "allocs/tok" << std::setw(12) << "bytes/tok"
+        << "\n";
+    out << std::fixed << std::setprecision(3);
+    for (const AllocPhase& phase : phases) {
+        const AllocSample& sample = phase.sample;
+        out << std::left << std::setw(11) << phase.name << std::right << std::setw(12) << sample.allocations
+            << std::setw(12) << sample.frees << std::setw(14) << sample.bytes << std::setw(14) << sample.peakLive
+            << std::setw(14) << sample.endLive << std::setw(13) << sample.allocations * per_token
+            << std::setw(12) << sample.bytes * per_token << "\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
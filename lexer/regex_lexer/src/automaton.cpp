@@ -0,0 +1,335 @@
+#include "automaton.hpp"
+#include "char_class.hpp"
+#include "exception.hpp"
+#include "pattern.hpp"
+#include <algorithm>
+#include <map>
+
+namespace {
+
+constexpr size_t kNoMatch = static_cast<size_t>(-1);
+
+bool isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+struct NfaState {
+    CharSet set;  // consumes one byte of `set` and moves to `target`
+    int target = -1;
+    std::vector<int> epsilon;
+    int rule = -1;          // accepting state of this rule
+    bool boundary = false;  // '\b': its epsilon edges are only taken before a non-word byte
+};
+
+struct Fragment {
+    int start;
+    int end;
+};
+
+// Thompson construction of one NFA holding every rule, each reachable from
+// state 0 by an epsilon edge.
+class NfaBuilder {
+public:
+    NfaBuilder() { add(); }
+
+    void addRule(uint32_t rule, const std::string& source) {
+        source_ = &source;
+        pos_ = 0;
+        const Fragment fragment = alternation(0);
+        if (pos_ != source.size()) fail("unbalanced ')'");
+        states_[0].epsilon.push_back(fragment.start);
+        states_[fragment.end].rule = static_cast<int>(rule);
+    }
+
+    const std::vector<NfaState>& states() const { return states_; }
+
+private:
+    std::vector<NfaState> states_;
+    const std::string* source_ = nullptr;
+    size_t pos_ = 0;
+
+    [[noreturn]] void fail(const std::string& why) const {
+        throw LexerError("Rule '" + *source_ + "' cannot be compiled to an automaton: " + why);
+    }
+
+    bool at(char c) const { return pos_ < source_->size() && (*source_)[pos_] == c; }
+    bool atEnd() const { return pos_ == source_->size() || at('|') || at(')'); }
+
+    int add() {
+        states_.emplace_back();
+        return static_cast<int>(states_.size() - 1);
+    }
+
+    void link(int from, int to) { states_[from].epsilon.push_back(to); }
+
+    Fragment alternation(int depth) {
+        Fragment fragment = sequence(depth);
+        while (at('|')) {
+            ++pos_;
+            const Fragment other = sequence(depth);
+            const Fragment both{add(), add()};
+            link(both.start, fragment.start);
+            link(both.start, other.start);
+            link(fragment.end, both.end);
+            link(other.end, both.end);
+            fragment = both;
+        }
+        return fragment;
+    }
+
+    Fragment sequence(int depth) {
+        const int start = add();
+        int end = start;
+        bool empty = true;
+        bool after_word = false;  // the last byte consumed is certainly a word character
+        while (!atEnd()) {
+            if (at('^')) {
+                if (!empty || depth != 0) fail("'^' is only supported at the start of an alternative");
+                ++pos_;
+                continue;
+            }
+            if (at('\\') && pos_ + 1 < source_->size() && (*source_)[pos_ + 1] == 'b') {
+                pos_ += 2;
+                if (!after_word || depth != 0 || !atEnd()) {
+                    fail("'\\b' is only supported at the end of an alternative, after a word character");
+                }
+                const int boundary = add();
+                const int after = add();
+                states_[boundary].boundary = true;
+                link(end, boundary);
+                link(boundary, after);
+                end = after;
+                continue;
+            }
+            CharSet set;
+            Fragment piece = atom(depth, set);
+            const char quantifier = pos_ < source_->size() ? (*source_)[pos_] : '\0';
+            if (quantifier == '*' || quantifier == '+' || quantifier == '?') {
+                ++pos_;
+                piece = repeat(piece, quantifier);
+            }
+            if (at('*') || at('+') || at('?') || at('{')) fail("unsupported quantifier");
+            after_word = set.any() && (set & ~escapeSet('w')).none() && quantifier != '*' && quantifier != '?';
+            link(end, piece.start);
+            end = piece.end;
+            empty = false;
+        }
+        return {start, end};
+    }
+
+    // One atom; `set` is left empty unless the atom consumes a single byte.
+    Fragment atom(int depth, CharSet& set) {
+        const std::string& source = *source_;
+        const char c = source[pos_];
+        if (c == '(') {
+            ++pos_;
+            if (at('?')) fail("unsupported group");
+            const Fragment group = alternation(depth + 1);
+            if (!at(')')) fail("unterminated group");
+            ++pos_;
+            return group;
+        }
+        if (c == '[') {
+            if (!parseClass(source, pos_, set)) fail("unterminated bracket expression");
+        } else if (c == '\\') {
+            if (pos_ + 1 == source.size()) fail("trailing backslash");
+            const char escaped = source[pos_ + 1];
+            if (escaped == 'B' || (escaped >= '0' && escaped <= '9')) fail("unsupported escape");
+            set = escapeSet(escaped);
+            pos_ += 2;
+        } else if (c == '.') {
+            // ECMAScript '.' stops at line terminators; libstdc++ checks '\n' and '\r'.
+            set = ~(singleChar('\n') | singleChar('\r'));
+            ++pos_;
+        } else if (c == '*' || c == '+' || c == '?' || c == '{' || c == '$' || c == '^') {
+            fail(std::string("unsupported '") + c + "'");
+        } else {
+            set = singleChar(c);
+            ++pos_;
+        }
+        const Fragment piece{add(), add()};
+        states_[piece.start].set = set;
+        states_[piece.start].target = piece.end;
+        return piece;
+    }
+
+    Fragment repeat(Fragment piece, char quantifier) {
+        const Fragment result{add(), add()};
+        link(result.start, piece.start);
+        link(piece.end, result.end);
+        if (quantifier != '+') link(result.start, result.end);
+        if (quantifier != '?') link(piece.end, piece.start);
+        return result;
+    }
+};
+
+// Epsilon closure of `seeds`, sorted. Boundary states are included but not
+// crossed, since crossing them depends on the byte that follows.
+std::vector<int> closure(const std::vector<NfaState>& states, std::vector<int> seeds) {
+    std::vector<bool> seen(states.size(), false);
+    std::vector<int> result;
+    while (!seeds.empty()) {
+        const int state = seeds.back();
+        seeds.pop_back();
+        if (seen[state]) continue;
+        seen[state] = true;
+        result.push_back(state);
+        if (states[state].boundary) continue;
+        for (int next : states[state].epsilon) seeds.push_back(next);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+} // namespace
+
+const RuleAutomaton& RuleAutomaton::instance() {
+    static const RuleAutomaton automaton;
+    return automaton;
+}
+
+RuleAutomaton::RuleAutomaton() {
+    NfaBuilder builder;
+    const std::vector<TokenPattern>& rules = Patterns::tokenPatterns;
+    for (size_t i = 0; i < rules.size(); ++i) builder.addRule(static_cast<uint32_t>(i), rules[i].source);
+    const std::vector<NfaState>& states = builder.states();
+
+    // Bytes that every transition treats alike share a class, which keeps the
+    // table at a few dozen columns instead of 256.
+    std::vector<CharSet> sets;
+    for (const NfaState& state : states) {
+        if (state.target >= 0 && std::find(sets.begin(), sets.end(), state.set) == sets.end()) {
+            sets.push_back(state.set);
+        }
+    }
+    std::map<std::vector<bool>, uint8_t> signatures;
+    std::vector<unsigned char> representative;
+    for (unsigned byte = 0; byte < 256; ++byte) {
+        std::vector<bool> signature(sets.size());
+        for (size_t i = 0; i < sets.size(); ++i) signature[i] = sets[i].test(byte);
+        auto found = signatures.emplace(signature, static_cast<uint8_t>(representative.size()));
+        if (found.second) representative.push_back(static_cast<unsigned char>(byte));
+        byteClass_[byte] = found.first->second;
+    }
+    classes_ = representative.size();
+
+    // Subset construction; state 0 is the empty (dead) set.
+    std::map<std::vector<int>, uint32_t> ids;
+    std::vector<std::vector<int>> subsets;
+    auto intern = [&](std::vector<int> subset) {
+        auto found = ids.emplace(subset, static_cast<uint32_t>(subsets.size()));
+        if (found.second) subsets.push_back(std::move(subset));
+        return found.first->second;
+    };
+    intern({});
+    start_ = intern(closure(states, {0}));
+    for (size_t current = 1; current < subsets.size(); ++current) {
+        next_.resize(subsets.size() * classes_, 0);
+        for (size_t k = 0; k < classes_; ++k) {
+            std::vector<int> targets;
+            for (int state : subsets[current]) {
+                if (states[state].target >= 0 && states[state].set.test(representative[k])) {
+                    targets.push_back(states[state].target);
+                }
+            }
+            const uint32_t target = intern(closure(states, std::move(targets)));
+            next_.resize(subsets.size() * classes_, 0);
+            next_[current * classes_ + k] = target;
+        }
+    }
+
+    accepts_.resize(subsets.size());
+    for (size_t current = 0; current < subsets.size(); ++current) {
+        std::vector<int> beyond;
+        for (int state : subsets[current]) {
+            const NfaState& nfa = states[state];
+            if (nfa.rule >= 0) accepts_[current].push_back({static_cast<uint32_t>(nfa.rule), false});
+            if (nfa.boundary) beyond.insert(beyond.end(), nfa.epsilon.begin(), nfa.epsilon.end());
+        }
+        for (int state : closure(states, std::move(beyond))) {
+            const int rule = states[state].rule;
+            if (rule < 0) continue;
+            const bool unconditional = std::any_of(accepts_[current].begin(), accepts_[current].end(),
+                                                   [rule](const Accept& a) { return a.rule == uint32_t(rule); });
+            if (!unconditional) accepts_[current].push_back({static_cast<uint32_t>(rule), true});
+        }
+    }
+}
+
+AutomatonScanner::AutomatonScanner(const RuleOrder& order)
+    : automaton_(RuleAutomaton::instance()),
+      rank_(Patterns::tokenPatterns.size()),
+      end_(Patterns::tokenPatterns.size(), kNoMatch),
+      stride_((automaton_.accepts_.size() + 63) / 64) {
+    for (size_t i = 0; i < order.indices().size(); ++i) rank_[order.indices()[i]] = i;
+}
+
+void AutomatonScanner::forgetBefore(size_t pos) {
+    if (pos <= failedBase_) return;
+    const size_t drop = pos - failedBase_;
+    failedBase_ = pos;
+    if (drop * stride_ >= failed_.size() - failedHead_) {
+        failed_.clear();
+        failedHead_ = 0;
+        return;
+    }
+    failedHead_ += drop * stride_;
+    // Moving the live part down once it is the smaller half keeps this
+    // amortized constant per position.
+    if (failedHead_ * 2 > failed_.size()) {
+        failed_.erase(failed_.begin(), failed_.begin() + static_cast<std::ptrdiff_t>(failedHead_));
+        failedHead_ = 0;
+    }
+}
+
+bool AutomatonScanner::failed(uint32_t state, size_t pos) const {
+    const size_t word = failedHead_ + (pos - failedBase_) * stride_ + state / 64;
+    return word < failed_.size() && ((failed_[word] >> (state % 64)) & 1) != 0;
+}
+
+void AutomatonScanner::markFailed(uint32_t state, size_t pos) {
+    const size_t word = failedHead_ + (pos - failedBase_) * stride_ + state / 64;
+    if (word >= failed_.size()) failed_.resize(word - state / 64 + stride_, 0);
+    failed_[word] |= uint64_t(1) << (state % 64);
+}
+
+bool AutomatonScanner::match(std::string_view source, size_t pos, size_t& rule, size_t& length) {
+    const RuleAutomaton& dfa = automaton_;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(source.data());
+    const size_t size = source.size();
+    forgetBefore(pos);
+    uint32_t state = dfa.start_;
+    size_t i = pos;
+    for (;;) {
+        if (failed(state, i)) break;
+        bool accepted = false;
+        for (const RuleAutomaton::Accept& accept : dfa.accepts_[state]) {
+            if (accept.boundary && i < size && isWordByte(bytes[i])) continue;
+            if (end_[accept.rule] == kNoMatch) matched_.push_back(accept.rule);
+            end_[accept.rule] = i;
+            accepted = true;
+        }
+        if (accepted) {
+            trail_.clear();
+        } else {
+            trail_.push_back((static_cast<uint64_t>(state) << 40) | i);
+        }
+        if (i == size) break;
+        state = dfa.next_[state * dfa.classes_ + dfa.byteClass_[bytes[i]]];
+        if (state == 0) break;
+        ++i;
+    }
+    for (uint64_t pair : trail_) markFailed(static_cast<uint32_t>(pair >> 40), pair & ((uint64_t(1) << 40) - 1));
+    trail_.clear();
+    if (matched_.empty()) return false;
+
+    uint32_t best = matched_[0];
+    for (uint32_t candidate : matched_) {
+        if (rank_[candidate] < rank_[best]) best = candidate;
+    }
+    rule = best;
+    length = end_[best] - pos;
+    for (uint32_t candidate : matched_) end_[candidate] = kNoMatch;
+    matched_.clear();
+    return true;
+}
@@ -0,0 +1,84 @@
+#include "batch_lexer.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+struct FileResult {
+    std::string output;
+    std::string diagnostics;
+    bool failed = false;
+};
+
+FileResult lexBuffer(const std::string& path, const FileBuffer& buffer, const RuleOrder& order,
+                     const BatchOptions& options) {
+    FileResult result;
+    std::ostringstream output;
+    std::ostringstream diagnostics;
+    if (!buffer.error.empty()) {
+        diagnostics << "Error: Could not read file " << path << ": " << buffer.error << '\n';
+        result.failed = true;
+    } else {
+        try {
+            Lexer lexer(buffer.data, order);
+            lexer.setEngine(options.engine);
+            lexer.setDiagnosticStream(diagnostics);
+            const std::vector<Token> tokens = lexer.tokenize();
+            if (options.format == TokenFormat::Text) output << "==> " << path << " <==\n";
+            writeTokens(output, tokens, options.format);
+        } catch (const LexerError& e) {
+            diagnostics << path << ": Lexical error: " << e.what() << '\n';
+            result.failed = true;
+        }
+    }
+    result.output = output.str();
+    result.diagnostics = diagnostics.str();
+    return result;
+}
+
+} // namespace
+
+int lexFiles(const std::vector<std::string>& paths, const RuleOrder& order, const BatchOptions& options) {
+    std::unique_ptr<FileBatchReader> reader;
+    try {
+        reader = std::make_unique<FileBatchReader>(paths, options.readAhead, options.backend);
+    } catch (const LexerError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Results wait here until every earlier file has been written; writing
+    // one releases its slot of the read window.
+    std::mutex output_mutex;
+    std::vector<std::unique_ptr<FileResult>> results(paths.size());
+    size_t written = 0;
+    bool failed = false;
+    {
+        ThreadPool pool(options.threads);
+        FileBuffer buffer;
+        while (reader->next(buffer)) {
+            auto shared = std::make_shared<FileBuffer>(std::move(buffer));
+            pool.submit([&, shared] {
+                auto result = std::make_unique<FileResult>(lexBuffer(paths[shared->index], *shared, order, options));
+                shared->data.clear();
+                shared->data.shrink_to_fit();
+                std::lock_guard<std::mutex> lock(output_mutex);
+                results[shared->index] = std::move(result);
+                while (written < results.size() && results[written]) {
+                    const FileResult& ready = *results[written];
+                    std::cerr << ready.diagnostics;
+                    std::cout << ready.output;
+                    failed = failed || ready.failed;
+                    results[written++].reset();
+                    reader->release();
+                }
+            });
+        }
+    }
+    std::cout.flush();
+    return failed ? 1 : 0;
+}
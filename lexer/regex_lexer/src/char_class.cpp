@@ -0,0 +1,69 @@
+#include "char_class.hpp"
+
+CharSet charRange(unsigned char first, unsigned char last) {
+    CharSet set;
+    for (unsigned c = first; c <= last; ++c) set.set(c);
+    return set;
+}
+
+CharSet singleChar(char c) {
+    CharSet set;
+    set.set(static_cast<unsigned char>(c));
+    return set;
+}
+
+CharSet escapeSet(char c) {
+    CharSet word = charRange('a', 'z') | charRange('A', 'Z') | charRange('0', '9') | singleChar('_');
+    CharSet space =
+        singleChar(' ') | singleChar('\t') | singleChar('\n') | singleChar('\v') | singleChar('\f') | singleChar('\r');
+    switch (c) {
+        case 's': return space;
+        case 'S': return ~space;
+        case 'd': return charRange('0', '9');
+        case 'D': return ~charRange('0', '9');
+        case 'w': return word;
+        case 'W': return ~word;
+        case 'n': return singleChar('\n');
+        case 't': return singleChar('\t');
+        case 'r': return singleChar('\r');
+        case 'f': return singleChar('\f');
+        case 'v': return singleChar('\v');
+        default: return singleChar(c);
+    }
+}
+
+bool parseClass(const std::string& source, size_t& pos, CharSet& set) {
+    size_t i = pos + 1;
+    bool negate = i < source.size() && source[i] == '^';
+    if (negate) ++i;
+    set.reset();
+    while (i < source.size() && source[i] != ']') {
+        CharSet item;
+        int literal = -1;
+        if (source[i] == '\\' && i + 1 < source.size()) {
+            item = escapeSet(source[i + 1]);
+            if (item.count() == 1) {
+                while (!item.test(++literal)) {}
+            }
+            i += 2;
+        } else {
+            literal = static_cast<unsigned char>(source[i]);
+            item = singleChar(source[i]);
+            ++i;
+        }
+        if (literal >= 0 && i + 1 < source.size() && source[i] == '-' && source[i + 1] != ']') {
+            ++i;
+            unsigned char last = static_cast<unsigned char>(source[i]);
+            if (source[i] == '\\' && i + 1 < source.size()) {
+                last = static_cast<unsigned char>(source[++i]);
+            }
+            ++i;
+            item = charRange(static_cast<unsigned char>(literal), last);
+        }
+        set |= item;
+    }
+    if (i >= source.size()) return false;
+    if (negate) set.flip();
+    pos = i + 1;
+    return true;
+}
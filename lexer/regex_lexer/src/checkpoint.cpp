@@ -0,0 +1,213 @@
+#include "checkpoint.hpp"
+#include "exception.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'L', 'X', 'C', 'P'};
+constexpr size_t kHeaderSize = 32;
+constexpr size_t kEntrySize = 16;
+
+uint32_t getU32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint64_t getU64(const unsigned char* p) {
+    return static_cast<uint64_t>(getU32(p)) | static_cast<uint64_t>(getU32(p + 4)) << 32;
+}
+
+void putU32(std::string& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<char>(value >> shift));
+}
+
+void putU64(std::string& out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value));
+    putU32(out, static_cast<uint32_t>(value >> 32));
+}
+
+bool parseNumber(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    errno = 0;
+    value = std::strtoull(text.c_str(), nullptr, 10);
+    return errno == 0;
+}
+
+} // namespace
+
+bool parseTokenRange(const std::string& spec, TokenRange::Unit unit, TokenRange& range) {
+    range.unit = unit;
+    const size_t dash = spec.find('-');
+    if (!parseNumber(spec.substr(0, dash), range.first)) return false;
+    if (dash == std::string::npos) {
+        range.last = range.first;
+    } else if (dash + 1 == spec.size()) {
+        range.last = std::numeric_limits<uint64_t>::max();
+    } else if (!parseNumber(spec.substr(dash + 1), range.last)) {
+        return false;
+    }
+    return range.first <= range.last && (unit == TokenRange::Unit::Bytes || range.first >= 1);
+}
+
+std::string checkpointPath(const std::string& source_path) {
+    return source_path + ".lxcp";
+}
+
+bool statCheckpointSource(const std::string& source_path, CheckpointFile& file) {
+    struct stat info;
+    if (stat(source_path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return false;
+    file.sourceSize = static_cast<uint64_t>(info.st_size);
+    file.sourceMtime = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+bool loadCheckpoints(const std::string& source_path, CheckpointFile& file) {
+    CheckpointFile current;
+    if (!statCheckpointSource(source_path, current)) return false;
+    std::ifstream in(checkpointPath(source_path), std::ios::binary);
+    if (!in.is_open()) return false;
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    if (data.size() < kHeaderSize || std::memcmp(bytes, kMagic, sizeof(kMagic)) != 0 ||
+        getU32(bytes + 4) != kCheckpointVersion) {
+        return false;
+    }
+    const uint32_t count = getU32(bytes + 12);
+    if (count == 0 || data.size() != kHeaderSize + size_t(count) * kEntrySize ||
+        getU64(bytes + 16) != current.sourceSize || static_cast<int64_t>(getU64(bytes + 24)) != current.sourceMtime) {
+        return false;
+    }
+    current.interval = getU32(bytes + 8);
+    current.checkpoints.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        const unsigned char* entry = bytes + kHeaderSize + size_t(i) * kEntrySize;
+        const LexerCheckpoint checkpoint{getU64(entry), getU32(entry + 8), getU32(entry + 12)};
+        // Offsets have to rise through the file; anything else is damage.
+        if (checkpoint.offset > current.sourceSize ||
+            (i > 0 && checkpoint.offset <= current.checkpoints.back().offset)) {
+            return false;
+        }
+        current.checkpoints.push_back(checkpoint);
+    }
+    if (current.checkpoints.front().offset != 0) return false;
+    file = std::move(current);
+    return true;
+}
+
+void saveCheckpoints(const std::string& source_path, const CheckpointFile& file) {
+    std::string out(kMagic, sizeof(kMagic));
+    putU32(out, kCheckpointVersion);
+    putU32(out, file.interval);
+    putU32(out, static_cast<uint32_t>(file.checkpoints.size()));
+    putU64(out, file.sourceSize);
+    putU64(out, static_cast<uint64_t>(file.sourceMtime));
+    for (const LexerCheckpoint& checkpoint : file.checkpoints) {
+        putU64(out, checkpoint.offset);
+        putU32(out, checkpoint.line);
+        putU32(out, checkpoint.column);
+    }
+    const std::string path = checkpointPath(source_path);
+    const std::string temporary = path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        stream.write(out.data(), static_cast<std::streamsize>(out.size()));
+        if (!stream.good()) {
+            std::remove(temporary.c_str());
+            throw LexerError("Could not write " + temporary);
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        const std::string reason = std::strerror(errno);
+        std::remove(temporary.c_str());
+        throw LexerError("Could not replace " + path + ": " + reason);
+    }
+}
+
+CheckpointFile buildCheckpoints(const std::string& source_path, size_t interval, const RuleOrder& order) {
+    CheckpointFile file;
+    // The source is stat'ed before it is read, so an edit during the pass
+    // leaves a sidecar that is already out of date rather than wrong.
+    std::ifstream in(source_path, std::ios::binary);
+    if (!statCheckpointSource(source_path, file) || !in.is_open()) {
+        throw LexerError("Could not open file " + source_path);
+    }
+    const std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    file.interval = static_cast<uint32_t>(interval);
+
+    std::ostream discard(nullptr);
+    Lexer lexer(source, order);
+    lexer.setDiagnosticStream(discard);
+    lexer.recordCheckpoints(interval, file.checkpoints);
+    Token token;
+    while (lexer.next(token)) {
+    }
+    try {
+        saveCheckpoints(source_path, file);
+    } catch (const LexerError& e) {
+        std::cerr << "Warning: " << e.what() << "; checkpoints are not kept" << std::endl;
+    }
+    return file;
+}
+
+std::vector<Token> lexRange(const std::string& source_path, const CheckpointFile& file, const TokenRange& range,
+                            const RuleOrder& order, MatchEngine engine, std::ostream& diagnostics) {
+    const std::vector<LexerCheckpoint>& checkpoints = file.checkpoints;
+    const bool lines = range.unit == TokenRange::Unit::Lines;
+    auto beforeRange = [&](const LexerCheckpoint& checkpoint) {
+        return lines ? checkpoint.line < range.first : checkpoint.offset <= range.first;
+    };
+    auto notAfterRange = [&](const LexerCheckpoint& checkpoint) {
+        return lines ? checkpoint.line <= range.last : checkpoint.offset <= range.last;
+    };
+
+    // Start at the last checkpoint before the range. Stop at the second one
+    // after it: everything up to the first one then comes out exactly as in
+    // a full run, including the one character a boundary check looks past
+    // the last token.
+    const auto first = std::partition_point(checkpoints.begin() + 1, checkpoints.end(), beforeRange);
+    const size_t begin = static_cast<size_t>(first - checkpoints.begin()) - 1;
+    const size_t after = static_cast<size_t>(std::partition_point(first, checkpoints.end(), notAfterRange) -
+                                             checkpoints.begin());
+    const uint64_t start = checkpoints[begin].offset;
+    const uint64_t end = after + 1 < checkpoints.size() ? checkpoints[after + 1].offset : file.sourceSize;
+
+    std::ifstream in(source_path, std::ios::binary);
+    if (!in.is_open()) throw LexerError("Could not open file " + source_path);
+    std::string slice(end - start, '\0');
+    in.seekg(static_cast<std::streamoff>(start));
+    in.read(&slice[0], static_cast<std::streamsize>(slice.size()));
+    if (static_cast<uint64_t>(in.gcount()) != slice.size()) {
+        throw LexerError("Could not read " + source_path + " (changed since its checkpoints were written?)");
+    }
+
+    // Diagnostics are held back until their token turns out to be in range.
+    std::ostringstream held;
+    Lexer lexer(slice, order);
+    lexer.setEngine(engine);
+    lexer.setDiagnosticStream(held);
+    lexer.resumeAt(checkpoints[begin]);
+    std::vector<Token> tokens;
+    Token token;
+    while (lexer.next(token)) {
+        token.offset += start;
+        const uint64_t position = lines ? static_cast<uint64_t>(token.line) : token.offset;
+        if (position > range.last || (token.type == TokenType::T_EOF && end != file.sourceSize)) break;
+        if (position >= range.first) {
+            diagnostics << held.str();
+            tokens.push_back(std::move(token));
+        }
+        held.str("");
+    }
+    return tokens;
+}
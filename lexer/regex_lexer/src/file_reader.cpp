@@ -0,0 +1,333 @@
+#include "file_reader.hpp"
+#include "exception.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define LEXER_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+struct FileBatchReader::Read {
+    size_t index;
+    int fd;
+    std::string data;  // sized from fstat(); shrunk if the file turns out shorter
+    size_t offset = 0;
+    iovec iov{};
+};
+
+#ifdef LEXER_HAVE_IO_URING
+
+// A raw io_uring instance: the submission and completion rings mapped from
+// the kernel, driven with the two system calls directly (no liburing).
+struct FileBatchReader::Uring {
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    static int enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+    }
+
+    // nullptr when the kernel refuses (ENOSYS, EPERM under seccomp, ...).
+    static std::unique_ptr<Uring> create(unsigned entries) {
+        io_uring_params params{};
+        const int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return nullptr;
+        auto ring = std::make_unique<Uring>();
+        ring->fd = fd;
+        ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+        ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+        if (ring->sqRing == MAP_FAILED) return nullptr;
+        ring->cqRing = single ? ring->sqRing
+                              : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                     fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) return nullptr;
+        ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED) return nullptr;
+
+        char* sq = static_cast<char*>(ring->sqRing);
+        char* cq = static_cast<char*>(ring->cqRing);
+        ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+
+    ~Uring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+    }
+
+    // Queues a readv of the rest of `read` and submits it. On failure the
+    // entry is taken back, so the kernel never sees it.
+    bool submit(Read& read, uint64_t slot) {
+        const unsigned tail = *sqTail;
+        const unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        read.iov.iov_base = &read.data[read.offset];
+        read.iov.iov_len = read.data.size() - read.offset;
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = read.fd;
+        sqe.off = read.offset;
+        sqe.addr = reinterpret_cast<uint64_t>(&read.iov);
+        sqe.len = 1;
+        sqe.user_data = slot;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        int submitted;
+        do {
+            submitted = enter(fd, 1, 0, 0);
+        } while (submitted < 0 && errno == EINTR);
+        if (submitted == 1) return true;
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+};
+
+#else
+
+struct FileBatchReader::Uring {
+    static std::unique_ptr<Uring> create(unsigned) { return nullptr; }
+};
+
+#endif
+
+namespace {
+
+// Reads the rest of `data` from `fd` with pread(); returns 0 or an errno value.
+int preadAll(int fd, std::string& data, size_t& offset) {
+    while (offset < data.size()) {
+        const ssize_t count = pread(fd, &data[offset], data.size() - offset, static_cast<off_t>(offset));
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (count == 0) {
+            data.resize(offset);
+            break;
+        }
+        offset += static_cast<size_t>(count);
+    }
+    return 0;
+}
+
+} // namespace
+
+FileBatchReader::FileBatchReader(std::vector<std::string> paths, size_t depth, Backend backend)
+    : paths_(std::move(paths)), depth_(std::min<size_t>(std::max<size_t>(depth, 1), kMaxDepth)) {
+    if (backend != Backend::Pread) {
+        uring_ = Uring::create(static_cast<unsigned>(depth_));
+        if (!uring_ && backend == Backend::IoUring) {
+            throw LexerError(std::string("io_uring is not available: ") + std::strerror(errno));
+        }
+    }
+    if (uring_) {
+        reads_.resize(depth_);
+    } else {
+        pool_ = std::make_unique<ThreadPool>(static_cast<unsigned>(std::min<size_t>(depth_, 16)));
+    }
+}
+
+FileBatchReader::~FileBatchReader() {
+    // Let every read land before the buffers it writes into go away.
+    pool_.reset();
+    while (uring_ && inFlight_ > 0) reapUring(true);
+}
+
+const char* FileBatchReader::backendName() const {
+    return uring_ ? "io_uring" : "pread";
+}
+
+bool FileBatchReader::next(FileBuffer& buffer) {
+    for (;;) {
+        fill();
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!done_.empty()) {
+            buffer = std::move(done_.front());
+            done_.pop_front();
+            ++returned_;
+            return true;
+        }
+        if (returned_ == paths_.size()) return false;
+        if (uring_ && inFlight_ > 0) {
+            lock.unlock();
+            reapUring(true);
+            continue;
+        }
+        // A pread() worker is busy, or the window is full until release().
+        changed_.wait(lock, [this] {
+            return !done_.empty() || (submitted_ < paths_.size() && submitted_ < released_ + depth_);
+        });
+    }
+}
+
+void FileBatchReader::release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++released_;
+    changed_.notify_all();
+}
+
+void FileBatchReader::fill() {
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (submitted_ == paths_.size() || submitted_ >= released_ + depth_) return;
+        }
+        const size_t index = submitted_++;
+        if (!startRead(index)) {
+            FileBuffer failed;
+            failed.index = index;
+            failed.error = std::strerror(errno);
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.push_back(std::move(failed));
+        }
+    }
+}
+
+// Opens the file and starts reading it. Returns false with errno set if it
+// cannot be opened.
+bool FileBatchReader::startRead(size_t index) {
+    const int fd = open(paths_[index].c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat info;
+    const int error = fstat(fd, &info) != 0 ? errno : S_ISDIR(info.st_mode) ? EISDIR : 0;
+    if (error != 0) {
+        close(fd);
+        errno = error;
+        return false;
+    }
+    auto read = std::make_unique<Read>();
+    read->index = index;
+    read->fd = fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++inFlight_;
+    }
+
+    // Pipes and devices have no size to read up to; they are drained here.
+    if (!S_ISREG(info.st_mode)) {
+        char chunk[65536];
+        int read_error = 0;
+        for (;;) {
+            const ssize_t count = ::read(fd, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR) continue;
+            if (count <= 0) {
+                read_error = count < 0 ? errno : 0;
+                break;
+            }
+            read->data.append(chunk, static_cast<size_t>(count));
+        }
+        finish(*read, read_error);
+        return true;
+    }
+    read->data.resize(static_cast<size_t>(info.st_size));
+    if (read->data.empty()) {
+        finish(*read, 0);
+        return true;
+    }
+
+#ifdef LEXER_HAVE_IO_URING
+    if (uring_) {
+        const size_t slot = static_cast<size_t>(std::find(reads_.begin(), reads_.end(), nullptr) - reads_.begin());
+        if (uring_->submit(*read, slot)) {
+            reads_[slot] = std::move(read);
+        } else {
+            finish(*read, preadAll(read->fd, read->data, read->offset));
+        }
+        return true;
+    }
+#endif
+    std::shared_ptr<Read> shared(std::move(read));
+    pool_->submit([this, shared] { finish(*shared, preadAll(shared->fd, shared->data, shared->offset)); });
+    return true;
+}
+
+void FileBatchReader::finish(Read& read, int error) {
+    close(read.fd);
+    FileBuffer buffer;
+    buffer.index = read.index;
+    if (error != 0) {
+        buffer.error = std::strerror(error);
+    } else {
+        buffer.data = std::move(read.data);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_.push_back(std::move(buffer));
+    --inFlight_;
+    changed_.notify_all();
+}
+
+// Handles every available completion, first waiting for one if `wait`.
+void FileBatchReader::reapUring(bool wait) {
+#ifdef LEXER_HAVE_IO_URING
+    Uring& ring = *uring_;
+    if (wait) {
+        while (Uring::enter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno == EINTR) {
+        }
+    }
+    unsigned head = *ring.cqHead;
+    const unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+        const size_t slot = static_cast<size_t>(cqe.user_data);
+        const int result = cqe.res;
+        Read& read = *reads_[slot];
+        bool complete = true;
+        int error = 0;
+        if (result == -EINTR || result == -EAGAIN) {
+            complete = false;
+        } else if (result < 0) {
+            error = -result;
+        } else if (result == 0) {
+            read.data.resize(read.offset);  // the file shrank since fstat()
+        } else {
+            read.offset += static_cast<size_t>(result);
+            complete = read.offset == read.data.size();
+        }
+        // Short reads continue where they stopped.
+        if (!complete && !ring.submit(read, slot)) {
+            error = preadAll(read.fd, read.data, read.offset);
+            complete = true;
+        }
+        if (complete) {
+            finish(read, error);
+            reads_[slot].reset();
+        }
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+#else
+    (void)wait;
+#endif
+}
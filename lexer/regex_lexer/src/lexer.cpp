@@ -1,30 +1,141 @@
 #include "lexer.hpp"
 #include "pattern.hpp"
+#include "utf8.hpp"
 #include <regex>
 #include <iostream>
 
-Lexer::Lexer(const std::string& source) : source_(source), line_(1), column_(1), pos_(0) {}
+Lexer::Lexer(std::string_view source, const RuleOrder& order)
+    : source_(source), line_(1), column_(1), pos_(0), finished_(false), order_(order),
+      ruleHits_(Patterns::tokenPatterns.size(), 0), diagnostics_(&std::cerr), engine_(MatchEngine::Automaton),
+      scanner_(order), checkpoints_(nullptr), checkpointInterval_(0), nextCheckpoint_(0) {
+    LEXER_STATS_ONLY(stats_.rules.resize(Patterns::tokenPatterns.size());)
+    LEXER_STATS_ONLY(stats_.bytes = source_.size();)
+    LEXER_STATS_ONLY(stats_.automaton = true;)
+    ascii_ = isAscii(source_.data(), source_.size());
+    if (!ascii_) {
+        const size_t invalid = findInvalidUtf8(source_.data(), source_.size());
+        if (invalid != source_.size()) {
+            advance(source_.data(), invalid);
+            throw LexerError("Invalid UTF-8 byte at line " + std::to_string(line_) + ", column " +
+                             std::to_string(column_));
+        }
+    }
+}
+
+// Moves line_ and column_ past `text`. Columns count code points, so a
+// multi-byte character is one column wide.
+void Lexer::advance(const char* text, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        const char c = text[i];
+        if (c == '\n') {
+            line_++;
+            column_ = 1;
+        } else if (ascii_ || (static_cast<unsigned char>(c) & 0xC0) != 0x80) {
+            column_++;
+        }
+    }
+}
+
+namespace {
+
+// The regex '\s' set in the "C" locale (see escapeSet). Unlike std::isspace it
+// does not depend on the locale and takes any char, negative ones included.
+bool isAsciiSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Characters that end an identifier without making it invalid; the same set
+// the T_INVALID_IDENTIFIER pattern excludes from its middle part.
+bool endsIdentifier(char c) {
+    if (isAsciiSpace(c)) return true;
+    switch (c) {
+    case ';': case '{': case '}': case '(': case ')': case '[': case ']': case ',': case '=': case '+':
+    case '-': case '/': case '%': case '&': case '|': case '^': case '~': case '<': case '>': case '?':
+    case ':': case '.': case '"':
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+// The token patterns only know ASCII letters, so identifiers with other
+// letters in them are scanned here. Identifiers spelled in ASCII alone are
+// left to the patterns, which also keeps keywords theirs. Invalid identifiers
+// follow the shape of the ASCII T_INVALID_IDENTIFIER pattern: at least two
+// identifier characters, a run of characters that neither continue nor end
+// an identifier, then identifier characters up to the next stray character.
+bool Lexer::scanUnicodeIdentifier(Token& token) {
+    const char* data = source_.data();
+    const size_t size = source_.size();
+    size_t length;
+    if (!isIdentifierStart(decodeUtf8(data + pos_, size - pos_, length))) return false;
+    bool unicode = false;
+    size_t characters = 0;
+    // Identifier characters from `at` on; returns where they stop.
+    auto identifierRun = [&](size_t at) {
+        uint32_t code_point;
+        while (at < size && isIdentifierContinue(code_point = decodeUtf8(data + at, size - at, length))) {
+            unicode = unicode || code_point >= 0x80;
+            ++characters;
+            at += length;
+        }
+        return at;
+    };
+    size_t end = identifierRun(pos_);
+    if (!unicode) return false;
+
+    size_t stray = end;
+    while (characters >= 2 && stray < size && !endsIdentifier(data[stray]) &&
+           !isIdentifierContinue(decodeUtf8(data + stray, size - stray, length))) {
+        stray += length;
+    }
+    TokenType type = TokenType::T_IDENTIFIER;
+    if (stray != end) {
+        type = TokenType::T_INVALID_IDENTIFIER;
+        end = identifierRun(stray);
+    }
+    const std::string value(source_.substr(pos_, end - pos_));
+    if (type == TokenType::T_INVALID_IDENTIFIER) {
+        *diagnostics_ << "Error: Invalid identifier '" << value << "' at line " << line_ << ", column " << column_
+                      << std::endl;
+    }
+    token = {type, value, line_, column_, pos_};
+    advance(value.data(), value.size());
+    pos_ = end;
+    return true;
+}
 
 void Lexer::skipWhitespace() {
+    LEXER_STATS_ONLY(ScopedPhaseTimer timer(stats_.whitespace);)
+    if (engine_ == MatchEngine::Automaton) {
+        size_t end = pos_;
+        while (end < source_.size() && isAsciiSpace(source_[end])) ++end;
+        advance(source_.data() + pos_, end - pos_);
+        pos_ = end;
+        return;
+    }
     std::smatch match;
-    const std::string current = source_.substr(pos_);
+    const std::string current(source_.substr(pos_));
     if (std::regex_search(current, match, std::regex("^\\s+"))) {
-        for (char c : match.str()) {
-            if (c == '\n') {
-                line_++;
-                column_ = 1;
-            } else {
-                column_++;
-            }
-        }
+        advance(match.str().data(), match.length());
         pos_ += match.length();
     }
 }
 
-void Lexer::handleMultiLineComment() {
-    std::smatch match;
-    const std::string current = source_.substr(pos_);
-    if (std::regex_search(current, match, std::regex("^/\\*"))) {
+// Skips a block comment at pos_; returns whether there was one.
+bool Lexer::handleMultiLineComment() {
+    LEXER_STATS_ONLY(ScopedPhaseTimer timer(stats_.comments);)
+    bool opens;
+    if (engine_ == MatchEngine::Automaton) {
+        opens = source_.compare(pos_, 2, "/*") == 0;
+    } else {
+        std::smatch match;
+        const std::string current(source_.substr(pos_));
+        opens = std::regex_search(current, match, std::regex("^/\\*"));
+    }
+    if (opens) {
         pos_ += 2;
         column_ += 2;
         size_t end_pos = source_.find("*/", pos_);
@@ -32,78 +143,111 @@ void Lexer::handleMultiLineComment() {
             throw LexerError("Unclosed multi-line comment at line " + std::to_string(line_) +
                             ", column " + std::to_string(column_));
         }
-        std::string comment_content = source_.substr(pos_, end_pos - pos_);
-        for (char c : comment_content) {
-            if (c == '\n') {
-                line_++;
-                column_ = 1;
-            } else {
-                column_++;
-            }
-        }
+        advance(source_.data() + pos_, end_pos - pos_);
         pos_ = end_pos + 2;
         column_ += 2;
     }
+    return opens;
 }
 
 Token Lexer::getNextToken() {
-    const std::string current = source_.substr(pos_);
-    for (const auto& pattern_pair : Patterns::tokenPatterns) {
-        const std::regex& pattern = pattern_pair.first;
-        TokenType type = pattern_pair.second;
-        std::smatch match;
-        if (std::regex_search(current, match, pattern)) {
-            std::string token_value = match.str();
-            Token token{type, token_value, line_, column_};
-            if (type == TokenType::T_COMMENT) {
-                for (char c : token_value) {
-                    if (c == '\n') {
-                        line_++;
-                        column_ = 1;
-                    } else {
-                        column_++;
-                    }
-                }
-                pos_ += match.length();
-                return {TokenType::T_COMMENT, "", line_, column_}; // Return empty token for comments
-            }
-            if (type == TokenType::T_INVALID_IDENTIFIER) {
-                std::cerr << "Error: Invalid identifier '" << token_value << "' at line " << line_
-                          << ", column " << column_ << std::endl;
-            }
-            for (char c : token_value) {
-                if (c == '\n') {
-                    line_++;
-                    column_ = 1;
-                } else {
-                    column_++;
-                }
-            }
-            pos_ += match.length();
-            return token;
+    if (!ascii_) {
+        Token token;
+        if (scanUnicodeIdentifier(token)) return token;
+    }
+    if (engine_ == MatchEngine::Automaton) {
+        size_t rule;
+        size_t length;
+        LEXER_STATS_ONLY(stats_.walks++; const auto started = StatsClock::now();)
+        if (scanner_.match(source_, pos_, rule, length)) {
+            LEXER_STATS_ONLY(RuleStats& hit = stats_.rules[rule]; hit.hits++; hit.nanos += elapsedNanos(started);)
+            return takeMatch(rule, std::string(source_.substr(pos_, length)));
+        }
+    } else {
+        const std::string current(source_.substr(pos_));
+        for (size_t i : order_.indices()) {
+            const std::regex& pattern = Patterns::tokenPatterns[i].regex;
+            std::smatch match;
+            LEXER_STATS_ONLY(RuleStats& rule = stats_.rules[i]; rule.attempts++;
+                             const auto started = StatsClock::now();)
+            const bool matched = std::regex_search(current, match, pattern);
+            LEXER_STATS_ONLY(rule.nanos += elapsedNanos(started); rule.hits += matched;)
+            if (matched) return takeMatch(i, match.str());
         }
     }
-    std::string unknown_char(1, source_[pos_]);
-    std::cerr << "Error: Unknown token at line " << line_ << ", column " << column_
+    // A whole character, however many bytes it takes.
+    size_t length = 1;
+    if (!ascii_) decodeUtf8(source_.data() + pos_, source_.size() - pos_, length);
+    std::string unknown_char(source_.substr(pos_, length));
+    *diagnostics_ << "Error: Unknown token at line " << line_ << ", column " << column_
               << " -> '" << unknown_char << "'" << std::endl;
-    Token token{TokenType::T_UNKNOWN, unknown_char, line_, column_};
-    pos_++;
+    Token token{TokenType::T_UNKNOWN, unknown_char, line_, column_, pos_};
+    pos_ += length;
     column_++;
     return token;
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
+// The token for a match of rule `rule` at pos_; moves past it.
+Token Lexer::takeMatch(size_t rule, const std::string& value) {
+    ruleHits_[rule]++;
+    const TokenType type = Patterns::tokenPatterns[rule].type;
+    Token token{type, value, line_, column_, pos_};
+    if (type == TokenType::T_COMMENT) {
+        advance(value.data(), value.size());
+        pos_ += value.size();
+        return {TokenType::T_COMMENT, "", line_, column_, pos_}; // Return empty token for comments
+    }
+    if (type == TokenType::T_INVALID_IDENTIFIER) {
+        *diagnostics_ << "Error: Invalid identifier '" << value << "' at line " << line_
+                  << ", column " << column_ << std::endl;
+    }
+    advance(value.data(), value.size());
+    pos_ += value.size();
+    return token;
+}
+
+void Lexer::recordCheckpoints(size_t interval, std::vector<LexerCheckpoint>& out) {
+    checkpoints_ = &out;
+    checkpointInterval_ = interval > 0 ? interval : 1;
+    nextCheckpoint_ = pos_;
+}
+
+void Lexer::resumeAt(const LexerCheckpoint& checkpoint) {
+    line_ = static_cast<int>(checkpoint.line);
+    column_ = static_cast<int>(checkpoint.column);
+}
+
+bool Lexer::next(Token& token) {
+    // Between calls the lexer always sits between two tokens.
+    if (checkpoints_ != nullptr && pos_ >= nextCheckpoint_ && !finished_) {
+        checkpoints_->push_back({pos_, static_cast<uint32_t>(line_), static_cast<uint32_t>(column_)});
+        nextCheckpoint_ = pos_ + checkpointInterval_;
+    }
     while (pos_ < source_.length()) {
         skipWhitespace();
         if (pos_ >= source_.length()) break;
-        handleMultiLineComment();
-        if (pos_ >= source_.length()) break;
-        Token token = getNextToken();
+        // Whatever follows a comment, whitespace or another comment
+        // included, starts over.
+        if (handleMultiLineComment()) continue;
+        token = getNextToken();
         if (token.type != TokenType::T_COMMENT) {
-            tokens.push_back(token);
+            LEXER_STATS_ONLY(stats_.tokens++;)
+            return true;
         }
     }
-    tokens.push_back({TokenType::T_EOF, "", line_, column_});
+    if (finished_) return false;
+    finished_ = true;
+    token = {TokenType::T_EOF, "", line_, column_, pos_};
+    LEXER_STATS_ONLY(stats_.tokens++;)
+    return true;
+}
+
+std::vector<Token> Lexer::tokenize() {
+    LEXER_STATS_ONLY(ScopedPhaseTimer timer(stats_.tokenize);)
+    std::vector<Token> tokens;
+    Token token;
+    while (next(token)) {
+        tokens.push_back(std::move(token));
+    }
     return tokens;
 }
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "liblexer.h"
+#include "lexer.hpp"
+#include <new>
+#include <sstream>
+#include <string_view>
+
+static_assert(sizeof(lexer_token) == 24, "lexer_token must stay packed");
+
+struct lexer {
+    const char* source = nullptr;  // the caller's buffer, never copied
+    std::vector<lexer_token> tokens;
+    std::string diagnostics;
+    std::string error;
+    bool failed = false;
+};
+
+extern "C" {
+
+uint32_t lexer_abi_version(void) {
+    return LEXER_ABI_VERSION;
+}
+
+lexer_t* lexer_create(void) {
+    return new (std::nothrow) lexer;
+}
+
+int lexer_lex_buffer(lexer_t* handle, const char* data, size_t size) {
+    // Exceptions must not cross the C boundary.
+    handle->tokens.clear();
+    handle->diagnostics.clear();
+    handle->error.clear();
+    handle->failed = false;
+    handle->source = data;
+    std::ostringstream diagnostics;
+    try {
+        // Tokens are packed as they come; only the one being packed exists
+        // as a Token, and its buffer is reused for the next.
+        Lexer lexer(std::string_view(data, size));
+        lexer.setDiagnosticStream(diagnostics);
+        Token token;
+        while (lexer.next(token)) {
+            handle->tokens.push_back({static_cast<uint32_t>(token.type), static_cast<uint32_t>(token.line),
+                                      static_cast<uint32_t>(token.column), static_cast<uint32_t>(token.value.size()),
+                                      static_cast<uint64_t>(token.offset)});
+        }
+        handle->diagnostics = diagnostics.str();
+        return 0;
+    } catch (const std::exception& e) {
+        handle->tokens.clear();
+        handle->diagnostics = diagnostics.str();
+        handle->error = e.what();
+        handle->failed = true;
+        return -1;
+    }
+}
+
+const lexer_token* lexer_tokens(const lexer_t* handle, size_t* count) {
+    *count = handle->tokens.size();
+    return handle->tokens.data();
+}
+
+const char* lexer_source(const lexer_t* handle) {
+    return handle->source;
+}
+
+const char* lexer_diagnostics(const lexer_t* handle) {
+    return handle->diagnostics.c_str();
+}
+
+const char* lexer_error(const lexer_t* handle) {
+    return handle->failed ? handle->error.c_str() : nullptr;
+}
+
+const char* lexer_token_type_name(uint32_t type) {
+    // The names are string literals, so they outlive the call and end in a NUL.
+    return type < kTokenTypeCount ? kTokenTypeNames[type].data() : "UNKNOWN";
+}
+
+void lexer_free(lexer_t* handle) {
+    delete handle;
+}
+
+} // extern "C"
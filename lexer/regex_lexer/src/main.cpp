@@ -1,39 +1,445 @@
 #include <iostream>
 #include <fstream>
+#include <optional>
 #include <string>
+#include <climits>
+#include <cstdlib>
+#include "alloc_stats.hpp"
+#include "batch_lexer.hpp"
+#include "checkpoint.hpp"
 #include "lexer.hpp"
+#include "perf_counters.hpp"
+#include "server.hpp"
+#include "token_format.hpp"
+#include "token_index.hpp"
+#include "token_pipeline.hpp"
 #include "utilis.hpp"
+#include "watch.hpp"
+
+namespace {
+
+// Empty when `path` cannot be resolved.
+std::string absolutePath(const char* path) {
+    char resolved[PATH_MAX];
+    return realpath(path, resolved) != nullptr ? std::string(resolved) : std::string();
+}
+
+} // namespace
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <input_file>" << std::endl;
+    enum class StatsFormat { None, Table, Json };
+    StatsFormat stats_format = StatsFormat::None;
+    TokenFormat output_format = TokenFormat::Text;
+    bool profile = false;
+    bool send_inline = false;
+    bool pipeline = false;
+    MatchEngine engine = MatchEngine::Automaton;
+    unsigned threads = 0;
+    std::string rule_profile;
+    std::string train_rules;
+    std::string serve_socket;
+    std::string client_socket;
+    const char* input_path = nullptr;
+    std::vector<std::string> more_paths;
+    std::string files_from;
+    BatchOptions batch;
+    std::string index_path;
+    std::string query_path;
+    bool index_literals = false;
+    std::string watch_dir;
+    WatchOptions watch;
+    size_t checkpoint_interval = 0;
+    std::optional<TokenRange> range;
+    bool alloc_stats = false;
+    double alloc_budget = -1;
+    bool usage_error = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--stats" || arg == "--stats=table") {
+            stats_format = StatsFormat::Table;
+        } else if (arg == "--stats=json") {
+            stats_format = StatsFormat::Json;
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg.rfind("--rule-profile=", 0) == 0) {
+            rule_profile = arg.substr(15);
+        } else if (arg.rfind("--train-rules=", 0) == 0) {
+            train_rules = arg.substr(14);
+        } else if (arg.rfind("--format=", 0) == 0) {
+            usage_error = !parseTokenFormat(arg.substr(9), output_format);
+        } else if (arg.rfind("--serve=", 0) == 0) {
+            serve_socket = arg.substr(8);
+        } else if (arg.rfind("--client=", 0) == 0) {
+            client_socket = arg.substr(9);
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            threads = static_cast<unsigned>(std::strtoul(arg.c_str() + 10, nullptr, 10));
+        } else if (arg == "--inline") {
+            send_inline = true;
+        } else if (arg == "--pipeline") {
+            pipeline = true;
+        } else if (arg == "--engine=automaton") {
+            engine = MatchEngine::Automaton;
+        } else if (arg == "--engine=backtracking") {
+            engine = MatchEngine::Backtracking;
+        } else if (arg.rfind("--files-from=", 0) == 0) {
+            files_from = arg.substr(13);
+        } else if (arg.rfind("--read-ahead=", 0) == 0) {
+            batch.readAhead = std::strtoul(arg.c_str() + 13, nullptr, 10);
+        } else if (arg == "--io=auto") {
+            batch.backend = FileBatchReader::Backend::Auto;
+        } else if (arg == "--io=uring") {
+            batch.backend = FileBatchReader::Backend::IoUring;
+        } else if (arg == "--io=pread") {
+            batch.backend = FileBatchReader::Backend::Pread;
+        } else if (arg.rfind("--index=", 0) == 0) {
+            index_path = arg.substr(8);
+        } else if (arg == "--index-literals") {
+            index_literals = true;
+        } else if (arg.rfind("--query=", 0) == 0) {
+            query_path = arg.substr(8);
+        } else if (arg.rfind("--watch=", 0) == 0) {
+            watch_dir = arg.substr(8);
+        } else if (arg.rfind("--debounce=", 0) == 0) {
+            watch.debounceMs = static_cast<unsigned>(std::strtoul(arg.c_str() + 11, nullptr, 10));
+        } else if (arg == "--checkpoints") {
+            checkpoint_interval = kDefaultCheckpointInterval;
+        } else if (arg.rfind("--checkpoints=", 0) == 0) {
+            checkpoint_interval = std::strtoul(arg.c_str() + 14, nullptr, 10) * 1024;
+            usage_error = checkpoint_interval == 0;
+        } else if (arg.rfind("--lines=", 0) == 0 || arg.rfind("--bytes=", 0) == 0) {
+            range.emplace();
+            usage_error = !parseTokenRange(arg.substr(8), arg[2] == 'l' ? TokenRange::Unit::Lines
+                                                                         : TokenRange::Unit::Bytes, *range);
+        } else if (arg == "--alloc-stats") {
+            alloc_stats = true;
+        } else if (arg.rfind("--alloc-budget=", 0) == 0) {
+            char* end = nullptr;
+            alloc_budget = std::strtod(arg.c_str() + 15, &end);
+            usage_error = end == arg.c_str() + 15 || *end != '\0' || alloc_budget < 0;
+        } else if (input_path == nullptr && (arg == "-" || arg.rfind("--", 0) != 0)) {
+            input_path = argv[i];
+        } else if (arg != "-" && arg.rfind("--", 0) != 0) {
+            more_paths.push_back(arg);
+        } else {
+            usage_error = true;
+        }
+    }
+
+    // --pipeline streams its output, so it cannot lead with a token count
+    // (binary) or report on a lexer that ran on another thread.
+    if (pipeline && (output_format == TokenFormat::Binary || stats_format != StatsFormat::None ||
+                     !train_rules.empty())) {
+        std::cerr << "Error: --pipeline cannot be combined with --format=binary, --stats or --train-rules" << std::endl;
+        usage_error = true;
+    }
+    // The backtracking engine is only there to check the automaton against.
+    if (engine == MatchEngine::Backtracking && (pipeline || !serve_socket.empty() || !client_socket.empty())) {
+        std::cerr << "Error: --engine=backtracking only applies to lexing a file in-process" << std::endl;
+        usage_error = true;
+    }
+
+    // Several files are lexed by the batch driver, which writes plain token output only;
+    // --index lexes its files the same way and --query takes names instead of files.
+    const bool many_files = !more_paths.empty() || !files_from.empty() || !index_path.empty() || !query_path.empty();
+    if (many_files && (pipeline || stats_format != StatsFormat::None || profile || !train_rules.empty() ||
+                       !serve_socket.empty() || !client_socket.empty() ||
+                       (input_path != nullptr && std::string(input_path) == "-"))) {
+        std::cerr << "Error: several input files, --index and --query cannot be combined with --pipeline,"
+                  << " --stats, --profile, --train-rules, --serve, --client or stdin" << std::endl;
+        usage_error = true;
+    }
+    if ((!index_path.empty() && !query_path.empty()) || (!query_path.empty() && !files_from.empty()) ||
+        (index_literals && index_path.empty())) {
+        usage_error = true;
+    }
+
+    // --watch prints text results for a whole tree until it is interrupted.
+    if (!watch_dir.empty() && (many_files || pipeline || stats_format != StatsFormat::None || profile ||
+                               !train_rules.empty() || !serve_socket.empty() || !client_socket.empty() ||
+                               output_format != TokenFormat::Text)) {
+        std::cerr << "Error: --watch cannot be combined with other modes, --stats, --profile, --train-rules"
+                  << " or --format" << std::endl;
+        usage_error = true;
+    }
+
+    // Checkpoints belong to one file on disk and are written next to it.
+    if ((checkpoint_interval != 0 || range) &&
+        (many_files || pipeline || stats_format != StatsFormat::None || profile || !train_rules.empty() ||
+         !serve_socket.empty() || !client_socket.empty() || !watch_dir.empty() ||
+         (input_path != nullptr && std::string(input_path) == "-"))) {
+        std::cerr << "Error: --checkpoints, --lines and --bytes only apply to lexing one file in-process" << std::endl;
+        usage_error = true;
+    }
+
+    // Allocations are counted around the phases of a single in-process run.
+    const bool count_allocations = alloc_stats || alloc_budget >= 0;
+    if (count_allocations && (many_files || !serve_socket.empty() || !client_socket.empty() || !watch_dir.empty() ||
+                              range || (input_path != nullptr && std::string(input_path) == "-"))) {
+        std::cerr << "Error: --alloc-stats and --alloc-budget only apply to lexing one file in-process" << std::endl;
+        usage_error = true;
+    }
+
+    // --serve and --watch take no input file; every other mode needs at least one.
+    const bool takes_input = serve_socket.empty() && watch_dir.empty();
+    if (usage_error || takes_input == (input_path == nullptr && files_from.empty())) {
+        std::cerr << "Usage: " << argv[0] << " [--stats[=table|json]] [--profile] [--rule-profile=<file>]"
+                  << " [--train-rules=<file>] [--format=text|json|binary] [--pipeline]"
+                  << " [--engine=automaton|backtracking] [--alloc-stats] [--alloc-budget=<allocs per token>]"
+                  << " <input_file>\n"
+                  << "       " << argv[0] << " [--checkpoints[=<KiB>]] [--lines=<first>-<last>|--bytes=<first>-<last>]"
+                  << " [--format=text|json|binary] <input_file>\n"
+                  << "       " << argv[0] << " [--format=text|json|binary] [--threads=<n>] [--read-ahead=<n>]"
+                  << " [--io=auto|uring|pread] [--files-from=<list>] <input_file>...\n"
+                  << "       " << argv[0] << " --index=<file> [--index-literals] [--threads=<n>] [--read-ahead=<n>]"
+                  << " [--io=auto|uring|pread] [--files-from=<list>] <input_file>...\n"
+                  << "       " << argv[0] << " --query=<file> <name>...\n"
+                  << "       " << argv[0] << " --watch=<dir> [--debounce=<ms>] [--threads=<n>]"
+                  << " [--rule-profile=<file>]\n"
+                  << "       " << argv[0] << " --serve=<socket> [--threads=<n>] [--rule-profile=<file>]\n"
+                  << "       " << argv[0] << " --client=<socket> [--format=text|json|binary] [--inline] <input_file|->"
+                  << std::endl;
+        return 1;
+    }
+
+    if (!client_socket.empty()) {
+        // A path is resolved here so the server does not depend on our working directory;
+        // --inline (or "-" for stdin) ships the source itself instead.
+        if (std::string(input_path) == "-") {
+            std::string source((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+            return runClient(client_socket, RequestSource::Inline, source, output_format);
+        }
+        if (!send_inline) {
+            // A relative path would be resolved against the server's working directory.
+            const std::string path = absolutePath(input_path);
+            if (path.empty()) {
+                std::cerr << "Error: Could not open file " << input_path << std::endl;
+                return 1;
+            }
+            return runClient(client_socket, RequestSource::Path, path, output_format);
+        }
+        std::ifstream input_file(input_path, std::ios::binary);
+        if (!input_file.is_open()) {
+            std::cerr << "Error: Could not open file " << input_path << std::endl;
+            return 1;
+        }
+        std::string source((std::istreambuf_iterator<char>(input_file)), std::istreambuf_iterator<char>());
+        return runClient(client_socket, RequestSource::Inline, source, output_format);
+    }
+
+#ifndef LEXER_STATS
+    if (stats_format != StatsFormat::None) {
+        std::cerr << "Error: --stats requires a lexer built with -DLEXER_STATS=ON" << std::endl;
+        return 1;
+    }
+#endif
+#ifndef LEXER_ALLOC_STATS
+    if (count_allocations) {
+        std::cerr << "Error: --alloc-stats and --alloc-budget require a lexer built with -DLEXER_ALLOC_STATS=ON"
+                  << std::endl;
+        return 1;
+    }
+#endif
+
+    std::optional<RuleOrder> profiled_order;
+    if (!rule_profile.empty() && engine == MatchEngine::Automaton) {
+        std::cerr << "Note: --rule-profile only changes the cost of --engine=backtracking; the automaton tries "
+                     "every rule in one walk" << std::endl;
+    }
+    if (!rule_profile.empty()) {
+        try {
+            profiled_order = RuleOrder::fromHits(loadRuleProfile(rule_profile));
+        } catch (const LexerError& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    const RuleOrder& rule_order = profiled_order ? *profiled_order : RuleOrder::declared();
+
+    if (!serve_socket.empty()) {
+        return runServer(serve_socket, threads, rule_order);
+    }
+
+    if (!watch_dir.empty()) {
+        watch.threads = threads;
+        watch.engine = engine;
+        return watchTree(watch_dir, rule_order, watch);
+    }
+
+    if (!query_path.empty()) {
+        std::vector<std::string> names{input_path};
+        names.insert(names.end(), more_paths.begin(), more_paths.end());
+        return queryTokenIndex(query_path, names);
+    }
+
+    if (many_files) {
+        // --files-from takes one path per line, for trees too large for the command line.
+        std::vector<std::string> paths;
+        if (input_path != nullptr) paths.push_back(input_path);
+        paths.insert(paths.end(), more_paths.begin(), more_paths.end());
+        if (!files_from.empty()) {
+            std::ifstream list(files_from);
+            if (!list.is_open()) {
+                std::cerr << "Error: Could not open file " << files_from << std::endl;
+                return 1;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) paths.push_back(line);
+            }
+        }
+        batch.threads = threads;
+        batch.format = output_format;
+        batch.engine = engine;
+        if (!index_path.empty()) return buildTokenIndex(index_path, paths, rule_order, {index_literals, batch});
+        return lexFiles(paths, rule_order, batch);
+    }
+
+    if (range) {
+        // The sidecar is (re)built on first use; later ranges only read a few kilobytes around them.
+        try {
+            CheckpointFile checkpoints;
+            if (!loadCheckpoints(input_path, checkpoints) ||
+                (checkpoint_interval != 0 && checkpoints.interval != checkpoint_interval)) {
+                std::cerr << "Writing checkpoints to " << checkpointPath(input_path) << std::endl;
+                checkpoints = buildCheckpoints(input_path, checkpoint_interval != 0 ? checkpoint_interval
+                                                                                    : kDefaultCheckpointInterval,
+                                               rule_order);
+            }
+            writeTokens(std::cout, lexRange(input_path, checkpoints, *range, rule_order, engine, std::cerr),
+                        output_format);
+            std::cout.flush();
+        } catch (const LexerError& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Counters are only opened for --profile (and allocations only counted for
+    // --alloc-stats or --alloc-budget); without them the phase markers below do nothing.
+    std::optional<PerfCounters> counters;
+    if (profile) counters.emplace();
+    std::vector<ProfilePhase> phases;
+    LEXER_ALLOC_STATS_ONLY(AllocCounters allocation_counters; std::vector<AllocPhase> allocation_phases;)
+    auto beginPhase = [&]() {
+        if (counters) counters->start();
+        LEXER_ALLOC_STATS_ONLY(if (count_allocations) allocation_counters.start();)
+    };
+    auto endPhase = [&](const char* name) {
+        if (counters) phases.push_back({name, counters->stop()});
+        LEXER_ALLOC_STATS_ONLY(if (count_allocations) allocation_phases.push_back({name, allocation_counters.stop()});)
+    };
+
+    // Stat'ed before reading, so an edit during the run makes the sidecar stale rather than wrong.
+    CheckpointFile checkpoints;
+    if (checkpoint_interval != 0 && !statCheckpointSource(input_path, checkpoints)) {
+        std::cerr << "Error: Could not open file " << input_path << std::endl;
         return 1;
     }
 
-    std::ifstream input_file(argv[1]);
+    beginPhase();
+    std::ifstream input_file(input_path);
     if (!input_file.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+        std::cerr << "Error: Could not open file " << input_path << std::endl;
         return 1;
     }
 
     std::string source_code((std::istreambuf_iterator<char>(input_file)),
                             std::istreambuf_iterator<char>());
     input_file.close();
+    endPhase("load");
+    const size_t source_size = source_code.size();
+    // Prints the reports that were asked for and returns the exit code: 1 when
+    // the lexing phase allocated more per token than --alloc-budget allows.
+    auto finishRun = [&](size_t token_count) {
+        if (counters) printProfileReport(std::cerr, phases, *counters, source_size, token_count);
+        LEXER_ALLOC_STATS_ONLY(
+            if (alloc_stats) printAllocReport(std::cerr, allocation_phases, source_size, token_count);
+            for (const AllocPhase& phase : allocation_phases) {
+                if (alloc_budget < 0 || (phase.name != "tokenize" && phase.name != "pipeline")) continue;
+                const double per_token = token_count == 0 ? 0.0 : double(phase.sample.allocations) / token_count;
+                if (per_token > alloc_budget) {
+                    std::cerr << "Error: " << phase.name << " made " << per_token
+                              << " allocations per token, over the budget of " << alloc_budget << std::endl;
+                    return 1;
+                }
+            }
+        )
+        return 0;
+    };
 
     try {
-        Lexer lexer(source_code);
+        if (pipeline) {
+            // The shared automaton is built once per process. Building it here
+            // keeps that one-time cost out of the per-token pipeline figures.
+            beginPhase();
+            RuleAutomaton::instance();
+            endPhase("construct");
+
+            // Lexing and output overlap, so they are measured as one phase.
+            beginPhase();
+            TokenPipeline token_pipeline(source_code, rule_order);
+            TokenStreamWriter writer(std::cout, output_format);
+            size_t token_count = 0;
+            while (const std::vector<Token>* batch = token_pipeline.nextBatch()) {
+                writer.write(*batch);
+                token_count += batch->size();
+            }
+            writer.finish();
+            std::cout.flush();
+            endPhase("pipeline");
+            return finishRun(token_count);
+        }
+
+        // Construction validates the source and copies it; the scanner itself is shared.
+        beginPhase();
+        Lexer lexer(source_code, rule_order);
+        lexer.setEngine(engine);
+        if (checkpoint_interval != 0) {
+            checkpoints.interval = static_cast<uint32_t>(checkpoint_interval);
+            lexer.recordCheckpoints(checkpoint_interval, checkpoints.checkpoints);
+        }
+        endPhase("construct");
+
+        beginPhase();
         std::vector<Token> tokens = lexer.tokenize();
+        endPhase("tokenize");
+        if (checkpoint_interval != 0) saveCheckpoints(input_path, checkpoints);
 
-        for (const auto& token : tokens) {
-            if (token.type != TokenType::T_COMMENT) {
-                std::cout << "Token(" << tokenTypeToString(token.type) << ", \"" << token.value
-                          << "\") at line " << token.line << ", column " << token.column << std::endl;
+        // Training accumulates into an existing profile so a whole corpus can be fed in file by file.
+        if (!train_rules.empty()) {
+            std::vector<uint64_t> hits = lexer.ruleHits();
+            if (std::ifstream(train_rules).good()) {
+                const std::vector<uint64_t> previous = loadRuleProfile(train_rules);
+                for (size_t i = 0; i < hits.size(); ++i) hits[i] += previous[i];
             }
+            saveRuleProfile(train_rules, hits);
+        }
+
+        LEXER_STATS_ONLY(LexerStats stats = lexer.stats();)
+        {
+            LEXER_STATS_ONLY(ScopedPhaseTimer timer(stats.output);)
+            beginPhase();
+            writeTokens(std::cout, tokens, output_format);
+            std::cout.flush();
+            endPhase("output");
         }
+
+        const int status = finishRun(tokens.size());
+
+        // The report goes to stderr so the token stream on stdout stays machine-readable.
+        LEXER_STATS_ONLY(
+            if (stats_format == StatsFormat::Table) {
+                printStatsTable(std::cerr, stats);
+            } else if (stats_format == StatsFormat::Json) {
+                printStatsJson(std::cerr, stats);
+            }
+        )
+        return status;
     } catch (const LexerError& e) {
+        std::cout.flush();
         std::cerr << "Lexical error: " << e.what() << std::endl;
         return 1;
     }
-
-    return 0;
-}
\ No newline at end of file
+}
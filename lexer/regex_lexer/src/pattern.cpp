@@ -1,88 +1,119 @@
 #include "pattern.hpp"
+#include <string_view>
 
-const std::vector<std::pair<std::regex, TokenType>> Patterns::tokenPatterns = {
+namespace {
+
+// Rules with a fixed spelling take it from the token registry
+// (token_types.hpp), so keywords, operators and punctuation are spelled in
+// one place. Only the order of the rules is decided here.
+std::string literalPattern(std::string_view text) {
+    std::string pattern = "^";
+    for (char c : text) {
+        if (std::string_view("\\^$.|?*+()[]{}").find(c) != std::string_view::npos) pattern += '\\';
+        pattern += c;
+    }
+    return pattern;
+}
+
+// Keywords end at a word boundary, so intValue does not start with 'int'.
+template <TokenType type>
+TokenPattern keyword() {
+    static_assert(isKeyword(type) && !tokenSpelling(type).empty(), "not a keyword");
+    return {literalPattern(tokenSpelling(type)) + "\\b", type};
+}
+
+template <TokenType type>
+TokenPattern symbol() {
+    static_assert((isOperator(type) || isPunctuation(type)) && !tokenSpelling(type).empty(),
+                  "not an operator or punctuation");
+    return {literalPattern(tokenSpelling(type)), type};
+}
+
+} // namespace
+
+const std::vector<TokenPattern> Patterns::tokenPatterns = {
     // Comments (single-line) - put BEFORE operator "/" rule
-    {std::regex("^//[^\\n]*"), TokenType::T_COMMENT},
-
-    // Keywords (word boundary so intValue doesn't become 'int')
-    {std::regex("^fn\\b"), TokenType::T_FUNCTION},
-    {std::regex("^int\\b"), TokenType::T_INT},
-    {std::regex("^float\\b"), TokenType::T_FLOAT},
-    {std::regex("^string\\b"), TokenType::T_STRING},
-    {std::regex("^bool\\b"), TokenType::T_BOOL},
-    {std::regex("^return\\b"), TokenType::T_RETURN},
-    {std::regex("^if\\b"), TokenType::T_IF},
-    {std::regex("^else\\b"), TokenType::T_ELSE},
-    {std::regex("^for\\b"), TokenType::T_FOR},
-    {std::regex("^while\\b"), TokenType::T_WHILE},
-    {std::regex("^break\\b"), TokenType::T_BREAK},
-    {std::regex("^continue\\b"), TokenType::T_CONTINUE},
-    {std::regex("^true\\b|^false\\b"), TokenType::T_BOOLLIT},
+    {"^//[^\\n]*", TokenType::T_COMMENT},
+
+    // Keywords
+    keyword<TokenType::T_FUNCTION>(),
+    keyword<TokenType::T_INT>(),
+    keyword<TokenType::T_FLOAT>(),
+    keyword<TokenType::T_STRING>(),
+    keyword<TokenType::T_BOOL>(),
+    keyword<TokenType::T_RETURN>(),
+    keyword<TokenType::T_IF>(),
+    keyword<TokenType::T_ELSE>(),
+    keyword<TokenType::T_FOR>(),
+    keyword<TokenType::T_WHILE>(),
+    keyword<TokenType::T_BREAK>(),
+    keyword<TokenType::T_CONTINUE>(),
+    {"^true\\b|^false\\b", TokenType::T_BOOLLIT},
 
     // Literals: floats and hex first
-    {std::regex("^\\.[0-9]+([eE][+-]?[0-9]+)?"), TokenType::T_FLOATLIT},
-    {std::regex("^[0-9]+\\.[0-9]+([eE][+-]?[0-9]+)?"), TokenType::T_FLOATLIT},
-    {std::regex("^[0-9]+\\.[0-9]+"), TokenType::T_FLOATLIT},
-    {std::regex("^0[xX][0-9a-fA-F]+"), TokenType::T_INTLIT},
+    {"^\\.[0-9]+([eE][+-]?[0-9]+)?", TokenType::T_FLOATLIT},
+    {"^[0-9]+\\.[0-9]+([eE][+-]?[0-9]+)?", TokenType::T_FLOATLIT},
+    {"^[0-9]+\\.[0-9]+", TokenType::T_FLOATLIT},
+    {"^0[xX][0-9a-fA-F]+", TokenType::T_INTLIT},
 
     // Invalid identifier that starts with digit AND has at least one letter/underscore after digits
-    {std::regex("^[0-9]+[a-zA-Z_][a-zA-Z0-9_]*"), TokenType::T_INVALID_IDENTIFIER},
+    {"^[0-9]+[a-zA-Z_][a-zA-Z0-9_]*", TokenType::T_INVALID_IDENTIFIER},
 
     // Decimal integer literal (pure digits)
-    {std::regex("^[0-9]+"), TokenType::T_INTLIT},
+    {"^[0-9]+", TokenType::T_INTLIT},
 
     // String literal (no raw newline inside)
-    {std::regex("^\"([^\"\\\\\\n]|\\\\.)*\""), TokenType::T_STRINGLIT},
+    {"^\"([^\"\\\\\\n]|\\\\.)*\"", TokenType::T_STRINGLIT},
 
     // Invalid identifier that starts with a letter/underscore BUT contains at least one invalid char
-    {std::regex("^[a-zA-Z_][a-zA-Z0-9_][^a-zA-Z0-9_\\s;{}()\\[\\],=+\\-/%&|^~<>?:.\"]+[a-zA-Z0-9_]*"), TokenType::T_INVALID_IDENTIFIER},
+    {"^[a-zA-Z_][a-zA-Z0-9_][^a-zA-Z0-9_\\s;{}()\\[\\],=+\\-/%&|^~<>?:.\"]+[a-zA-Z0-9_]*", TokenType::T_INVALID_IDENTIFIER},
 
     // Valid identifiers (only reach here when there are no invalid chars)
-    {std::regex("^[a-zA-Z_][a-zA-Z0-9_]*"), TokenType::T_IDENTIFIER},
+    {"^[a-zA-Z_][a-zA-Z0-9_]*", TokenType::T_IDENTIFIER},
 
     // Operators (multi-character first)
-    {std::regex("^=="), TokenType::T_EQUALSOP},
-    {std::regex("^\\+\\+"), TokenType::T_INCREMENT},
-    {std::regex("^\\+\\="), TokenType::T_PLUS_ASSIGN},
-    {std::regex("^--"), TokenType::T_DECREMENT},
-    {std::regex("^\\-\\="), TokenType::T_MINUS_ASSIGN},
-    {std::regex("^<<"), TokenType::T_LEFTSHIFT},
-    {std::regex("^>>"), TokenType::T_RIGHTSHIFT},
-    {std::regex("^<="), TokenType::T_LTE},
-    {std::regex("^>="), TokenType::T_GTE},
-    {std::regex("^!="), TokenType::T_NEQ},
-    {std::regex("^&&"), TokenType::T_AND},
-    {std::regex("^\\|\\|"), TokenType::T_OR},
+    symbol<TokenType::T_EQUALSOP>(),
+    symbol<TokenType::T_INCREMENT>(),
+    symbol<TokenType::T_PLUS_ASSIGN>(),
+    symbol<TokenType::T_DECREMENT>(),
+    symbol<TokenType::T_MINUS_ASSIGN>(),
+    symbol<TokenType::T_LEFTSHIFT>(),
+    symbol<TokenType::T_RIGHTSHIFT>(),
+    symbol<TokenType::T_LTE>(),
+    symbol<TokenType::T_GTE>(),
+    symbol<TokenType::T_NEQ>(),
+    symbol<TokenType::T_AND>(),
+    symbol<TokenType::T_OR>(),
 
     // Single-character operators
-    {std::regex("^="), TokenType::T_ASSIGNOP},
-    {std::regex("^\\+"), TokenType::T_PLUS},
-    {std::regex("^-"), TokenType::T_MINUS},
-    {std::regex("^\\*"), TokenType::T_MULT},
-    {std::regex("^/"), TokenType::T_DIV},
-    {std::regex("^%"), TokenType::T_MOD},
-    {std::regex("^<"), TokenType::T_LT},
-    {std::regex("^>"), TokenType::T_GT},
-    {std::regex("^!"), TokenType::T_NOT},
+    symbol<TokenType::T_ASSIGNOP>(),
+    symbol<TokenType::T_PLUS>(),
+    symbol<TokenType::T_MINUS>(),
+    symbol<TokenType::T_MULT>(),
+    symbol<TokenType::T_DIV>(),
+    symbol<TokenType::T_MOD>(),
+    symbol<TokenType::T_LT>(),
+    symbol<TokenType::T_GT>(),
+    symbol<TokenType::T_NOT>(),
 
     // Bitwise operators (single char; & and | after &&/||)
-    {std::regex("^&"), TokenType::T_BITAND},
-    {std::regex("^\\|"), TokenType::T_BITOR},
-    {std::regex("^\\^"), TokenType::T_BITXOR},
-    {std::regex("^~"), TokenType::T_BITNOT},
+    symbol<TokenType::T_BITAND>(),
+    symbol<TokenType::T_BITOR>(),
+    symbol<TokenType::T_BITXOR>(),
+    symbol<TokenType::T_BITNOT>(),
 
     // Punctuation
-    {std::regex("^\\("), TokenType::T_PARENL},
-    {std::regex("^\\)"), TokenType::T_PARENR},
-    {std::regex("^\\{"), TokenType::T_BRACEL},
-    {std::regex("^\\}"), TokenType::T_BRACER},
-    {std::regex("^\\["), TokenType::T_BRACKL},
-    {std::regex("^\\]"), TokenType::T_BRACKR},
-    {std::regex("^,"), TokenType::T_COMMA},
-    {std::regex("^;"), TokenType::T_SEMICOLON},
-    {std::regex("^:"), TokenType::T_COLON},
-    {std::regex("^\\?"), TokenType::T_QUESTION},
-    {std::regex("^\\."), TokenType::T_DOT}
+    symbol<TokenType::T_PARENL>(),
+    symbol<TokenType::T_PARENR>(),
+    symbol<TokenType::T_BRACEL>(),
+    symbol<TokenType::T_BRACER>(),
+    symbol<TokenType::T_BRACKL>(),
+    symbol<TokenType::T_BRACKR>(),
+    symbol<TokenType::T_COMMA>(),
+    symbol<TokenType::T_SEMICOLON>(),
+    symbol<TokenType::T_COLON>(),
+    symbol<TokenType::T_QUESTION>(),
+    symbol<TokenType::T_DOT>()
 };
 
 
@@ -0,0 +1,161 @@
+#include "perf_counters.hpp"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+uint64_t nowNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#ifdef __linux__
+int openEvent(uint32_t type, uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+uint64_t cacheConfig(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+} // namespace
+
+PerfCounters::PerfCounters() {
+    fds_.fill(-1);
+#ifdef __linux__
+    fds_[Cycles] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if (fds_[Cycles] < 0) {
+        reason_ = std::string("perf_event_open: ") + std::strerror(errno);
+    }
+    fds_[Instructions] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds_[BranchMisses] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds_[L1DMisses] = openEvent(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D));
+    fds_[LLCMisses] = openEvent(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL));
+#else
+    reason_ = "hardware counters are only supported on Linux";
+#endif
+    if (available()) {
+        reason_.clear();
+    } else if (reason_.empty()) {
+        reason_ = "no hardware events could be opened";
+    }
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+bool PerfCounters::available() const {
+    for (int fd : fds_) {
+        if (fd >= 0) return true;
+    }
+    return false;
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    startNanos_ = nowNanos();
+}
+
+PerfCounters::Sample PerfCounters::stop() {
+    Sample sample;
+    sample.nanos = nowNanos() - startNanos_;
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int i = 0; i < EventCount; ++i) {
+        uint64_t data[3];  // value, time enabled, time running
+        if (fds_[i] < 0 || read(fds_[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) {
+            continue;
+        }
+        // Scale up when the kernel had to multiplex more events than the PMU has slots.
+        sample.values[i] = data[2] < data[1]
+            ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+            : data[0];
+        sample.valid[i] = true;
+    }
+#endif
+    return sample;
+}
+
+const char* PerfCounters::eventName(Event event) {
+    switch (event) {
+        case Cycles: return "cycles";
+        case Instructions: return "instructions";
+        case BranchMisses: return "branch-misses";
+        case L1DMisses: return "L1d-misses";
+        case LLCMisses: return "LLC-misses";
+        default: return "unknown";
+    }
+}
+
+void printProfileReport(std::ostream& out, const std::vector<ProfilePhase>& phases, const PerfCounters& counters,
+                        uint64_t bytes, uint64_t tokens) {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    const double per_byte = bytes == 0 ? 0.0 : 1.0 / bytes;
+    const double per_token = tokens == 0 ? 0.0 : 1.0 / tokens;
+
+    out << "Profile: " << bytes << " bytes, " << tokens << " tokens\n";
+    if (!counters.available()) {
+        out << "Hardware counters unavailable (" << counters.unavailableReason()
+            << "); reporting wall-clock time only\n";
+    }
+    out << "\n" << std::left << std::setw(10) << "phase" << std::setw(15) << "event" << std::right
+        << std::setw(16) << "total" << std::setw(14) << "per byte" << std::setw(14) << "per token" << "\n";
+    out << std::fixed;
+
+    for (const ProfilePhase& phase : phases) {
+        out << std::left << std::setw(10) << phase.name << std::setw(15) << "time (ns)" << std::right
+            << std::setw(16) << phase.sample.nanos << std::setprecision(3)
+            << std::setw(14) << phase.sample.nanos * per_byte
+            << std::setw(14) << phase.sample.nanos * per_token << "\n";
+        for (int i = 0; i < PerfCounters::EventCount; ++i) {
+            if (!phase.sample.valid[i]) continue;
+            const uint64_t value = phase.sample.values[i];
+            out << std::left << std::setw(10) << "" << std::setw(15)
+                << PerfCounters::eventName(static_cast<PerfCounters::Event>(i)) << std::right
+                << std::setw(16) << value << std::setw(14) << value * per_byte
+                << std::setw(14) << value * per_token << "\n";
+        }
+        if (phase.sample.valid[PerfCounters::Cycles] && phase.sample.valid[PerfCounters::Instructions] &&
+            phase.sample.values[PerfCounters::Cycles] != 0) {
+            out << std::left << std::setw(10) << "" << std::setw(15) << "IPC" << std::right << std::setw(16)
+                << static_cast<double>(phase.sample.values[PerfCounters::Instructions]) /
+                       phase.sample.values[PerfCounters::Cycles] << "\n";
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,208 @@
+#include "rule_order.hpp"
+#include "char_class.hpp"
+#include "exception.hpp"
+#include "pattern.hpp"
+#include <fstream>
+#include <unordered_map>
+
+namespace {
+
+// The characters a match of one alternative is guaranteed to start with, one
+// set per position. It stops at the first construct whose length is not fixed.
+using Prefix = std::vector<CharSet>;
+
+Prefix branchPrefix(const std::string& branch) {
+    Prefix prefix;
+    size_t i = 0;
+    if (i < branch.size() && branch[i] == '^') ++i;
+    while (i < branch.size()) {
+        CharSet set;
+        const char c = branch[i];
+        if (c == '\\' && i + 1 < branch.size()) {
+            if (branch[i + 1] == 'b' || branch[i + 1] == 'B') {  // zero-width
+                i += 2;
+                continue;
+            }
+            set = escapeSet(branch[i + 1]);
+            i += 2;
+        } else if (c == '[') {
+            if (!parseClass(branch, i, set)) break;
+        } else if (c == '(' || c == '^' || c == '$' || c == '*' || c == '+' || c == '?' || c == '{') {
+            break;
+        } else if (c == '.') {
+            set.set();
+            ++i;
+        } else {
+            set = singleChar(c);
+            ++i;
+        }
+
+        const char quantifier = i < branch.size() ? branch[i] : '\0';
+        if (quantifier == '*' || quantifier == '?' || quantifier == '{') break;
+        prefix.push_back(set);
+        if (quantifier == '+') break;
+    }
+    return prefix;
+}
+
+std::vector<Prefix> alternativePrefixes(const std::string& source) {
+    std::vector<Prefix> prefixes;
+    int depth = 0;
+    bool in_class = false;
+    size_t start = 0;
+    for (size_t i = 0; i < source.size(); ++i) {
+        const char c = source[i];
+        if (c == '\\') {
+            ++i;
+        } else if (in_class) {
+            in_class = c != ']';
+        } else if (c == '[') {
+            in_class = true;
+        } else if (c == '(') {
+            ++depth;
+        } else if (c == ')') {
+            --depth;
+        } else if (c == '|' && depth == 0) {
+            prefixes.push_back(branchPrefix(source.substr(start, i - start)));
+            start = i + 1;
+        }
+    }
+    prefixes.push_back(branchPrefix(source.substr(start)));
+    return prefixes;
+}
+
+bool prefixesDisjoint(const Prefix& a, const Prefix& b) {
+    const size_t common = std::min(a.size(), b.size());
+    for (size_t i = 0; i < common; ++i) {
+        if ((a[i] & b[i]).none()) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool rulesAreDisjoint(const std::string& first, const std::string& second) {
+    for (const Prefix& a : alternativePrefixes(first)) {
+        for (const Prefix& b : alternativePrefixes(second)) {
+            if (!prefixesDisjoint(a, b)) return false;
+        }
+    }
+    return true;
+}
+
+RuleOrder::RuleOrder(std::vector<size_t> indices) : indices_(std::move(indices)) {}
+
+const RuleOrder& RuleOrder::declared() {
+    static const RuleOrder order([] {
+        std::vector<size_t> indices(Patterns::tokenPatterns.size());
+        for (size_t i = 0; i < indices.size(); ++i) indices[i] = i;
+        return indices;
+    }());
+    return order;
+}
+
+RuleOrder RuleOrder::fromHits(const std::vector<uint64_t>& hits) {
+    const auto& rules = Patterns::tokenPatterns;
+    const size_t n = rules.size();
+    auto weight = [&](size_t rule) { return rule < hits.size() ? hits[rule] : 0; };
+
+    // before[j] lists the earlier rules that may match where rule j matches;
+    // those must stay ahead of j for the first-match result to be unchanged.
+    std::vector<std::vector<size_t>> before(n);
+    for (size_t j = 0; j < n; ++j) {
+        for (size_t i = 0; i < j; ++i) {
+            if (!rulesAreDisjoint(rules[i].source, rules[j].source)) before[j].push_back(i);
+        }
+    }
+
+    std::vector<bool> placed(n, false);
+    std::vector<size_t> order;
+    order.reserve(n);
+
+    // Greedy Sidney-style scheduling: a rule can only be tried once everything it
+    // must follow has been tried, so rank each rule together with its unplaced
+    // ancestors by hits per trial and emit the best such group next.
+    while (order.size() < n) {
+        std::vector<bool> best_group;
+        uint64_t best_hits = 0;
+        size_t best_size = 0;
+        for (size_t v = 0; v < n; ++v) {
+            if (placed[v]) continue;
+            std::vector<bool> group(n, false);
+            std::vector<size_t> stack{v};
+            group[v] = true;
+            uint64_t group_hits = 0;
+            size_t group_size = 0;
+            while (!stack.empty()) {
+                const size_t rule = stack.back();
+                stack.pop_back();
+                group_hits += weight(rule);
+                ++group_size;
+                for (size_t ancestor : before[rule]) {
+                    if (!placed[ancestor] && !group[ancestor]) {
+                        group[ancestor] = true;
+                        stack.push_back(ancestor);
+                    }
+                }
+            }
+            // group_hits / group_size > best_hits / best_size, without division.
+            if (best_size == 0 || static_cast<long double>(group_hits) * best_size >
+                                      static_cast<long double>(best_hits) * group_size) {
+                best_group = std::move(group);
+                best_hits = group_hits;
+                best_size = group_size;
+            }
+        }
+
+        // Emit the group in a valid order, most frequent ready rule first.
+        for (size_t emitted = 0; emitted < best_size; ++emitted) {
+            size_t next = n;
+            for (size_t rule = 0; rule < n; ++rule) {
+                if (!best_group[rule] || placed[rule]) continue;
+                bool ready = true;
+                for (size_t ancestor : before[rule]) ready = ready && placed[ancestor];
+                if (ready && (next == n || weight(rule) > weight(next))) next = rule;
+            }
+            placed[next] = true;
+            order.push_back(next);
+        }
+    }
+    return RuleOrder(std::move(order));
+}
+
+std::vector<uint64_t> loadRuleProfile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        throw LexerError("Could not open rule profile " + path);
+    }
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < Patterns::tokenPatterns.size(); ++i) {
+        index.emplace(Patterns::tokenPatterns[i].source, i);
+    }
+
+    std::vector<uint64_t> hits(Patterns::tokenPatterns.size(), 0);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        const size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            throw LexerError("Malformed rule profile line in " + path + ": " + line);
+        }
+        auto it = index.find(line.substr(tab + 1));
+        if (it != index.end()) {
+            hits[it->second] += std::stoull(line.substr(0, tab));
+        }
+    }
+    return hits;
+}
+
+void saveRuleProfile(const std::string& path, const std::vector<uint64_t>& hits) {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw LexerError("Could not write rule profile " + path);
+    }
+    out << "# lexer rule profile: <hits>\\t<pattern>\n";
+    for (size_t i = 0; i < Patterns::tokenPatterns.size(); ++i) {
+        out << (i < hits.size() ? hits[i] : 0) << '\t' << Patterns::tokenPatterns[i].source << '\n';
+    }
+}
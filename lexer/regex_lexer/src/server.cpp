@@ -0,0 +1,404 @@
+#include "server.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr char kRequestMagic[4] = {'L', 'X', 'R', 'Q'};
+constexpr size_t kRequestHeaderSize = 12;
+constexpr size_t kResponseHeaderSize = 12;
+constexpr uint32_t kMaxPayload = 1u << 30;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void onStopSignal(int) { stop_requested = 1; }
+
+uint32_t getU32(const unsigned char* bytes) {
+    return static_cast<uint32_t>(bytes[0]) | static_cast<uint32_t>(bytes[1]) << 8 |
+           static_cast<uint32_t>(bytes[2]) << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+void putU32(unsigned char* bytes, uint32_t value) {
+    bytes[0] = static_cast<unsigned char>(value);
+    bytes[1] = static_cast<unsigned char>(value >> 8);
+    bytes[2] = static_cast<unsigned char>(value >> 16);
+    bytes[3] = static_cast<unsigned char>(value >> 24);
+}
+
+// Both return false on EOF or error.
+bool readExact(int fd, void* data, size_t size) {
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = read(fd, out, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* in = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = write(fd, in, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        in += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+std::string encodeResponse(uint8_t status, const std::string& output, const std::string& diagnostics) {
+    unsigned char header[kResponseHeaderSize] = {status, 0, 0, 0};
+    putU32(header + 4, static_cast<uint32_t>(output.size()));
+    putU32(header + 8, static_cast<uint32_t>(diagnostics.size()));
+    std::string response(reinterpret_cast<const char*>(header), sizeof(header));
+    response.reserve(sizeof(header) + output.size() + diagnostics.size());
+    response += output;
+    response += diagnostics;
+    return response;
+}
+
+bool socketAddress(const std::string& path, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+using RequestHeader = std::array<unsigned char, kRequestHeaderSize>;
+
+// Lexes one request and returns the response. Lexical and I/O errors become
+// an error response rather than taking the connection down.
+std::string handleRequest(const RequestHeader& header, std::string& payload, const RuleOrder& order) {
+    const auto source = static_cast<RequestSource>(header[4]);
+    const uint8_t format_byte = header[5];
+    std::ostringstream output;
+    std::ostringstream diagnostics;
+
+    if (format_byte > static_cast<uint8_t>(TokenFormat::Binary) || header[4] > static_cast<uint8_t>(RequestSource::Inline)) {
+        return encodeResponse(1, "", "Error: Malformed request header\n");
+    }
+
+    if (source == RequestSource::Path) {
+        // The server's working directory means nothing to the client.
+        if (payload.empty() || payload[0] != '/') {
+            return encodeResponse(1, "", "Error: Path requests need an absolute path: " + payload + "\n");
+        }
+        std::ifstream input_file(payload, std::ios::binary);
+        if (!input_file.is_open()) {
+            return encodeResponse(1, "", "Error: Could not open file " + payload + "\n");
+        }
+        payload.assign(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>());
+    }
+
+    try {
+        Lexer lexer(payload, order);
+        lexer.setDiagnosticStream(diagnostics);
+        writeTokens(output, lexer.tokenize(), static_cast<TokenFormat>(format_byte));
+    } catch (const LexerError& e) {
+        diagnostics << "Lexical error: " << e.what() << '\n';
+        return encodeResponse(1, "", diagnostics.str());
+    }
+    return encodeResponse(0, output.str(), diagnostics.str());
+}
+
+// One client, as seen by the poll loop. Requests are handled one at a time
+// per connection, so responses go out in request order; while a worker has
+// the request, the connection is not read any further.
+struct Connection {
+    std::string in;        // bytes received and not yet handed to a worker
+    std::string out;       // response bytes not yet written
+    size_t written = 0;    // of `out`
+    bool busy = false;     // a worker is lexing its request
+    bool closing = false;  // the client is done sending, or the connection broke
+};
+
+class Server {
+public:
+    Server(int listen_fd, int wake_fd, const RuleOrder& order, ThreadPool& pool)
+        : listenFd_(listen_fd), wakeFd_(wake_fd), order_(order), pool_(pool) {}
+
+    ~Server() {
+        for (const auto& entry : connections_) close(entry.first);
+    }
+
+    // Waits in ppoll() with `unblocked` as the signal mask until a stop
+    // signal arrives. Returns false on an unexpected error.
+    bool run(const sigset_t& unblocked, int wake_read_fd) {
+        std::vector<pollfd> events;
+        while (!stop_requested) {
+            events.clear();
+            events.push_back({listenFd_, POLLIN, 0});
+            events.push_back({wake_read_fd, POLLIN, 0});
+            for (const auto& entry : connections_) {
+                const Connection& connection = entry.second;
+                short wanted = 0;
+                if (!connection.out.empty()) {
+                    wanted = POLLOUT;
+                } else if (!connection.busy && !connection.closing) {
+                    wanted = POLLIN;
+                }
+                // A busy connection is left out, so its hang-up cannot spin the loop.
+                if (wanted != 0) events.push_back({entry.first, wanted, 0});
+            }
+            if (ppoll(events.data(), events.size(), nullptr, &unblocked) < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Error: poll failed: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            if (events[1].revents != 0) collectResponses(wake_read_fd);
+            for (size_t i = 2; i < events.size(); ++i) {
+                if (events[i].revents != 0) service(events[i].fd, events[i].revents);
+            }
+            if (events[0].revents != 0 && !acceptAll()) return false;
+        }
+        return true;
+    }
+
+private:
+    int listenFd_;
+    int wakeFd_;
+    const RuleOrder& order_;
+    ThreadPool& pool_;
+    std::unordered_map<int, Connection> connections_;
+    std::mutex doneMutex_;
+    std::vector<std::pair<int, std::string>> done_;  // responses from workers, by connection
+
+    bool acceptAll() {
+        for (;;) {
+            const int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd >= 0) {
+                connections_.emplace(fd, Connection{});
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) return true;
+            // Out of descriptors: keep serving the clients already connected.
+            if (errno == EMFILE || errno == ENFILE) return true;
+            std::cerr << "Error: accept failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    void collectResponses(int wake_read_fd) {
+        char drain[64];
+        while (read(wake_read_fd, drain, sizeof(drain)) > 0) {
+        }
+        std::vector<std::pair<int, std::string>> done;
+        {
+            std::lock_guard<std::mutex> lock(doneMutex_);
+            done.swap(done_);
+        }
+        for (auto& response : done) {
+            Connection& connection = connections_.at(response.first);
+            connection.busy = false;
+            connection.out = std::move(response.second);
+            connection.written = 0;
+            flush(response.first, connection);
+            settle(response.first);
+        }
+    }
+
+    void service(int fd, short revents) {
+        auto it = connections_.find(fd);
+        if (it == connections_.end()) return;
+        Connection& connection = it->second;
+        if (!connection.out.empty()) {
+            flush(fd, connection);
+        } else if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+            receive(fd, connection);
+        }
+        settle(fd);
+    }
+
+    void receive(int fd, Connection& connection) {
+        char buffer[1 << 16];
+        for (;;) {
+            const ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                connection.in.append(buffer, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            connection.closing = true;  // end of input or a broken connection
+            return;
+        }
+    }
+
+    void flush(int fd, Connection& connection) {
+        while (connection.written < connection.out.size()) {
+            const ssize_t n = write(fd, connection.out.data() + connection.written,
+                                    connection.out.size() - connection.written);
+            if (n > 0) {
+                connection.written += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            // The client went away; nothing more can be sent to it.
+            connection.in.clear();
+            connection.closing = true;
+            break;
+        }
+        connection.out.clear();
+        connection.written = 0;
+    }
+
+    // Hands the next complete request to a worker if the connection is free,
+    // and closes the connection once it has nothing left to do.
+    void settle(int fd) {
+        Connection& connection = connections_.at(fd);
+        if (!connection.busy && connection.out.empty() && connection.in.size() >= kRequestHeaderSize) {
+            RequestHeader header;
+            std::memcpy(header.data(), connection.in.data(), header.size());
+            const uint32_t size = getU32(header.data() + 8);
+            if (std::memcmp(header.data(), kRequestMagic, sizeof(kRequestMagic)) != 0 || size > kMaxPayload) {
+                connection.in.clear();
+                connection.out = encodeResponse(1, "", "Error: Malformed request header\n");
+                connection.closing = true;
+                flush(fd, connection);
+            } else if (connection.in.size() - kRequestHeaderSize >= size) {
+                std::string payload = connection.in.substr(kRequestHeaderSize, size);
+                connection.in.erase(0, kRequestHeaderSize + size);
+                connection.busy = true;
+                pool_.submit([this, fd, header, payload = std::move(payload)]() mutable {
+                    std::string response = handleRequest(header, payload, order_);
+                    {
+                        std::lock_guard<std::mutex> lock(doneMutex_);
+                        done_.emplace_back(fd, std::move(response));
+                    }
+                    const char byte = 0;
+                    // A full pipe already has a wake-up pending.
+                    (void)!write(wakeFd_, &byte, 1);
+                });
+            }
+        }
+        if (connection.closing && !connection.busy && connection.out.empty()) {
+            close(fd);
+            connections_.erase(fd);
+        }
+    }
+};
+
+} // namespace
+
+int runServer(const std::string& socket_path, unsigned threads, const RuleOrder& order) {
+    sockaddr_un address;
+    if (!socketAddress(socket_path, address)) return 1;
+
+    // Replace a stale socket from a previous run, but never an unrelated file.
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Error: " << socket_path << " exists and is not a socket" << std::endl;
+            return 1;
+        }
+        unlink(socket_path.c_str());
+    }
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        if (listen_fd >= 0) close(listen_fd);
+        return 1;
+    }
+    // Workers write a byte here when a response is ready.
+    int wake[2];
+    if (pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        std::cerr << "Error: Could not create pipe: " << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        return 1;
+    }
+
+    // The stop signals stay blocked everywhere except inside ppoll(), so one
+    // that arrives between checking stop_requested and waiting still ends
+    // the wait. Workers start after this and inherit the blocked mask.
+    struct sigaction action{};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+    sigset_t stop_signals;
+    sigset_t unblocked;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &unblocked);
+
+    bool ok;
+    {
+        ThreadPool pool(threads);
+        std::cerr << "Listening on " << socket_path << " with " << pool.size() << " worker threads" << std::endl;
+        Server server(listen_fd, wake[1], order, pool);
+        ok = server.run(unblocked, wake[0]);
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        // Requests already with a worker finish before the connections close.
+        pool.wait();
+    }
+    close(wake[0]);
+    close(wake[1]);
+    pthread_sigmask(SIG_SETMASK, &unblocked, nullptr);
+    return ok ? 0 : 1;
+}
+
+int runClient(const std::string& socket_path, RequestSource source, const std::string& payload, TokenFormat format) {
+    sockaddr_un address;
+    if (!socketAddress(socket_path, address)) return 1;
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Error: Could not connect to " << socket_path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    unsigned char header[kRequestHeaderSize] = {'L', 'X', 'R', 'Q', static_cast<unsigned char>(source),
+                                                static_cast<unsigned char>(format), 0, 0};
+    putU32(header + 8, static_cast<uint32_t>(payload.size()));
+    unsigned char response[kResponseHeaderSize];
+    if (!writeAll(fd, header, sizeof(header)) || !writeAll(fd, payload.data(), payload.size()) ||
+        !readExact(fd, response, sizeof(response))) {
+        std::cerr << "Error: Lost connection to " << socket_path << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    std::string output(getU32(response + 4), '\0');
+    std::string diagnostics(getU32(response + 8), '\0');
+    const bool complete = readExact(fd, &output[0], output.size()) &&
+                          readExact(fd, &diagnostics[0], diagnostics.size());
+    close(fd);
+    if (!complete) {
+        std::cerr << "Error: Truncated response from " << socket_path << std::endl;
+        return 1;
+    }
+    std::cout.write(output.data(), static_cast<std::streamsize>(output.size()));
+    std::cerr.write(diagnostics.data(), static_cast<std::streamsize>(diagnostics.size()));
+    return response[0] == 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include "stats.hpp"
+#include "pattern.hpp"
+#include "utilis.hpp"
+#include <iomanip>
+
+namespace {
+
+uint64_t attempts(const RuleStats& rule, const LexerStats& stats) {
+    return stats.automaton ? stats.walks : rule.attempts;
+}
+
+double perUnit(uint64_t value, uint64_t units) {
+    return units == 0 ? 0.0 : static_cast<double>(value) / static_cast<double>(units);
+}
+
+void printPhaseRow(std::ostream& out, const char* name, const PhaseStats& phase, const LexerStats& stats) {
+    out << std::left << std::setw(12) << name << std::right
+        << std::setw(12) << phase.calls
+        << std::setw(14) << std::fixed << std::setprecision(3) << phase.nanos / 1e6
+        << std::setw(12) << std::setprecision(1) << perUnit(phase.nanos, stats.bytes)
+        << std::setw(12) << perUnit(phase.nanos, stats.tokens) << "\n";
+}
+
+void printPhaseJson(std::ostream& out, const char* name, const PhaseStats& phase, bool last) {
+    out << "    \"" << name << "\": {\"calls\": " << phase.calls << ", \"nanos\": " << phase.nanos << "}"
+        << (last ? "\n" : ",\n");
+}
+
+} // namespace
+
+void printStatsTable(std::ostream& out, const LexerStats& stats) {
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+
+    out << "Input: " << stats.bytes << " bytes, " << stats.tokens << " tokens\n";
+    out << "Engine: " << (stats.automaton ? "automaton (every walk tries all rules; time goes to the match)"
+                                          : "backtracking (rules tried one by one)") << "\n\n";
+    out << std::left << std::setw(12) << "phase" << std::right
+        << std::setw(12) << "calls" << std::setw(14) << "total ms"
+        << std::setw(12) << "ns/byte" << std::setw(12) << "ns/token" << "\n";
+    printPhaseRow(out, "whitespace", stats.whitespace, stats);
+    printPhaseRow(out, "comments", stats.comments, stats);
+    printPhaseRow(out, "tokenize", stats.tokenize, stats);
+    printPhaseRow(out, "output", stats.output, stats);
+
+    out << "\n" << std::setw(4) << "#" << "  " << std::left << std::setw(22) << "token type"
+        << std::right << std::setw(12) << "attempts" << std::setw(10) << "hits"
+        << std::setw(8) << "hit%" << std::setw(12) << "total ms" << std::setw(10) << "ns/try"
+        << "  pattern\n";
+    for (size_t i = 0; i < stats.rules.size(); ++i) {
+        const RuleStats& rule = stats.rules[i];
+        const TokenPattern& pattern = Patterns::tokenPatterns[i];
+        out << std::setw(4) << i << "  " << std::left << std::setw(22) << tokenTypeName(pattern.type)
+            << std::right << std::setw(12) << attempts(rule, stats) << std::setw(10) << rule.hits
+            << std::setw(8) << std::fixed << std::setprecision(1)
+            << 100.0 * perUnit(rule.hits, attempts(rule, stats))
+            << std::setw(12) << std::setprecision(3) << rule.nanos / 1e6
+            << std::setw(10) << std::setprecision(0) << perUnit(rule.nanos, attempts(rule, stats))
+            << "  " << pattern.source << "\n";
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void printStatsJson(std::ostream& out, const LexerStats& stats) {
+    out << "{\n  \"bytes\": " << stats.bytes << ",\n  \"tokens\": " << stats.tokens << ",\n";
+    out << "  \"engine\": \"" << (stats.automaton ? "automaton" : "backtracking") << "\",\n";
+    out << "  \"phases\": {\n";
+    printPhaseJson(out, "whitespace", stats.whitespace, false);
+    printPhaseJson(out, "comments", stats.comments, false);
+    printPhaseJson(out, "tokenize", stats.tokenize, false);
+    printPhaseJson(out, "output", stats.output, true);
+    out << "  },\n  \"rules\": [\n";
+    for (size_t i = 0; i < stats.rules.size(); ++i) {
+        const RuleStats& rule = stats.rules[i];
+        const TokenPattern& pattern = Patterns::tokenPatterns[i];
+        out << "    {\"index\": " << i << ", \"type\": \"" << tokenTypeName(pattern.type)
+            << "\", \"pattern\": \"" << jsonEscape(pattern.source) << "\", \"attempts\": " << attempts(rule, stats)
+            << ", \"hits\": " << rule.hits << ", \"nanos\": " << rule.nanos << "}"
+            << (i + 1 < stats.rules.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
@@ -0,0 +1,78 @@
+#include "token_format.hpp"
+#include "utilis.hpp"
+
+namespace {
+
+void putU32(std::ostream& out, uint32_t value) {
+    const char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                           static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+    out.write(bytes, 4);
+}
+
+void writeBinary(std::ostream& out, const std::vector<Token>& tokens) {
+    uint32_t count = 0;
+    for (const auto& token : tokens) count += token.type != TokenType::T_COMMENT;
+    out.write("LXTK", 4);
+    putU32(out, kBinaryTokenVersion);
+    putU32(out, count);
+    for (const auto& token : tokens) {
+        if (token.type == TokenType::T_COMMENT) continue;
+        putU32(out, static_cast<uint32_t>(token.type));
+        putU32(out, static_cast<uint32_t>(token.line));
+        putU32(out, static_cast<uint32_t>(token.column));
+        putU32(out, static_cast<uint32_t>(token.value.size()));
+        out.write(token.value.data(), static_cast<std::streamsize>(token.value.size()));
+    }
+}
+
+} // namespace
+
+bool parseTokenFormat(const std::string& name, TokenFormat& format) {
+    if (name == "text") {
+        format = TokenFormat::Text;
+    } else if (name == "json") {
+        format = TokenFormat::Json;
+    } else if (name == "binary") {
+        format = TokenFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void writeTokens(std::ostream& out, const std::vector<Token>& tokens, TokenFormat format) {
+    if (format == TokenFormat::Binary) {
+        writeBinary(out, tokens);
+        return;
+    }
+    TokenStreamWriter writer(out, format);
+    writer.write(tokens);
+    writer.finish();
+}
+
+TokenStreamWriter::TokenStreamWriter(std::ostream& out, TokenFormat format) : out_(out), format_(format) {
+    if (format_ == TokenFormat::Json) {
+        out_ << "{\"tokens\": [";
+    }
+}
+
+void TokenStreamWriter::write(const std::vector<Token>& tokens) {
+    for (const auto& token : tokens) {
+        if (token.type == TokenType::T_COMMENT) continue;
+        if (format_ == TokenFormat::Json) {
+            out_ << (first_ ? "\n" : ",\n") << "  {\"type\": \"" << tokenTypeName(token.type)
+                 << "\", \"value\": \"" << jsonEscape(token.value) << "\", \"line\": " << token.line
+                 << ", \"column\": " << token.column << "}";
+        } else {
+            out_ << "Token(" << tokenTypeName(token.type) << ", \"" << token.value
+                 << "\") at line " << token.line << ", column " << token.column << '\n';
+        }
+        first_ = false;
+    }
+}
+
+void TokenStreamWriter::finish() {
+    if (format_ == TokenFormat::Json) {
+        out_ << "\n]}\n";
+    }
+}
@@ -0,0 +1,471 @@
+#include "token_index.hpp"
+#include "exception.hpp"
+#include "file_reader.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[4] = {'L', 'X', 'I', 'X'};
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kFileEntrySize = 32;
+constexpr size_t kTermEntrySize = 32;
+constexpr uint32_t kFlagLiterals = 1;
+
+uint32_t getU32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+uint64_t getU64(const unsigned char* p) {
+    return static_cast<uint64_t>(getU32(p)) | static_cast<uint64_t>(getU32(p + 4)) << 32;
+}
+
+void putU32(std::string& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<char>(value >> shift));
+}
+
+void putU64(std::string& out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value));
+    putU32(out, static_cast<uint32_t>(value >> 32));
+}
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+[[noreturn]] void corrupt() {
+    throw LexerError("Corrupt token index");
+}
+
+uint64_t getVarint(const unsigned char*& p, const unsigned char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) corrupt();
+        const unsigned char byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) return value;
+    }
+    corrupt();
+}
+
+bool indexedType(TokenType type, bool literals) {
+    return type == TokenType::T_IDENTIFIER || (literals && isLiteral(type));
+}
+
+int64_t mtimeNanos(const struct stat& info) {
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+struct FileRecord {
+    std::string path;
+    uint64_t size;
+    int64_t mtime;
+};
+
+// Terms interned by token type and text while an index is built.
+class TermTable {
+public:
+    struct Term {
+        uint32_t type;
+        std::string text;
+        std::vector<TokenIndex::Occurrence> occurrences;
+    };
+
+    std::vector<TokenIndex::Occurrence>& occurrences(uint32_t type, const std::string& text) {
+        std::string key(1, static_cast<char>(type));
+        key += text;
+        auto found = ids_.emplace(std::move(key), static_cast<uint32_t>(terms_.size()));
+        if (found.second) terms_.push_back({type, text, {}});
+        return terms_[found.first->second].occurrences;
+    }
+
+    std::vector<Term>& terms() { return terms_; }
+
+private:
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<Term> terms_;
+};
+
+std::string serialize(const std::vector<FileRecord>& files, std::vector<TermTable::Term>& terms, bool literals) {
+    std::sort(terms.begin(), terms.end(), [](const TermTable::Term& a, const TermTable::Term& b) {
+        return a.text != b.text ? a.text < b.text : a.type < b.type;
+    });
+
+    std::string strings;
+    std::string postings;
+    std::string file_table;
+    std::string term_table;
+    for (const FileRecord& file : files) {
+        putU64(file_table, strings.size());
+        putU32(file_table, static_cast<uint32_t>(file.path.size()));
+        putU32(file_table, 0);
+        putU64(file_table, file.size);
+        putU64(file_table, static_cast<uint64_t>(file.mtime));
+        strings += file.path;
+    }
+    for (TermTable::Term& term : terms) {
+        std::vector<TokenIndex::Occurrence>& occurrences = term.occurrences;
+        std::sort(occurrences.begin(), occurrences.end(), [](const auto& a, const auto& b) {
+            return a.file != b.file ? a.file < b.file : a.offset < b.offset;
+        });
+        const size_t start = postings.size();
+        uint32_t previous_file = 0;
+        for (size_t i = 0; i < occurrences.size();) {
+            size_t end = i;
+            while (end < occurrences.size() && occurrences[end].file == occurrences[i].file) ++end;
+            putVarint(postings, occurrences[i].file - previous_file);
+            putVarint(postings, end - i);
+            uint64_t previous_offset = 0;
+            uint32_t previous_line = 0;
+            for (size_t k = i; k < end; ++k) {
+                putVarint(postings, occurrences[k].offset - previous_offset);
+                putVarint(postings, occurrences[k].line - previous_line);
+                putVarint(postings, occurrences[k].column);
+                previous_offset = occurrences[k].offset;
+                previous_line = occurrences[k].line;
+            }
+            previous_file = occurrences[i].file;
+            i = end;
+        }
+        putU64(term_table, strings.size());
+        putU32(term_table, static_cast<uint32_t>(term.text.size()));
+        putU32(term_table, term.type);
+        putU64(term_table, start);
+        putU32(term_table, static_cast<uint32_t>(postings.size() - start));
+        putU32(term_table, static_cast<uint32_t>(occurrences.size()));
+        strings += term.text;
+    }
+    strings.resize((strings.size() + 7) & ~size_t(7), '\0');
+
+    std::string out(kMagic, sizeof(kMagic));
+    putU32(out, kTokenIndexVersion);
+    putU32(out, literals ? kFlagLiterals : 0);
+    putU32(out, static_cast<uint32_t>(files.size()));
+    putU32(out, static_cast<uint32_t>(terms.size()));
+    putU32(out, 0);
+    const size_t files_at = kHeaderSize;
+    const size_t terms_at = files_at + file_table.size();
+    const size_t strings_at = terms_at + term_table.size();
+    const size_t postings_at = strings_at + strings.size();
+    putU64(out, files_at);
+    putU64(out, terms_at);
+    putU64(out, strings_at);
+    putU64(out, postings_at);
+    putU64(out, postings_at + postings.size());
+    out += file_table;
+    out += term_table;
+    out += strings;
+    out += postings;
+    return out;
+}
+
+} // namespace
+
+TokenIndex::TokenIndex(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw LexerError("Could not open token index " + path + ": " + std::strerror(errno));
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(kHeaderSize)) {
+        close(fd);
+        throw LexerError("Not a token index: " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) throw LexerError("Could not map token index " + path + ": " + std::strerror(errno));
+    data_ = static_cast<const unsigned char*>(mapped);
+
+    const uint64_t files_at = getU64(data_ + 24);
+    const uint64_t terms_at = getU64(data_ + 32);
+    const uint64_t strings_at = getU64(data_ + 40);
+    const uint64_t postings_at = getU64(data_ + 48);
+    const bool valid = std::memcmp(data_, kMagic, sizeof(kMagic)) == 0 && getU32(data_ + 4) == kTokenIndexVersion &&
+                       getU64(data_ + 56) == size_ && files_at == kHeaderSize &&
+                       terms_at == files_at + uint64_t(fileCount()) * kFileEntrySize &&
+                       strings_at == terms_at + uint64_t(termCount()) * kTermEntrySize && strings_at <= postings_at &&
+                       postings_at <= size_;
+    if (!valid) {
+        munmap(mapped, size_);
+        data_ = nullptr;
+        throw LexerError("Not a token index (or written by another version): " + path);
+    }
+}
+
+TokenIndex::~TokenIndex() {
+    if (data_ != nullptr) munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+uint32_t TokenIndex::fileCount() const { return getU32(data_ + 12); }
+uint32_t TokenIndex::termCount() const { return getU32(data_ + 16); }
+bool TokenIndex::literals() const { return (getU32(data_ + 8) & kFlagLiterals) != 0; }
+
+const unsigned char* TokenIndex::fileEntry(uint32_t file) const {
+    return data_ + kHeaderSize + size_t(file) * kFileEntrySize;
+}
+
+const unsigned char* TokenIndex::termEntry(uint32_t term) const {
+    return data_ + getU64(data_ + 32) + size_t(term) * kTermEntrySize;
+}
+
+namespace {
+
+// A string in the blob, bounds checked against the end of the postings.
+std::string blobString(const unsigned char* data, size_t size, uint64_t offset, uint32_t length) {
+    const uint64_t at = getU64(data + 40) + offset;
+    if (at > getU64(data + 48) || length > getU64(data + 48) - at || at + length > size) corrupt();
+    return std::string(reinterpret_cast<const char*>(data + at), length);
+}
+
+} // namespace
+
+std::string TokenIndex::filePath(uint32_t file) const {
+    const unsigned char* entry = fileEntry(file);
+    return blobString(data_, size_, getU64(entry), getU32(entry + 8));
+}
+
+uint64_t TokenIndex::fileSize(uint32_t file) const { return getU64(fileEntry(file) + 16); }
+int64_t TokenIndex::fileMtime(uint32_t file) const { return static_cast<int64_t>(getU64(fileEntry(file) + 24)); }
+
+std::string TokenIndex::termText(uint32_t term) const {
+    const unsigned char* entry = termEntry(term);
+    return blobString(data_, size_, getU64(entry), getU32(entry + 8));
+}
+
+uint32_t TokenIndex::termType(uint32_t term) const { return getU32(termEntry(term) + 12); }
+
+std::vector<TokenIndex::Occurrence> TokenIndex::postings(uint32_t term) const {
+    const unsigned char* entry = termEntry(term);
+    const uint64_t postings_at = getU64(data_ + 48);
+    const uint64_t start = getU64(entry + 16);
+    const uint32_t bytes = getU32(entry + 24);
+    if (start > size_ - postings_at || bytes > size_ - postings_at - start) corrupt();
+    const unsigned char* p = data_ + postings_at + start;
+    const unsigned char* end = p + bytes;
+
+    std::vector<Occurrence> occurrences;
+    occurrences.reserve(getU32(entry + 28));
+    uint64_t file = 0;
+    while (p != end) {
+        file += getVarint(p, end);
+        const uint64_t count = getVarint(p, end);
+        if (file >= fileCount() || count > static_cast<uint64_t>(end - p)) corrupt();
+        uint64_t offset = 0;
+        uint64_t line = 0;
+        for (uint64_t i = 0; i < count; ++i) {
+            offset += getVarint(p, end);
+            line += getVarint(p, end);
+            const uint64_t column = getVarint(p, end);
+            if (line > UINT32_MAX || column > UINT32_MAX) corrupt();
+            occurrences.push_back({static_cast<uint32_t>(file), offset, static_cast<uint32_t>(line),
+                                   static_cast<uint32_t>(column)});
+        }
+    }
+    return occurrences;
+}
+
+std::vector<uint32_t> TokenIndex::find(const std::string& text) const {
+    // Lower bound by text over the sorted term table; only the probed
+    // entries and their strings are ever paged in.
+    uint32_t low = 0;
+    uint32_t high = termCount();
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (termText(middle) < text) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    std::vector<uint32_t> found;
+    for (uint32_t term = low; term < termCount() && termText(term) == text; ++term) found.push_back(term);
+    return found;
+}
+
+int buildTokenIndex(const std::string& index_path, const std::vector<std::string>& paths, const RuleOrder& order,
+                    const IndexOptions& options) {
+    std::unique_ptr<TokenIndex> previous;
+    std::unordered_map<std::string, uint32_t> previous_ids;
+    if (access(index_path.c_str(), F_OK) == 0) {
+        try {
+            previous = std::make_unique<TokenIndex>(index_path);
+            if (previous->literals() != options.literals) {
+                previous.reset();
+            } else {
+                for (uint32_t file = 0; file < previous->fileCount(); ++file) {
+                    previous_ids.emplace(previous->filePath(file), file);
+                }
+            }
+        } catch (const LexerError& e) {
+            std::cerr << "Warning: " << e.what() << "; rebuilding it" << std::endl;
+            previous.reset();
+        }
+    }
+
+    // Files are numbered in list order. An unchanged file keeps its postings
+    // from the previous index; the rest are read and lexed.
+    std::vector<FileRecord> files;
+    std::vector<int64_t> new_ids(previous ? previous->fileCount() : 0, -1);
+    std::vector<std::string> to_lex;
+    std::vector<uint32_t> to_lex_ids;
+    std::unordered_set<std::string> seen;
+    for (const std::string& path : paths) {
+        if (!seen.insert(path).second) continue;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            std::cerr << "Warning: skipping " << path << ": " << std::strerror(errno) << std::endl;
+            continue;
+        }
+        if (!S_ISREG(info.st_mode)) {
+            std::cerr << "Warning: skipping " << path << ": not a regular file" << std::endl;
+            continue;
+        }
+        const uint32_t id = static_cast<uint32_t>(files.size());
+        files.push_back({path, static_cast<uint64_t>(info.st_size), mtimeNanos(info)});
+        auto old = previous_ids.find(path);
+        if (old != previous_ids.end() && previous->fileSize(old->second) == files.back().size &&
+            previous->fileMtime(old->second) == files.back().mtime) {
+            new_ids[old->second] = id;
+        } else {
+            to_lex.push_back(path);
+            to_lex_ids.push_back(id);
+        }
+    }
+
+    TermTable table;
+    size_t reused = 0;
+    if (previous) {
+        for (int64_t id : new_ids) reused += id >= 0;
+        for (uint32_t term = 0; term < previous->termCount(); ++term) {
+            std::vector<TokenIndex::Occurrence>* occurrences = nullptr;
+            for (const TokenIndex::Occurrence& occurrence : previous->postings(term)) {
+                const int64_t id = new_ids[occurrence.file];
+                if (id < 0) continue;
+                if (occurrences == nullptr) {
+                    occurrences = &table.occurrences(previous->termType(term), previous->termText(term));
+                }
+                occurrences->push_back({static_cast<uint32_t>(id), occurrence.offset, occurrence.line,
+                                        occurrence.column});
+            }
+        }
+    }
+
+    std::mutex table_mutex;
+    bool failed = false;
+    std::unique_ptr<FileBatchReader> reader;
+    try {
+        reader = std::make_unique<FileBatchReader>(to_lex, options.batch.readAhead, options.batch.backend);
+    } catch (const LexerError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    {
+        ThreadPool pool(options.batch.threads);
+        FileBuffer buffer;
+        while (reader->next(buffer)) {
+            auto shared = std::make_shared<FileBuffer>(std::move(buffer));
+            pool.submit([&, shared] {
+                const std::string& path = to_lex[shared->index];
+                std::vector<Token> tokens;
+                std::string error = shared->error;
+                if (error.empty()) {
+                    try {
+                        std::ostream discard(nullptr);
+                        Lexer lexer(shared->data, order);
+                        lexer.setEngine(options.batch.engine);
+                        lexer.setDiagnosticStream(discard);
+                        tokens = lexer.tokenize();
+                    } catch (const LexerError& e) {
+                        error = e.what();
+                    }
+                }
+                std::lock_guard<std::mutex> lock(table_mutex);
+                reader->release();
+                if (!error.empty()) {
+                    std::cerr << "Warning: " << path << " not indexed: " << error << std::endl;
+                    failed = true;
+                    return;
+                }
+                const uint32_t id = to_lex_ids[shared->index];
+                for (const Token& token : tokens) {
+                    if (!indexedType(token.type, options.literals)) continue;
+                    table.occurrences(token.type, token.value)
+                        .push_back({id, token.offset, static_cast<uint32_t>(token.line),
+                                    static_cast<uint32_t>(token.column)});
+                }
+            });
+        }
+    }
+    previous.reset();
+
+    const std::string serialized = serialize(files, table.terms(), options.literals);
+    const std::string temporary = index_path + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(serialized.data(), static_cast<std::streamsize>(serialized.size()));
+        if (!out.good()) {
+            std::cerr << "Error: Could not write token index " << temporary << std::endl;
+            std::remove(temporary.c_str());
+            return 1;
+        }
+    }
+    if (std::rename(temporary.c_str(), index_path.c_str()) != 0) {
+        std::cerr << "Error: Could not replace " << index_path << ": " << std::strerror(errno) << std::endl;
+        std::remove(temporary.c_str());
+        return 1;
+    }
+    std::cerr << "Indexed " << files.size() << " files (" << to_lex.size() << " lexed, " << reused << " reused), "
+              << table.terms().size() << " terms, " << serialized.size() << " bytes" << std::endl;
+    return failed ? 1 : 0;
+}
+
+int queryTokenIndex(const std::string& index_path, const std::vector<std::string>& terms) {
+    try {
+        const TokenIndex index(index_path);
+        bool found = false;
+        for (const std::string& text : terms) {
+            for (uint32_t term : index.find(text)) {
+                const std::vector<TokenIndex::Occurrence> occurrences = index.postings(term);
+                // Positions are the ones recorded at indexing time; a stat()
+                // per file tells whether they may have moved since.
+                for (size_t i = 0; i < occurrences.size();) {
+                    const uint32_t file = occurrences[i].file;
+                    const std::string path = index.filePath(file);
+                    struct stat info;
+                    const bool current = stat(path.c_str(), &info) == 0 &&
+                                         static_cast<uint64_t>(info.st_size) == index.fileSize(file) &&
+                                         mtimeNanos(info) == index.fileMtime(file);
+                    for (; i < occurrences.size() && occurrences[i].file == file; ++i) {
+                        std::cout << path << ':' << occurrences[i].line << ':' << occurrences[i].column << ": "
+                                  << text << (current ? "\n" : " (file changed since indexing)\n");
+                        found = true;
+                    }
+                }
+            }
+        }
+        std::cout.flush();
+        return found ? 0 : 1;
+    } catch (const LexerError& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+}
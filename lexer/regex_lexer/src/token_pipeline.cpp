@@ -0,0 +1,83 @@
+#include "token_pipeline.hpp"
+#include <algorithm>
+
+namespace {
+
+// Spin briefly, then give the CPU away until the other side catches up.
+void backoff(unsigned spins) {
+    if (spins >= 64) std::this_thread::yield();
+}
+
+} // namespace
+
+TokenPipeline::TokenPipeline(const std::string& source, const RuleOrder& order, size_t batch_size,
+                             size_t batches_in_flight)
+    : lexer_(source, order), batchSize_(batch_size == 0 ? 1 : batch_size),
+      filled_(batches_in_flight), free_(batches_in_flight) {
+    for (size_t i = 0; i < std::max<size_t>(batches_in_flight, 1); ++i) {
+        std::vector<Token> batch;
+        batch.reserve(batchSize_);
+        free_.tryPush(batch);
+    }
+    producer_ = std::thread([this] { produce(); });
+}
+
+TokenPipeline::~TokenPipeline() {
+    cancelled_.store(true, std::memory_order_relaxed);
+    producer_.join();
+}
+
+template <typename Ring>
+bool TokenPipeline::waitPush(Ring& ring, std::vector<Token>& batch) {
+    for (unsigned spins = 0; !ring.tryPush(batch); ++spins) {
+        if (cancelled_.load(std::memory_order_relaxed)) return false;
+        backoff(spins);
+    }
+    return true;
+}
+
+template <typename Ring>
+bool TokenPipeline::waitPop(Ring& ring, std::vector<Token>& batch) {
+    for (unsigned spins = 0; !ring.tryPop(batch); ++spins) {
+        if (cancelled_.load(std::memory_order_relaxed)) return false;
+        backoff(spins);
+    }
+    return true;
+}
+
+void TokenPipeline::produce() {
+    std::vector<Token> batch;
+    try {
+        Token token;
+        bool more = true;
+        while (more) {
+            if (!waitPop(free_, batch)) return;
+            batch.clear();
+            while (batch.size() < batchSize_ && (more = lexer_.next(token))) {
+                batch.push_back(std::move(token));
+            }
+            if (!batch.empty() && !waitPush(filled_, batch)) return;
+        }
+    } catch (...) {
+        // Deliver the tokens lexed before the error, then an empty batch to end the stream.
+        error_ = std::current_exception();
+        if (!batch.empty() && !waitPush(filled_, batch)) return;
+        std::vector<Token> end;
+        waitPush(filled_, end);
+    }
+}
+
+const std::vector<Token>* TokenPipeline::nextBatch() {
+    if (finished_) return nullptr;
+    if (current_.capacity() != 0) {
+        free_.tryPush(current_);  // never full: it holds at most the batches we handed out
+    }
+    waitPop(filled_, current_);
+    if (current_.empty()) {
+        finished_ = true;
+        if (error_) std::rethrow_exception(error_);
+        return nullptr;
+    }
+    finished_ = current_.back().type == TokenType::T_EOF;
+    return &current_;
+}
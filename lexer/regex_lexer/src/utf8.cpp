@@ -0,0 +1,124 @@
+#include "utf8.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Length of the leading run of ASCII bytes.
+size_t asciiPrefix(const char* data, size_t size) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= size; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(chunk));
+        if (mask != 0) return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask != 0) return i + static_cast<size_t>(__builtin_ctz(mask));
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0) break;
+    }
+    while (i < size && static_cast<unsigned char>(data[i]) < 0x80) ++i;
+    return i;
+}
+
+bool inRanges(const CodePointRange* ranges, size_t count, uint32_t code_point) {
+    const CodePointRange* end = ranges + count;
+    const CodePointRange* it = std::upper_bound(ranges, end, code_point,
+                                                [](uint32_t cp, const CodePointRange& range) { return cp < range.first; });
+    return it != ranges && code_point <= (it - 1)->last;
+}
+
+} // namespace
+
+bool isAscii(const char* data, size_t size) {
+    return asciiPrefix(data, size) == size;
+}
+
+size_t findInvalidUtf8(const char* data, size_t size) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < size) {
+        i += asciiPrefix(data + i, size - i);
+        if (i == size) break;
+        // Multi-byte sequence; the bounds on the second byte exclude overlong
+        // forms, surrogates and values above U+10FFFF (RFC 3629, table 3-7).
+        const unsigned char lead = bytes[i];
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            if (lead == 0xF4) high = 0x8F;
+        } else {
+            return i;
+        }
+        if (size - i < length || bytes[i + 1] < low || bytes[i + 1] > high) return i;
+        for (size_t k = 2; k < length; ++k) {
+            if ((bytes[i + k] & 0xC0) != 0x80) return i;
+        }
+        i += length;
+    }
+    return size;
+}
+
+uint32_t decodeUtf8(const char* data, size_t size, size_t& length) {
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char lead = bytes[0];
+    length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    if (length > size) {
+        length = 1;
+        return 0xFFFD;
+    }
+    if (length == 1) return lead;
+    uint32_t code_point = lead & (0x7Fu >> length);
+    for (size_t k = 1; k < length; ++k) code_point = (code_point << 6) | (bytes[k] & 0x3Fu);
+    return code_point;
+}
+
+size_t countCodePoints(const char* data, size_t size) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < size) {
+        const size_t ascii = asciiPrefix(data + i, size - i);
+        count += ascii;
+        i += ascii;
+        // Every byte that is not a continuation byte starts a code point.
+        for (; i < size && static_cast<unsigned char>(data[i]) >= 0x80; ++i) {
+            if ((static_cast<unsigned char>(data[i]) & 0xC0) != 0x80) ++count;
+        }
+    }
+    return count;
+}
+
+bool isIdentifierStart(uint32_t code_point) {
+    if (code_point < 0x80) {
+        return (code_point >= 'a' && code_point <= 'z') || (code_point >= 'A' && code_point <= 'Z') || code_point == '_';
+    }
+    return inRanges(kXidStartRanges, kXidStartRangesSize, code_point);
+}
+
+bool isIdentifierContinue(uint32_t code_point) {
+    if (code_point < 0x80) return isIdentifierStart(code_point) || (code_point >= '0' && code_point <= '9');
+    return inRanges(kXidContinueRanges, kXidContinueRangesSize, code_point);
+}
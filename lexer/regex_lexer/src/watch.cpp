@@ -0,0 +1,282 @@
+#include "watch.hpp"
+#include "exception.hpp"
+#include "lexer.hpp"
+#include "thread_pool.hpp"
+#include "token_format.hpp"
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <poll.h>
+#include <pthread.h>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t kDirectoryEvents = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE |
+                                      IN_DELETE_SELF | IN_ONLYDIR;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void onStopSignal(int) { stop_requested = 1; }
+
+// 64-bit FNV-1a of a file's contents, to skip saves that changed nothing.
+uint64_t contentHash(const std::string& data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool ignoredName(const char* name) {
+    return name[0] == '.';
+}
+
+class TreeWatcher {
+public:
+    TreeWatcher(const std::string& root, const RuleOrder& order, const WatchOptions& options, int fd)
+        : root_(root), order_(order), options_(options), fd_(fd), pool_(options.threads) {}
+
+    // Watches `dir` and everything below it, queueing every file found.
+    void addDirectory(const std::string& dir) {
+        const int wd = inotify_add_watch(fd_, dir.c_str(), kDirectoryEvents);
+        if (wd < 0) {
+            std::cerr << "Warning: cannot watch " << dir << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        directories_[wd] = dir;
+        DIR* listing = opendir(dir.c_str());
+        if (listing == nullptr) return;
+        while (const dirent* entry = readdir(listing)) {
+            if (ignoredName(entry->d_name)) continue;
+            const std::string path = dir + "/" + entry->d_name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0) continue;
+            if (S_ISDIR(info.st_mode)) {
+                addDirectory(path);
+            } else if (S_ISREG(info.st_mode)) {
+                pending_.insert(path);
+            }
+        }
+        closedir(listing);
+    }
+
+    // Reads and applies the queued inotify events. Returns false once the
+    // root has gone away.
+    bool readEvents() {
+        alignas(inotify_event) char buffer[64 * 1024];
+        for (;;) {
+            const ssize_t length = read(fd_, buffer, sizeof(buffer));
+            if (length <= 0) return length == 0 || errno == EAGAIN || errno == EINTR;
+            for (ssize_t at = 0; at < length;) {
+                const auto* event = reinterpret_cast<const inotify_event*>(buffer + at);
+                at += sizeof(inotify_event) + event->len;
+                if (!handle(*event)) return false;
+            }
+        }
+    }
+
+    // Hands every queued path to the pool.
+    void flush() {
+        for (const std::string& path : pending_) {
+            uint64_t generation;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                generation = ++generations_[path];
+            }
+            pool_.submit([this, path, generation] { relex(path, generation); });
+        }
+        pending_.clear();
+    }
+
+    bool hasPending() const { return !pending_.empty(); }
+    void wait() { pool_.wait(); }
+
+    size_t fileCount() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return files_.size();
+    }
+
+private:
+    struct FileState {
+        uint64_t hash;
+        std::vector<Token> tokens;
+    };
+
+    bool handle(const inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            // Events were lost; look at the whole tree again. Unchanged files
+            // hash the same and are not printed.
+            rescan();
+            return true;
+        }
+        auto dir = directories_.find(event.wd);
+        if (dir == directories_.end()) return true;
+        if (event.mask & (IN_DELETE_SELF | IN_IGNORED)) {
+            if (dir->second == root_) return false;
+            directories_.erase(dir);
+            return true;
+        }
+        if (event.len == 0 || ignoredName(event.name)) return true;
+        const std::string path = dir->second + "/" + event.name;
+        if (event.mask & IN_ISDIR) {
+            if (event.mask & (IN_CREATE | IN_MOVED_TO)) addDirectory(path);
+            if (event.mask & (IN_DELETE | IN_MOVED_FROM)) forgetDirectory(path);
+        } else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) {
+            // A plain IN_CREATE is followed by IN_CLOSE_WRITE once written.
+            pending_.insert(path);
+        }
+        return true;
+    }
+
+    void rescan() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& file : files_) pending_.insert(file.first);
+        }
+        addDirectory(root_);
+    }
+
+    // Drops the watches below a removed or moved-away directory and queues
+    // its files, which then read as deleted.
+    void forgetDirectory(const std::string& dir) {
+        const std::string prefix = dir + "/";
+        for (auto it = directories_.begin(); it != directories_.end();) {
+            if (it->second == dir || it->second.compare(0, prefix.size(), prefix) == 0) {
+                inotify_rm_watch(fd_, it->first);
+                it = directories_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& file : files_) {
+            if (file.first.compare(0, prefix.size(), prefix) == 0) pending_.insert(file.first);
+        }
+    }
+
+    // Runs on a worker. `generation` orders tasks for the same path: a result
+    // is dropped if the file was queued again while it was being lexed.
+    void relex(const std::string& path, uint64_t generation) {
+        std::ifstream input(path, std::ios::binary);
+        struct stat info;
+        if (!input.is_open() || stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generations_[path] != generation || files_.erase(path) == 0) return;
+            std::cout << "==> " << path << " (deleted) <==" << std::endl;
+            return;
+        }
+        const std::string source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        const uint64_t hash = contentHash(source);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto known = files_.find(path);
+            if (known != files_.end() && known->second.hash == hash) return;
+        }
+
+        std::ostringstream output;
+        std::ostringstream diagnostics;
+        std::vector<Token> tokens;
+        try {
+            Lexer lexer(source, order_);
+            lexer.setEngine(options_.engine);
+            lexer.setDiagnosticStream(diagnostics);
+            tokens = lexer.tokenize();
+            output << "==> " << path << " <==\n";
+            writeTokens(output, tokens, TokenFormat::Text);
+        } catch (const LexerError& e) {
+            diagnostics << path << ": Lexical error: " << e.what() << '\n';
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (generations_[path] != generation) return;
+        files_[path] = {hash, std::move(tokens)};
+        std::cerr << diagnostics.str() << std::flush;
+        std::cout << output.str() << std::flush;
+    }
+
+    const std::string root_;
+    const RuleOrder& order_;
+    const WatchOptions& options_;
+    const int fd_;
+    std::unordered_map<int, std::string> directories_;  // watch descriptor to path
+    std::set<std::string> pending_;                     // changed since the last flush
+
+    std::mutex mutex_;  // guards the members below and the output streams
+    std::unordered_map<std::string, FileState> files_;
+    std::unordered_map<std::string, uint64_t> generations_;
+
+    ThreadPool pool_;  // last, so its tasks finish before the members above go away
+};
+
+} // namespace
+
+int watchTree(const std::string& root_path, const RuleOrder& order, const WatchOptions& options) {
+    char resolved[PATH_MAX];
+    if (realpath(root_path.c_str(), resolved) == nullptr) {
+        std::cerr << "Error: Could not open directory " << root_path << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    const std::string root = resolved;
+    struct stat info;
+    if (stat(root.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        std::cerr << "Error: " << root_path << " is not a directory" << std::endl;
+        return 1;
+    }
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Error: inotify is not available: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // The stop signals stay blocked everywhere except inside ppoll() below, so
+    // they always interrupt the wait instead of landing on a pool worker.
+    struct sigaction action{};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    sigset_t stop_signals;
+    sigset_t unblocked;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &unblocked);
+
+    {
+        TreeWatcher watcher(root, order, options, fd);
+        // Watches go in before the first lex, so a save during startup is
+        // not missed.
+        watcher.addDirectory(root);
+        watcher.flush();
+        watcher.wait();
+        std::cerr << "Watching " << watcher.fileCount() << " files under " << root << std::endl;
+
+        pollfd events{fd, POLLIN, 0};
+        while (!stop_requested) {
+            const timespec debounce{options.debounceMs / 1000, (options.debounceMs % 1000) * 1000000L};
+            const int ready = ppoll(&events, 1, watcher.hasPending() ? &debounce : nullptr, &unblocked);
+            if (ready < 0 && errno != EINTR) {
+                std::cerr << "Error: poll failed: " << std::strerror(errno) << std::endl;
+                break;
+            }
+            if (ready > 0 && !watcher.readEvents()) break;
+            if (ready == 0) watcher.flush();
+        }
+    }
+    close(fd);
+    pthread_sigmask(SIG_SETMASK, &unblocked, nullptr);
+    return 0;
+}